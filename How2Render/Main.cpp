@@ -1,7 +1,66 @@
+#include "Helpers/ConstantRingBenchmark.hpp"
+#include "Helpers/CullingBenchmark.hpp"
+#include "Helpers/DepthSortBenchmark.hpp"
+#include "Helpers/MipmapBenchmark.hpp"
+#include "Helpers/OcclusionCullingBenchmark.hpp"
+#include "Helpers/RenderGraphReport.hpp"
+#include "Helpers/ShadowCascadeBenchmark.hpp"
+#include "Helpers/TextureCompressionBenchmark.hpp"
+#include "Helpers/TextureDecodeBenchmark.hpp"
 #include "Renderer.hpp"
+#include <string_view>
 
 int main(int argc, char *args[])
 {
+	if (argc == 3 && std::string_view(args[1]) == "--bake-model")
+	{
+		return h2r::BakeModelCache(args[2]) ? 0 : 1;
+	}
+	if (argc == 3 && std::string_view(args[1]) == "--bench-obj")
+	{
+		return h2r::BenchmarkObjParsing(args[2]) ? 0 : 1;
+	}
+	if (argc == 3 && std::string_view(args[1]) == "--bench-texture-cache")
+	{
+		return h2r::BenchmarkTextureFileCache(args[2]) ? 0 : 1;
+	}
+	if (argc == 2 && std::string_view(args[1]) == "--bench-mips")
+	{
+		return h2r::BenchmarkMipmapGeneration() ? 0 : 1;
+	}
+	if (argc == 3 && std::string_view(args[1]) == "--bench-decode")
+	{
+		return h2r::BenchmarkTextureDecode(args[2]) ? 0 : 1;
+	}
+	if ((argc == 2 || argc == 3) && std::string_view(args[1]) == "--bench-bc")
+	{
+		return h2r::BenchmarkTextureCompression(argc == 3 ? args[2] : "") ? 0 : 1;
+	}
+	if (argc == 2 && std::string_view(args[1]) == "--bench-bvh")
+	{
+		return h2r::BenchmarkBvhCulling() ? 0 : 1;
+	}
+	if ((argc == 2 || argc == 3) && std::string_view(args[1]) == "--bench-occlusion")
+	{
+		return h2r::BenchmarkOcclusionCulling(argc == 3 ? args[2] : "") ? 0 : 1;
+	}
+	if (argc == 2 && std::string_view(args[1]) == "--bench-cascades")
+	{
+		return h2r::BenchmarkShadowCascades() ? 0 : 1;
+	}
+	if (argc == 2 && std::string_view(args[1]) == "--bench-cbuffer")
+	{
+		return h2r::BenchmarkConstantSubmission() ? 0 : 1;
+	}
+	if (argc == 2 && std::string_view(args[1]) == "--bench-depth-sort")
+	{
+		return h2r::BenchmarkDepthSort() ? 0 : 1;
+	}
+	if (argc == 2 && std::string_view(args[1]) == "--report-graph")
+	{
+		return h2r::ReportRenderGraphMemory() ? 0 : 1;
+	}
+
 	h2r::MainLoop();
 	return 0;
 }
@@ -2,6 +2,7 @@
 // Constants
 //--------------------------------------------------------------------------------------
 #define PCF_SAMPLES 16
+#define SHADOW_CASCADES 4
 #define AO_SAMPLES 64
 static const float AlphaThreshold = 0.3f;
 static const float PI = 3.141592f;
@@ -35,6 +36,7 @@ cbuffer PerPassCB : register(b2)
 	struct RenderTargetCB
 	{
 		uint2 Dimensions;
+		uint ShadowCascade;
 	} RenderTarget;
 }
 
@@ -48,13 +50,20 @@ cbuffer PerFrameCB : register(b3)
 		matrix inverseProj;
 		float4 PosWorld;
 	} Camera;
+
+	struct ShadowCascadesCB
+	{
+		matrix ViewProj[SHADOW_CASCADES];
+		float4 SplitFar;
+		matrix CacheReprojection[SHADOW_CASCADES];
+		matrix CacheViewProj;
+	} ShadowCascades;
 };
 
 cbuffer InfrequentCB : register(b4)
 {
 	struct LightsCB
 	{
-		matrix ViewProj;
 		float4 ViewDir;
 	} Lights;
 
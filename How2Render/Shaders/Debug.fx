@@ -82,8 +82,17 @@ float4 PS(PS_INPUT input) : SV_Target
 	{
 		float depth = depthTexture.Sample(textureSampler, input.Tex).r;
 		float3 p = WorldPosFromDepth(depth, input.Tex, Camera.inverseProj, Camera.inverseView);
-		float4 shadowPos = mul(Lights.ViewProj, float4(p, 1));
-		color = float3(shadowPos.zzz / shadowPos.w);
+		// Light depth tinted by the cascade the pixel reads its shadow from
+		const float3 cascadeTints[SHADOW_CASCADES] =
+		{
+			float3(1, 0.3, 0.3),
+			float3(0.3, 1, 0.3),
+			float3(0.3, 0.3, 1),
+			float3(1, 1, 0.3),
+		};
+		uint cascade = 0;
+		float3 shadowPos = ShadowAtlasPosition(p, mul(Camera.View, float4(p, 1)).z, cascade);
+		color = shadowPos.zzz * cascadeTints[cascade];
 	}
 	else
 	{
@@ -48,7 +48,7 @@ PS_INPUT VS(VS_INPUT input)
 // Pixel Shader
 //--------------------------------------------------------------------------------------
 
-float PercentageCloserFiltering(float4 shadowPos, float radius, float bias, float theta)
+float PercentageCloserFiltering(float3 shadowPos, uint cascade, float radius, float bias, float theta)
 {
 	const float2 poisson[PCF_SAMPLES] =
 	{
@@ -73,7 +73,6 @@ float PercentageCloserFiltering(float4 shadowPos, float radius, float bias, floa
 	shadowDepthTexture.GetDimensions(width, height);
 	float2 normalizedRadius = float2(radius, radius) / float2(width, height);
 	shadowPos.z -= bias;
-	float2 shadowDepthTexCoords = float2(0.5 + shadowPos.x * 0.5, 0.5 - shadowPos.y * 0.5);
 
 	float sum = 0.;
 	for (uint i = 0; i < Shadows.PcfKernelSize; ++i)
@@ -82,7 +81,7 @@ float PercentageCloserFiltering(float4 shadowPos, float radius, float bias, floa
 		float2 offset = poisson[i] * normalizedRadius;
 		offset = RotateVector2D(offset, sin(theta), cos(theta));
 		sum += shadowDepthTexture.SampleCmpLevelZero(
-			depthSampler, shadowDepthTexCoords + offset, shadowPos.z);
+			depthSampler, ClampToShadowCascade(shadowPos.xy + offset, cascade, 1. / width), shadowPos.z);
 	}
 
 	return sum / (float)Shadows.PcfKernelSize;
@@ -110,8 +109,9 @@ float4 PS(PS_INPUT input) : SV_Target
 	float shadow = 1.f;
 	if (Debug.ShadowMappingEnabled)
 	{
-		// No need to divide by w because of orthographic projection
-		float4 shadowPos = mul(Lights.ViewProj, float4(p, 1));
+		uint cascade = 0;
+		float viewDepth = mul(Camera.View, float4(p, 1)).z;
+		float3 shadowPos = ShadowAtlasPosition(p, viewDepth, cascade);
 		if (Shadows.PcfEnabled)
 		{
 			uint2 noiseTextureDimensions;
@@ -119,14 +119,13 @@ float4 PS(PS_INPUT input) : SV_Target
 
 			float theta = 6.28 * noiseTexture.SampleLevel(
 				pointSampler, RenderTarget.Dimensions / noiseTextureDimensions * input.Tex, 0).x;
-			shadow = PercentageCloserFiltering(shadowPos, Shadows.PcfRadius, Shadows.Bias, theta);
+			shadow = PercentageCloserFiltering(shadowPos, cascade, Shadows.PcfRadius, Shadows.Bias, theta);
 		}
 		else
 		{
 			// Compare z coordinate with depth stored in the shadow map
 			shadowPos.z -= Shadows.Bias;
-			float2 shadowDepthTexCoords = float2(0.5 + shadowPos.x * 0.5, 0.5 - shadowPos.y * 0.5);
-			shadow = shadowDepthTexture.SampleCmpLevelZero(depthSampler, shadowDepthTexCoords, shadowPos.z);
+			shadow = shadowDepthTexture.SampleCmpLevelZero(depthSampler, shadowPos.xy, shadowPos.z);
 		}
 	}
 
@@ -71,11 +71,11 @@ PS_OUTPUT PS(PS_INPUT input)
 		// In terms of normal maps, the difference result in how the green channel of a RGB texture should be interpreted.
 		// OpenGL expects the first pixel to be at the bottom while DirectX expects it to be at the top
 		// https://docs.substance3d.com/bake/what-is-the-difference-between-the-opengl-and-directx-normal-format-182256965.html
-		float3 micronormal = normalMapTexture.Sample(textureSampler, input.Tex).xyz;
+		float2 micronormal = normalMapTexture.Sample(textureSampler, input.Tex).xy;
 		micronormal.y = 1. - micronormal.y;
 
 		// Transform normal from texture space to object space
-		float3 n = mul(normalize(micronormal * 2. - 1.), TBN);
+		float3 n = mul(UnpackNormalMap(micronormal), TBN);
 
 		output.Normal = Float32x3ToOct(n) * 0.5f + 0.5;
 	}
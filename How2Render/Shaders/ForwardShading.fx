@@ -51,7 +51,7 @@ PS_INPUT VS(VS_INPUT input)
 //--------------------------------------------------------------------------------------
 // Pixel Shader
 //--------------------------------------------------------------------------------------
-float PercentageCloserFiltering(float4 shadowPos, float radius, float bias, float theta)
+float PercentageCloserFiltering(float3 shadowPos, uint cascade, float radius, float bias, float theta)
 {
 	const float2 poisson[PCF_SAMPLES] =
 	{
@@ -76,7 +76,6 @@ float PercentageCloserFiltering(float4 shadowPos, float radius, float bias, floa
 	shadowDepthTexture.GetDimensions(width, height);
 	float2 normalizedRadius = float2(radius, radius) / float2(width, height);
 	shadowPos.z -= bias;
-	float2 shadowDepthTexCoords = float2(0.5 + shadowPos.x * 0.5, 0.5 - shadowPos.y * 0.5);
 
 	float sum = 0.;
 	for (uint i = 0; i < Shadows.PcfKernelSize; ++i)
@@ -85,7 +84,7 @@ float PercentageCloserFiltering(float4 shadowPos, float radius, float bias, floa
 		float2 offset = poisson[i] * normalizedRadius;
 		offset = RotateVector2D(offset, sin(theta), cos(theta));
 		sum += shadowDepthTexture.SampleCmpLevelZero(
-			depthSampler, shadowDepthTexCoords + offset, shadowPos.z);
+			depthSampler, ClampToShadowCascade(shadowPos.xy + offset, cascade, 1. / width), shadowPos.z);
 	}
 
 	return sum / (float)Shadows.PcfKernelSize;
@@ -97,7 +96,7 @@ float4 PS(PS_INPUT input) : SV_Target
 	float3 ambient = ambientTexture.Sample(anisatropicSampler, input.Tex).rgb;
 	float4 albedo = albedoTexture.Sample(anisatropicSampler, input.Tex).rgba;
 	float3 specular = specularTexture.Sample(anisatropicSampler, input.Tex).rgb;
-	float3 micronormal = normalMapTexture.Sample(anisatropicSampler, input.Tex).rgb;
+	float2 micronormal = normalMapTexture.Sample(anisatropicSampler, input.Tex).rg;
 	float ao = aoTexture.Sample(pointSampler, fullScreenUV).r;
 
 	float3 n = normalize(input.Normal);
@@ -111,7 +110,7 @@ float4 PS(PS_INPUT input) : SV_Target
 		// https://docs.substance3d.com/bake/what-is-the-difference-between-the-opengl-and-directx-normal-format-182256965.html
 		micronormal.y = 1. - micronormal.y;
 		// Transform normal from texture space to object space
-		n = mul(micronormal * 2. - 1., TBN);
+		n = mul(UnpackNormalMap(micronormal), TBN);
 	}
 
 	float3 v = normalize(Camera.PosWorld.xyz - input.WorldPos);
@@ -124,8 +123,9 @@ float4 PS(PS_INPUT input) : SV_Target
 	float shadow = 1.f;
 	if (Debug.ShadowMappingEnabled)
 	{
-		// No need to divide by w because of orthographic projection
-		float4 shadowPos = mul(Lights.ViewProj, float4(input.WorldPos, 1));
+		uint cascade = 0;
+		float viewDepth = mul(Camera.View, float4(input.WorldPos, 1)).z;
+		float3 shadowPos = ShadowAtlasPosition(input.WorldPos, viewDepth, cascade);
 		if (Shadows.PcfEnabled)
 		{
 			uint2 noiseTextureDimensions = uint2(0, 0);
@@ -133,14 +133,13 @@ float4 PS(PS_INPUT input) : SV_Target
 
 			float theta = 6.28 * noiseTexture.SampleLevel(
 				pointSampler, RenderTarget.Dimensions / noiseTextureDimensions * fullScreenUV, 0).x;
-			shadow = PercentageCloserFiltering(shadowPos, Shadows.PcfRadius, Shadows.Bias, theta);
+			shadow = PercentageCloserFiltering(shadowPos, cascade, Shadows.PcfRadius, Shadows.Bias, theta);
 		}
 		else
 		{
 			// Compare z coordinate with depth stored in the shadow map
 			shadowPos.z -= Shadows.Bias;
-			float2 shadowDepthTexCoords = float2(0.5 + shadowPos.x * 0.5, 0.5 - shadowPos.y * 0.5);
-			shadow = shadowDepthTexture.SampleCmpLevelZero(depthSampler, shadowDepthTexCoords, shadowPos.z);
+			shadow = shadowDepthTexture.SampleCmpLevelZero(depthSampler, shadowPos.xy, shadowPos.z);
 		}
 	}
 
@@ -18,6 +18,16 @@ float3x3 CotangentFrame(float3 N, float3 p, float2 uv)
     return float3x3(T * invmax, B * invmax, N);
 }
 
+//--------------------------------------------------------------------------------------
+// Tangent space normals have a positive z, so z is rebuilt from xy. This lets normal maps
+// use two channel formats such as BC5.
+//--------------------------------------------------------------------------------------
+float3 UnpackNormalMap(float2 xy)
+{
+    float2 n = xy * 2. - 1.;
+    return float3(n, sqrt(saturate(1. - dot(n, n))));
+}
+
 //--------------------------------------------------------------------------------------
 // Survey of Efficient Representations for Independent Unit Vectors
 // http://jcgt.org/published/0003/02/01/
@@ -74,4 +84,30 @@ float2 RotateVector2D(float2 vec, float sinX, float cosX)
 {
     return float2(dot(vec, float2(cosX, -sinX)),
                   dot(vec, float2(sinX,  cosX)));
-}
\ No newline at end of file
+}
+//--------------------------------------------------------------------------------------
+// Cascaded shadow maps, the cascades sit side by side in one atlas
+//--------------------------------------------------------------------------------------
+// Picks the first cascade reaching past the view depth. Returns the atlas coordinates in xy
+// and the depth in light space in z.
+float3 ShadowAtlasPosition(float3 worldPos, float viewDepth, out uint cascade)
+{
+    cascade = 0;
+    for (uint i = 0; i < SHADOW_CASCADES - 1; ++i)
+    {
+        cascade += viewDepth > ShadowCascades.SplitFar[i] ? 1 : 0;
+    }
+
+    // No need to divide by w because of orthographic projection
+    float4 shadowPos = mul(ShadowCascades.ViewProj[cascade], float4(worldPos, 1));
+    float2 uv = float2(0.5 + shadowPos.x * 0.5, 0.5 - shadowPos.y * 0.5);
+
+    return float3((cascade + saturate(uv.x)) / SHADOW_CASCADES, uv.y, shadowPos.z);
+}
+
+// Keeps filter taps from reaching into the tile of the neighbouring cascade
+float2 ClampToShadowCascade(float2 uv, uint cascade, float texelWidth)
+{
+    uv.x = clamp(uv.x, cascade / (float)SHADOW_CASCADES + texelWidth, (cascade + 1) / (float)SHADOW_CASCADES - texelWidth);
+    return uv;
+}
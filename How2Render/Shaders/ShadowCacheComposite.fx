@@ -0,0 +1,64 @@
+#include "CBuffers.fx"
+
+//--------------------------------------------------------------------------------------
+// Textures
+//--------------------------------------------------------------------------------------
+Texture2D<float> txShadowCache : register(t0);
+
+//--------------------------------------------------------------------------------------
+struct VS_INPUT
+{
+	float3 Pos : POSITION;
+	float3 Normal : NORMAL;
+	float2 Tex : TEXCOORD0;
+};
+
+struct PS_INPUT
+{
+	float4 Pos : SV_POSITION;
+	float2 Tex : TEXCOORD0;
+};
+
+//--------------------------------------------------------------------------------------
+// Vertex Shader
+//--------------------------------------------------------------------------------------
+PS_INPUT VS(VS_INPUT input)
+{
+	PS_INPUT output = (PS_INPUT)0;
+
+	output.Pos = float4(input.Pos, 1.f);
+	output.Tex = input.Tex;
+
+	return output;
+}
+
+//--------------------------------------------------------------------------------------
+// Pixel Shader
+//--------------------------------------------------------------------------------------
+// Writes the static caster depth of the cache into the tile of the current cascade
+float PS(PS_INPUT input) : SV_Depth
+{
+	matrix reprojection = ShadowCascades.CacheReprojection[RenderTarget.ShadowCascade];
+	float2 clipPos = float2(input.Tex.x * 2.f - 1.f, 1.f - input.Tex.y * 2.f);
+
+	// Both projections are orthographic along the light, the near and far end of the texel
+	// only differ in depth. No need to divide by w.
+	float4 nearPos = mul(reprojection, float4(clipPos, 0.f, 1.f));
+	float4 farPos = mul(reprojection, float4(clipPos, 1.f, 1.f));
+	float2 uv = float2(0.5f + nearPos.x * 0.5f, 0.5f - nearPos.y * 0.5f);
+	if (any(uv < 0.f) || any(uv >= 1.f))
+	{
+		return 1.f;
+	}
+
+	uint width, height;
+	txShadowCache.GetDimensions(width, height);
+	float cacheDepth = txShadowCache.Load(int3(uv * float2(width, height), 0));
+	// Cleared texels hold no caster, they stay cleared in the cascade as well
+	if (cacheDepth >= 1.f)
+	{
+		return 1.f;
+	}
+
+	return saturate((cacheDepth - nearPos.z) / (farPos.z - nearPos.z));
+}
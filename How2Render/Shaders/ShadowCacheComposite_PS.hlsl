@@ -0,0 +1 @@
+#include "ShadowCacheComposite.fx"
\ No newline at end of file
@@ -27,7 +27,11 @@ PS_INPUT VS(VS_INPUT input)
 {
 	PS_INPUT output = (PS_INPUT)0;
 
-	matrix WVP = mul(Lights.ViewProj, Transform.World);
+	// The cascade index past the last cascade draws into the shadow cache
+	matrix viewProj = RenderTarget.ShadowCascade < SHADOW_CASCADES
+		? ShadowCascades.ViewProj[RenderTarget.ShadowCascade]
+		: ShadowCascades.CacheViewProj;
+	matrix WVP = mul(viewProj, Transform.World);
 	output.Pos = mul(WVP, float4(input.Pos, 1.f));
 	output.Tex = input.Tex;
 
@@ -8,6 +8,20 @@
 namespace h2r
 {
 
+    // What changed since the previous frame, work that only depends on the rest is skipped
+    using FrameChangeFlags = uint8_t;
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_NONE = 0;
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_CAMERA = 1;
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_LIGHT = 2;
+    // States deciding which casters end up in the shadow maps, the shadow cache is redrawn for them
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_SHADOW_CASTERS = 4;
+    // States the cascade fit depends on
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_SHADOW_CASCADES = 8;
+    // Every other state, they only affect how the frame is shaded
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_SHADING = 16;
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_SHADERS = 32;
+    constexpr FrameChangeFlags FRAME_CHANGE_FLAG_ALL = 63;
+
     struct Application
     {
         enum class eShadingType : int32_t
@@ -37,6 +51,9 @@ namespace h2r
             bool drawOpaque = true;
             bool drawTransparent = true;
             bool drawTranslucent = true;
+            bool frustumCullingEnabled = true;
+            bool occlusionCullingEnabled = true;
+            bool dynamicObjectsAnimated = true;
 
             bool normalMappingEnabled = true;
 
@@ -51,9 +68,31 @@ namespace h2r
             int32_t pcfKernelSize = 16;
             float pcfRadius = 1.5f;
             float shadowMappingBias = 0.f;
+            // Blends uniform (0) and logarithmic (1) cascade splits
+            float shadowCascadeSplitLambda = 0.75f;
+            bool shadowCacheEnabled = true;
 
             eShadingType shadingType = eShadingType::Deferred;
-            double shadingGPUTimeMs = 0;
+            uint32_t cameraDrawnMeshCount = 0;
+            uint32_t cameraCulledMeshCount = 0;
+            uint32_t occlusionCulledMeshCount = 0;
+            uint32_t shadowDrawnMeshCount = 0;
+            uint32_t shadowCulledMeshCount = 0;
+            uint32_t shadowCacheSkippedFrameCount = 0;
+            uint32_t shadowCacheRenderedFrameCount = 0;
+            uint32_t shadowCacheCascadeCount = 0;
+            uint32_t drawPacketCount = 0;
+            uint32_t stateChangeCount = 0;
+            uint32_t stateChangesSaved = 0;
+            uint32_t stateCallsIssued = 0;
+            uint32_t stateCallsElided = 0;
+            uint64_t renderTargetDeclaredByteSize = 0;
+            uint64_t renderTargetAllocatedByteSize = 0;
+
+            int32_t framesInFlight = 2;
+            float cpuFrameTimeMs = 0;
+            float frameWaitTimeMs = 0;
+            float inputLatencyMs = 0;
 
             eFinalOutput finalOutput = eFinalOutput::FinalImage;
         };
@@ -30,6 +30,10 @@ namespace h2r
 
 		float speed;
 		bool isMouseCaptured;
+		// Set whenever fov, aspect ratio or the clip planes change, the projection is only rebuilt then
+		bool isProjectionDirty;
+		// Set when the position is edited from outside, such as the UI, the view is rebuilt on the next update
+		bool isViewDirty;
 	};
 
 	inline Camera CreateDefaultCamera()
@@ -56,12 +60,16 @@ namespace h2r
 
 			.speed{0.005f},
 			.isMouseCaptured{false},
+			.isProjectionDirty{true},
+			.isViewDirty{true},
 		};
 	}
 
+	// Returns true when any of the matrices changed, they are left untouched otherwise
 	inline bool UpdateCamera(Camera &camera, InputEvents const &events, Window const &window)
 	{
-		bool isCameraChanged = false;
+		bool isCameraChanged = camera.isProjectionDirty || camera.isViewDirty;
+		camera.isViewDirty = false;
 
 		//Update relative mouse mode
 		if (events.keys[SDL_SCANCODE_F] == eKeyState::Press)
@@ -121,13 +129,20 @@ namespace h2r
 			isCameraChanged |= (XMVector2Length({mouseDelta.x, mouseDelta.y}).m128_f32[0]) > 1e-3;
 		}
 
-		camera.position = XMVectorAdd(XMVectorAdd(camera.position, forward), right);
-		camera.view = math::CreateViewMatrix(camera.position, camera.yaw, camera.pitch);
-		camera.proj = XMMatrixPerspectiveFovLH(camera.fov, camera.aspectRatio, camera.zNear, camera.zFar);
-		camera.viewProj = camera.view * camera.proj;
-		camera.inverseView = math::CreateCameraMatrix(camera.position, camera.yaw, camera.pitch);
-		XMVECTOR det;
-		camera.inverseProj = XMMatrixInverse(&det, camera.proj);
+		if (camera.isProjectionDirty)
+		{
+			camera.proj = XMMatrixPerspectiveFovLH(camera.fov, camera.aspectRatio, camera.zNear, camera.zFar);
+			XMVECTOR det;
+			camera.inverseProj = XMMatrixInverse(&det, camera.proj);
+			camera.isProjectionDirty = false;
+		}
+		if (isCameraChanged)
+		{
+			camera.position = XMVectorAdd(XMVectorAdd(camera.position, forward), right);
+			camera.view = math::CreateViewMatrix(camera.position, camera.yaw, camera.pitch);
+			camera.viewProj = camera.view * camera.proj;
+			camera.inverseView = math::CreateCameraMatrix(camera.position, camera.yaw, camera.pitch);
+		}
 
 		return isCameraChanged;
 	}
@@ -0,0 +1,424 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "Helpers/CpuProfiler.hpp"
+#include "RenderCommon.hpp"
+#include "RenderObject.hpp"
+#include "Wrapper/ConstantRing.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <map>
+#include <utility>
+
+namespace h2r
+{
+
+    // Sort key layout from the most significant bit: pass 8, depth bucket 16, shader 8, material 16, mesh 16
+    constexpr uint32_t g_drawKeyMeshShift = 0;
+    constexpr uint32_t g_drawKeyMaterialShift = 16;
+    constexpr uint32_t g_drawKeyShaderShift = 32;
+    constexpr uint32_t g_drawKeyDepthShift = 40;
+    constexpr uint32_t g_drawKeyPassShift = 56;
+
+    // Material and mesh ids saturate here, packets with this id always rebind
+    constexpr uint16_t g_drawKeyOverflowId = UINT16_MAX;
+    constexpr uint32_t g_drawFrontToBackBucketCount = 16;
+
+    enum class eDrawDepthOrder : uint8_t
+    {
+        None,
+        FrontToBack,
+        // Packets keep the order of the visible list, which SortByViewDepth already put back to front
+        BackToFront,
+    };
+
+    // Dense ids for the material and mesh of every entry of a RenderObjectBounds. Meshes binding the same
+    // vertex and index buffer and materials binding the same textures and constants share an id.
+    struct DrawKeyTable
+    {
+        std::vector<uint16_t> materialIds;
+        std::vector<uint16_t> meshIds;
+    };
+
+    struct DrawPacket
+    {
+        uint64_t key = 0;
+        MeshReference mesh;
+    };
+
+    // Constant slices a packet binds when drawing from a constant ring
+    struct DrawPacketConstants
+    {
+        ConstantRingSlice instance;
+        ConstantRingSlice material;
+    };
+
+    struct DrawPacketQueue
+    {
+        uint8_t pass = 0;
+        // Programs are bound by the pass, the shader field stays constant within a queue for now
+        uint8_t shader = 0;
+        eMeshList meshList = eMeshList::Opaque;
+        eDrawDepthOrder depthOrder = eDrawDepthOrder::None;
+        std::vector<DrawPacket> packets;
+        std::vector<DrawPacket> scratch;
+        std::vector<DrawPacketConstants> constants;
+    };
+
+    // Material binds, mesh binds and per instance updates, saved counts them against rebinding all three per packet
+    struct DrawStateCounters
+    {
+        uint32_t packetCount = 0;
+        uint32_t stateChangeCount = 0;
+        uint32_t stateChangesSaved = 0;
+    };
+
+    inline DrawPacketQueue CreateDrawPacketQueue(uint8_t pass, eMeshList meshList, eDrawDepthOrder depthOrder);
+
+    // Has to run again whenever UpdateRenderObjectBounds ran for the same list
+    inline void UpdateDrawKeyTable(
+        std::vector<RenderObject> const &objects, RenderObjectBounds const &bounds, DrawKeyTable &table);
+
+    inline void EmitDrawPackets(
+        DrawPacketQueue &queue,
+        DrawKeyTable const &table,
+        RenderObjectBounds const &bounds,
+        VisibleMeshes const &visible,
+        Camera const &camera);
+
+    // Back to front queues are left in the order they were emitted in
+    inline void SortDrawPackets(DrawPacketQueue &queue);
+
+    // ring may be null, constants are then updated in place
+    inline void SubmitDrawPackets(
+        Context const &context,
+        DrawPacketQueue &queue,
+        std::vector<RenderObject> const &objects,
+        ConstantRing *ring,
+        DeviceConstBuffers const &cbuffersDevice,
+        HostConstBuffers &cbuffersHost,
+        DrawStateCounters &counters);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+    inline DrawPacketQueue CreateDrawPacketQueue(uint8_t pass, eMeshList meshList, eDrawDepthOrder depthOrder)
+    {
+        DrawPacketQueue queue;
+
+        queue.pass = pass;
+        queue.meshList = meshList;
+        queue.depthOrder = depthOrder;
+
+        return queue;
+    }
+
+    inline bool IsSameMaterialState(DeviceMaterial const &a, DeviceMaterial const &b)
+    {
+        return a.ambientTexture.shaderResourceView == b.ambientTexture.shaderResourceView &&
+               a.albedoTexture.shaderResourceView == b.albedoTexture.shaderResourceView &&
+               a.specularTexture.shaderResourceView == b.specularTexture.shaderResourceView &&
+               a.normalTexture.shaderResourceView == b.normalTexture.shaderResourceView &&
+               a.scalarAmbient.x == b.scalarAmbient.x && a.scalarAmbient.y == b.scalarAmbient.y && a.scalarAmbient.z == b.scalarAmbient.z &&
+               a.scalarDiffuse.x == b.scalarDiffuse.x && a.scalarDiffuse.y == b.scalarDiffuse.y && a.scalarDiffuse.z == b.scalarDiffuse.z &&
+               a.scalarSpecular.x == b.scalarSpecular.x && a.scalarSpecular.y == b.scalarSpecular.y && a.scalarSpecular.z == b.scalarSpecular.z &&
+               a.scalarShininess == b.scalarShininess &&
+               a.scalarAlpha == b.scalarAlpha &&
+               (a.normalTexture.texture != nullptr) == (b.normalTexture.texture != nullptr);
+    }
+
+    inline void UpdateDrawKeyTable(
+        std::vector<RenderObject> const &objects, RenderObjectBounds const &bounds, DrawKeyTable &table)
+    {
+        table.materialIds.clear();
+        table.meshIds.clear();
+
+        // Id 0 is meshes without a material, scenes hold few unique materials so a linear search does
+        std::vector<DeviceMaterial const *> uniqueMaterials = {nullptr};
+        // BindMesh sets both buffers, a mesh only skips the bind when neither of them differs
+        std::map<std::pair<ID3D11Buffer *, ID3D11Buffer *>, uint16_t> uniqueMeshes;
+
+        for (auto const &reference : bounds.meshes)
+        {
+            auto const &object = objects[reference.objectIndex];
+            auto const &mesh = GetMeshList(object.model, bounds.meshList)[reference.meshIndex];
+
+            size_t materialId = 0;
+            if (mesh.materialId != InvalidMaterialId)
+            {
+                DeviceMaterial const &material = object.model.materials[mesh.materialId];
+                auto const found = std::find_if(uniqueMaterials.begin() + 1, uniqueMaterials.end(), [&material](auto const *unique) {
+                    return IsSameMaterialState(*unique, material);
+                });
+                materialId = std::distance(uniqueMaterials.begin(), found);
+                if (found == uniqueMaterials.end())
+                {
+                    uniqueMaterials.push_back(&material);
+                }
+            }
+            table.materialIds.push_back(static_cast<uint16_t>(std::min<size_t>(materialId, g_drawKeyOverflowId)));
+
+            auto const [meshIt, isInserted] = uniqueMeshes.try_emplace(
+                std::make_pair(mesh.vertexBuffer.pVertexBuffer, mesh.indexBuffer.pIndexBuffer),
+                static_cast<uint16_t>(std::min<size_t>(uniqueMeshes.size(), g_drawKeyOverflowId)));
+            table.meshIds.push_back(meshIt->second);
+        }
+    }
+
+    inline uint64_t MakeDrawKey(uint8_t pass, uint16_t depthBucket, uint8_t shader, uint16_t material, uint16_t mesh)
+    {
+        return uint64_t(pass) << g_drawKeyPassShift |
+               uint64_t(depthBucket) << g_drawKeyDepthShift |
+               uint64_t(shader) << g_drawKeyShaderShift |
+               uint64_t(material) << g_drawKeyMaterialShift |
+               uint64_t(mesh) << g_drawKeyMeshShift;
+    }
+
+    // Front to back only uses a few logarithmic buckets so material batches survive within a bucket.
+    // Back to front is not bucketed, blending needs the exact per mesh order the visible list comes in.
+    inline uint16_t CalculateDepthBucket(eDrawDepthOrder order, float viewDepth, float zFar)
+    {
+        float const depth = std::clamp(viewDepth, 0.f, zFar);
+        switch (order)
+        {
+        case eDrawDepthOrder::FrontToBack:
+            return static_cast<uint16_t>(std::min(std::log2(1.f + depth), float(g_drawFrontToBackBucketCount - 1)));
+        default:
+            return 0;
+        }
+    }
+
+    inline void EmitDrawPackets(
+        DrawPacketQueue &queue,
+        DrawKeyTable const &table,
+        RenderObjectBounds const &bounds,
+        VisibleMeshes const &visible,
+        Camera const &camera)
+    {
+        queue.packets.clear();
+
+        for (auto const &reference : visible.meshes)
+        {
+            uint32_t const entry = bounds.objectFirstEntries[reference.objectIndex] + reference.meshIndex;
+
+            uint16_t depthBucket = 0;
+            if (queue.depthOrder == eDrawDepthOrder::FrontToBack)
+            {
+                XMVECTOR const center = XMVectorSet(
+                    bounds.bounds.centerX[entry], bounds.bounds.centerY[entry], bounds.bounds.centerZ[entry], 1.f);
+                float const viewDepth = XMVectorGetZ(XMVector3Transform(center, camera.view));
+                depthBucket = CalculateDepthBucket(queue.depthOrder, viewDepth, camera.zFar);
+            }
+
+            uint64_t const key = MakeDrawKey(
+                queue.pass, depthBucket, queue.shader, table.materialIds[entry], table.meshIds[entry]);
+            queue.packets.push_back(DrawPacket{key, reference});
+        }
+    }
+
+    // Stable LSD radix sort on bytes of the key, bytes every packet shares are skipped
+    inline void SortDrawPackets(DrawPacketQueue &queue)
+    {
+        if (queue.depthOrder == eDrawDepthOrder::BackToFront)
+        {
+            return;
+        }
+
+        auto &packets = queue.packets;
+        auto &scratch = queue.scratch;
+        scratch.resize(packets.size());
+
+        for (uint32_t shift = 0; shift < 64; shift += 8)
+        {
+            std::array<uint32_t, 256> offsets = {};
+            for (auto const &packet : packets)
+            {
+                ++offsets[(packet.key >> shift) & 0xFF];
+            }
+            if (packets.empty() || offsets[(packets.front().key >> shift) & 0xFF] == packets.size())
+            {
+                continue;
+            }
+
+            uint32_t sum = 0;
+            for (auto &offset : offsets)
+            {
+                uint32_t const count = offset;
+                offset = sum;
+                sum += count;
+            }
+            for (auto const &packet : packets)
+            {
+                scratch[offsets[(packet.key >> shift) & 0xFF]++] = packet;
+            }
+            packets.swap(scratch);
+        }
+    }
+
+    inline uint16_t GetDrawKeyMaterial(uint64_t key)
+    {
+        return static_cast<uint16_t>(key >> g_drawKeyMaterialShift);
+    }
+
+    inline uint16_t GetDrawKeyMesh(uint64_t key)
+    {
+        return static_cast<uint16_t>(key >> g_drawKeyMeshShift);
+    }
+
+    inline bool IsDrawPacketMaterialChange(DrawPacket const *previous, DrawPacket const &packet)
+    {
+        uint16_t const material = GetDrawKeyMaterial(packet.key);
+        return previous == nullptr || material != GetDrawKeyMaterial(previous->key) || material == g_drawKeyOverflowId;
+    }
+
+    inline bool IsDrawPacketInstanceChange(DrawPacket const *previous, DrawPacket const &packet)
+    {
+        return previous == nullptr || packet.mesh.objectIndex != previous->mesh.objectIndex;
+    }
+
+    // Writes the material and instance constants of packets [first, last) with a single map. Only packets
+    // that change them get a slice, the others reuse the slice of the packet before.
+    inline bool WriteDrawPacketConstants(
+        Context const &context,
+        DrawPacketQueue &queue,
+        size_t first,
+        size_t last,
+        std::vector<RenderObject> const &objects,
+        ConstantRing &ring,
+        HostConstBuffers &cbuffersHost)
+    {
+        uint32_t const maxByteSize = static_cast<uint32_t>(last - first) * 2 * g_constantRingAlignment;
+        if (!MapConstantRing(context, ring, maxByteSize))
+        {
+            return false;
+        }
+
+        queue.constants.resize(queue.packets.size());
+        for (size_t i = first; i < last; ++i)
+        {
+            DrawPacket const &packet = queue.packets[i];
+            DrawPacket const *previous = i > first ? &queue.packets[i - 1] : nullptr;
+            auto const &object = objects[packet.mesh.objectIndex];
+            auto const &mesh = GetMeshList(object.model, queue.meshList)[packet.mesh.meshIndex];
+
+            DrawPacketConstants &constants = queue.constants[i];
+            if (IsDrawPacketMaterialChange(previous, packet))
+            {
+                FillPerMaterialConstantBuffer(mesh, object.model.materials, cbuffersHost.perMaterial);
+                constants.material = WriteConstantRing(ring, &cbuffersHost.perMaterial, sizeof(cbuffersHost.perMaterial));
+            }
+            else
+            {
+                constants.material = queue.constants[i - 1].material;
+            }
+
+            if (IsDrawPacketInstanceChange(previous, packet))
+            {
+                cbuffersHost.perInstance.transform.worldMatrix = object.transform.world;
+                constants.instance = WriteConstantRing(ring, &cbuffersHost.perInstance, sizeof(cbuffersHost.perInstance));
+            }
+            else
+            {
+                constants.instance = queue.constants[i - 1].instance;
+            }
+        }
+
+        UnmapConstantRing(context, ring);
+
+        return true;
+    }
+
+    // Puts the static per instance and per material buffers back where an earlier batch bound ring slices
+    inline void BindStaticDrawConstants(Context const &context, DeviceConstBuffers const &cbuffersDevice)
+    {
+        for (eShaderStage stage : {eShaderStage::Vertex, eShaderStage::Pixel})
+        {
+            SetCachedConstantBuffers(context, stage, g_perInstanceConstantBufferSlot, 1, &cbuffersDevice.pPerInstance);
+            SetCachedConstantBuffers(context, stage, g_perMaterialConstantBufferSlot, 1, &cbuffersDevice.pPerMaterial);
+        }
+    }
+
+    // Material, mesh buffers and the per instance constants are only rebound when they differ from the
+    // previous packet. State is not carried over between queues since passes rebind around them.
+    // With a ring the constants of a whole batch are written up front and bound by offset,
+    // otherwise every change goes through UpdateSubresource.
+    inline void SubmitDrawPackets(
+        Context const &context,
+        DrawPacketQueue &queue,
+        std::vector<RenderObject> const &objects,
+        ConstantRing *ring,
+        DeviceConstBuffers const &cbuffersDevice,
+        HostConstBuffers &cbuffersHost,
+        DrawStateCounters &counters)
+    {
+        H2R_CPU_ZONE("SubmitDrawPackets");
+
+        // Each packet takes at most two slices, a batch never needs more than the whole ring
+        size_t const batchSize = ring != nullptr ? ring->byteSize / (2 * g_constantRingAlignment) : queue.packets.size();
+
+        for (size_t first = 0; first < queue.packets.size(); first += batchSize)
+        {
+            size_t const last = std::min(first + batchSize, queue.packets.size());
+            bool const isRingWritten =
+                ring != nullptr && WriteDrawPacketConstants(context, queue, first, last, objects, *ring, cbuffersHost);
+            if (ring != nullptr && !isRingWritten)
+            {
+                // The fallback updates the static buffers, which ring slices may still be covering
+                BindStaticDrawConstants(context, cbuffersDevice);
+            }
+
+            uint32_t currentMesh = UINT32_MAX;
+            for (size_t i = first; i < last; ++i)
+            {
+                DrawPacket const &packet = queue.packets[i];
+                DrawPacket const *previous = i > first ? &queue.packets[i - 1] : nullptr;
+                auto const &object = objects[packet.mesh.objectIndex];
+                auto const &mesh = GetMeshList(object.model, queue.meshList)[packet.mesh.meshIndex];
+
+                if (IsDrawPacketMaterialChange(previous, packet))
+                {
+                    if (isRingWritten)
+                    {
+                        BindConstantRingSlice(context, *ring, g_perMaterialConstantBufferSlot, queue.constants[i].material);
+                        BindMaterialTextures(context, mesh, object.model.materials);
+                    }
+                    else
+                    {
+                        UpdatePerMaterialConstantBuffer(context, mesh, object.model.materials, cbuffersDevice, cbuffersHost.perMaterial);
+                    }
+                    ++counters.stateChangeCount;
+                }
+
+                if (IsDrawPacketInstanceChange(previous, packet))
+                {
+                    if (isRingWritten)
+                    {
+                        BindConstantRingSlice(context, *ring, g_perInstanceConstantBufferSlot, queue.constants[i].instance);
+                    }
+                    else
+                    {
+                        UpdatePerInstanceConstantBuffer(context, mesh, object.transform, cbuffersDevice, cbuffersHost.perInstance);
+                    }
+                    ++counters.stateChangeCount;
+                }
+
+                uint16_t const meshId = GetDrawKeyMesh(packet.key);
+                if (meshId != currentMesh || meshId == g_drawKeyOverflowId)
+                {
+                    BindMesh(context, mesh);
+                    currentMesh = meshId;
+                    ++counters.stateChangeCount;
+                }
+
+                DrawMesh(context, mesh);
+            }
+        }
+
+        counters.packetCount += static_cast<uint32_t>(queue.packets.size());
+        counters.stateChangesSaved = 3 * counters.packetCount - counters.stateChangeCount;
+    }
+
+} // namespace h2r
@@ -0,0 +1,263 @@
+#pragma once
+
+#include <Windows.h>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace h2r
+{
+
+	struct MappedFile
+	{
+		HANDLE file = INVALID_HANDLE_VALUE;
+		HANDLE mapping = nullptr;
+		uint8_t const *data = nullptr;
+		uint64_t size = 0;
+	};
+
+	struct SourceFileStamp
+	{
+		uint64_t size = 0;
+		int64_t lastWriteTime = 0;
+	};
+
+	struct BinaryReader
+	{
+		uint8_t const *data = nullptr;
+		uint64_t size = 0;
+		uint64_t offset = 0;
+	};
+
+	inline std::optional<MappedFile> CreateMappedFile(std::filesystem::path const &path);
+
+	inline void CleanupMappedFile(MappedFile &file);
+
+	inline std::optional<SourceFileStamp> GetSourceFileStamp(std::filesystem::path const &path);
+
+	inline std::filesystem::path GetCacheFilePath(std::filesystem::path const &source, char const *extension);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline std::optional<MappedFile> CreateMappedFile(std::filesystem::path const &path)
+	{
+		MappedFile mappedFile;
+
+		mappedFile.file = CreateFileW(
+			path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (mappedFile.file == INVALID_HANDLE_VALUE)
+		{
+			return std::nullopt;
+		}
+
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(mappedFile.file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			CleanupMappedFile(mappedFile);
+			return std::nullopt;
+		}
+		mappedFile.size = static_cast<uint64_t>(fileSize.QuadPart);
+
+		mappedFile.mapping = CreateFileMappingW(mappedFile.file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (mappedFile.mapping == nullptr)
+		{
+			wprintf(L"Failed to map file: '%s'\n", path.c_str());
+			CleanupMappedFile(mappedFile);
+			return std::nullopt;
+		}
+
+		mappedFile.data = static_cast<uint8_t const *>(MapViewOfFile(mappedFile.mapping, FILE_MAP_READ, 0, 0, 0));
+		if (mappedFile.data == nullptr)
+		{
+			wprintf(L"Failed to map view of file: '%s'\n", path.c_str());
+			CleanupMappedFile(mappedFile);
+			return std::nullopt;
+		}
+
+		return mappedFile;
+	}
+
+	inline void CleanupMappedFile(MappedFile &file)
+	{
+		if (file.data != nullptr)
+		{
+			UnmapViewOfFile(file.data);
+			file.data = nullptr;
+		}
+		if (file.mapping != nullptr)
+		{
+			CloseHandle(file.mapping);
+			file.mapping = nullptr;
+		}
+		if (file.file != INVALID_HANDLE_VALUE)
+		{
+			CloseHandle(file.file);
+			file.file = INVALID_HANDLE_VALUE;
+		}
+		file.size = 0;
+	}
+
+	inline std::optional<SourceFileStamp> GetSourceFileStamp(std::filesystem::path const &path)
+	{
+		std::error_code error;
+
+		SourceFileStamp stamp;
+		stamp.size = std::filesystem::file_size(path, error);
+		if (error)
+		{
+			return std::nullopt;
+		}
+		stamp.lastWriteTime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+		if (error)
+		{
+			return std::nullopt;
+		}
+
+		return stamp;
+	}
+
+	inline uint64_t HashBytesFnv1a(void const *bytes, size_t size, uint64_t hash = 0xCBF29CE484222325ull)
+	{
+		auto const *data = static_cast<uint8_t const *>(bytes);
+		for (size_t i = 0; i < size; ++i)
+		{
+			hash ^= data[i];
+			hash *= 0x100000001B3ull;
+		}
+		return hash;
+	}
+
+	// Cache files live in a flat directory, the source path hash keeps files with equal names apart
+	inline std::filesystem::path GetCacheFilePath(std::filesystem::path const &source, char const *extension)
+	{
+		std::wstring const sourceString = source.lexically_normal().wstring();
+		uint64_t const hash = HashBytesFnv1a(sourceString.data(), sourceString.size() * sizeof(wchar_t));
+
+		char hashString[17] = {};
+		snprintf(hashString, sizeof(hashString), "%016llx", static_cast<unsigned long long>(hash));
+
+		std::filesystem::path cachePath = std::filesystem::path("Data") / "Cache" / source.filename();
+		cachePath += ".";
+		cachePath += hashString;
+		cachePath += extension;
+
+		return cachePath;
+	}
+
+	inline BinaryReader CreateBinaryReader(MappedFile const &file)
+	{
+		return BinaryReader{file.data, file.size, 0};
+	}
+
+	template <typename T>
+	inline bool ReadBinary(BinaryReader &reader, T &value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+
+		if (reader.offset + sizeof(T) > reader.size)
+		{
+			return false;
+		}
+		std::memcpy(&value, reader.data + reader.offset, sizeof(T));
+		reader.offset += sizeof(T);
+
+		return true;
+	}
+
+	template <typename T>
+	inline bool ReadBinaryArray(BinaryReader &reader, std::vector<T> &values, uint64_t count)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+
+		uint64_t const byteSize = count * sizeof(T);
+		if (reader.offset + byteSize > reader.size)
+		{
+			return false;
+		}
+		values.resize(count);
+		std::memcpy(values.data(), reader.data + reader.offset, byteSize);
+		reader.offset += byteSize;
+
+		return true;
+	}
+
+	inline bool ReadBinaryString(BinaryReader &reader, std::string &value)
+	{
+		uint32_t length = 0;
+		if (!ReadBinary(reader, length) || reader.offset + length > reader.size)
+		{
+			return false;
+		}
+		value.assign(reinterpret_cast<char const *>(reader.data + reader.offset), length);
+		reader.offset += length;
+
+		return true;
+	}
+
+	template <typename T>
+	inline void WriteBinary(std::ofstream &stream, T const &value)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		stream.write(reinterpret_cast<char const *>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	inline void WriteBinaryArray(std::ofstream &stream, std::vector<T> const &values)
+	{
+		static_assert(std::is_trivially_copyable_v<T>);
+		stream.write(reinterpret_cast<char const *>(values.data()), values.size() * sizeof(T));
+	}
+
+	inline void WriteBinaryString(std::ofstream &stream, std::string const &value)
+	{
+		WriteBinary(stream, static_cast<uint32_t>(value.size()));
+		stream.write(value.data(), value.size());
+	}
+
+	// Writes through a temporary file so an interrupted write never leaves a truncated cache behind
+	template <typename WriteFunction>
+	inline bool WriteBinaryFile(std::filesystem::path const &path, WriteFunction &&write)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(path.parent_path(), error);
+
+		std::filesystem::path tempPath = path;
+		tempPath += ".tmp";
+		{
+			std::ofstream stream(tempPath, std::ios::binary | std::ios::trunc);
+			if (!stream)
+			{
+				wprintf(L"Failed to open file for writing: '%s'\n", tempPath.c_str());
+				return false;
+			}
+			write(stream);
+			if (!stream)
+			{
+				wprintf(L"Failed to write file: '%s'\n", tempPath.c_str());
+				stream.close();
+				std::filesystem::remove(tempPath, error);
+				return false;
+			}
+		}
+
+		std::filesystem::rename(tempPath, path, error);
+		if (error)
+		{
+			std::filesystem::remove(tempPath, error);
+			return false;
+		}
+
+		return true;
+	}
+
+} // namespace h2r
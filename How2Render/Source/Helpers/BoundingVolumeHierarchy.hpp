@@ -0,0 +1,273 @@
+#pragma once
+
+#include "Helpers/FrustumCulling.hpp"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace h2r
+{
+
+	constexpr uint32_t g_bvhMaxLeafSize = 4;
+	constexpr uint32_t g_bvhInvalidNode = UINT32_MAX;
+
+	// Leaves have a non zero count and own primitives [first, first + count),
+	// internal nodes keep their children next to each other at first and first + 1
+	struct BvhNode
+	{
+		XMFLOAT3 boundsMin = {};
+		uint32_t first = 0;
+		XMFLOAT3 boundsMax = {};
+		uint32_t count = 0;
+	};
+
+	// Hierarchy over the boxes of a CullingBounds. Entries are referenced by their index in the bounds,
+	// so moving an entry only needs a refit of the path from its leaf to the root.
+	struct Bvh
+	{
+		std::vector<BvhNode> nodes;
+		std::vector<uint32_t> parents;
+		std::vector<uint32_t> primitives;
+		std::vector<uint32_t> primitiveLeaves;
+	};
+
+	inline Bvh CreateBvh(CullingBounds const &bounds);
+
+	// Call after the bounds of entry index changed
+	inline void RefitBvh(Bvh &bvh, CullingBounds const &bounds, uint32_t index);
+
+	// Replaces visible with the indices of all bounds that intersect the frustum. Gives the same set as
+	// CullBounds, but in traversal order, callers that depend on the order of the bounds have to sort.
+	inline void QueryBvh(Bvh const &bvh, CullingBounds const &bounds, Frustum const &frustum, std::vector<uint32_t> &visible);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline void GetCullingBox(CullingBounds const &bounds, uint32_t index, XMVECTOR &boxMin, XMVECTOR &boxMax)
+	{
+		XMVECTOR const center = XMVectorSet(bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index], 0.f);
+		XMVECTOR const extents = XMVectorSet(bounds.extentX[index], bounds.extentY[index], bounds.extentZ[index], 0.f);
+		boxMin = XMVectorSubtract(center, extents);
+		boxMax = XMVectorAdd(center, extents);
+	}
+
+	inline void UpdateBvhLeafBounds(Bvh &bvh, CullingBounds const &bounds, BvhNode &node)
+	{
+		XMVECTOR nodeMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR nodeMax = XMVectorReplicate(-FLT_MAX);
+		for (uint32_t i = node.first; i < node.first + node.count; ++i)
+		{
+			XMVECTOR boxMin, boxMax;
+			GetCullingBox(bounds, bvh.primitives[i], boxMin, boxMax);
+			nodeMin = XMVectorMin(nodeMin, boxMin);
+			nodeMax = XMVectorMax(nodeMax, boxMax);
+		}
+		XMStoreFloat3(&node.boundsMin, nodeMin);
+		XMStoreFloat3(&node.boundsMax, nodeMax);
+	}
+
+	// Returns true if the bounds of the node changed
+	inline bool UpdateBvhInternalBounds(Bvh &bvh, BvhNode &node)
+	{
+		BvhNode const &left = bvh.nodes[node.first];
+		BvhNode const &right = bvh.nodes[node.first + 1];
+		XMFLOAT3 boundsMin, boundsMax;
+		XMStoreFloat3(&boundsMin, XMVectorMin(XMLoadFloat3(&left.boundsMin), XMLoadFloat3(&right.boundsMin)));
+		XMStoreFloat3(&boundsMax, XMVectorMax(XMLoadFloat3(&left.boundsMax), XMLoadFloat3(&right.boundsMax)));
+
+		bool const isChanged =
+			boundsMin.x != node.boundsMin.x || boundsMin.y != node.boundsMin.y || boundsMin.z != node.boundsMin.z ||
+			boundsMax.x != node.boundsMax.x || boundsMax.y != node.boundsMax.y || boundsMax.z != node.boundsMax.z;
+		node.boundsMin = boundsMin;
+		node.boundsMax = boundsMax;
+
+		return isChanged;
+	}
+
+	// Splits at the median centroid of the longest centroid axis. Children are built before the
+	// parent bounds are set, so every internal node ends up as the union of its two children.
+	inline void BuildBvhNode(Bvh &bvh, CullingBounds const &bounds, uint32_t nodeIndex, uint32_t first, uint32_t count)
+	{
+		if (count <= g_bvhMaxLeafSize)
+		{
+			BvhNode &leaf = bvh.nodes[nodeIndex];
+			leaf.first = first;
+			leaf.count = count;
+			UpdateBvhLeafBounds(bvh, bounds, leaf);
+			for (uint32_t i = first; i < first + count; ++i)
+			{
+				bvh.primitiveLeaves[bvh.primitives[i]] = nodeIndex;
+			}
+			return;
+		}
+
+		XMVECTOR centroidMin = XMVectorReplicate(FLT_MAX);
+		XMVECTOR centroidMax = XMVectorReplicate(-FLT_MAX);
+		for (uint32_t i = first; i < first + count; ++i)
+		{
+			uint32_t const index = bvh.primitives[i];
+			XMVECTOR const center = XMVectorSet(bounds.centerX[index], bounds.centerY[index], bounds.centerZ[index], 0.f);
+			centroidMin = XMVectorMin(centroidMin, center);
+			centroidMax = XMVectorMax(centroidMax, center);
+		}
+		XMFLOAT3 size;
+		XMStoreFloat3(&size, XMVectorSubtract(centroidMax, centroidMin));
+		std::vector<float> const &axis =
+			size.x >= size.y && size.x >= size.z ? bounds.centerX : (size.y >= size.z ? bounds.centerY : bounds.centerZ);
+
+		uint32_t const half = count / 2;
+		auto const begin = bvh.primitives.begin() + first;
+		std::nth_element(begin, begin + half, begin + count, [&axis](uint32_t a, uint32_t b) {
+			return axis[a] < axis[b];
+		});
+
+		uint32_t const childIndex = static_cast<uint32_t>(bvh.nodes.size());
+		bvh.nodes.resize(bvh.nodes.size() + 2);
+		bvh.parents.resize(bvh.nodes.size(), nodeIndex);
+		bvh.nodes[nodeIndex].first = childIndex;
+		bvh.nodes[nodeIndex].count = 0;
+
+		BuildBvhNode(bvh, bounds, childIndex, first, half);
+		BuildBvhNode(bvh, bounds, childIndex + 1, first + half, count - half);
+		UpdateBvhInternalBounds(bvh, bvh.nodes[nodeIndex]);
+	}
+
+	inline Bvh CreateBvh(CullingBounds const &bounds)
+	{
+		Bvh bvh;
+
+		uint32_t const count = static_cast<uint32_t>(bounds.radius.size());
+		if (count == 0)
+		{
+			return bvh;
+		}
+
+		bvh.primitives.resize(count);
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			bvh.primitives[i] = i;
+		}
+		bvh.primitiveLeaves.resize(count, g_bvhInvalidNode);
+		bvh.nodes.reserve(2 * (count / g_bvhMaxLeafSize + 1));
+		bvh.parents.reserve(bvh.nodes.capacity());
+		bvh.nodes.resize(1);
+		bvh.parents.resize(1, g_bvhInvalidNode);
+
+		BuildBvhNode(bvh, bounds, 0, 0, count);
+
+		return bvh;
+	}
+
+	// Walks up from the leaf and stops as soon as a node keeps its bounds
+	inline void RefitBvh(Bvh &bvh, CullingBounds const &bounds, uint32_t index)
+	{
+		uint32_t nodeIndex = bvh.primitiveLeaves[index];
+		UpdateBvhLeafBounds(bvh, bounds, bvh.nodes[nodeIndex]);
+
+		for (nodeIndex = bvh.parents[nodeIndex]; nodeIndex != g_bvhInvalidNode; nodeIndex = bvh.parents[nodeIndex])
+		{
+			if (!UpdateBvhInternalBounds(bvh, bvh.nodes[nodeIndex]))
+			{
+				break;
+			}
+		}
+	}
+
+	inline void AppendBvhSubtree(Bvh const &bvh, uint32_t nodeIndex, std::vector<uint32_t> &visible)
+	{
+		BvhNode const &node = bvh.nodes[nodeIndex];
+		if (node.count > 0)
+		{
+			visible.insert(visible.end(), bvh.primitives.begin() + node.first, bvh.primitives.begin() + node.first + node.count);
+			return;
+		}
+		AppendBvhSubtree(bvh, node.first, visible);
+		AppendBvhSubtree(bvh, node.first + 1, visible);
+	}
+
+	// Each traversal entry carries the planes its node still crosses. Planes a node lies fully in front
+	// of are dropped for its subtree, and nodes inside all planes are accepted without further tests.
+	inline void QueryBvh(Bvh const &bvh, CullingBounds const &bounds, Frustum const &frustum, std::vector<uint32_t> &visible)
+	{
+		visible.clear();
+		if (bvh.nodes.empty())
+		{
+			return;
+		}
+
+		constexpr uint32_t allPlanes = (1u << std::tuple_size_v<decltype(frustum.planes)>) - 1;
+
+		struct Entry
+		{
+			uint32_t nodeIndex;
+			uint32_t planeMask;
+		};
+		std::array<Entry, 64> stack;
+		uint32_t stackSize = 0;
+		stack[stackSize++] = Entry{0, allPlanes};
+
+		while (stackSize > 0)
+		{
+			Entry const entry = stack[--stackSize];
+			BvhNode const &node = bvh.nodes[entry.nodeIndex];
+
+			XMFLOAT3 const center = {
+				(node.boundsMin.x + node.boundsMax.x) * 0.5f,
+				(node.boundsMin.y + node.boundsMax.y) * 0.5f,
+				(node.boundsMin.z + node.boundsMax.z) * 0.5f};
+			XMFLOAT3 const extents = {
+				(node.boundsMax.x - node.boundsMin.x) * 0.5f,
+				(node.boundsMax.y - node.boundsMin.y) * 0.5f,
+				(node.boundsMax.z - node.boundsMin.z) * 0.5f};
+
+			bool isOutside = false;
+			uint32_t planeMask = entry.planeMask;
+			for (uint32_t i = 0; i < frustum.planes.size() && !isOutside; ++i)
+			{
+				if ((planeMask & (1u << i)) == 0)
+				{
+					continue;
+				}
+				XMFLOAT4 const &plane = frustum.planes[i];
+				float const distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+				float const boxRadius =
+					std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z;
+				isOutside = distance + boxRadius < 0.f;
+				if (distance - boxRadius >= 0.f)
+				{
+					planeMask &= ~(1u << i);
+				}
+			}
+
+			if (isOutside)
+			{
+				continue;
+			}
+			if (planeMask == 0)
+			{
+				AppendBvhSubtree(bvh, entry.nodeIndex, visible);
+			}
+			else if (node.count > 0)
+			{
+				for (uint32_t i = node.first; i < node.first + node.count; ++i)
+				{
+					if (IsBoundsInFrustum(frustum, bounds, bvh.primitives[i]))
+					{
+						visible.push_back(bvh.primitives[i]);
+					}
+				}
+			}
+			else
+			{
+				stack[stackSize++] = Entry{node.first + 1, planeMask};
+				stack[stackSize++] = Entry{node.first, planeMask};
+			}
+		}
+	}
+
+} // namespace h2r
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "Mesh.hpp"
+#include "RenderCommon.hpp"
+#include "Wrapper/ConstantRing.hpp"
+#include "Wrapper/Shader.hpp"
+#include <chrono>
+#include <cstdio>
+
+namespace h2r
+{
+
+	// Feeds 10k draws with their own instance constants and a material change every 8 draws, once through
+	// UpdateSubresource per change and once through a constant ring written with a single map. Times are
+	// CPU times up to a Flush, so the driver work the calls queue up is included. Nothing is rendered,
+	// the draws go to no render target.
+	inline bool BenchmarkConstantSubmission()
+	{
+		constexpr uint32_t drawCount = 10000;
+		constexpr uint32_t drawsPerMaterial = 8;
+		constexpr uint32_t runCount = 10;
+
+		Context context = CreateContext();
+		auto cbuffers = CreateDeviceConstantBuffers(context);
+		auto ring = CreateConstantRing(context, g_constantRingByteSize);
+
+		ShaderProgramDescriptor desc;
+		desc.vertexShaderPath = "Shaders/Depth.fx";
+		desc.pixelShaderPath = "Shaders/Depth.fx";
+		auto program = CreateShaderProgram(context, desc);
+
+		if (!cbuffers || !ring || !program)
+		{
+			printf("Failed to create constant submission benchmark resources\n");
+			if (cbuffers)
+			{
+				CleanupDeviceConstantBuffers(cbuffers.value());
+			}
+			if (ring)
+			{
+				CleanupConstantRing(ring.value());
+			}
+			if (program)
+			{
+				CleanupShaderProgram(program.value());
+			}
+			CleanupContext(context);
+			return false;
+		}
+
+		HostMesh hostMesh;
+		hostMesh.vertices = {
+			Vertex{{0.f, 0.f, 0.f}, {0.f, 0.f, -1.f}, {0.f, 0.f}},
+			Vertex{{0.f, 1.f, 0.f}, {0.f, 0.f, -1.f}, {0.f, 1.f}},
+			Vertex{{1.f, 0.f, 0.f}, {0.f, 0.f, -1.f}, {1.f, 0.f}},
+		};
+		hostMesh.indices = {0, 1, 2};
+		DeviceMesh mesh = CreateDeviceMesh(context, hostMesh);
+
+		std::vector<HostConstBuffers::PerInstance> instances(drawCount);
+		for (uint32_t i = 0; i < drawCount; ++i)
+		{
+			instances[i].transform.worldMatrix = XMMatrixTranslation(float(i % 100), float(i / 100), 0.f);
+		}
+		HostConstBuffers::PerMaterial material;
+		material.material = CreateDefaultMaterialConstantBuffer();
+
+		BindShaders(context, program.value());
+		BindConstantBuffers(context, cbuffers.value());
+		BindMesh(context, mesh);
+
+		auto const measure = [&context](auto const &submit) {
+			double bestMs = 0.0;
+			for (uint32_t run = 0; run < runCount; ++run)
+			{
+				auto const start = std::chrono::steady_clock::now();
+				submit();
+				context.pImmediateContext->Flush();
+				double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				bestMs = run == 0 ? ms : std::min(bestMs, ms);
+			}
+			return bestMs;
+		};
+
+		double const updateMs = measure([&]() {
+			for (uint32_t i = 0; i < drawCount; ++i)
+			{
+				if (i % drawsPerMaterial == 0)
+				{
+					material.material.alpha = float(i / drawsPerMaterial % 2);
+					context.pImmediateContext->UpdateSubresource(cbuffers->pPerMaterial, 0, nullptr, &material, 0, 0);
+				}
+				context.pImmediateContext->UpdateSubresource(cbuffers->pPerInstance, 0, nullptr, &instances[i], 0, 0);
+				DrawMesh(context, mesh);
+			}
+		});
+
+		std::vector<ConstantRingSlice> instanceSlices(drawCount);
+		std::vector<ConstantRingSlice> materialSlices(drawCount / drawsPerMaterial + 1);
+		double const ringMs = measure([&]() {
+			BeginConstantRingFrame(ring.value());
+			uint32_t const byteSize = static_cast<uint32_t>(instanceSlices.size() + materialSlices.size()) * g_constantRingAlignment;
+			if (!MapConstantRing(context, ring.value(), byteSize))
+			{
+				return;
+			}
+			for (uint32_t i = 0; i < drawCount; ++i)
+			{
+				if (i % drawsPerMaterial == 0)
+				{
+					material.material.alpha = float(i / drawsPerMaterial % 2);
+					materialSlices[i / drawsPerMaterial] = WriteConstantRing(ring.value(), &material, sizeof(material));
+				}
+				instanceSlices[i] = WriteConstantRing(ring.value(), &instances[i], sizeof(instances[i]));
+			}
+			UnmapConstantRing(context, ring.value());
+
+			for (uint32_t i = 0; i < drawCount; ++i)
+			{
+				if (i % drawsPerMaterial == 0)
+				{
+					BindConstantRingSlice(context, ring.value(), g_perMaterialConstantBufferSlot, materialSlices[i / drawsPerMaterial]);
+				}
+				BindConstantRingSlice(context, ring.value(), g_perInstanceConstantBufferSlot, instanceSlices[i]);
+				DrawMesh(context, mesh);
+			}
+		});
+
+		printf("%u draws, UpdateSubresource: %7.3f ms (%.3f us per draw)\n", drawCount, updateMs, 1000.0 * updateMs / drawCount);
+		printf("%u draws, constant ring:     %7.3f ms (%.3f us per draw), %.2fx\n",
+			   drawCount, ringMs, 1000.0 * ringMs / drawCount, updateMs / std::max(ringMs, 1e-6));
+
+		UnbindConstantBuffer(context);
+		UnbindShaders(context);
+		CleanupDeviceMesh(mesh);
+		CleanupShaderProgram(program.value());
+		CleanupConstantRing(ring.value());
+		CleanupDeviceConstantBuffers(cbuffers.value());
+		CleanupContext(context);
+
+		return true;
+	}
+
+} // namespace h2r
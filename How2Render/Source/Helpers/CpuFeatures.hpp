@@ -0,0 +1,55 @@
+#pragma once
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+#define H2R_CPU_FEATURES_X64 1
+#include <intrin.h>
+#else
+#define H2R_CPU_FEATURES_X64 0
+#endif
+
+namespace h2r
+{
+
+	// Instruction sets the CPU and the OS both support, SSE2 is implied on x64
+	struct CpuFeatures
+	{
+		bool hasAvx = false;
+		bool hasAvx2 = false;
+	};
+
+	// Queried once, the kernels of every module pick their fastest variant from it
+	inline CpuFeatures const &GetCpuFeatures();
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline CpuFeatures const &GetCpuFeatures()
+	{
+		static CpuFeatures const features = []() {
+			CpuFeatures result;
+#if H2R_CPU_FEATURES_X64
+			int info[4] = {};
+			__cpuid(info, 0);
+			int const maxLeaf = info[0];
+
+			__cpuid(info, 1);
+			bool const hasOsxsave = (info[2] & (1 << 27)) != 0;
+			bool const hasAvx = (info[2] & (1 << 28)) != 0;
+			// The OS has to save the ymm registers on context switches as well
+			result.hasAvx = hasOsxsave && hasAvx && (_xgetbv(0) & 0x6) == 0x6;
+
+			if (result.hasAvx && maxLeaf >= 7)
+			{
+				__cpuidex(info, 7, 0);
+				result.hasAvx2 = (info[1] & (1 << 5)) != 0;
+			}
+#endif
+			return result;
+		}();
+
+		return features;
+	}
+
+} // namespace h2r
@@ -0,0 +1,228 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Zones cost two clock reads and a store into a thread local ring, cheap enough to stay on in release.
+// Define H2R_CPU_PROFILER to 0 to compile them out.
+#ifndef H2R_CPU_PROFILER
+#define H2R_CPU_PROFILER 1
+#endif
+
+#define H2R_CPU_ZONE_CONCAT_IMPL(a, b) a##b
+#define H2R_CPU_ZONE_CONCAT(a, b) H2R_CPU_ZONE_CONCAT_IMPL(a, b)
+#if H2R_CPU_PROFILER
+// The name has to outlive the profiler, string literals or names of passes do
+#define H2R_CPU_ZONE(name) ::h2r::CpuZone H2R_CPU_ZONE_CONCAT(cpuZone, __LINE__)(name)
+#else
+#define H2R_CPU_ZONE(name)
+#endif
+
+namespace h2r
+{
+
+	// Zones kept per thread, the oldest get overwritten once a thread records more
+	constexpr uint32_t g_cpuZoneRingCapacity = 1 << 14;
+
+	struct CpuZoneEvent
+	{
+		char const *name = nullptr;
+		uint64_t beginNs = 0;
+		uint64_t endNs = 0;
+	};
+
+	// Written by its thread only, read by whoever dumps the trace
+	struct CpuZoneRing
+	{
+		uint32_t threadIndex = 0;
+		std::atomic<uint64_t> writeCount = 0;
+		CpuZoneEvent events[g_cpuZoneRingCapacity] = {};
+	};
+
+	struct CpuProfiler
+	{
+		std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		// Only taken when a thread records its first zone or exits, and when the trace is written
+		std::mutex mutex;
+		std::vector<std::unique_ptr<CpuZoneRing>> rings;
+		// Rings of exited threads, reused by new ones so short lived workers do not grow the profiler
+		std::vector<CpuZoneRing *> freeRings;
+	};
+
+	struct CpuZone
+	{
+		explicit CpuZone(char const *name);
+		~CpuZone();
+
+		CpuZone(CpuZone const &) = delete;
+		CpuZone &operator=(CpuZone const &) = delete;
+
+		char const *name = nullptr;
+		uint64_t beginNs = 0;
+	};
+
+	inline CpuProfiler &GetCpuProfiler();
+
+	inline uint64_t GetCpuProfilerTimeNs();
+
+	inline void RecordCpuZone(char const *name, uint64_t beginNs, uint64_t endNs);
+
+	// Chrome trace event JSON, opens in chrome://tracing and ui.perfetto.dev
+	inline bool WriteCpuTrace(std::filesystem::path const &path);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline CpuProfiler &GetCpuProfiler()
+	{
+		static CpuProfiler s_profiler;
+		return s_profiler;
+	}
+
+	inline uint64_t GetCpuProfilerTimeNs()
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+										 std::chrono::steady_clock::now() - GetCpuProfiler().epoch)
+										 .count());
+	}
+
+	inline CpuZoneRing *AcquireCpuZoneRing()
+	{
+		CpuProfiler &profiler = GetCpuProfiler();
+		std::lock_guard lock(profiler.mutex);
+
+		if (!profiler.freeRings.empty())
+		{
+			CpuZoneRing *ring = profiler.freeRings.back();
+			profiler.freeRings.pop_back();
+			return ring;
+		}
+
+		profiler.rings.push_back(std::make_unique<CpuZoneRing>());
+		profiler.rings.back()->threadIndex = static_cast<uint32_t>(profiler.rings.size() - 1);
+		return profiler.rings.back().get();
+	}
+
+	inline void ReleaseCpuZoneRing(CpuZoneRing *ring)
+	{
+		CpuProfiler &profiler = GetCpuProfiler();
+		std::lock_guard lock(profiler.mutex);
+		profiler.freeRings.push_back(ring);
+	}
+
+	struct CpuZoneRingOwner
+	{
+		~CpuZoneRingOwner()
+		{
+			if (pRing != nullptr)
+			{
+				ReleaseCpuZoneRing(pRing);
+			}
+		}
+
+		CpuZoneRing *pRing = nullptr;
+	};
+
+	inline thread_local CpuZoneRingOwner t_cpuZoneRingOwner;
+
+	inline void RecordCpuZone(char const *name, uint64_t beginNs, uint64_t endNs)
+	{
+		CpuZoneRing *ring = t_cpuZoneRingOwner.pRing;
+		if (ring == nullptr)
+		{
+			ring = AcquireCpuZoneRing();
+			t_cpuZoneRingOwner.pRing = ring;
+		}
+
+		uint64_t const index = ring->writeCount.load(std::memory_order_relaxed);
+		ring->events[index % g_cpuZoneRingCapacity] = CpuZoneEvent{name, beginNs, endNs};
+		ring->writeCount.store(index + 1, std::memory_order_release);
+	}
+
+	inline CpuZone::CpuZone(char const *name)
+		: name(name), beginNs(GetCpuProfilerTimeNs())
+	{
+	}
+
+	inline CpuZone::~CpuZone()
+	{
+		RecordCpuZone(name, beginNs, GetCpuProfilerTimeNs());
+	}
+
+	// Copies what the ring holds. Its thread keeps recording meanwhile, so events it may have overwritten
+	// during the copy are dropped by checking the write count again afterwards.
+	inline void CopyCpuZoneRing(CpuZoneRing const &ring, std::vector<CpuZoneEvent> &events)
+	{
+		uint64_t const end = ring.writeCount.load(std::memory_order_acquire);
+		uint64_t const begin = end > g_cpuZoneRingCapacity ? end - g_cpuZoneRingCapacity : 0;
+
+		size_t const offset = events.size();
+		for (uint64_t i = begin; i < end; ++i)
+		{
+			events.push_back(ring.events[i % g_cpuZoneRingCapacity]);
+		}
+
+		uint64_t const after = ring.writeCount.load(std::memory_order_acquire);
+		uint64_t const validBegin = after > g_cpuZoneRingCapacity ? std::max(begin, after - g_cpuZoneRingCapacity) : begin;
+		uint64_t const overwrittenCount = std::min(validBegin - begin, end - begin);
+		events.erase(events.begin() + offset, events.begin() + offset + overwrittenCount);
+	}
+
+	inline bool WriteCpuTrace(std::filesystem::path const &path)
+	{
+		CpuProfiler &profiler = GetCpuProfiler();
+
+		std::ofstream stream(path, std::ios::trunc);
+		if (!stream)
+		{
+			wprintf(L"Failed to open %s for the CPU trace\n", path.c_str());
+			return false;
+		}
+		stream << std::fixed << std::setprecision(3);
+
+		std::lock_guard lock(profiler.mutex);
+
+		stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+		size_t eventCount = 0;
+		std::vector<CpuZoneEvent> events;
+		for (auto const &ring : profiler.rings)
+		{
+			uint32_t const tid = ring->threadIndex;
+			stream << (tid == 0 ? "\n" : ",\n")
+				   << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << tid
+				   << ",\"args\":{\"name\":\"Thread " << tid << "\"}}";
+
+			events.clear();
+			CopyCpuZoneRing(*ring, events);
+			for (CpuZoneEvent const &event : events)
+			{
+				stream << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+					   << ",\"ts\":" << event.beginNs / 1000.0
+					   << ",\"dur\":" << (event.endNs - event.beginNs) / 1000.0 << "}";
+			}
+			eventCount += events.size();
+		}
+		stream << "\n]}\n";
+
+		if (!stream)
+		{
+			wprintf(L"Failed to write the CPU trace to %s\n", path.c_str());
+			return false;
+		}
+		wprintf(L"Wrote %zu CPU zones of %zu threads to %s\n", eventCount, profiler.rings.size(), path.c_str());
+
+		return true;
+	}
+
+} // namespace h2r
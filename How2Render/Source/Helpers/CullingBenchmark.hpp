@@ -0,0 +1,100 @@
+#pragma once
+
+#include "Helpers/BoundingVolumeHierarchy.hpp"
+#include "Helpers/FrustumCulling.hpp"
+#include "Random.hpp"
+#include <chrono>
+#include <cstdio>
+
+namespace h2r
+{
+
+	// Scatters count small boxes over a square world, about as dense as instanced props in a large level
+	inline CullingBounds CreateBenchmarkCullingBounds(uint32_t count, float worldSize)
+	{
+		CullingBounds bounds;
+		splitmix random(11);
+		auto const uniform = [&random](float minimum, float maximum) {
+			return std::uniform_real_distribution<float>(minimum, maximum)(random);
+		};
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			XMFLOAT3 const center = {uniform(-worldSize, worldSize), uniform(0.f, 10.f), uniform(-worldSize, worldSize)};
+			XMFLOAT3 const extents = {uniform(0.25f, 2.f), uniform(0.25f, 2.f), uniform(0.25f, 2.f)};
+			float const radius = std::sqrt(extents.x * extents.x + extents.y * extents.y + extents.z * extents.z);
+			AddCullingBounds(bounds, center, extents, radius);
+		}
+
+		return bounds;
+	}
+
+	// Culls 1k, 10k and 100k instances against a perspective camera with the SIMD linear scan and the bvh.
+	// Also reports build time and the time to refit after 1% of the instances moved, and checks that the
+	// bvh query returns the same visible set as the linear scan.
+	inline bool BenchmarkBvhCulling()
+	{
+		constexpr uint32_t runCount = 20;
+
+		XMMATRIX const view = XMMatrixLookAtLH({0.f, 20.f, 0.f, 1.f}, {60.f, 0.f, 60.f, 1.f}, {0.f, 1.f, 0.f, 0.f});
+		XMMATRIX const proj = XMMatrixPerspectiveFovLH(XMConvertToRadians(70.f), 16.f / 9.f, 0.1f, 300.f);
+		Frustum const frustum = CreateFrustum(view * proj);
+
+		auto const measure = [](auto const &function) {
+			double bestMs = 0.0;
+			for (uint32_t run = 0; run < runCount; ++run)
+			{
+				auto const start = std::chrono::steady_clock::now();
+				function();
+				double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				bestMs = run == 0 ? ms : std::min(bestMs, ms);
+			}
+			return bestMs;
+		};
+
+		bool isMatching = true;
+		for (uint32_t count : {1000u, 10000u, 100000u})
+		{
+			// Keeps the density constant, so larger counts mean a larger world rather than more clutter
+			float const worldSize = 50.f * std::sqrt(count / 1000.f);
+			CullingBounds bounds = CreateBenchmarkCullingBounds(count, worldSize);
+
+			std::vector<uint32_t> linearVisible;
+			std::vector<uint32_t> bvhVisible;
+			Bvh bvh;
+
+			double const buildMs = measure([&]() {
+				bvh = CreateBvh(bounds);
+			});
+			double const linearMs = measure([&]() {
+				CullBounds(frustum, bounds, linearVisible);
+			});
+			double const bvhMs = measure([&]() {
+				QueryBvh(bvh, bounds, frustum, bvhVisible);
+			});
+
+			uint32_t const movedCount = std::max(1u, count / 100);
+			double const refitMs = measure([&]() {
+				for (uint32_t i = 0; i < movedCount; ++i)
+				{
+					uint32_t const index = (i * 7919u) % count;
+					bounds.centerY[index] += 0.01f;
+					RefitBvh(bvh, bounds, index);
+				}
+			});
+
+			CullBounds(frustum, bounds, linearVisible);
+			QueryBvh(bvh, bounds, frustum, bvhVisible);
+			std::sort(bvhVisible.begin(), bvhVisible.end());
+			bool const isSame = linearVisible == bvhVisible;
+			isMatching = isMatching && isSame;
+
+			printf("%6u instances, %5zu visible: linear %7.3f ms, bvh %7.3f ms (%.1fx), build %7.3f ms, refit %u %7.3f ms%s\n",
+				   count, linearVisible.size(), linearMs, bvhMs, linearMs / std::max(bvhMs, 1e-6), buildMs,
+				   movedCount, refitMs, isSame ? "" : ", visible sets differ");
+		}
+
+		return isMatching;
+	}
+
+} // namespace h2r
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "Helpers/FrustumCulling.hpp"
+#include "Math.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+namespace h2r
+{
+
+	// Shifts per entry the insertion sort may spend before the radix sort takes over
+	constexpr uint32_t g_depthSortInsertionShiftBudget = 4;
+
+	enum class eDepthSortPath : uint8_t
+	{
+		Insertion,
+		Radix,
+	};
+
+	// Back to front order of the entries of a CullingBounds, kept from frame to frame. A moving camera
+	// barely changes the order, so an insertion sort over the previous order usually finishes in linear time.
+	struct DepthSort
+	{
+		// Entry indices, farthest first
+		std::vector<uint32_t> order;
+		std::vector<uint32_t> keys;
+		// Key in the upper half and entry index in the lower, so sorting moves 8 bytes per entry
+		std::vector<uint64_t> packed;
+		std::vector<uint64_t> scratch;
+		eDepthSortPath path = eDepthSortPath::Radix;
+	};
+
+	// Ascending keys are back to front, depths behind the camera clamp to it
+	inline uint32_t MakeBackToFrontDepthKey(float viewDepth);
+
+	// Stable, ties keep the order of the previous frame so equally deep meshes do not swap back and forth
+	inline void SortByViewDepth(DepthSort &sort, XMMATRIX const &view, CullingBounds const &bounds);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline uint32_t MakeBackToFrontDepthKey(float viewDepth)
+	{
+		// Bits of non negative floats order like the floats themselves
+		float const depth = std::max(viewDepth, 0.f);
+		uint32_t bits;
+		std::memcpy(&bits, &depth, sizeof(bits));
+
+		return ~bits;
+	}
+
+	inline void CalculateDepthSortKeys(XMMATRIX const &view, CullingBounds const &bounds, std::vector<uint32_t> &keys)
+	{
+		XMFLOAT4X4 matrix;
+		XMStoreFloat4x4(&matrix, view);
+
+		size_t const count = bounds.centerX.size();
+		keys.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			float const depth =
+				bounds.centerX[i] * matrix._13 + bounds.centerY[i] * matrix._23 + bounds.centerZ[i] * matrix._33 + matrix._43;
+			keys[i] = MakeBackToFrontDepthKey(depth);
+		}
+	}
+
+	// Returns false once the budget ran out, the entries are then partially sorted
+	inline bool InsertionSortDepthKeys(std::vector<uint64_t> &packed, uint64_t shiftBudget)
+	{
+		uint64_t shiftCount = 0;
+		for (size_t i = 1; i < packed.size(); ++i)
+		{
+			uint64_t const entry = packed[i];
+			uint32_t const key = static_cast<uint32_t>(entry >> 32);
+
+			size_t j = i;
+			while (j > 0 && static_cast<uint32_t>(packed[j - 1] >> 32) > key)
+			{
+				packed[j] = packed[j - 1];
+				--j;
+				if (++shiftCount > shiftBudget)
+				{
+					packed[j] = entry;
+					return false;
+				}
+			}
+			packed[j] = entry;
+		}
+
+		return true;
+	}
+
+	// Stable LSD radix sort on the key bytes, bytes every entry shares are skipped
+	inline void RadixSortDepthKeys(std::vector<uint64_t> &packed, std::vector<uint64_t> &scratch)
+	{
+		scratch.resize(packed.size());
+
+		for (uint32_t shift = 32; shift < 64; shift += 8)
+		{
+			std::array<uint32_t, 256> offsets = {};
+			for (uint64_t entry : packed)
+			{
+				++offsets[(entry >> shift) & 0xFF];
+			}
+			if (packed.empty() || offsets[(packed.front() >> shift) & 0xFF] == packed.size())
+			{
+				continue;
+			}
+
+			uint32_t sum = 0;
+			for (auto &offset : offsets)
+			{
+				uint32_t const count = offset;
+				offset = sum;
+				sum += count;
+			}
+			for (uint64_t entry : packed)
+			{
+				scratch[offsets[(entry >> shift) & 0xFF]++] = entry;
+			}
+			packed.swap(scratch);
+		}
+	}
+
+	inline void SortByViewDepth(DepthSort &sort, XMMATRIX const &view, CullingBounds const &bounds)
+	{
+		CalculateDepthSortKeys(view, bounds, sort.keys);
+
+		size_t const count = sort.keys.size();
+		bool const isCoherent = sort.order.size() == count;
+		if (!isCoherent)
+		{
+			sort.order.resize(count);
+			std::iota(sort.order.begin(), sort.order.end(), 0u);
+		}
+
+		sort.packed.resize(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint32_t const entry = sort.order[i];
+			sort.packed[i] = uint64_t(sort.keys[entry]) << 32 | entry;
+		}
+
+		sort.path = eDepthSortPath::Insertion;
+		if (!isCoherent || !InsertionSortDepthKeys(sort.packed, uint64_t(count) * g_depthSortInsertionShiftBudget))
+		{
+			sort.path = eDepthSortPath::Radix;
+			RadixSortDepthKeys(sort.packed, sort.scratch);
+		}
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			sort.order[i] = static_cast<uint32_t>(sort.packed[i]);
+		}
+	}
+
+} // namespace h2r
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "Helpers/CullingBenchmark.hpp"
+#include "Helpers/DepthSort.hpp"
+#include "RenderObject.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace h2r
+{
+
+	// Order has to hold every entry once, with the view depth of the entries never increasing along it
+	inline bool IsBackToFrontOrder(DepthSort const &sort, XMMATRIX const &view, CullingBounds const &bounds)
+	{
+		size_t const count = bounds.centerX.size();
+		if (sort.order.size() != count)
+		{
+			return false;
+		}
+
+		std::vector<bool> isSeen(count, false);
+		float previousDepth = FLT_MAX;
+		for (uint32_t entry : sort.order)
+		{
+			if (entry >= count || isSeen[entry])
+			{
+				return false;
+			}
+			isSeen[entry] = true;
+
+			float const depth = std::max(XMVectorGetZ(XMVector3Transform(
+				XMVectorSet(bounds.centerX[entry], bounds.centerY[entry], bounds.centerZ[entry], 1.f), view)), 0.f);
+			if (depth > previousDepth + 1e-4f * std::max(1.f, depth))
+			{
+				return false;
+			}
+			previousDepth = depth;
+		}
+
+		return true;
+	}
+
+	// Headless check of the translucent depth sort on 10k instances. Walks a camera through them the way
+	// a player would, sorting every frame as the renderer does, next to sorting whole render objects with
+	// a distance comparator. Verifies every order and reports the time per frame and the paths taken,
+	// then the cold sort after a camera cut.
+	inline bool BenchmarkDepthSort()
+	{
+		constexpr uint32_t instanceCount = 10000;
+		constexpr uint32_t frameCount = 200;
+		constexpr uint32_t runCount = 20;
+
+		CullingBounds const bounds = CreateBenchmarkCullingBounds(instanceCount, 50.f);
+		std::vector<RenderObject> objects(instanceCount);
+		for (uint32_t i = 0; i < instanceCount; ++i)
+		{
+			objects[i].transform = CreateTransform({bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]}, {0.f, 0.f, 0.f}, 1.f);
+		}
+
+		// Sorted whole objects back to front by squared distance every frame
+		auto const sortObjects = [](XMVECTOR position, std::vector<RenderObject> &objects) {
+			std::sort(objects.begin(), objects.end(), [&position](auto const &a, auto const &b) {
+				float const aLengthSq = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(a.transform.position, position)));
+				float const bLengthSq = XMVectorGetX(XMVector3LengthSq(XMVectorSubtract(b.transform.position, position)));
+				return aLengthSq > bLengthSq;
+			});
+		};
+		auto const elapsedMs = [](auto const start) {
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		};
+
+		bool isCorrect = true;
+
+		// Walks forward a few centimetres per frame, once looking around slowly and once turning quickly.
+		// The quick turn reorders too much for the insertion sort and should take the radix path.
+		DepthSort sort;
+		for (float turnDegrees : {0.05f, 0.5f})
+		{
+			XMVECTOR position = XMVectorSet(-45.f, 2.f, -45.f, 1.f);
+			float yaw = XMConvertToRadians(45.f);
+			std::vector<RenderObject> walkedObjects = objects;
+			sort = {};
+			double sortMs = 0.0;
+			double objectSortMs = 0.0;
+			uint32_t insertionCount = 0;
+			for (uint32_t frame = 0; frame < frameCount; ++frame)
+			{
+				position = XMVectorAdd(position, XMVectorSet(0.05f * std::sin(yaw), 0.f, 0.05f * std::cos(yaw), 0.f));
+				yaw += XMConvertToRadians(turnDegrees);
+				XMMATRIX const view = math::CreateViewMatrix(position, yaw, 0.f);
+
+				auto const start = std::chrono::steady_clock::now();
+				SortByViewDepth(sort, view, bounds);
+				sortMs += elapsedMs(start);
+				insertionCount += sort.path == eDepthSortPath::Insertion ? 1 : 0;
+
+				auto const objectStart = std::chrono::steady_clock::now();
+				sortObjects(position, walkedObjects);
+				objectSortMs += elapsedMs(objectStart);
+
+				if (!IsBackToFrontOrder(sort, view, bounds))
+				{
+					printf("Frame %u turning %.2f degrees is not sorted back to front\n", frame, turnDegrees);
+					isCorrect = false;
+				}
+			}
+			printf("%u instances, %u frames turning %.2f degrees per frame: depth sort %.3f ms, object sort %.3f ms per frame, "
+				   "%u frames on the insertion path\n",
+				   instanceCount, frameCount, turnDegrees, sortMs / frameCount, objectSortMs / frameCount, insertionCount);
+		}
+
+		// A camera cut, last frame's order is of no use and the insertion sort has to hand over
+		XMMATRIX const cutView = math::CreateViewMatrix(XMVectorSet(40.f, 5.f, 40.f, 1.f), XMConvertToRadians(225.f), 0.f);
+		SortByViewDepth(sort, cutView, bounds);
+		bool const isCutCorrect = IsBackToFrontOrder(sort, cutView, bounds);
+		printf("Camera cut: %s path%s\n", sort.path == eDepthSortPath::Radix ? "radix" : "insertion",
+			   isCutCorrect ? "" : ", not sorted back to front");
+		isCorrect &= isCutCorrect;
+
+		double coldMs = 0.0;
+		double coldObjectMs = 0.0;
+		for (uint32_t run = 0; run < runCount; ++run)
+		{
+			DepthSort coldSort;
+			auto const start = std::chrono::steady_clock::now();
+			SortByViewDepth(coldSort, cutView, bounds);
+			double const ms = elapsedMs(start);
+			coldMs = run == 0 ? ms : std::min(coldMs, ms);
+
+			std::vector<RenderObject> coldObjects = objects;
+			auto const objectStart = std::chrono::steady_clock::now();
+			sortObjects(XMVectorSet(40.f, 5.f, 40.f, 1.f), coldObjects);
+			double const objectMs = elapsedMs(objectStart);
+			coldObjectMs = run == 0 ? objectMs : std::min(coldObjectMs, objectMs);
+		}
+		printf("Cold sort: depth sort %.3f ms, object sort %.3f ms\n", coldMs, coldObjectMs);
+
+		return isCorrect;
+	}
+
+} // namespace h2r
@@ -0,0 +1,291 @@
+#pragma once
+
+#include "Helpers/CpuFeatures.hpp"
+#include "Math.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+#define H2R_CULLING_SIMD 1
+#include <immintrin.h>
+#else
+#define H2R_CULLING_SIMD 0
+#endif
+
+namespace h2r
+{
+
+	// Normalized planes facing into the frustum: left, right, bottom, top, near, far
+	struct Frustum
+	{
+		std::array<XMFLOAT4, 6> planes;
+	};
+
+	// World space bounds in SoA layout, one box and one sphere sharing the box center per entry
+	struct CullingBounds
+	{
+		std::vector<float> centerX;
+		std::vector<float> centerY;
+		std::vector<float> centerZ;
+		std::vector<float> extentX;
+		std::vector<float> extentY;
+		std::vector<float> extentZ;
+		std::vector<float> radius;
+	};
+
+	enum class eCullingKernel : uint8_t
+	{
+		Scalar,
+		Sse,
+		Avx,
+	};
+
+	inline Frustum CreateFrustum(XMMATRIX const &viewProj);
+
+	inline void ClearCullingBounds(CullingBounds &bounds);
+
+	inline void AddCullingBounds(CullingBounds &bounds, XMFLOAT3 const &center, XMFLOAT3 const &extents, float radius);
+
+	inline void SetCullingBounds(
+		CullingBounds &bounds, uint32_t index, XMFLOAT3 const &center, XMFLOAT3 const &extents, float radius);
+
+	inline eCullingKernel GetBestCullingKernel();
+
+	// Replaces visible with the indices of all bounds that intersect the frustum, in ascending order
+	inline void CullBounds(
+		Frustum const &frustum, CullingBounds const &bounds, eCullingKernel kernel, std::vector<uint32_t> &visible);
+
+	inline void CullBounds(Frustum const &frustum, CullingBounds const &bounds, std::vector<uint32_t> &visible);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	// Planes are taken from the columns of the row vector viewProj, with the D3D clip depth range [0, w]
+	inline Frustum CreateFrustum(XMMATRIX const &viewProj)
+	{
+		XMMATRIX const columns = XMMatrixTranspose(viewProj);
+		std::array<XMVECTOR, 6> const planes = {
+			XMVectorAdd(columns.r[3], columns.r[0]),
+			XMVectorSubtract(columns.r[3], columns.r[0]),
+			XMVectorAdd(columns.r[3], columns.r[1]),
+			XMVectorSubtract(columns.r[3], columns.r[1]),
+			columns.r[2],
+			XMVectorSubtract(columns.r[3], columns.r[2]),
+		};
+
+		Frustum frustum;
+		for (size_t i = 0; i < planes.size(); ++i)
+		{
+			XMStoreFloat4(&frustum.planes[i], XMPlaneNormalize(planes[i]));
+		}
+
+		return frustum;
+	}
+
+	inline void ClearCullingBounds(CullingBounds &bounds)
+	{
+		bounds.centerX.clear();
+		bounds.centerY.clear();
+		bounds.centerZ.clear();
+		bounds.extentX.clear();
+		bounds.extentY.clear();
+		bounds.extentZ.clear();
+		bounds.radius.clear();
+	}
+
+	inline void AddCullingBounds(CullingBounds &bounds, XMFLOAT3 const &center, XMFLOAT3 const &extents, float radius)
+	{
+		bounds.centerX.push_back(center.x);
+		bounds.centerY.push_back(center.y);
+		bounds.centerZ.push_back(center.z);
+		bounds.extentX.push_back(extents.x);
+		bounds.extentY.push_back(extents.y);
+		bounds.extentZ.push_back(extents.z);
+		bounds.radius.push_back(radius);
+	}
+
+	inline void SetCullingBounds(
+		CullingBounds &bounds, uint32_t index, XMFLOAT3 const &center, XMFLOAT3 const &extents, float radius)
+	{
+		bounds.centerX[index] = center.x;
+		bounds.centerY[index] = center.y;
+		bounds.centerZ[index] = center.z;
+		bounds.extentX[index] = extents.x;
+		bounds.extentY[index] = extents.y;
+		bounds.extentZ[index] = extents.z;
+		bounds.radius[index] = radius;
+	}
+
+	inline eCullingKernel GetBestCullingKernel()
+	{
+#if H2R_CULLING_SIMD
+		return GetCpuFeatures().hasAvx ? eCullingKernel::Avx : eCullingKernel::Sse;
+#else
+		return eCullingKernel::Scalar;
+#endif
+	}
+
+	// An entry is outside once it lies behind any plane. Box and sphere both enclose the mesh,
+	// so whichever reaches less far towards the plane decides.
+	inline bool IsBoundsInFrustum(Frustum const &frustum, CullingBounds const &bounds, size_t index)
+	{
+		for (auto const &plane : frustum.planes)
+		{
+			float const distance =
+				plane.x * bounds.centerX[index] + plane.y * bounds.centerY[index] + plane.z * bounds.centerZ[index] + plane.w;
+			float const boxRadius =
+				std::abs(plane.x) * bounds.extentX[index] +
+				std::abs(plane.y) * bounds.extentY[index] +
+				std::abs(plane.z) * bounds.extentZ[index];
+			if (distance + std::min(boxRadius, bounds.radius[index]) < 0.f)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	inline void CullBoundsScalar(Frustum const &frustum, CullingBounds const &bounds, size_t first, std::vector<uint32_t> &visible)
+	{
+		for (size_t i = first; i < bounds.radius.size(); ++i)
+		{
+			if (IsBoundsInFrustum(frustum, bounds, i))
+			{
+				visible.push_back(static_cast<uint32_t>(i));
+			}
+		}
+	}
+
+#if H2R_CULLING_SIMD
+	inline void AppendVisibleIndices(uint32_t mask, size_t first, std::vector<uint32_t> &visible)
+	{
+		for (; mask != 0; mask &= mask - 1)
+		{
+			unsigned long bit = 0;
+#if defined(_MSC_VER)
+			_BitScanForward(&bit, mask);
+#else
+			bit = static_cast<unsigned long>(__builtin_ctz(mask));
+#endif
+			visible.push_back(static_cast<uint32_t>(first + bit));
+		}
+	}
+
+	// Tests four entries per iteration, the remainder goes through the scalar test
+	inline size_t CullBoundsSse(Frustum const &frustum, CullingBounds const &bounds, std::vector<uint32_t> &visible)
+	{
+		__m128 const signMask = _mm_set1_ps(-0.f);
+		__m128 const zero = _mm_setzero_ps();
+
+		size_t const count = bounds.radius.size() & ~size_t(3);
+		for (size_t i = 0; i < count; i += 4)
+		{
+			__m128 const centerX = _mm_loadu_ps(bounds.centerX.data() + i);
+			__m128 const centerY = _mm_loadu_ps(bounds.centerY.data() + i);
+			__m128 const centerZ = _mm_loadu_ps(bounds.centerZ.data() + i);
+			__m128 const extentX = _mm_loadu_ps(bounds.extentX.data() + i);
+			__m128 const extentY = _mm_loadu_ps(bounds.extentY.data() + i);
+			__m128 const extentZ = _mm_loadu_ps(bounds.extentZ.data() + i);
+			__m128 const radius = _mm_loadu_ps(bounds.radius.data() + i);
+
+			__m128 inside = _mm_cmpeq_ps(zero, zero);
+			for (auto const &plane : frustum.planes)
+			{
+				__m128 const planeX = _mm_set1_ps(plane.x);
+				__m128 const planeY = _mm_set1_ps(plane.y);
+				__m128 const planeZ = _mm_set1_ps(plane.z);
+
+				__m128 distance = _mm_add_ps(_mm_mul_ps(planeX, centerX), _mm_set1_ps(plane.w));
+				distance = _mm_add_ps(distance, _mm_mul_ps(planeY, centerY));
+				distance = _mm_add_ps(distance, _mm_mul_ps(planeZ, centerZ));
+
+				__m128 boxRadius = _mm_mul_ps(_mm_andnot_ps(signMask, planeX), extentX);
+				boxRadius = _mm_add_ps(boxRadius, _mm_mul_ps(_mm_andnot_ps(signMask, planeY), extentY));
+				boxRadius = _mm_add_ps(boxRadius, _mm_mul_ps(_mm_andnot_ps(signMask, planeZ), extentZ));
+
+				__m128 const reach = _mm_add_ps(distance, _mm_min_ps(boxRadius, radius));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(reach, zero));
+			}
+
+			AppendVisibleIndices(static_cast<uint32_t>(_mm_movemask_ps(inside)), i, visible);
+		}
+
+		return count;
+	}
+
+	inline size_t CullBoundsAvx(Frustum const &frustum, CullingBounds const &bounds, std::vector<uint32_t> &visible)
+	{
+		__m256 const signMask = _mm256_set1_ps(-0.f);
+		__m256 const zero = _mm256_setzero_ps();
+
+		size_t const count = bounds.radius.size() & ~size_t(7);
+		for (size_t i = 0; i < count; i += 8)
+		{
+			__m256 const centerX = _mm256_loadu_ps(bounds.centerX.data() + i);
+			__m256 const centerY = _mm256_loadu_ps(bounds.centerY.data() + i);
+			__m256 const centerZ = _mm256_loadu_ps(bounds.centerZ.data() + i);
+			__m256 const extentX = _mm256_loadu_ps(bounds.extentX.data() + i);
+			__m256 const extentY = _mm256_loadu_ps(bounds.extentY.data() + i);
+			__m256 const extentZ = _mm256_loadu_ps(bounds.extentZ.data() + i);
+			__m256 const radius = _mm256_loadu_ps(bounds.radius.data() + i);
+
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (auto const &plane : frustum.planes)
+			{
+				__m256 const planeX = _mm256_set1_ps(plane.x);
+				__m256 const planeY = _mm256_set1_ps(plane.y);
+				__m256 const planeZ = _mm256_set1_ps(plane.z);
+
+				__m256 distance = _mm256_add_ps(_mm256_mul_ps(planeX, centerX), _mm256_set1_ps(plane.w));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(planeY, centerY));
+				distance = _mm256_add_ps(distance, _mm256_mul_ps(planeZ, centerZ));
+
+				__m256 boxRadius = _mm256_mul_ps(_mm256_andnot_ps(signMask, planeX), extentX);
+				boxRadius = _mm256_add_ps(boxRadius, _mm256_mul_ps(_mm256_andnot_ps(signMask, planeY), extentY));
+				boxRadius = _mm256_add_ps(boxRadius, _mm256_mul_ps(_mm256_andnot_ps(signMask, planeZ), extentZ));
+
+				__m256 const reach = _mm256_add_ps(distance, _mm256_min_ps(boxRadius, radius));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(reach, zero, _CMP_GE_OQ));
+			}
+
+			AppendVisibleIndices(static_cast<uint32_t>(_mm256_movemask_ps(inside)), i, visible);
+		}
+
+		return count;
+	}
+#endif
+
+	inline void CullBounds(
+		Frustum const &frustum, CullingBounds const &bounds, eCullingKernel kernel, std::vector<uint32_t> &visible)
+	{
+		visible.clear();
+
+		size_t first = 0;
+		switch (kernel)
+		{
+#if H2R_CULLING_SIMD
+		case eCullingKernel::Avx:
+			first = CullBoundsAvx(frustum, bounds, visible);
+			break;
+		case eCullingKernel::Sse:
+			first = CullBoundsSse(frustum, bounds, visible);
+			break;
+#endif
+		default:
+			break;
+		}
+
+		CullBoundsScalar(frustum, bounds, first, visible);
+	}
+
+	inline void CullBounds(Frustum const &frustum, CullingBounds const &bounds, std::vector<uint32_t> &visible)
+	{
+		CullBounds(frustum, bounds, GetBestCullingKernel(), visible);
+	}
+
+} // namespace h2r
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace h2r
+{
+
+	// Heap usage of image decoding on the calling thread, stb_image allocations are tracked
+	// through the hooks below and texture pixel buffers through TrackImageAllocation
+	struct ImageAllocationStats
+	{
+		uint64_t allocationCount = 0;
+		uint64_t liveByteSize = 0;
+		uint64_t peakByteSize = 0;
+	};
+
+	// Lets stb_image decode into memory owned by the caller, the first allocation of exactly
+	// byteSize bytes made while the target is set is served from pixels instead of the heap
+	struct ImageDecodeTarget
+	{
+		uint8_t *pixels = nullptr;
+		size_t byteSize = 0;
+		bool isClaimed = false;
+	};
+
+	inline ImageAllocationStats &GetImageAllocationStats();
+
+	inline ImageDecodeTarget &GetImageDecodeTarget();
+
+	inline void TrackImageAllocation(size_t byteSize);
+
+	inline void TrackImageFree(size_t byteSize);
+
+	inline void *AllocateImageMemory(size_t byteSize);
+
+	inline void *ReallocateImageMemory(void *memory, size_t oldByteSize, size_t newByteSize);
+
+	inline void FreeImageMemory(void *memory);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	// Tracked allocations keep their size in front of the returned memory since stb frees without a size
+	constexpr size_t g_imageAllocationHeaderSize = 16;
+
+	inline ImageAllocationStats &GetImageAllocationStats()
+	{
+		thread_local ImageAllocationStats stats;
+		return stats;
+	}
+
+	inline ImageDecodeTarget &GetImageDecodeTarget()
+	{
+		thread_local ImageDecodeTarget target;
+		return target;
+	}
+
+	inline void TrackImageAllocation(size_t byteSize)
+	{
+		auto &stats = GetImageAllocationStats();
+		++stats.allocationCount;
+		stats.liveByteSize += byteSize;
+		stats.peakByteSize = std::max(stats.peakByteSize, stats.liveByteSize);
+	}
+
+	inline void TrackImageFree(size_t byteSize)
+	{
+		auto &stats = GetImageAllocationStats();
+		stats.liveByteSize -= std::min<uint64_t>(stats.liveByteSize, byteSize);
+	}
+
+	inline void *AllocateImageMemory(size_t byteSize)
+	{
+		auto &target = GetImageDecodeTarget();
+		if (target.pixels != nullptr && !target.isClaimed && target.byteSize == byteSize)
+		{
+			target.isClaimed = true;
+			return target.pixels;
+		}
+
+		auto *memory = static_cast<uint8_t *>(std::malloc(byteSize + g_imageAllocationHeaderSize));
+		if (memory == nullptr)
+		{
+			return nullptr;
+		}
+		std::memcpy(memory, &byteSize, sizeof(byteSize));
+		TrackImageAllocation(byteSize);
+
+		return memory + g_imageAllocationHeaderSize;
+	}
+
+	inline void *ReallocateImageMemory(void *memory, size_t oldByteSize, size_t newByteSize)
+	{
+		if (memory == nullptr)
+		{
+			return AllocateImageMemory(newByteSize);
+		}
+
+		// The target can not grow, its contents move to the heap and the target is free again
+		auto &target = GetImageDecodeTarget();
+		if (memory == target.pixels)
+		{
+			if (newByteSize <= target.byteSize)
+			{
+				return memory;
+			}
+			target.isClaimed = false;
+			void *moved = AllocateImageMemory(newByteSize);
+			if (moved != nullptr)
+			{
+				std::memcpy(moved, memory, std::min(oldByteSize, newByteSize));
+			}
+			return moved;
+		}
+
+		auto *header = static_cast<uint8_t *>(memory) - g_imageAllocationHeaderSize;
+		auto *resized = static_cast<uint8_t *>(std::realloc(header, newByteSize + g_imageAllocationHeaderSize));
+		if (resized == nullptr)
+		{
+			return nullptr;
+		}
+		TrackImageFree(oldByteSize);
+		TrackImageAllocation(newByteSize);
+		std::memcpy(resized, &newByteSize, sizeof(newByteSize));
+
+		return resized + g_imageAllocationHeaderSize;
+	}
+
+	inline void FreeImageMemory(void *memory)
+	{
+		if (memory == nullptr)
+		{
+			return;
+		}
+
+		auto &target = GetImageDecodeTarget();
+		if (memory == target.pixels)
+		{
+			target.isClaimed = false;
+			return;
+		}
+
+		auto *header = static_cast<uint8_t *>(memory) - g_imageAllocationHeaderSize;
+		size_t byteSize = 0;
+		std::memcpy(&byteSize, header, sizeof(byteSize));
+		TrackImageFree(byteSize);
+		std::free(header);
+	}
+
+} // namespace h2r
@@ -60,8 +60,8 @@ namespace h2r
 												   DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
 			if (hostTexture)
 			{
-				desc.hostTexture = hostTexture.value();
-				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture.format;
+				desc.hostTexture = hostTexture.get();
+				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture->format;
 				auto texture = CreateDeviceTexture(context, desc);
 				if (texture)
 				{
@@ -85,8 +85,8 @@ namespace h2r
 												   DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
 			if (hostTexture)
 			{
-				desc.hostTexture = hostTexture.value();
-				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture.format;
+				desc.hostTexture = hostTexture.get();
+				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture->format;
 				auto texture = CreateDeviceTexture(context, desc);
 				if (texture)
 				{
@@ -110,8 +110,8 @@ namespace h2r
 												   DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
 			if (hostTexture)
 			{
-				desc.hostTexture = hostTexture.value();
-				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture.format;
+				desc.hostTexture = hostTexture.get();
+				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture->format;
 				auto texture = CreateDeviceTexture(context, desc);
 				if (texture)
 				{
@@ -130,6 +130,46 @@ namespace h2r
 		return {sphereBlue, sphereRed, sphereGreen};
 	}
 
+	// Opaque sphere that moves every frame, its shadow goes into the cascades and never into the shadow cache
+	inline RenderObject GenerateDynamicSphere(Context const &context, TextureCache &cache)
+	{
+		DeviceMaterial material;
+		material.scalarAmbient = XMFLOAT3(1.f, 1.f, 1.f);
+		material.scalarDiffuse = XMFLOAT3(1.f, 1.f, 1.f);
+		material.scalarSpecular = XMFLOAT3(1.f, 1.f, 1.f);
+		material.scalarShininess = 0.f;
+		material.scalarAlpha = 1.f;
+		material.alphaMask = eAlphaMask::Opaque;
+
+		auto hostTexture = LoadTextureFromFile(cache,
+											   "Data/Textures/sponza_fabric_diff.tga",
+											   TEX_LOAD_FLAG_FLIP_VERTICALLY | TEX_LOAD_FLAG_GEN_CPU_MIPMAP,
+											   DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+		if (hostTexture)
+		{
+			DeviceTexture::Descriptor desc;
+			desc.bindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+			desc.mipmapFlag = DeviceTexture::Descriptor::eMipMapFlag::USE_DX_GENERATED;
+			desc.hostTexture = hostTexture.get();
+			desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture->format;
+			auto texture = CreateDeviceTexture(context, desc);
+			if (texture)
+			{
+				material.albedoTexture = texture.value();
+			}
+		}
+
+		DeviceModel model;
+		model.opaqueMeshes = {CreateDeviceMesh(context, GenerateSphereHostMesh(context, 0.5f, 16))};
+		model.opaqueMeshes[0].materialId = 0;
+		model.materials = {material};
+
+		RenderObject sphere = CreateRenderObject(model, {0, 1.5f, 0}, {0, 0, 0}, 1);
+		sphere.isStatic = false;
+
+		return sphere;
+	}
+
 	inline RenderObject GenerateFullscreenTriangle(Context const &context)
 	{
 		HostMesh triangleHostMesh;
@@ -0,0 +1,377 @@
+#pragma once
+
+#include "Helpers/BinaryFile.hpp"
+#include "Math.hpp"
+#include "Mesh.hpp"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+namespace h2r
+{
+
+	struct MeshWeldStats
+	{
+		uint64_t verticesBefore = 0;
+		uint64_t verticesAfter = 0;
+	};
+
+	struct VertexCacheStats
+	{
+		uint64_t triangleCount = 0;
+		uint64_t vertexCount = 0;
+		uint64_t cacheMissCount = 0;
+	};
+
+	// Size of the simulated FIFO post-transform cache, a conservative estimate for current GPUs
+	constexpr uint32_t g_vertexCacheSize = 16;
+
+	inline MeshWeldStats WeldVertices(HostMesh &mesh);
+
+	inline VertexCacheStats AnalyzeVertexCache(HostMesh const &mesh, uint32_t cacheSize = g_vertexCacheSize);
+
+	inline void OptimizeMesh(HostMesh &mesh);
+
+	inline float GetAcmr(VertexCacheStats const &stats);
+
+	inline float GetAtvr(VertexCacheStats const &stats);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	// Vertices are compared bitwise, so only exact duplicates are merged
+	struct VertexHash
+	{
+		size_t operator()(Vertex const &vertex) const
+		{
+			return static_cast<size_t>(HashBytesFnv1a(&vertex, sizeof(Vertex)));
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(Vertex const &a, Vertex const &b) const
+		{
+			return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+		}
+	};
+
+	inline MeshWeldStats WeldVertices(HostMesh &mesh)
+	{
+		static_assert(sizeof(Vertex) == sizeof(float) * 8, "Vertex must not contain padding to be hashed bitwise");
+
+		MeshWeldStats stats;
+		stats.verticesBefore = mesh.vertices.size();
+
+		uint64_t const indexCount = mesh.indices.empty() ? mesh.vertices.size() : mesh.indices.size();
+
+		std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> uniqueVertices;
+		uniqueVertices.reserve(mesh.vertices.size());
+
+		std::vector<Vertex> vertices;
+		vertices.reserve(mesh.vertices.size());
+		std::vector<uint32_t> indices;
+		indices.reserve(indexCount);
+
+		for (uint64_t i = 0; i < indexCount; ++i)
+		{
+			Vertex const &vertex = mesh.vertices[mesh.indices.empty() ? i : mesh.indices[i]];
+			auto const [it, isInserted] = uniqueVertices.try_emplace(vertex, static_cast<uint32_t>(vertices.size()));
+			if (isInserted)
+			{
+				vertices.push_back(vertex);
+			}
+			indices.push_back(it->second);
+		}
+
+		vertices.shrink_to_fit();
+		mesh.vertices = std::move(vertices);
+		mesh.indices = std::move(indices);
+
+		stats.verticesAfter = mesh.vertices.size();
+
+		return stats;
+	}
+
+	inline float GetAcmr(VertexCacheStats const &stats)
+	{
+		return stats.triangleCount > 0 ? float(stats.cacheMissCount) / float(stats.triangleCount) : 0.f;
+	}
+
+	inline float GetAtvr(VertexCacheStats const &stats)
+	{
+		return stats.vertexCount > 0 ? float(stats.cacheMissCount) / float(stats.vertexCount) : 0.f;
+	}
+
+	inline VertexCacheStats AnalyzeVertexCache(HostMesh const &mesh, uint32_t cacheSize)
+	{
+		VertexCacheStats stats;
+		stats.triangleCount = mesh.indices.size() / 3;
+		stats.vertexCount = mesh.vertices.size();
+
+		// FIFO cache, a vertex stays cached until cacheSize misses happened after its own miss
+		std::vector<uint64_t> missTimestamps(mesh.vertices.size(), 0);
+		for (uint32_t const index : mesh.indices)
+		{
+			if (missTimestamps[index] == 0 || stats.cacheMissCount - missTimestamps[index] >= cacheSize)
+			{
+				stats.cacheMissCount++;
+				missTimestamps[index] = stats.cacheMissCount;
+			}
+		}
+
+		return stats;
+	}
+
+	struct VertexTriangleAdjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+	};
+
+	inline VertexTriangleAdjacency CreateVertexTriangleAdjacency(std::vector<uint32_t> const &indices, size_t vertexCount)
+	{
+		VertexTriangleAdjacency adjacency;
+		adjacency.offsets.assign(vertexCount + 1, 0);
+		adjacency.triangles.resize(indices.size());
+
+		for (uint32_t const index : indices)
+		{
+			adjacency.offsets[index + 1]++;
+		}
+		std::partial_sum(adjacency.offsets.begin(), adjacency.offsets.end(), adjacency.offsets.begin());
+
+		std::vector<uint32_t> cursors(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i)
+		{
+			adjacency.triangles[cursors[indices[i]]++] = static_cast<uint32_t>(i / 3);
+		}
+
+		return adjacency;
+	}
+
+	// Tipsify [Sander et al. 2007]: fans around the most recently cached vertex and falls back to
+	// a dead-end stack when no candidate survives in the cache. Every fallback starts a new cluster,
+	// the cluster start triangles are returned for the overdraw pass.
+	inline std::vector<uint32_t> OptimizeVertexCache(HostMesh &mesh, uint32_t cacheSize = g_vertexCacheSize)
+	{
+		uint32_t const vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+		uint32_t const triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+		int64_t const cacheSizeSigned = cacheSize;
+
+		auto const adjacency = CreateVertexTriangleAdjacency(mesh.indices, vertexCount);
+
+		std::vector<uint32_t> liveTriangles(vertexCount);
+		for (uint32_t v = 0; v < vertexCount; ++v)
+		{
+			liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+		}
+
+		std::vector<int64_t> cacheTimestamps(vertexCount, 0);
+		std::vector<bool> isEmitted(triangleCount, false);
+		std::vector<uint32_t> deadEnds;
+		std::vector<uint32_t> candidates;
+		std::vector<uint32_t> clusters;
+		std::vector<uint32_t> indices;
+		indices.reserve(mesh.indices.size());
+
+		int64_t timestamp = cacheSizeSigned + 1;
+		uint32_t cursor = 0;
+		int64_t fanningVertex = triangleCount > 0 ? 0 : -1;
+		bool isClusterStart = true;
+
+		while (fanningVertex >= 0)
+		{
+			candidates.clear();
+			for (uint32_t i = adjacency.offsets[fanningVertex]; i < adjacency.offsets[fanningVertex + 1]; ++i)
+			{
+				uint32_t const triangle = adjacency.triangles[i];
+				if (isEmitted[triangle])
+				{
+					continue;
+				}
+				if (isClusterStart)
+				{
+					clusters.push_back(static_cast<uint32_t>(indices.size() / 3));
+					isClusterStart = false;
+				}
+
+				for (uint32_t corner = 0; corner < 3; ++corner)
+				{
+					uint32_t const v = mesh.indices[size_t(triangle) * 3 + corner];
+					indices.push_back(v);
+					deadEnds.push_back(v);
+					candidates.push_back(v);
+					liveTriangles[v]--;
+					if (timestamp - cacheTimestamps[v] > cacheSizeSigned)
+					{
+						cacheTimestamps[v] = timestamp++;
+					}
+				}
+				isEmitted[triangle] = true;
+			}
+
+			// Prefer the candidate that stays in the cache the longest while its remaining fan is emitted
+			int64_t bestVertex = -1;
+			int64_t bestPriority = -1;
+			for (uint32_t const v : candidates)
+			{
+				if (liveTriangles[v] == 0)
+				{
+					continue;
+				}
+				int64_t priority = 0;
+				if (timestamp - cacheTimestamps[v] + 2 * int64_t(liveTriangles[v]) <= cacheSizeSigned)
+				{
+					priority = timestamp - cacheTimestamps[v];
+				}
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					bestVertex = v;
+				}
+			}
+
+			if (bestVertex < 0)
+			{
+				isClusterStart = true;
+				while (!deadEnds.empty() && bestVertex < 0)
+				{
+					uint32_t const v = deadEnds.back();
+					deadEnds.pop_back();
+					if (liveTriangles[v] > 0)
+					{
+						bestVertex = v;
+					}
+				}
+				while (cursor < vertexCount && bestVertex < 0)
+				{
+					if (liveTriangles[cursor] > 0)
+					{
+						bestVertex = cursor;
+					}
+					cursor++;
+				}
+			}
+
+			fanningVertex = bestVertex;
+		}
+
+		mesh.indices = std::move(indices);
+
+		return clusters;
+	}
+
+	// Orders the vertex cache clusters by how likely they are to occlude the rest of the mesh: clusters
+	// far from the mesh center facing outwards go first [Sander et al. 2007]. Cache locality inside
+	// clusters is preserved, only the cluster boundaries cost extra misses.
+	inline void OptimizeOverdraw(HostMesh &mesh, std::vector<uint32_t> const &clusters)
+	{
+		uint32_t const triangleCount = static_cast<uint32_t>(mesh.indices.size() / 3);
+		if (clusters.size() < 2)
+		{
+			return;
+		}
+
+		auto const getPosition = [&mesh](uint32_t index) {
+			return XMLoadFloat3(&mesh.vertices[mesh.indices[index]].position);
+		};
+
+		XMVECTOR meshCentroid = XMVectorZero();
+		float meshArea = 0.f;
+		std::vector<XMFLOAT3> clusterCentroids(clusters.size());
+		std::vector<XMFLOAT3> clusterNormals(clusters.size());
+
+		for (size_t c = 0; c < clusters.size(); ++c)
+		{
+			uint32_t const begin = clusters[c];
+			uint32_t const end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+			XMVECTOR centroid = XMVectorZero();
+			XMVECTOR normal = XMVectorZero();
+			float area = 0.f;
+			for (uint32_t t = begin; t < end; ++t)
+			{
+				XMVECTOR const p0 = getPosition(t * 3);
+				XMVECTOR const p1 = getPosition(t * 3 + 1);
+				XMVECTOR const p2 = getPosition(t * 3 + 2);
+
+				// Cross product length is twice the triangle area, so it works as an area-weighted normal
+				XMVECTOR const weightedNormal = XMVector3Cross(p1 - p0, p2 - p0);
+				float const triangleArea = XMVectorGetX(XMVector3Length(weightedNormal));
+
+				centroid += (p0 + p1 + p2) * (triangleArea / 3.f);
+				normal += weightedNormal;
+				area += triangleArea;
+			}
+
+			meshCentroid += centroid;
+			meshArea += area;
+			XMStoreFloat3(&clusterCentroids[c], area > 0.f ? centroid / area : centroid);
+			XMStoreFloat3(&clusterNormals[c], XMVector3Normalize(normal));
+		}
+		meshCentroid = meshArea > 0.f ? meshCentroid / meshArea : meshCentroid;
+
+		std::vector<float> occlusionPotentials(clusters.size());
+		for (size_t c = 0; c < clusters.size(); ++c)
+		{
+			XMVECTOR const toCluster = XMLoadFloat3(&clusterCentroids[c]) - meshCentroid;
+			occlusionPotentials[c] = XMVectorGetX(XMVector3Dot(toCluster, XMLoadFloat3(&clusterNormals[c])));
+		}
+
+		std::vector<uint32_t> order(clusters.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&occlusionPotentials](uint32_t a, uint32_t b) {
+			return occlusionPotentials[a] > occlusionPotentials[b];
+		});
+
+		std::vector<uint32_t> indices;
+		indices.reserve(mesh.indices.size());
+		for (uint32_t const c : order)
+		{
+			uint32_t const begin = clusters[c];
+			uint32_t const end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+			indices.insert(indices.end(), mesh.indices.begin() + size_t(begin) * 3, mesh.indices.begin() + size_t(end) * 3);
+		}
+
+		mesh.indices = std::move(indices);
+	}
+
+	// Lays vertices out in the order the index buffer first references them, unreferenced vertices are dropped
+	inline void OptimizeVertexFetch(HostMesh &mesh)
+	{
+		constexpr uint32_t InvalidIndex = UINT32_MAX;
+		std::vector<uint32_t> remap(mesh.vertices.size(), InvalidIndex);
+
+		std::vector<Vertex> vertices;
+		vertices.reserve(mesh.vertices.size());
+		for (uint32_t &index : mesh.indices)
+		{
+			if (remap[index] == InvalidIndex)
+			{
+				remap[index] = static_cast<uint32_t>(vertices.size());
+				vertices.push_back(mesh.vertices[index]);
+			}
+			index = remap[index];
+		}
+
+		mesh.vertices = std::move(vertices);
+	}
+
+	inline void OptimizeMesh(HostMesh &mesh)
+	{
+		if (mesh.indices.empty())
+		{
+			return;
+		}
+
+		auto const clusters = OptimizeVertexCache(mesh);
+		OptimizeOverdraw(mesh, clusters);
+		OptimizeVertexFetch(mesh);
+	}
+
+} // namespace h2r
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "Helpers/MipmapGenerator.hpp"
+#include "Random.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+
+namespace h2r
+{
+
+	// The original per-texel downsampler, kept as the baseline for BenchmarkMipmapGeneration.
+	// Only valid for 4 byte pixels with even dimensions.
+	inline void BoxDownsampleReference(
+		std::vector<uint8_t> &pixels,
+		HostTexture::MipLevel const &nextMip,
+		HostTexture::MipLevel const &currMip)
+	{
+		auto const getTexel = [&pixels](HostTexture::MipLevel const &mipLevel, uint32_t col, uint32_t row) {
+			const uint32_t index = row * mipLevel.width + col;
+			const size_t offset = index * sizeof(RGBQUAD);
+			return (RGBQUAD *)(pixels.data() + mipLevel.byteOffset + offset);
+		};
+
+		for (uint32_t j = 0; j < currMip.height; j += 2)
+		{
+			for (uint32_t i = 0; i < currMip.width; i += 2)
+			{
+				const RGBQUAD *tx0 = getTexel(currMip, i, j);
+				const RGBQUAD *tx1 = getTexel(currMip, i + 1, j);
+				const RGBQUAD *tx2 = getTexel(currMip, i, j + 1);
+				const RGBQUAD *tx3 = getTexel(currMip, i + 1, j + 1);
+				RGBQUAD *dst = getTexel(nextMip, i >> 1, j >> 1);
+				dst->rgbRed = (tx0->rgbRed + tx1->rgbRed + tx2->rgbRed + tx3->rgbRed) >> 2;
+				dst->rgbGreen = (tx0->rgbGreen + tx1->rgbGreen + tx2->rgbGreen + tx3->rgbGreen) >> 2;
+				dst->rgbBlue = (tx0->rgbBlue + tx1->rgbBlue + tx2->rgbBlue + tx3->rgbBlue) >> 2;
+				dst->rgbReserved = (tx0->rgbReserved + tx1->rgbReserved + tx2->rgbReserved + tx3->rgbReserved) >> 2;
+			}
+		}
+	}
+
+	inline HostTexture CreateBenchmarkTexture(uint32_t width, uint32_t height, DXGI_FORMAT format)
+	{
+		std::vector<uint8_t> pixels(static_cast<size_t>(width) * height * BytesPerPixel(format));
+		splitmix random(42);
+		for (uint8_t &pixel : pixels)
+		{
+			pixel = static_cast<uint8_t>(random());
+		}
+
+		HostTexture::Descriptor desc;
+		desc.path = L"MipmapBenchmark";
+		desc.pixels = pixels.data();
+		desc.width = width;
+		desc.height = height;
+		desc.format = format;
+
+		return CreateHostTexture(desc);
+	}
+
+	// Builds full mip chains of a 4K RGBA8 texture with the reference downsampler and every available
+	// kernel, then with the best kernel on 1 to N threads. Reports the best of several runs and checks
+	// the results against each other. Allocating the chain is not part of the measurement.
+	inline bool BenchmarkMipmapGeneration()
+	{
+		constexpr uint32_t size = 4096;
+		constexpr uint32_t runCount = 5;
+
+		using Generate = std::function<void(HostTexture &)>;
+		auto const measure = [](DXGI_FORMAT format, Generate const &generate, HostTexture &result) {
+			double bestMs = 0.0;
+			for (uint32_t run = 0; run < runCount; ++run)
+			{
+				HostTexture texture = CreateBenchmarkTexture(size, size, format);
+				texture.mipChain = CalculateMipChain(texture);
+				texture.pixels.resize(texture.mipChain.back().byteOffset + texture.mipChain.back().byteSize);
+
+				auto const start = std::chrono::steady_clock::now();
+				generate(texture);
+				double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				bestMs = run == 0 ? ms : std::min(bestMs, ms);
+				result = std::move(texture);
+			}
+			return bestMs;
+		};
+
+		HostTexture reference;
+		double const referenceMs = measure(DXGI_FORMAT_R8G8B8A8_UNORM, [](HostTexture &texture) {
+			for (size_t i = 1; i < texture.mipChain.size(); ++i)
+			{
+				BoxDownsampleReference(texture.pixels, texture.mipChain[i], texture.mipChain[i - 1]);
+			}
+		}, reference);
+		printf("Mip chain %ux%u reference : %8.2f ms\n", size, size, referenceMs);
+
+		struct Run
+		{
+			char const *name;
+			DXGI_FORMAT format;
+			eMipmapKernel kernel;
+		};
+		std::vector<Run> runs = {{"scalar", DXGI_FORMAT_R8G8B8A8_UNORM, eMipmapKernel::Scalar}};
+#if H2R_MIPMAP_SIMD
+		runs.push_back({"sse2", DXGI_FORMAT_R8G8B8A8_UNORM, eMipmapKernel::Sse2});
+		if (GetBestMipmapKernel() == eMipmapKernel::Avx2)
+		{
+			runs.push_back({"avx2", DXGI_FORMAT_R8G8B8A8_UNORM, eMipmapKernel::Avx2});
+		}
+#endif
+		runs.push_back({"srgb", DXGI_FORMAT_R8G8B8A8_UNORM_SRGB, GetBestMipmapKernel()});
+
+		bool isMatching = true;
+		HostTexture scalar;
+		for (auto const &run : runs)
+		{
+			auto const layout = GetMipPixelLayout(run.format);
+			HostTexture result;
+			double const ms = measure(run.format, [&](HostTexture &texture) {
+				for (size_t i = 1; i < texture.mipChain.size(); ++i)
+				{
+					DownsampleMip(texture.pixels, texture.mipChain[i], texture.mipChain[i - 1], layout, run.kernel);
+				}
+			}, result);
+
+			if (run.format == DXGI_FORMAT_R8G8B8A8_UNORM)
+			{
+				// The reference truncates while the kernels round, which drifts apart further down the chain.
+				// The first level may differ by one, the SIMD kernels have to match the scalar one exactly.
+				auto const &firstMip = result.mipChain[1];
+				for (uint32_t i = firstMip.byteOffset; i < firstMip.byteOffset + firstMip.byteSize; ++i)
+				{
+					isMatching = isMatching && std::abs(int(result.pixels[i]) - int(reference.pixels[i])) <= 1;
+				}
+				if (run.kernel == eMipmapKernel::Scalar)
+				{
+					scalar = std::move(result);
+				}
+				else
+				{
+					isMatching = isMatching && result.pixels == scalar.pixels;
+				}
+			}
+
+			printf("Mip chain %ux%u %-10s: %8.2f ms (%.2fx)\n", size, size, run.name, ms, referenceMs / std::max(ms, 1e-3));
+		}
+
+		auto const layout = GetMipPixelLayout(DXGI_FORMAT_R8G8B8A8_UNORM);
+		std::vector<uint32_t> threadCounts;
+		for (uint32_t threadCount = 1; threadCount < GetDefaultThreadCount(); threadCount *= 2)
+		{
+			threadCounts.push_back(threadCount);
+		}
+		threadCounts.push_back(GetDefaultThreadCount());
+
+		double singleThreadMs = 0.0;
+		HostTexture singleThread;
+		for (uint32_t threadCount : threadCounts)
+		{
+			HostTexture result;
+			double const ms = measure(DXGI_FORMAT_R8G8B8A8_UNORM, [&](HostTexture &texture) {
+				GenerateMipLevels(texture, layout, GetBestMipmapKernel(), threadCount);
+			}, result);
+
+			auto const schedule = ScheduleMipBands(result.mipChain, layout.bytesPerPixel, threadCount);
+			if (threadCount == 1)
+			{
+				singleThreadMs = ms;
+				singleThread = std::move(result);
+			}
+			else
+			{
+				isMatching = isMatching && result.pixels == singleThread.pixels;
+			}
+
+			printf("Mip chain %ux%u %2u threads: %8.2f ms (%.2fx), %u bands of %u rows down to level %zu\n",
+				   size, size, threadCount, ms, singleThreadMs / std::max(ms, 1e-3),
+				   schedule.bandCount, schedule.bandRows, schedule.lastBandLevel);
+		}
+
+		if (!isMatching)
+		{
+			printf("Mip chain kernels disagree with the reference\n");
+		}
+
+		return isMatching;
+	}
+
+} // namespace h2r
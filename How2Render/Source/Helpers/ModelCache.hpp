@@ -0,0 +1,202 @@
+#pragma once
+
+#include "Helpers/BinaryFile.hpp"
+#include "Mesh.hpp"
+#include "ThirdParty/tiny_obj_loader.h"
+#include <algorithm>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace h2r
+{
+
+	constexpr uint32_t g_modelCacheMagic = 0x4D523248; // "H2RM"
+	constexpr uint32_t g_modelCacheVersion = 3;
+	constexpr char const *g_modelCacheExtension = ".h2rmodel";
+
+	// Everything LoadObjModel needs to rebuild a HostModel without touching the OBJ text.
+	// Materials are kept in tinyobj form so textures go through the regular loading path.
+	struct ModelCacheData
+	{
+		std::vector<tinyobj::material_t> materials;
+		std::vector<HostMesh> opaqueMeshes;
+		std::vector<HostMesh> transparentMeshes;
+	};
+
+	inline std::optional<ModelCacheData> ReadModelCache(std::filesystem::path const &sourcePath);
+
+	inline bool WriteModelCache(std::filesystem::path const &sourcePath, ModelCacheData const &data);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	struct ModelCacheHeader
+	{
+		uint32_t magic = g_modelCacheMagic;
+		uint32_t version = g_modelCacheVersion;
+		SourceFileStamp source;
+		uint32_t materialCount = 0;
+		uint32_t opaqueMeshCount = 0;
+		uint32_t transparentMeshCount = 0;
+		uint32_t padding = 0;
+	};
+
+	struct ModelCacheMaterial
+	{
+		tinyobj::real_t ambient[3] = {};
+		tinyobj::real_t diffuse[3] = {};
+		tinyobj::real_t specular[3] = {};
+		tinyobj::real_t shininess = 0;
+		tinyobj::real_t dissolve = 1;
+	};
+
+	struct ModelCacheMesh
+	{
+		int32_t materialId = InvalidMaterialId;
+		uint32_t vertexCount = 0;
+		uint32_t indexCount = 0;
+	};
+
+	inline bool ReadModelCacheMeshes(BinaryReader &reader, uint32_t count, std::vector<HostMesh> &meshes)
+	{
+		meshes.resize(count);
+		for (auto &mesh : meshes)
+		{
+			ModelCacheMesh record;
+			if (!ReadBinary(reader, record) ||
+				!ReadBinaryArray(reader, mesh.vertices, record.vertexCount) ||
+				!ReadBinaryArray(reader, mesh.indices, record.indexCount))
+			{
+				return false;
+			}
+			mesh.materialId = record.materialId;
+		}
+
+		return true;
+	}
+
+	inline void WriteModelCacheMeshes(std::ofstream &stream, std::vector<HostMesh> const &meshes)
+	{
+		for (auto const &mesh : meshes)
+		{
+			ModelCacheMesh record;
+			record.materialId = mesh.materialId;
+			record.vertexCount = static_cast<uint32_t>(mesh.vertices.size());
+			record.indexCount = static_cast<uint32_t>(mesh.indices.size());
+
+			WriteBinary(stream, record);
+			WriteBinaryArray(stream, mesh.vertices);
+			WriteBinaryArray(stream, mesh.indices);
+		}
+	}
+
+	inline std::optional<ModelCacheData> ReadModelCache(std::filesystem::path const &sourcePath)
+	{
+		auto const stamp = GetSourceFileStamp(sourcePath);
+		if (!stamp)
+		{
+			return std::nullopt;
+		}
+
+		auto mappedFile = CreateMappedFile(GetCacheFilePath(sourcePath, g_modelCacheExtension));
+		if (!mappedFile)
+		{
+			return std::nullopt;
+		}
+
+		BinaryReader reader = CreateBinaryReader(mappedFile.value());
+		ModelCacheData data;
+		bool isValid = false;
+
+		ModelCacheHeader header;
+		if (ReadBinary(reader, header) &&
+			header.magic == g_modelCacheMagic &&
+			header.version == g_modelCacheVersion &&
+			header.source.size == stamp->size &&
+			header.source.lastWriteTime == stamp->lastWriteTime)
+		{
+			isValid = true;
+			data.materials.resize(header.materialCount);
+			for (auto &material : data.materials)
+			{
+				ModelCacheMaterial record;
+				isValid = isValid &&
+						  ReadBinary(reader, record) &&
+						  ReadBinaryString(reader, material.name) &&
+						  ReadBinaryString(reader, material.ambient_texname) &&
+						  ReadBinaryString(reader, material.diffuse_texname) &&
+						  ReadBinaryString(reader, material.specular_texname) &&
+						  ReadBinaryString(reader, material.bump_texname) &&
+						  ReadBinaryString(reader, material.displacement_texname);
+				if (!isValid)
+				{
+					break;
+				}
+
+				std::copy(std::begin(record.ambient), std::end(record.ambient), material.ambient);
+				std::copy(std::begin(record.diffuse), std::end(record.diffuse), material.diffuse);
+				std::copy(std::begin(record.specular), std::end(record.specular), material.specular);
+				material.shininess = record.shininess;
+				material.dissolve = record.dissolve;
+			}
+
+			isValid = isValid &&
+					  ReadModelCacheMeshes(reader, header.opaqueMeshCount, data.opaqueMeshes) &&
+					  ReadModelCacheMeshes(reader, header.transparentMeshCount, data.transparentMeshes);
+		}
+
+		CleanupMappedFile(mappedFile.value());
+
+		if (!isValid)
+		{
+			wprintf(L"Model cache is stale or corrupted: '%s'\n", sourcePath.filename().c_str());
+			return std::nullopt;
+		}
+
+		return data;
+	}
+
+	inline bool WriteModelCache(std::filesystem::path const &sourcePath, ModelCacheData const &data)
+	{
+		auto const stamp = GetSourceFileStamp(sourcePath);
+		if (!stamp)
+		{
+			return false;
+		}
+
+		ModelCacheHeader header;
+		header.source = stamp.value();
+		header.materialCount = static_cast<uint32_t>(data.materials.size());
+		header.opaqueMeshCount = static_cast<uint32_t>(data.opaqueMeshes.size());
+		header.transparentMeshCount = static_cast<uint32_t>(data.transparentMeshes.size());
+
+		return WriteBinaryFile(GetCacheFilePath(sourcePath, g_modelCacheExtension), [&](std::ofstream &stream) {
+			WriteBinary(stream, header);
+
+			for (auto const &material : data.materials)
+			{
+				ModelCacheMaterial record;
+				std::copy(std::begin(material.ambient), std::end(material.ambient), record.ambient);
+				std::copy(std::begin(material.diffuse), std::end(material.diffuse), record.diffuse);
+				std::copy(std::begin(material.specular), std::end(material.specular), record.specular);
+				record.shininess = material.shininess;
+				record.dissolve = material.dissolve;
+
+				WriteBinary(stream, record);
+				WriteBinaryString(stream, material.name);
+				WriteBinaryString(stream, material.ambient_texname);
+				WriteBinaryString(stream, material.diffuse_texname);
+				WriteBinaryString(stream, material.specular_texname);
+				WriteBinaryString(stream, material.bump_texname);
+				WriteBinaryString(stream, material.displacement_texname);
+			}
+
+			WriteModelCacheMeshes(stream, data.opaqueMeshes);
+			WriteModelCacheMeshes(stream, data.transparentMeshes);
+		});
+	}
+
+} // namespace h2r
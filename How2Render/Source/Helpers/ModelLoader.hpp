@@ -1,16 +1,35 @@
 #pragma once
 
+#include "Helpers/CpuProfiler.hpp"
+#include "Helpers/MeshOptimizer.hpp"
+#include "Helpers/ModelCache.hpp"
+#include "Helpers/ObjParser.hpp"
+#include "Helpers/Parallel.hpp"
 #include "Helpers/TextureLoader.hpp"
 #include "Math.hpp"
 #include "Model.hpp"
 #include "ThirdParty/tiny_obj_loader.h"
 #include "Wrapper/Shader.hpp"
 #include "Wrapper/VertexBuffer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
 #include <optional>
 
 namespace h2r
 {
 
+	using ModelLoadFlags = uint32_t;
+	constexpr ModelLoadFlags MODEL_LOAD_FLAG_NONE = 0;
+	constexpr ModelLoadFlags MODEL_LOAD_FLAG_SKIP_TEXTURES = 1;
+	constexpr ModelLoadFlags MODEL_LOAD_FLAG_IGNORE_CACHE = 2;
+	// Textures are block compressed by default, BC3 for color with alpha, BC1 for specular and BC5 for normals
+	constexpr ModelLoadFlags MODEL_LOAD_FLAG_UNCOMPRESSED_TEXTURES = 4;
+	// Uses BC7 instead of BC1 and BC3 for color textures
+	constexpr ModelLoadFlags MODEL_LOAD_FLAG_HIGH_QUALITY_TEXTURES = 8;
+	// Decodes every texture from its source image instead of the DDS texture cache
+	constexpr ModelLoadFlags MODEL_LOAD_FLAG_IGNORE_TEXTURE_CACHE = 16;
+
 	inline XMFLOAT2 TobjVertexToFloat2(std::vector<tinyobj::real_t> const &attribs, int index)
 	{
 		XMFLOAT2 v;
@@ -48,6 +67,7 @@ namespace h2r
 		mesh.materialId = shape.mesh.material_ids[0];
 
 		const uint32_t numFaces = (uint32_t)(shape.mesh.indices.size() / 3);
+		mesh.vertices.reserve(size_t(numFaces) * 3);
 		for (uint32_t faceIndex = 0; faceIndex < numFaces; ++faceIndex)
 		{
 			const uint32_t firstIndex = faceIndex * 3;
@@ -121,66 +141,140 @@ namespace h2r
 		return mesh;
 	}
 
-	inline HostMaterial TobjMaterialToHostMaterial(tinyobj::material_t const &mat, TextureCache &cache, std::filesystem::path const &modelDir)
+	inline eAlphaMask TobjMaterialToAlphaMask(tinyobj::material_t const &mat)
+	{
+		return (mat.dissolve == 0.f) ? eAlphaMask::Opaque : eAlphaMask::Transparent;
+	}
+
+	// Host material whose textures are still being decoded on the loader pool
+	struct PendingHostMaterial
 	{
 		HostMaterial material;
+		HostTextureFuture ambientTexture;
+		HostTextureFuture albedoTexture;
+		HostTextureFuture specularTexture;
+		HostTextureFuture normalTexture;
+	};
 
-		auto ambientTexture = LoadTextureFromFile(cache,
-												  modelDir / mat.ambient_texname,
-												  TEX_LOAD_FLAG_FLIP_VERTICALLY | TEX_LOAD_FLAG_GEN_CPU_MIPMAP,
-												  DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
-		if (ambientTexture)
-		{
-			material.ambientTexture = ambientTexture.value();
-		}
-		auto albedoTexture = LoadTextureFromFile(cache,
-												 modelDir / mat.diffuse_texname,
-												 TEX_LOAD_FLAG_FLIP_VERTICALLY | TEX_LOAD_FLAG_GEN_CPU_MIPMAP,
-												 DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
-		if (albedoTexture)
+	inline PendingHostMaterial TobjMaterialToHostMaterial(
+		tinyobj::material_t const &mat,
+		TextureCache &cache,
+		ThreadPool &pool,
+		std::filesystem::path const &modelDir,
+		ModelLoadFlags flags)
+	{
+		PendingHostMaterial pending;
+		HostMaterial &material = pending.material;
+
+		material.scalarAmbient = XMFLOAT3(mat.ambient);
+		material.scalarDiffuse = XMFLOAT3(mat.diffuse);
+		material.scalarSpecular = XMFLOAT3(mat.specular);
+		material.scalarShininess = mat.shininess;
+		material.scalarAlpha = 1.0f; // OBJ doesn't have scalar alpha value
+		material.alphaMask = TobjMaterialToAlphaMask(mat);
+
+		if (flags & MODEL_LOAD_FLAG_SKIP_TEXTURES)
 		{
-			material.albedoTexture = albedoTexture.value();
+			return pending;
 		}
-		auto specularTexture = LoadTextureFromFile(cache, 
-			modelDir / mat.specular_texname,
-			TEX_LOAD_FLAG_FLIP_VERTICALLY | TEX_LOAD_FLAG_GEN_CPU_MIPMAP,
-			DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
-		if (specularTexture)
+
+		TextureLoadFlags const loadFlags = TEX_LOAD_FLAG_FLIP_VERTICALLY | TEX_LOAD_FLAG_GEN_CPU_MIPMAP |
+										   (flags & MODEL_LOAD_FLAG_IGNORE_TEXTURE_CACHE ? TEX_LOAD_FLAG_IGNORE_FILE_CACHE : 0);
+		TextureLoadFlags colorFlags = loadFlags;
+		TextureLoadFlags specularFlags = loadFlags;
+		TextureLoadFlags normalFlags = loadFlags;
+		if (!(flags & MODEL_LOAD_FLAG_UNCOMPRESSED_TEXTURES))
 		{
-			material.specularTexture = specularTexture.value();
+			bool const isHighQuality = flags & MODEL_LOAD_FLAG_HIGH_QUALITY_TEXTURES;
+			// Ambient and albedo alpha drive the alpha test, so color keeps an alpha channel
+			colorFlags |= isHighQuality ? TEX_LOAD_FLAG_COMPRESS_BC7 : TEX_LOAD_FLAG_COMPRESS_BC3;
+			specularFlags |= isHighQuality ? TEX_LOAD_FLAG_COMPRESS_BC7 : TEX_LOAD_FLAG_COMPRESS_BC1;
+			normalFlags |= TEX_LOAD_FLAG_COMPRESS_BC5;
 		}
 
+		pending.ambientTexture = LoadTextureFromFileAsync(cache, pool,
+														  modelDir / mat.ambient_texname,
+														  colorFlags,
+														  DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+		pending.albedoTexture = LoadTextureFromFileAsync(cache, pool,
+														 modelDir / mat.diffuse_texname,
+														 colorFlags,
+														 DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+		pending.specularTexture = LoadTextureFromFileAsync(cache, pool,
+														   modelDir / mat.specular_texname,
+														   specularFlags,
+														   DXGI_FORMAT_R8G8B8A8_UNORM_SRGB);
+
 		// Some exporters export under different name
 		std::string normalMapName = mat.bump_texname.empty() ? mat.displacement_texname : mat.bump_texname;
-		auto normalTexture = LoadTextureFromFile(cache,
-												 modelDir / normalMapName,
-												 TEX_LOAD_FLAG_FLIP_VERTICALLY | TEX_LOAD_FLAG_GEN_CPU_MIPMAP,
-												 DXGI_FORMAT_R8G8B8A8_UNORM);
-		if (normalTexture)
+		pending.normalTexture = LoadTextureFromFileAsync(cache, pool,
+														 modelDir / normalMapName,
+														 normalFlags,
+														 DXGI_FORMAT_R8G8B8A8_UNORM);
+
+		return pending;
+	}
+
+	inline HostMaterial ResolvePendingHostMaterial(PendingHostMaterial &&pending)
+	{
+		HostMaterial material = std::move(pending.material);
+
+		auto const resolve = [](HostTextureFuture const &future, HostTextureHandle &texture) {
+			if (future.valid())
+			{
+				texture = future.get();
+			}
+		};
+		resolve(pending.ambientTexture, material.ambientTexture);
+		resolve(pending.albedoTexture, material.albedoTexture);
+		resolve(pending.specularTexture, material.specularTexture);
+		resolve(pending.normalTexture, material.normalTexture);
+
+		return material;
+	}
+
+	inline HostModel CacheDataToHostModel(
+		ModelCacheData &&data, TextureCache &cache, std::filesystem::path const &modelDir, ModelLoadFlags flags)
+	{
+		HostModel model;
+
+		// All textures of all materials are queued first, so they decode concurrently
+		ThreadPool pool;
+		CreateThreadPool(pool, GetDefaultThreadCount());
+
+		std::vector<PendingHostMaterial> pendingMaterials;
+		pendingMaterials.reserve(data.materials.size());
+		for (auto const &tobjMaterial : data.materials)
+		{
+			pendingMaterials.push_back(TobjMaterialToHostMaterial(tobjMaterial, cache, pool, modelDir, flags));
+		}
+		for (auto &pending : pendingMaterials)
 		{
-			material.normalTexture = normalTexture.value();
+			model.materials.push_back(ResolvePendingHostMaterial(std::move(pending)));
 		}
 
-		material.scalarAmbient = XMFLOAT3(mat.ambient);
-		material.scalarDiffuse = XMFLOAT3(mat.diffuse);
-		material.scalarSpecular = XMFLOAT3(mat.specular);
-		material.scalarShininess = mat.shininess;
-		material.scalarAlpha = 1.0f; // OBJ doesn't have scalar alpha value
-		material.alphaMask = (mat.dissolve == 0.f) ? eAlphaMask::Opaque : eAlphaMask::Transparent;
+		CleanupThreadPool(pool);
 
-		return material;
+		model.opaqueMeshes = std::move(data.opaqueMeshes);
+		model.transparentMeshes = std::move(data.transparentMeshes);
+
+		return model;
 	}
 
-	inline std::optional<HostModel> LoadObjModel(std::filesystem::path path, TextureCache &cache)
+	// threadCount of 1 keeps the original serial tinyobj path, both paths produce byte-identical meshes
+	inline std::optional<ModelCacheData> ParseObjModel(std::filesystem::path const &path, uint32_t threadCount)
 	{
+		H2R_CPU_ZONE("ParseObjModel");
+
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		std::string warn, err;
 
-		wprintf(L"Loading model %s\n", path.filename().c_str());
-		bool const load = tinyobj::LoadObj(
-			&attrib, &shapes, &materials, &warn, &err, path.string().c_str(), path.parent_path().string().c_str());
+		bool const load = threadCount > 1
+							  ? LoadObjParallel(attrib, shapes, materials, warn, err, path, threadCount)
+							  : tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
+												 path.string().c_str(), path.parent_path().string().c_str());
 		if (!warn.empty())
 		{
 			printf("warning: %s\n", warn.c_str());
@@ -191,37 +285,278 @@ namespace h2r
 		}
 		if (!load)
 		{
-			return {};
+			return std::nullopt;
 		}
 
-		HostModel model;
-		for (auto const &tobjMaterial : materials)
-		{
-			model.materials.push_back(TobjMaterialToHostMaterial(tobjMaterial, cache, path.parent_path()));
-		}
+		// OBJ faces index positions, normals and uvs separately, so every face corner becomes
+		// its own vertex. Welding restores sharing and gives the meshes real index buffers.
+		// The triangle order is then reordered for the post-transform cache and early-z.
+		std::vector<HostMesh> meshes(shapes.size());
+		std::vector<MeshWeldStats> weldStats(shapes.size());
+		std::vector<VertexCacheStats> cacheStatsBefore(shapes.size());
+		std::vector<VertexCacheStats> cacheStatsAfter(shapes.size());
+		ParallelFor(threadCount, shapes.size(), [&](uint64_t i) {
+			meshes[i] = TobjMeshToHostMesh(shapes[i], attrib);
+			weldStats[i] = WeldVertices(meshes[i]);
+			cacheStatsBefore[i] = AnalyzeVertexCache(meshes[i]);
+			OptimizeMesh(meshes[i]);
+			cacheStatsAfter[i] = AnalyzeVertexCache(meshes[i]);
+		});
+
+		ModelCacheData data;
 
 		// We need to separate original model based on the material basis.
 		// Since we are going to draw opaque first and than transparent in the separate pass.
 		// We have to split meshes that use transparent materials into one collection and meshes
 		// that use opaque material into another collection.
-		for (auto const &shape : shapes)
+		for (size_t i = 0; i < shapes.size(); ++i)
 		{
-			switch (model.materials[shape.mesh.material_ids[0]].alphaMask)
+			switch (TobjMaterialToAlphaMask(materials[shapes[i].mesh.material_ids[0]]))
 			{
 			case eAlphaMask::Opaque:
-				model.opaqueMeshes.push_back(TobjMeshToHostMesh(shape, attrib));
+				data.opaqueMeshes.push_back(std::move(meshes[i]));
 				break;
 			case eAlphaMask::Transparent:
-				model.transparentMeshes.push_back(TobjMeshToHostMesh(shape, attrib));
+				data.transparentMeshes.push_back(std::move(meshes[i]));
 				break;
 			default:
 				printf("Host materials has invalid alpha mask value");
 				assert(true);
-				return {};
+				return std::nullopt;
 			}
 		}
+		data.materials = std::move(materials);
 
-		return model;
+		MeshWeldStats totalWeldStats;
+		VertexCacheStats totalCacheStatsBefore;
+		VertexCacheStats totalCacheStatsAfter;
+		auto const accumulate = [](VertexCacheStats &total, VertexCacheStats const &stats) {
+			total.triangleCount += stats.triangleCount;
+			total.vertexCount += stats.vertexCount;
+			total.cacheMissCount += stats.cacheMissCount;
+		};
+		for (size_t i = 0; i < shapes.size(); ++i)
+		{
+			totalWeldStats.verticesBefore += weldStats[i].verticesBefore;
+			totalWeldStats.verticesAfter += weldStats[i].verticesAfter;
+			accumulate(totalCacheStatsBefore, cacheStatsBefore[i]);
+			accumulate(totalCacheStatsAfter, cacheStatsAfter[i]);
+		}
+		printf("Welded vertices: %llu -> %llu\n",
+			   static_cast<unsigned long long>(totalWeldStats.verticesBefore),
+			   static_cast<unsigned long long>(totalWeldStats.verticesAfter));
+		printf("Vertex cache ACMR: %.3f -> %.3f, ATVR: %.3f -> %.3f\n",
+			   GetAcmr(totalCacheStatsBefore), GetAcmr(totalCacheStatsAfter),
+			   GetAtvr(totalCacheStatsBefore), GetAtvr(totalCacheStatsAfter));
+
+		return data;
+	}
+
+	inline std::optional<HostModel> LoadObjModel(
+		std::filesystem::path path, TextureCache &cache, ModelLoadFlags flags = MODEL_LOAD_FLAG_NONE)
+	{
+		H2R_CPU_ZONE("LoadObjModel");
+
+		wprintf(L"Loading model %s\n", path.filename().c_str());
+
+		if (!(flags & MODEL_LOAD_FLAG_IGNORE_CACHE))
+		{
+			if (auto data = ReadModelCache(path); data)
+			{
+				return CacheDataToHostModel(std::move(data.value()), cache, path.parent_path(), flags);
+			}
+		}
+
+		auto data = ParseObjModel(path, GetDefaultThreadCount());
+		if (!data)
+		{
+			return std::nullopt;
+		}
+
+		if (!WriteModelCache(path, data.value()))
+		{
+			wprintf(L"Failed to write model cache for %s\n", path.filename().c_str());
+		}
+
+		return CacheDataToHostModel(std::move(data.value()), cache, path.parent_path(), flags);
+	}
+
+	// Compares everything the model cache stores, so a round trip through it has to come back the same
+	inline bool IsSameModelCacheData(ModelCacheData const &a, ModelCacheData const &b)
+	{
+		auto const isSameMaterials = [](std::vector<tinyobj::material_t> const &a, std::vector<tinyobj::material_t> const &b) {
+			return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](tinyobj::material_t const &a, tinyobj::material_t const &b) {
+				return std::equal(std::begin(a.ambient), std::end(a.ambient), std::begin(b.ambient)) &&
+					   std::equal(std::begin(a.diffuse), std::end(a.diffuse), std::begin(b.diffuse)) &&
+					   std::equal(std::begin(a.specular), std::end(a.specular), std::begin(b.specular)) &&
+					   a.shininess == b.shininess &&
+					   a.dissolve == b.dissolve &&
+					   a.name == b.name &&
+					   a.ambient_texname == b.ambient_texname &&
+					   a.diffuse_texname == b.diffuse_texname &&
+					   a.specular_texname == b.specular_texname &&
+					   a.bump_texname == b.bump_texname &&
+					   a.displacement_texname == b.displacement_texname;
+			});
+		};
+		auto const isSameMeshes = [](std::vector<HostMesh> const &a, std::vector<HostMesh> const &b) {
+			return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](HostMesh const &a, HostMesh const &b) {
+				return a.materialId == b.materialId &&
+					   a.vertices.size() == b.vertices.size() &&
+					   a.indices == b.indices &&
+					   std::memcmp(a.vertices.data(), b.vertices.data(), a.vertices.size() * sizeof(Vertex)) == 0;
+			});
+		};
+
+		return isSameMaterials(a.materials, b.materials) &&
+			   isSameMeshes(a.opaqueMeshes, b.opaqueMeshes) &&
+			   isSameMeshes(a.transparentMeshes, b.transparentMeshes);
+	}
+
+	// Headless entry point: parses the OBJ, writes the binary cache and reports parse vs cache load time.
+	// Verifies that the cache reads back exactly what was parsed.
+	inline bool BakeModelCache(std::filesystem::path const &path)
+	{
+		auto const parseStart = std::chrono::steady_clock::now();
+		auto const parsedData = ParseObjModel(path, GetDefaultThreadCount());
+		auto const parseEnd = std::chrono::steady_clock::now();
+		if (!parsedData)
+		{
+			wprintf(L"Failed to load model %s\n", path.c_str());
+			return false;
+		}
+		if (!WriteModelCache(path, parsedData.value()))
+		{
+			wprintf(L"Failed to write model cache for %s\n", path.c_str());
+			return false;
+		}
+
+		auto const cacheStart = std::chrono::steady_clock::now();
+		auto const cachedData = ReadModelCache(path);
+		auto const cacheEnd = std::chrono::steady_clock::now();
+		if (!cachedData)
+		{
+			wprintf(L"Failed to load model cache %s\n", path.c_str());
+			return false;
+		}
+
+		double const parseMs = std::chrono::duration<double, std::milli>(parseEnd - parseStart).count();
+		double const cacheMs = std::chrono::duration<double, std::milli>(cacheEnd - cacheStart).count();
+		wprintf(L"Model cache written to %s\n", GetCacheFilePath(path, g_modelCacheExtension).c_str());
+		printf("OBJ parse: %.2f ms, cache load: %.2f ms (%.1fx)\n", parseMs, cacheMs, parseMs / std::max(cacheMs, 1e-3));
+
+		bool const isSame = IsSameModelCacheData(parsedData.value(), cachedData.value());
+		if (!isSame)
+		{
+			printf("Model cache differs from the parsed model\n");
+		}
+
+		return isSame;
+	}
+
+	// Headless entry point: loads the model textures once from their source images, which rewrites the DDS
+	// texture cache, and once from the cache. Reports cold vs warm load time and checks both give the same pixels.
+	inline bool BenchmarkTextureFileCache(std::filesystem::path const &path)
+	{
+		auto data = ReadModelCache(path);
+		if (!data)
+		{
+			data = ParseObjModel(path, GetDefaultThreadCount());
+		}
+		if (!data)
+		{
+			wprintf(L"Failed to load model %s\n", path.c_str());
+			return false;
+		}
+
+		auto const load = [&](ModelLoadFlags flags, double &ms) {
+			TextureCache cache;
+			ModelCacheData copy = data.value();
+			auto const start = std::chrono::steady_clock::now();
+			HostModel model = CacheDataToHostModel(std::move(copy), cache, path.parent_path(), flags);
+			ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return model;
+		};
+
+		double coldMs = 0.0;
+		double warmMs = 0.0;
+		HostModel const coldModel = load(MODEL_LOAD_FLAG_IGNORE_TEXTURE_CACHE, coldMs);
+		HostModel const warmModel = load(MODEL_LOAD_FLAG_NONE, warmMs);
+
+		uint32_t textureCount = 0;
+		uint64_t byteSize = 0;
+		bool isIdentical = coldModel.materials.size() == warmModel.materials.size();
+		auto const compare = [&](HostTextureHandle const &cold, HostTextureHandle const &warm) {
+			if (!cold || !warm)
+			{
+				isIdentical = isIdentical && cold == warm;
+				return;
+			}
+			++textureCount;
+			byteSize += cold->pixels.size();
+			isIdentical = isIdentical &&
+						  cold->format == warm->format &&
+						  cold->mipChain.size() == warm->mipChain.size() &&
+						  cold->pixels == warm->pixels;
+		};
+		for (size_t i = 0; isIdentical && i < coldModel.materials.size(); ++i)
+		{
+			compare(coldModel.materials[i].ambientTexture, warmModel.materials[i].ambientTexture);
+			compare(coldModel.materials[i].albedoTexture, warmModel.materials[i].albedoTexture);
+			compare(coldModel.materials[i].specularTexture, warmModel.materials[i].specularTexture);
+			compare(coldModel.materials[i].normalTexture, warmModel.materials[i].normalTexture);
+		}
+
+		printf("Texture loads (%u textures, %.1f MB): decode %.2f ms, DDS cache %.2f ms (%.1fx)\n",
+			   textureCount, byteSize / (1024.0 * 1024.0), coldMs, warmMs, coldMs / std::max(warmMs, 1e-3));
+		if (!isIdentical)
+		{
+			printf("Cached textures differ from the decoded textures\n");
+		}
+
+		return isIdentical;
+	}
+
+	// Headless entry point: parses the OBJ with the serial loader and with a growing number of threads,
+	// reports the speedup and verifies that every parallel run produces the same meshes
+	inline bool BenchmarkObjParsing(std::filesystem::path const &path)
+	{
+		auto const parse = [&path](uint32_t threadCount, double &ms) {
+			auto const start = std::chrono::steady_clock::now();
+			auto data = ParseObjModel(path, threadCount);
+			ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			return data;
+		};
+
+		double serialMs = 0.0;
+		auto const serialData = parse(1, serialMs);
+		if (!serialData)
+		{
+			wprintf(L"Failed to parse model %s\n", path.c_str());
+			return false;
+		}
+
+		std::vector<std::pair<uint32_t, double>> results = {{1, serialMs}};
+		bool isIdentical = true;
+		for (uint32_t threadCount = 2; threadCount <= GetDefaultThreadCount() * 2; threadCount *= 2)
+		{
+			double ms = 0.0;
+			auto const data = parse(threadCount, ms);
+			bool const isSame = data && IsSameModelCacheData(serialData.value(), data.value());
+			isIdentical = isIdentical && isSame;
+			results.emplace_back(threadCount, ms);
+			if (!isSame)
+			{
+				printf("Parallel OBJ parse with %u threads differs from the serial parse\n", threadCount);
+			}
+		}
+
+		for (auto const &[threadCount, ms] : results)
+		{
+			printf("OBJ parse with %2u threads: %8.2f ms (%.2fx)\n", threadCount, ms, serialMs / std::max(ms, 1e-3));
+		}
+
+		return isIdentical;
 	}
 
 } // namespace h2r
@@ -0,0 +1,561 @@
+#pragma once
+
+#include "Helpers/BinaryFile.hpp"
+#include "Helpers/Parallel.hpp"
+#include "ThirdParty/tiny_obj_loader.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <istream>
+#include <limits>
+#include <map>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace h2r
+{
+
+	// Parallel counterpart of tinyobj::LoadObj with triangulation enabled. The file is split into
+	// line-aligned chunks that are parsed concurrently, shapes are then assembled in file order.
+	// Lines, points, tags, smoothing groups and vertex colors are not read, nothing downstream uses them.
+	inline bool LoadObjParallel(
+		tinyobj::attrib_t &attrib,
+		std::vector<tinyobj::shape_t> &shapes,
+		std::vector<tinyobj::material_t> &materials,
+		std::string &warn,
+		std::string &err,
+		std::filesystem::path const &path,
+		uint32_t threadCount);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	enum class eObjChunkEvent : uint8_t
+	{
+		Face,
+		UseMaterial,
+		MaterialLibrary,
+		Group,
+		Object,
+	};
+
+	struct ObjChunkEvent
+	{
+		eObjChunkEvent type = eObjChunkEvent::Face;
+		// Face: first corner in ObjChunk::indices, others: entry in ObjChunk::names
+		uint32_t first = 0;
+		uint32_t count = 0;
+		// Attributes parsed by this chunk before the event, relative face indices depend on them
+		uint32_t vertexCount = 0;
+		uint32_t normalCount = 0;
+		uint32_t texcoordCount = 0;
+	};
+
+	struct ObjChunk
+	{
+		std::vector<tinyobj::real_t> vertices;
+		std::vector<tinyobj::real_t> normals;
+		std::vector<tinyobj::real_t> texcoords;
+		std::vector<tinyobj::index_t> indices;
+		std::vector<std::string> names;
+		std::vector<ObjChunkEvent> events;
+	};
+
+	class ObjMemoryStreamBuffer : public std::streambuf
+	{
+	public:
+		ObjMemoryStreamBuffer(char const *begin, char const *end)
+		{
+			char *data = const_cast<char *>(begin);
+			setg(data, data, data + (end - begin));
+		}
+	};
+
+	// Records mtllib file names in place instead of reading them, materials are loaded once all chunks are parsed
+	class ObjMaterialLibraryRecorder : public tinyobj::MaterialReader
+	{
+	public:
+		explicit ObjMaterialLibraryRecorder(ObjChunk &chunk) : m_chunk(chunk) {}
+
+		bool operator()(std::string const &matId,
+						std::vector<tinyobj::material_t> *,
+						std::map<std::string, int> *,
+						std::string *,
+						std::string *) override
+		{
+			PushObjChunkEvent(m_chunk, eObjChunkEvent::MaterialLibrary, matId);
+			return false;
+		}
+
+		static void PushObjChunkEvent(ObjChunk &chunk, eObjChunkEvent type, std::string name)
+		{
+			ObjChunkEvent event;
+			event.type = type;
+			event.first = static_cast<uint32_t>(chunk.names.size());
+			chunk.names.push_back(std::move(name));
+			chunk.events.push_back(event);
+		}
+
+	private:
+		ObjChunk &m_chunk;
+	};
+
+	inline ObjChunk ParseObjChunk(char const *begin, char const *end)
+	{
+		ObjChunk chunk;
+
+		tinyobj::callback_t callback;
+		callback.vertex_cb = [](void *userData, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z, tinyobj::real_t) {
+			auto &vertices = static_cast<ObjChunk *>(userData)->vertices;
+			vertices.insert(vertices.end(), {x, y, z});
+		};
+		callback.normal_cb = [](void *userData, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t z) {
+			auto &normals = static_cast<ObjChunk *>(userData)->normals;
+			normals.insert(normals.end(), {x, y, z});
+		};
+		callback.texcoord_cb = [](void *userData, tinyobj::real_t x, tinyobj::real_t y, tinyobj::real_t) {
+			auto &texcoords = static_cast<ObjChunk *>(userData)->texcoords;
+			texcoords.insert(texcoords.end(), {x, y});
+		};
+		callback.index_cb = [](void *userData, tinyobj::index_t *indices, int count) {
+			auto &chunk = *static_cast<ObjChunk *>(userData);
+			ObjChunkEvent event;
+			event.type = eObjChunkEvent::Face;
+			event.first = static_cast<uint32_t>(chunk.indices.size());
+			event.count = static_cast<uint32_t>(count);
+			event.vertexCount = static_cast<uint32_t>(chunk.vertices.size() / 3);
+			event.normalCount = static_cast<uint32_t>(chunk.normals.size() / 3);
+			event.texcoordCount = static_cast<uint32_t>(chunk.texcoords.size() / 2);
+			chunk.indices.insert(chunk.indices.end(), indices, indices + count);
+			chunk.events.push_back(event);
+		};
+		callback.usemtl_cb = [](void *userData, char const *name, int) {
+			// LoadObj reads a single token, the callback API hands over the rest of the line
+			std::string_view token = name;
+			token.remove_prefix(std::min(token.find_first_not_of(" \t"), token.size()));
+			token = token.substr(0, token.find_first_of(" \t\r"));
+			ObjMaterialLibraryRecorder::PushObjChunkEvent(
+				*static_cast<ObjChunk *>(userData), eObjChunkEvent::UseMaterial, std::string(token));
+		};
+		callback.group_cb = [](void *userData, char const **names, int count) {
+			std::string name;
+			for (int i = 0; i < count; ++i)
+			{
+				name += (i > 0 ? " " : "");
+				name += names[i];
+			}
+			ObjMaterialLibraryRecorder::PushObjChunkEvent(
+				*static_cast<ObjChunk *>(userData), eObjChunkEvent::Group, std::move(name));
+		};
+		callback.object_cb = [](void *userData, char const *name) {
+			ObjMaterialLibraryRecorder::PushObjChunkEvent(
+				*static_cast<ObjChunk *>(userData), eObjChunkEvent::Object, name);
+		};
+
+		ObjMemoryStreamBuffer buffer(begin, end);
+		std::istream stream(&buffer);
+		ObjMaterialLibraryRecorder recorder(chunk);
+		tinyobj::LoadObjWithCallback(stream, callback, &chunk, &recorder);
+
+		return chunk;
+	}
+
+	// Same as tinyobj fixIndex, except that 0 marks a missing normal or texcoord in the callback API
+	inline bool ResolveObjIndex(int &index, uint32_t offset, uint32_t localCount, bool isOptional)
+	{
+		if (index > 0)
+		{
+			index -= 1;
+			return true;
+		}
+		if (index < 0)
+		{
+			index += static_cast<int>(offset + localCount);
+			return true;
+		}
+
+		index = -1;
+		return isOptional;
+	}
+
+	inline int ObjPointInTriangle(tinyobj::real_t const *vx, tinyobj::real_t const *vy, tinyobj::real_t tx, tinyobj::real_t ty)
+	{
+		int c = 0;
+		for (int i = 0, j = 2; i < 3; j = i++)
+		{
+			if (((vy[i] > ty) != (vy[j] > ty)) &&
+				(tx < (vx[j] - vx[i]) * (ty - vy[i]) / (vy[j] - vy[i]) + vx[i]))
+			{
+				c = !c;
+			}
+		}
+		return c;
+	}
+
+	inline void PushObjTriangle(tinyobj::mesh_t &mesh, tinyobj::index_t const corners[3], int materialId)
+	{
+		mesh.indices.insert(mesh.indices.end(), corners, corners + 3);
+		mesh.num_face_vertices.push_back(3);
+		mesh.material_ids.push_back(materialId);
+		mesh.smoothing_group_ids.push_back(0);
+	}
+
+	// Ear clipping exactly as tinyobj exportGroupsToShape does it, so both loaders emit the same triangles
+	inline void TriangulateObjFace(
+		tinyobj::index_t const *face, size_t cornerCount, std::vector<tinyobj::real_t> const &v, int materialId, tinyobj::mesh_t &mesh)
+	{
+		using real_t = tinyobj::real_t;
+
+		if (cornerCount < 3)
+		{
+			return;
+		}
+		if (cornerCount == 3)
+		{
+			PushObjTriangle(mesh, face, materialId);
+			return;
+		}
+
+		// Find the two axes to work in
+		size_t axes[2] = {1, 2};
+		for (size_t k = 0; k < cornerCount; ++k)
+		{
+			size_t const vi0 = size_t(face[(k + 0) % cornerCount].vertex_index);
+			size_t const vi1 = size_t(face[(k + 1) % cornerCount].vertex_index);
+			size_t const vi2 = size_t(face[(k + 2) % cornerCount].vertex_index);
+			if (((3 * vi0 + 2) >= v.size()) || ((3 * vi1 + 2) >= v.size()) || ((3 * vi2 + 2) >= v.size()))
+			{
+				continue;
+			}
+
+			real_t const e0x = v[vi1 * 3 + 0] - v[vi0 * 3 + 0];
+			real_t const e0y = v[vi1 * 3 + 1] - v[vi0 * 3 + 1];
+			real_t const e0z = v[vi1 * 3 + 2] - v[vi0 * 3 + 2];
+			real_t const e1x = v[vi2 * 3 + 0] - v[vi1 * 3 + 0];
+			real_t const e1y = v[vi2 * 3 + 1] - v[vi1 * 3 + 1];
+			real_t const e1z = v[vi2 * 3 + 2] - v[vi1 * 3 + 2];
+			real_t const cx = std::fabs(e0y * e1z - e0z * e1y);
+			real_t const cy = std::fabs(e0z * e1x - e0x * e1z);
+			real_t const cz = std::fabs(e0x * e1y - e0y * e1x);
+			real_t const epsilon = std::numeric_limits<real_t>::epsilon();
+			if (cx > epsilon || cy > epsilon || cz > epsilon)
+			{
+				if (!(cx > cy && cx > cz))
+				{
+					axes[0] = 0;
+					if (cz > cx && cz > cy)
+					{
+						axes[1] = 1;
+					}
+				}
+				break;
+			}
+		}
+
+		real_t area = 0;
+		for (size_t k = 0; k < cornerCount; ++k)
+		{
+			size_t const vi0 = size_t(face[(k + 0) % cornerCount].vertex_index);
+			size_t const vi1 = size_t(face[(k + 1) % cornerCount].vertex_index);
+			if (((vi0 * 3 + axes[0]) >= v.size()) || ((vi0 * 3 + axes[1]) >= v.size()) ||
+				((vi1 * 3 + axes[0]) >= v.size()) || ((vi1 * 3 + axes[1]) >= v.size()))
+			{
+				continue;
+			}
+			area += (v[vi0 * 3 + axes[0]] * v[vi1 * 3 + axes[1]] - v[vi0 * 3 + axes[1]] * v[vi1 * 3 + axes[0]]) *
+					static_cast<real_t>(0.5);
+		}
+
+		std::vector<tinyobj::index_t> remaining(face, face + cornerCount);
+		size_t guessVertex = 0;
+		tinyobj::index_t corners[3];
+		real_t vx[3];
+		real_t vy[3];
+
+		// How many iterations can we do without decreasing the remaining vertices
+		size_t remainingIterations = cornerCount;
+		size_t previousRemainingVertices = cornerCount;
+
+		while (remaining.size() > 3 && remainingIterations > 0)
+		{
+			size_t const polygonSize = remaining.size();
+			if (guessVertex >= polygonSize)
+			{
+				guessVertex -= polygonSize;
+			}
+
+			if (previousRemainingVertices != polygonSize)
+			{
+				previousRemainingVertices = polygonSize;
+				remainingIterations = polygonSize;
+			}
+			else
+			{
+				remainingIterations--;
+			}
+
+			for (size_t k = 0; k < 3; k++)
+			{
+				corners[k] = remaining[(guessVertex + k) % polygonSize];
+				size_t const vi = size_t(corners[k].vertex_index);
+				if (((vi * 3 + axes[0]) >= v.size()) || ((vi * 3 + axes[1]) >= v.size()))
+				{
+					vx[k] = static_cast<real_t>(0.0);
+					vy[k] = static_cast<real_t>(0.0);
+				}
+				else
+				{
+					vx[k] = v[vi * 3 + axes[0]];
+					vy[k] = v[vi * 3 + axes[1]];
+				}
+			}
+
+			// Skip internal angles
+			real_t const e0x = vx[1] - vx[0];
+			real_t const e0y = vy[1] - vy[0];
+			real_t const e1x = vx[2] - vx[1];
+			real_t const e1y = vy[2] - vy[1];
+			real_t const cross = e0x * e1y - e0y * e1x;
+			if (cross * area < static_cast<real_t>(0.0))
+			{
+				guessVertex += 1;
+				continue;
+			}
+
+			// Skip triangles that contain any other vertex
+			bool overlap = false;
+			for (size_t otherVertex = 3; otherVertex < polygonSize; ++otherVertex)
+			{
+				size_t const ovi = size_t(remaining[(guessVertex + otherVertex) % polygonSize].vertex_index);
+				if (((ovi * 3 + axes[0]) >= v.size()) || ((ovi * 3 + axes[1]) >= v.size()))
+				{
+					continue;
+				}
+				if (ObjPointInTriangle(vx, vy, v[ovi * 3 + axes[0]], v[ovi * 3 + axes[1]]))
+				{
+					overlap = true;
+					break;
+				}
+			}
+			if (overlap)
+			{
+				guessVertex += 1;
+				continue;
+			}
+
+			PushObjTriangle(mesh, corners, materialId);
+			remaining.erase(remaining.begin() + (guessVertex + 1) % polygonSize);
+		}
+
+		if (remaining.size() == 3)
+		{
+			PushObjTriangle(mesh, remaining.data(), materialId);
+		}
+	}
+
+	inline std::vector<char const *> SplitObjIntoChunks(char const *data, uint64_t size, uint32_t threadCount)
+	{
+		// A few chunks per thread keep the workers busy when some chunks are all faces and others all vertices
+		constexpr uint64_t MinChunkSize = 1ull << 20;
+		uint64_t const chunkSize = std::max(MinChunkSize, size / (uint64_t(threadCount) * 4));
+
+		std::vector<char const *> boundaries = {data};
+		char const *const end = data + size;
+		while (end - boundaries.back() > static_cast<int64_t>(chunkSize))
+		{
+			char const *boundary = boundaries.back() + chunkSize;
+			boundary = static_cast<char const *>(std::memchr(boundary, '\n', end - boundary));
+			if (boundary == nullptr || boundary + 1 == end)
+			{
+				break;
+			}
+			boundaries.push_back(boundary + 1);
+		}
+		boundaries.push_back(end);
+
+		return boundaries;
+	}
+
+	inline bool LoadObjParallel(
+		tinyobj::attrib_t &attrib,
+		std::vector<tinyobj::shape_t> &shapes,
+		std::vector<tinyobj::material_t> &materials,
+		std::string &warn,
+		std::string &err,
+		std::filesystem::path const &path,
+		uint32_t threadCount)
+	{
+		auto mappedFile = CreateMappedFile(path);
+		if (!mappedFile)
+		{
+			err += "Cannot open file [" + path.string() + "]\n";
+			return false;
+		}
+
+		auto const boundaries = SplitObjIntoChunks(
+			reinterpret_cast<char const *>(mappedFile->data), mappedFile->size, threadCount);
+		std::vector<ObjChunk> chunks(boundaries.size() - 1);
+		ParallelFor(threadCount, chunks.size(), [&](uint64_t i) {
+			chunks[i] = ParseObjChunk(boundaries[i], boundaries[i + 1]);
+		});
+
+		CleanupMappedFile(mappedFile.value());
+
+		// Attribute offsets of every chunk, then indices are made absolute and attributes are concatenated
+		std::vector<uint32_t> vertexOffsets(chunks.size() + 1, 0);
+		std::vector<uint32_t> normalOffsets(chunks.size() + 1, 0);
+		std::vector<uint32_t> texcoordOffsets(chunks.size() + 1, 0);
+		for (size_t i = 0; i < chunks.size(); ++i)
+		{
+			vertexOffsets[i + 1] = vertexOffsets[i] + static_cast<uint32_t>(chunks[i].vertices.size() / 3);
+			normalOffsets[i + 1] = normalOffsets[i] + static_cast<uint32_t>(chunks[i].normals.size() / 3);
+			texcoordOffsets[i + 1] = texcoordOffsets[i] + static_cast<uint32_t>(chunks[i].texcoords.size() / 2);
+		}
+
+		attrib = tinyobj::attrib_t();
+		attrib.vertices.resize(size_t(vertexOffsets.back()) * 3);
+		attrib.normals.resize(size_t(normalOffsets.back()) * 3);
+		attrib.texcoords.resize(size_t(texcoordOffsets.back()) * 2);
+
+		std::vector<uint8_t> isChunkValid(chunks.size(), 1);
+		ParallelFor(threadCount, chunks.size(), [&](uint64_t i) {
+			auto &chunk = chunks[i];
+			std::copy(chunk.vertices.begin(), chunk.vertices.end(), attrib.vertices.begin() + size_t(vertexOffsets[i]) * 3);
+			std::copy(chunk.normals.begin(), chunk.normals.end(), attrib.normals.begin() + size_t(normalOffsets[i]) * 3);
+			std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), attrib.texcoords.begin() + size_t(texcoordOffsets[i]) * 2);
+
+			for (auto const &event : chunk.events)
+			{
+				if (event.type != eObjChunkEvent::Face)
+				{
+					continue;
+				}
+				for (uint32_t c = event.first; c < event.first + event.count; ++c)
+				{
+					auto &index = chunk.indices[c];
+					bool const isValid =
+						ResolveObjIndex(index.vertex_index, vertexOffsets[i], event.vertexCount, false) &&
+						ResolveObjIndex(index.normal_index, normalOffsets[i], event.normalCount, true) &&
+						ResolveObjIndex(index.texcoord_index, texcoordOffsets[i], event.texcoordCount, true);
+					isChunkValid[i] &= isValid ? 1 : 0;
+				}
+			}
+		});
+
+		if (std::find(isChunkValid.begin(), isChunkValid.end(), 0) != isChunkValid.end())
+		{
+			err += "Failed parse `f' line(e.g. zero value for face index.)\n";
+			return false;
+		}
+
+		// Replays the chunk events in file order with the same shape splitting rules as LoadObj
+		std::string baseDir = path.parent_path().string();
+		if (!baseDir.empty() && baseDir.back() != '\\')
+		{
+			baseDir += '\\';
+		}
+		tinyobj::MaterialFileReader materialReader(baseDir);
+		std::map<std::string, int> materialMap;
+		materials.clear();
+		shapes.clear();
+
+		struct ObjFace
+		{
+			tinyobj::index_t const *corners;
+			uint32_t count;
+		};
+		std::vector<ObjFace> faceGroup;
+		tinyobj::shape_t shape;
+		std::string name;
+		int materialId = -1;
+		bool isMaterialLibraryLoaded = false;
+		eObjChunkEvent previousEvent = eObjChunkEvent::Face;
+
+		auto const exportFaceGroup = [&]() {
+			if (faceGroup.empty())
+			{
+				return false;
+			}
+			shape.name = name;
+			for (auto const &face : faceGroup)
+			{
+				TriangulateObjFace(face.corners, face.count, attrib.vertices, materialId, shape.mesh);
+			}
+			faceGroup.clear();
+			return true;
+		};
+
+		for (auto const &chunk : chunks)
+		{
+			for (auto const &event : chunk.events)
+			{
+				switch (event.type)
+				{
+				case eObjChunkEvent::Face:
+					faceGroup.push_back({chunk.indices.data() + event.first, event.count});
+					break;
+				case eObjChunkEvent::UseMaterial:
+				{
+					auto const it = materialMap.find(chunk.names[event.first]);
+					int const newMaterialId = it != materialMap.end() ? it->second : -1;
+					if (it == materialMap.end())
+					{
+						warn += "material [ '" + chunk.names[event.first] + "' ] not found in .mtl\n";
+					}
+					if (newMaterialId != materialId)
+					{
+						exportFaceGroup();
+						materialId = newMaterialId;
+					}
+					break;
+				}
+				case eObjChunkEvent::MaterialLibrary:
+					// One mtllib line lists alternatives, the first file that loads wins. The recorder
+					// can't see line breaks, so consecutive mtllib lines are treated as one such line.
+					if (previousEvent != eObjChunkEvent::MaterialLibrary)
+					{
+						isMaterialLibraryLoaded = false;
+					}
+					if (!isMaterialLibraryLoaded)
+					{
+						std::string materialWarn;
+						std::string materialErr;
+						isMaterialLibraryLoaded = materialReader(
+							chunk.names[event.first], &materials, &materialMap, &materialWarn, &materialErr);
+						warn += materialWarn;
+						err += materialErr;
+					}
+					break;
+				case eObjChunkEvent::Group:
+				case eObjChunkEvent::Object:
+					exportFaceGroup();
+					if (!shape.mesh.indices.empty())
+					{
+						shapes.push_back(std::move(shape));
+					}
+					shape = tinyobj::shape_t();
+					name = chunk.names[event.first];
+					break;
+				default:
+					assert(true);
+					break;
+				}
+				previousEvent = event.type;
+			}
+		}
+
+		if (exportFaceGroup() || !shape.mesh.indices.empty())
+		{
+			shapes.push_back(std::move(shape));
+		}
+
+		return true;
+	}
+
+} // namespace h2r
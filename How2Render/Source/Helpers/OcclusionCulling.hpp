@@ -0,0 +1,515 @@
+#pragma once
+
+#include "Helpers/FrustumCulling.hpp"
+#include "Math.hpp"
+#include "Mesh.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <vector>
+
+namespace h2r
+{
+
+	// Tiles are 8x4 pixels, so the coverage of a tile fits a 32 bit mask and a tile row fits 8 float lanes
+	constexpr uint32_t g_occlusionTileWidth = 8;
+	constexpr uint32_t g_occlusionTileHeight = 4;
+	constexpr uint32_t g_occlusionBufferWidth = 320;
+	constexpr uint32_t g_occlusionBufferHeight = 192;
+	// Occluders are rasterized every frame, the largest and simplest meshes are picked up to this many triangles
+	constexpr uint32_t g_occluderTriangleBudget = 32 * 1024;
+
+	// Depth as in the D3D depth buffer, 0 at the near and 1 at the far plane. Every pixel of the tile
+	// lies at or in front of z0. The pixels of mask belong to a working layer that lies at or in front of
+	// z1, once the working layer covers the whole tile it becomes the new z0.
+	struct OcclusionTile
+	{
+		float z0 = 1.f;
+		float z1 = 0.f;
+		uint32_t mask = 0;
+	};
+
+	struct OcclusionBuffer
+	{
+		uint32_t width = 0;
+		uint32_t height = 0;
+		uint32_t tileCountX = 0;
+		uint32_t tileCountY = 0;
+		std::vector<OcclusionTile> tiles;
+		XMFLOAT4X4 viewProj = {};
+		uint32_t rasterizedTriangleCount = 0;
+	};
+
+	// World space triangles of every occluder in one list
+	struct OccluderSet
+	{
+		std::vector<XMFLOAT3> positions;
+		std::vector<uint32_t> indices;
+	};
+
+	inline OcclusionBuffer CreateOcclusionBuffer(
+		uint32_t width = g_occlusionBufferWidth, uint32_t height = g_occlusionBufferHeight);
+
+	inline void ClearOcclusionBuffer(OcclusionBuffer &buffer, XMMATRIX const &viewProj);
+
+	inline void AddOccluderMesh(OccluderSet &occluders, HostMesh const &mesh, XMMATRIX const &world);
+
+	// Prefers meshes with a large bounding sphere and few triangles, walls and floors over detailed props
+	inline void SelectOccluderMeshes(
+		OccluderSet &occluders, std::vector<HostMesh> const &meshes, XMMATRIX const &world, uint32_t triangleBudget);
+
+	inline void RasterizeOccluders(OcclusionBuffer &buffer, OccluderSet const &occluders, eCullingKernel kernel);
+
+	inline void RasterizeOccluders(OcclusionBuffer &buffer, OccluderSet const &occluders);
+
+	// Boxes crossing the near plane or reaching off screen count as visible
+	inline bool IsBoxOccluded(OcclusionBuffer const &buffer, XMFLOAT3 const &center, XMFLOAT3 const &extents);
+
+	// Removes the indices of occluded bounds from visible, keeping the order, and returns how many were removed
+	inline uint32_t CullOccludedBounds(
+		OcclusionBuffer const &buffer, CullingBounds const &bounds, std::vector<uint32_t> &visible);
+
+	// Binary PGM of the per pixel depth, stretched over the depth range the occluders cover
+	inline bool WriteOcclusionBufferImage(OcclusionBuffer const &buffer, std::filesystem::path const &path);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline OcclusionBuffer CreateOcclusionBuffer(uint32_t width, uint32_t height)
+	{
+		OcclusionBuffer buffer;
+		buffer.tileCountX = (width + g_occlusionTileWidth - 1) / g_occlusionTileWidth;
+		buffer.tileCountY = (height + g_occlusionTileHeight - 1) / g_occlusionTileHeight;
+		buffer.width = buffer.tileCountX * g_occlusionTileWidth;
+		buffer.height = buffer.tileCountY * g_occlusionTileHeight;
+		buffer.tiles.resize(buffer.tileCountX * buffer.tileCountY);
+
+		return buffer;
+	}
+
+	inline void ClearOcclusionBuffer(OcclusionBuffer &buffer, XMMATRIX const &viewProj)
+	{
+		std::fill(buffer.tiles.begin(), buffer.tiles.end(), OcclusionTile{});
+		XMStoreFloat4x4(&buffer.viewProj, viewProj);
+		buffer.rasterizedTriangleCount = 0;
+	}
+
+	inline void AddOccluderMesh(OccluderSet &occluders, HostMesh const &mesh, XMMATRIX const &world)
+	{
+		uint32_t const firstVertex = static_cast<uint32_t>(occluders.positions.size());
+		for (auto const &vertex : mesh.vertices)
+		{
+			XMFLOAT3 position;
+			XMStoreFloat3(&position, XMVector3TransformCoord(XMLoadFloat3(&vertex.position), world));
+			occluders.positions.push_back(position);
+		}
+		for (uint32_t index : mesh.indices)
+		{
+			occluders.indices.push_back(firstVertex + index);
+		}
+	}
+
+	inline void SelectOccluderMeshes(
+		OccluderSet &occluders, std::vector<HostMesh> const &meshes, XMMATRIX const &world, uint32_t triangleBudget)
+	{
+		std::vector<float> scores(meshes.size());
+		for (size_t i = 0; i < meshes.size(); ++i)
+		{
+			float const radius = CalculateMeshBounds(meshes[i].vertices).radius;
+			float const triangleCount = static_cast<float>(std::max<size_t>(meshes[i].indices.size() / 3, 1));
+			scores[i] = radius * radius / triangleCount;
+		}
+
+		std::vector<uint32_t> order(meshes.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&scores](uint32_t a, uint32_t b) { return scores[a] > scores[b]; });
+
+		uint32_t triangleCount = static_cast<uint32_t>(occluders.indices.size() / 3);
+		for (uint32_t i : order)
+		{
+			uint32_t const meshTriangleCount = static_cast<uint32_t>(meshes[i].indices.size() / 3);
+			if (triangleCount + meshTriangleCount > triangleBudget)
+			{
+				continue;
+			}
+			AddOccluderMesh(occluders, meshes[i], world);
+			triangleCount += meshTriangleCount;
+		}
+	}
+
+	// Row vector times the matrix, as XMVector3Transform does
+	inline XMFLOAT4 TransformOcclusionPoint(XMFLOAT4X4 const &m, float x, float y, float z)
+	{
+		return XMFLOAT4(
+			x * m._11 + y * m._21 + z * m._31 + m._41,
+			x * m._12 + y * m._22 + z * m._32 + m._42,
+			x * m._13 + y * m._23 + z * m._33 + m._43,
+			x * m._14 + y * m._24 + z * m._34 + m._44);
+	}
+
+	// Edge functions are a * x + b * y + c, positive inside the triangle
+	struct OcclusionEdges
+	{
+		float a[3];
+		float b[3];
+		float c[3];
+	};
+
+	// Coverage of the pixel centers of one tile, bit x + 8 * y for the pixel at x, y within the tile.
+	// All kernels compute a * x as one product and add the row term b * y + c, so their masks match exactly.
+	inline uint32_t CalculateTileCoverageScalar(OcclusionEdges const &edges, uint32_t pixelX, uint32_t pixelY)
+	{
+		uint32_t mask = 0;
+		for (uint32_t y = 0; y < g_occlusionTileHeight; ++y)
+		{
+			float const centerY = static_cast<float>(pixelY + y) + 0.5f;
+			float rows[3];
+			for (uint32_t e = 0; e < 3; ++e)
+			{
+				rows[e] = edges.b[e] * centerY + edges.c[e];
+			}
+			for (uint32_t x = 0; x < g_occlusionTileWidth; ++x)
+			{
+				float const centerX = static_cast<float>(pixelX + x) + 0.5f;
+				bool isInside = true;
+				for (uint32_t e = 0; e < 3; ++e)
+				{
+					isInside = isInside && edges.a[e] * centerX + rows[e] >= 0.f;
+				}
+				mask |= isInside ? 1u << (x + y * g_occlusionTileWidth) : 0u;
+			}
+		}
+
+		return mask;
+	}
+
+#if H2R_CULLING_SIMD
+	inline uint32_t CalculateTileCoverageSse(OcclusionEdges const &edges, uint32_t pixelX, uint32_t pixelY)
+	{
+		__m128 const tileX = _mm_set1_ps(static_cast<float>(pixelX));
+		__m128 const centerX0 = _mm_add_ps(tileX, _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+		__m128 const centerX1 = _mm_add_ps(tileX, _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f));
+		__m128 const zero = _mm_setzero_ps();
+
+		__m128 ax0[3];
+		__m128 ax1[3];
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			__m128 const a = _mm_set1_ps(edges.a[e]);
+			ax0[e] = _mm_mul_ps(a, centerX0);
+			ax1[e] = _mm_mul_ps(a, centerX1);
+		}
+
+		uint32_t mask = 0;
+		for (uint32_t y = 0; y < g_occlusionTileHeight; ++y)
+		{
+			float const centerY = static_cast<float>(pixelY + y) + 0.5f;
+			__m128 inside0 = _mm_cmpeq_ps(zero, zero);
+			__m128 inside1 = inside0;
+			for (uint32_t e = 0; e < 3; ++e)
+			{
+				__m128 const row = _mm_set1_ps(edges.b[e] * centerY + edges.c[e]);
+				inside0 = _mm_and_ps(inside0, _mm_cmpge_ps(_mm_add_ps(ax0[e], row), zero));
+				inside1 = _mm_and_ps(inside1, _mm_cmpge_ps(_mm_add_ps(ax1[e], row), zero));
+			}
+			uint32_t const rowMask = static_cast<uint32_t>(_mm_movemask_ps(inside0) | (_mm_movemask_ps(inside1) << 4));
+			mask |= rowMask << (y * g_occlusionTileWidth);
+		}
+
+		return mask;
+	}
+
+	inline uint32_t CalculateTileCoverageAvx(OcclusionEdges const &edges, uint32_t pixelX, uint32_t pixelY)
+	{
+		__m256 const centerX = _mm256_add_ps(
+			_mm256_set1_ps(static_cast<float>(pixelX)), _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+		__m256 const zero = _mm256_setzero_ps();
+
+		__m256 ax[3];
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			ax[e] = _mm256_mul_ps(_mm256_set1_ps(edges.a[e]), centerX);
+		}
+
+		uint32_t mask = 0;
+		for (uint32_t y = 0; y < g_occlusionTileHeight; ++y)
+		{
+			float const centerY = static_cast<float>(pixelY + y) + 0.5f;
+			__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+			for (uint32_t e = 0; e < 3; ++e)
+			{
+				__m256 const row = _mm256_set1_ps(edges.b[e] * centerY + edges.c[e]);
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(ax[e], row), zero, _CMP_GE_OQ));
+			}
+			mask |= static_cast<uint32_t>(_mm256_movemask_ps(inside)) << (y * g_occlusionTileWidth);
+		}
+
+		return mask;
+	}
+#endif
+
+	inline uint32_t CalculateTileCoverage(
+		OcclusionEdges const &edges, uint32_t pixelX, uint32_t pixelY, eCullingKernel kernel)
+	{
+		switch (kernel)
+		{
+#if H2R_CULLING_SIMD
+		case eCullingKernel::Avx:
+			return CalculateTileCoverageAvx(edges, pixelX, pixelY);
+		case eCullingKernel::Sse:
+			return CalculateTileCoverageSse(edges, pixelX, pixelY);
+#endif
+		default:
+			return CalculateTileCoverageScalar(edges, pixelX, pixelY);
+		}
+	}
+
+	// Merges a triangle covering mask at or in front of depth into the tile. When the triangle lies
+	// closer to z0 than to the working layer, the working layer is dropped rather than pushed back.
+	inline void UpdateOcclusionTile(OcclusionTile &tile, uint32_t mask, float depth)
+	{
+		if (depth >= tile.z0)
+		{
+			return;
+		}
+
+		if (tile.mask != 0 && depth - tile.z1 > tile.z0 - depth)
+		{
+			tile.mask = 0;
+			tile.z1 = 0.f;
+		}
+
+		tile.mask |= mask;
+		tile.z1 = std::max(tile.z1, depth);
+		if (tile.mask == ~0u)
+		{
+			tile.z0 = tile.z1;
+			tile.z1 = 0.f;
+			tile.mask = 0;
+		}
+	}
+
+	inline void RasterizeOccluderTriangle(
+		OcclusionBuffer &buffer, XMFLOAT4 const &clip0, XMFLOAT4 const &clip1, XMFLOAT4 const &clip2, eCullingKernel kernel)
+	{
+		XMFLOAT4 const *clips[3] = {&clip0, &clip1, &clip2};
+
+		// Triangles reaching behind the near plane are skipped instead of clipped, leaving out an occluder is safe
+		float screenX[3];
+		float screenY[3];
+		float depth[3];
+		for (uint32_t i = 0; i < 3; ++i)
+		{
+			XMFLOAT4 const &clip = *clips[i];
+			if (clip.z < 0.f || clip.w <= 0.f)
+			{
+				return;
+			}
+			float const invW = 1.f / clip.w;
+			screenX[i] = (clip.x * invW * 0.5f + 0.5f) * buffer.width;
+			screenY[i] = (0.5f - clip.y * invW * 0.5f) * buffer.height;
+			depth[i] = clip.z * invW;
+		}
+
+		float const area =
+			(screenX[1] - screenX[0]) * (screenY[2] - screenY[0]) - (screenX[2] - screenX[0]) * (screenY[1] - screenY[0]);
+		if (area == 0.f || std::isnan(area))
+		{
+			return;
+		}
+
+		float const minX = std::max(std::min({screenX[0], screenX[1], screenX[2]}), 0.f);
+		float const maxX = std::min(std::max({screenX[0], screenX[1], screenX[2]}), static_cast<float>(buffer.width - 1));
+		float const minY = std::max(std::min({screenY[0], screenY[1], screenY[2]}), 0.f);
+		float const maxY = std::min(std::max({screenY[0], screenY[1], screenY[2]}), static_cast<float>(buffer.height - 1));
+		float const maxDepth = std::max({depth[0], depth[1], depth[2]});
+		if (minX > maxX || minY > maxY || maxDepth > 1.f)
+		{
+			return;
+		}
+
+		// Occluders are rasterized from both sides, either winding is turned into positive edge functions
+		float const sign = area > 0.f ? 1.f : -1.f;
+		OcclusionEdges edges;
+		for (uint32_t e = 0; e < 3; ++e)
+		{
+			uint32_t const i0 = e;
+			uint32_t const i1 = (e + 1) % 3;
+			edges.a[e] = sign * (screenY[i0] - screenY[i1]);
+			edges.b[e] = sign * (screenX[i1] - screenX[i0]);
+			edges.c[e] = -(edges.a[e] * screenX[i0] + edges.b[e] * screenY[i0]);
+		}
+
+		// Depth is linear in screen space, its largest value over a tile sits in a tile corner
+		float const depthX = ((depth[1] - depth[0]) * (screenY[2] - screenY[0]) - (depth[2] - depth[0]) * (screenY[1] - screenY[0])) / area;
+		float const depthY = ((depth[2] - depth[0]) * (screenX[1] - screenX[0]) - (depth[1] - depth[0]) * (screenX[2] - screenX[0])) / area;
+		float const depthAtOrigin = depth[0] - depthX * screenX[0] - depthY * screenY[0];
+
+		uint32_t const firstTileX = static_cast<uint32_t>(minX) / g_occlusionTileWidth;
+		uint32_t const lastTileX = static_cast<uint32_t>(maxX) / g_occlusionTileWidth;
+		uint32_t const firstTileY = static_cast<uint32_t>(minY) / g_occlusionTileHeight;
+		uint32_t const lastTileY = static_cast<uint32_t>(maxY) / g_occlusionTileHeight;
+		for (uint32_t tileY = firstTileY; tileY <= lastTileY; ++tileY)
+		{
+			uint32_t const pixelY = tileY * g_occlusionTileHeight;
+			for (uint32_t tileX = firstTileX; tileX <= lastTileX; ++tileX)
+			{
+				uint32_t const pixelX = tileX * g_occlusionTileWidth;
+				uint32_t const mask = CalculateTileCoverage(edges, pixelX, pixelY, kernel);
+				if (mask == 0)
+				{
+					continue;
+				}
+
+				float const left = static_cast<float>(pixelX);
+				float const right = left + g_occlusionTileWidth;
+				float const top = static_cast<float>(pixelY);
+				float const bottom = top + g_occlusionTileHeight;
+				float const cornerDepth = depthAtOrigin + std::max(depthX * left, depthX * right) + std::max(depthY * top, depthY * bottom);
+				UpdateOcclusionTile(buffer.tiles[tileX + tileY * buffer.tileCountX], mask, std::min(cornerDepth, maxDepth));
+			}
+		}
+
+		++buffer.rasterizedTriangleCount;
+	}
+
+	inline void RasterizeOccluders(OcclusionBuffer &buffer, OccluderSet const &occluders, eCullingKernel kernel)
+	{
+		std::vector<XMFLOAT4> clips(occluders.positions.size());
+		for (size_t i = 0; i < occluders.positions.size(); ++i)
+		{
+			XMFLOAT3 const &position = occluders.positions[i];
+			clips[i] = TransformOcclusionPoint(buffer.viewProj, position.x, position.y, position.z);
+		}
+
+		for (size_t i = 0; i + 2 < occluders.indices.size(); i += 3)
+		{
+			RasterizeOccluderTriangle(
+				buffer, clips[occluders.indices[i]], clips[occluders.indices[i + 1]], clips[occluders.indices[i + 2]], kernel);
+		}
+	}
+
+	inline void RasterizeOccluders(OcclusionBuffer &buffer, OccluderSet const &occluders)
+	{
+		RasterizeOccluders(buffer, occluders, GetBestCullingKernel());
+	}
+
+	inline bool IsBoxOccluded(OcclusionBuffer const &buffer, XMFLOAT3 const &center, XMFLOAT3 const &extents)
+	{
+		float minX = FLT_MAX;
+		float maxX = -FLT_MAX;
+		float minY = FLT_MAX;
+		float maxY = -FLT_MAX;
+		float minDepth = FLT_MAX;
+		for (uint32_t corner = 0; corner < 8; ++corner)
+		{
+			XMFLOAT4 const clip = TransformOcclusionPoint(
+				buffer.viewProj,
+				center.x + (corner & 1 ? extents.x : -extents.x),
+				center.y + (corner & 2 ? extents.y : -extents.y),
+				center.z + (corner & 4 ? extents.z : -extents.z));
+			if (clip.z < 0.f || clip.w <= 0.f)
+			{
+				return false;
+			}
+			float const invW = 1.f / clip.w;
+			float const screenX = (clip.x * invW * 0.5f + 0.5f) * buffer.width;
+			float const screenY = (0.5f - clip.y * invW * 0.5f) * buffer.height;
+			minX = std::min(minX, screenX);
+			maxX = std::max(maxX, screenX);
+			minY = std::min(minY, screenY);
+			maxY = std::max(maxY, screenY);
+			minDepth = std::min(minDepth, clip.z * invW);
+		}
+
+		if (minX < 0.f || minY < 0.f || maxX >= buffer.width || maxY >= buffer.height)
+		{
+			return false;
+		}
+
+		// Every pixel of a tile lies at or in front of z0, the box is hidden once it is behind that in every tile
+		uint32_t const firstTileX = static_cast<uint32_t>(minX) / g_occlusionTileWidth;
+		uint32_t const lastTileX = static_cast<uint32_t>(maxX) / g_occlusionTileWidth;
+		uint32_t const firstTileY = static_cast<uint32_t>(minY) / g_occlusionTileHeight;
+		uint32_t const lastTileY = static_cast<uint32_t>(maxY) / g_occlusionTileHeight;
+		for (uint32_t tileY = firstTileY; tileY <= lastTileY; ++tileY)
+		{
+			OcclusionTile const *row = buffer.tiles.data() + tileY * buffer.tileCountX;
+			for (uint32_t tileX = firstTileX; tileX <= lastTileX; ++tileX)
+			{
+				if (minDepth <= row[tileX].z0)
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	inline uint32_t CullOccludedBounds(
+		OcclusionBuffer const &buffer, CullingBounds const &bounds, std::vector<uint32_t> &visible)
+	{
+		size_t const count = visible.size();
+		auto const isOccluded = [&buffer, &bounds](uint32_t i) {
+			return IsBoxOccluded(
+				buffer,
+				XMFLOAT3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]),
+				XMFLOAT3(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]));
+		};
+		visible.erase(std::remove_if(visible.begin(), visible.end(), isOccluded), visible.end());
+
+		return static_cast<uint32_t>(count - visible.size());
+	}
+
+	inline float GetOcclusionPixelDepth(OcclusionBuffer const &buffer, uint32_t x, uint32_t y)
+	{
+		OcclusionTile const &tile = buffer.tiles[x / g_occlusionTileWidth + y / g_occlusionTileHeight * buffer.tileCountX];
+		uint32_t const bit = x % g_occlusionTileWidth + y % g_occlusionTileHeight * g_occlusionTileWidth;
+
+		return tile.mask & (1u << bit) ? tile.z1 : tile.z0;
+	}
+
+	inline bool WriteOcclusionBufferImage(OcclusionBuffer const &buffer, std::filesystem::path const &path)
+	{
+		float nearest = 1.f;
+		for (uint32_t y = 0; y < buffer.height; ++y)
+		{
+			for (uint32_t x = 0; x < buffer.width; ++x)
+			{
+				nearest = std::min(nearest, GetOcclusionPixelDepth(buffer, x, y));
+			}
+		}
+
+		// Near is white, the far plane and pixels no occluder covers are black
+		std::vector<uint8_t> pixels(buffer.width * buffer.height);
+		float const range = std::max(1.f - nearest, 1e-6f);
+		for (uint32_t y = 0; y < buffer.height; ++y)
+		{
+			for (uint32_t x = 0; x < buffer.width; ++x)
+			{
+				float const depth = GetOcclusionPixelDepth(buffer, x, y);
+				pixels[x + y * buffer.width] = static_cast<uint8_t>(255.f * (1.f - depth) / range + 0.5f);
+			}
+		}
+
+		std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+		stream << "P5\n" << buffer.width << " " << buffer.height << "\n255\n";
+		stream.write(reinterpret_cast<char const *>(pixels.data()), pixels.size());
+		if (!stream)
+		{
+			wprintf(L"Failed to write occlusion buffer image %s\n", path.c_str());
+			return false;
+		}
+
+		return true;
+	}
+
+} // namespace h2r
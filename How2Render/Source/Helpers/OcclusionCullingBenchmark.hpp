@@ -0,0 +1,181 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "Helpers/ModelLoader.hpp"
+#include "Helpers/OcclusionCulling.hpp"
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+
+namespace h2r
+{
+
+	// A wall in front of the camera standing on a floor, with boxes placed around it whose visibility is known
+	inline bool RunOcclusionCullingSceneChecks(OcclusionBuffer const &buffer)
+	{
+		struct Check
+		{
+			char const *name;
+			XMFLOAT3 center;
+			XMFLOAT3 extents;
+			bool isOccluded;
+		};
+		Check const checks[] = {
+			{"behind the wall", {0.f, 0.f, 20.f}, {1.f, 1.f, 1.f}, true},
+			{"in front of the wall", {0.f, 0.f, 5.f}, {1.f, 1.f, 1.f}, false},
+			{"beside the wall", {9.f, 0.f, 20.f}, {1.f, 1.f, 1.f}, false},
+			{"under the floor", {6.f, -5.f, 20.f}, {1.f, 1.f, 1.f}, true},
+			{"on the floor", {12.f, -2.5f, 20.f}, {1.f, 0.5f, 1.f}, false},
+			{"crossing the near plane", {0.f, 0.f, 0.f}, {1.f, 1.f, 1.f}, false},
+		};
+
+		bool isCorrect = true;
+		for (Check const &check : checks)
+		{
+			bool const isOccluded = IsBoxOccluded(buffer, check.center, check.extents);
+			if (isOccluded != check.isOccluded)
+			{
+				printf("Box %s is %s, expected %s\n", check.name, isOccluded ? "occluded" : "visible",
+					   check.isOccluded ? "occluded" : "visible");
+				isCorrect = false;
+			}
+		}
+
+		return isCorrect;
+	}
+
+	// Headless check of the occlusion rasterizer. Rasterizes a synthetic scene with every kernel the CPU
+	// supports, verifies they produce the same tiles and the expected occlusion results and times them.
+	// Given an OBJ model the same is done for its opaque meshes from the default camera. Both occlusion
+	// buffers are dumped as PGM images next to the working directory.
+	inline bool BenchmarkOcclusionCulling(std::filesystem::path const &modelPath)
+	{
+		constexpr uint32_t runCount = 50;
+
+		auto const measure = [](auto const &function) {
+			double bestMs = 0.0;
+			for (uint32_t run = 0; run < runCount; ++run)
+			{
+				auto const start = std::chrono::steady_clock::now();
+				function();
+				double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				bestMs = run == 0 ? ms : std::min(bestMs, ms);
+			}
+			return bestMs;
+		};
+
+		std::vector<eCullingKernel> kernels = {eCullingKernel::Scalar};
+		if (GetBestCullingKernel() != eCullingKernel::Scalar)
+		{
+			kernels.push_back(eCullingKernel::Sse);
+		}
+		if (GetBestCullingKernel() == eCullingKernel::Avx)
+		{
+			kernels.push_back(eCullingKernel::Avx);
+		}
+		char const *const kernelNames[] = {"scalar", "sse", "avx"};
+
+		// Rasterizes with every kernel, returns false if any of them disagrees with the scalar one
+		auto const rasterize = [&](XMMATRIX const &viewProj, OccluderSet const &occluders, OcclusionBuffer &buffer) {
+			bool isMatching = true;
+			std::vector<OcclusionTile> reference;
+			for (eCullingKernel kernel : kernels)
+			{
+				double const ms = measure([&]() {
+					ClearOcclusionBuffer(buffer, viewProj);
+					RasterizeOccluders(buffer, occluders, kernel);
+				});
+
+				bool isSame = true;
+				if (reference.empty())
+				{
+					reference = buffer.tiles;
+				}
+				else
+				{
+					for (size_t i = 0; i < reference.size(); ++i)
+					{
+						isSame &= reference[i].z0 == buffer.tiles[i].z0 && reference[i].z1 == buffer.tiles[i].z1 &&
+								  reference[i].mask == buffer.tiles[i].mask;
+					}
+				}
+				isMatching = isMatching && isSame;
+
+				printf("  %-6s %7.3f ms, %u triangles%s\n", kernelNames[static_cast<uint32_t>(kernel)], ms,
+					   buffer.rasterizedTriangleCount, isSame ? "" : ", tiles differ from scalar");
+			}
+			return isMatching;
+		};
+
+		bool isCorrect = true;
+
+		{
+			OccluderSet occluders;
+			occluders.positions = {
+				{-4.f, -4.f, 10.f}, {4.f, -4.f, 10.f}, {4.f, 4.f, 10.f}, {-4.f, 4.f, 10.f},
+				{-30.f, -3.f, 0.5f}, {30.f, -3.f, 0.5f}, {30.f, -3.f, 60.f}, {-30.f, -3.f, 60.f}};
+			occluders.indices = {0, 1, 2, 0, 2, 3, 4, 6, 5, 4, 7, 6};
+
+			XMMATRIX const viewProj = XMMatrixPerspectiveFovLH(
+				XMConvertToRadians(90.f), float(g_occlusionBufferWidth) / g_occlusionBufferHeight, 0.1f, 100.f);
+
+			printf("Synthetic scene:\n");
+			OcclusionBuffer buffer = CreateOcclusionBuffer();
+			isCorrect &= rasterize(viewProj, occluders, buffer);
+			isCorrect &= RunOcclusionCullingSceneChecks(buffer);
+			WriteOcclusionBufferImage(buffer, "OcclusionScene.pgm");
+		}
+
+		if (modelPath.empty())
+		{
+			return isCorrect;
+		}
+
+		TextureCache cache;
+		auto const model = LoadObjModel(modelPath, cache, MODEL_LOAD_FLAG_SKIP_TEXTURES);
+		if (!model)
+		{
+			wprintf(L"Failed to load model %s\n", modelPath.c_str());
+			return false;
+		}
+
+		// Placed and viewed the way the renderer shows sponza
+		XMMATRIX const world = XMMatrixScaling(0.01f, 0.01f, 0.01f);
+		Camera const camera = CreateDefaultCamera();
+		XMMATRIX const viewProj = math::CreateViewMatrix(camera.position, camera.yaw, camera.pitch) *
+								  XMMatrixPerspectiveFovLH(camera.fov, camera.aspectRatio, camera.zNear, camera.zFar);
+
+		OccluderSet occluders;
+		SelectOccluderMeshes(occluders, model->opaqueMeshes, world, g_occluderTriangleBudget);
+
+		CullingBounds bounds;
+		for (auto const *meshes : {&model->opaqueMeshes, &model->transparentMeshes})
+		{
+			for (HostMesh const &mesh : *meshes)
+			{
+				MeshBounds const meshBounds = TransformMeshBounds(CalculateMeshBounds(mesh.vertices), world);
+				AddCullingBounds(bounds, meshBounds.center, meshBounds.extents, meshBounds.radius);
+			}
+		}
+
+		wprintf(L"%s:\n", modelPath.filename().c_str());
+		OcclusionBuffer buffer = CreateOcclusionBuffer();
+		isCorrect &= rasterize(viewProj, occluders, buffer);
+
+		Frustum const frustum = CreateFrustum(viewProj);
+		std::vector<uint32_t> visible;
+		CullBounds(frustum, bounds, visible);
+		size_t const frustumVisibleCount = visible.size();
+		uint32_t occludedCount = 0;
+		double const testMs = measure([&]() {
+			std::vector<uint32_t> tested = visible;
+			occludedCount = CullOccludedBounds(buffer, bounds, tested);
+		});
+		printf("  %zu meshes, %zu in the frustum, %u of them occluded, tested in %.3f ms\n",
+			   bounds.centerX.size(), frustumVisibleCount, occludedCount, testMs);
+		WriteOcclusionBufferImage(buffer, "OcclusionModel.pgm");
+
+		return isCorrect;
+	}
+
+} // namespace h2r
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace h2r
+{
+
+	struct ThreadPool
+	{
+		std::vector<std::thread> threads;
+		std::deque<std::function<void()>> jobs;
+		std::mutex mutex;
+		std::condition_variable jobAvailable;
+		bool isStopping = false;
+	};
+
+	inline uint32_t GetDefaultThreadCount();
+
+	// Workers shared by every ParallelFor, started on first use and joined at exit
+	inline ThreadPool &GetParallelForPool();
+
+	inline void CreateThreadPool(ThreadPool &pool, uint32_t threadCount);
+
+	inline void CleanupThreadPool(ThreadPool &pool);
+
+	template <typename Job>
+	inline auto SubmitJob(ThreadPool &pool, Job &&job) -> std::future<std::invoke_result_t<Job>>;
+
+	template <typename Function>
+	inline void ParallelFor(uint32_t threadCount, uint64_t count, Function &&function);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline uint32_t GetDefaultThreadCount()
+	{
+		return std::max(1u, std::thread::hardware_concurrency());
+	}
+
+	inline ThreadPool &GetParallelForPool()
+	{
+		struct SharedThreadPool
+		{
+			ThreadPool pool;
+
+			SharedThreadPool()
+			{
+				// The thread calling ParallelFor always works as well
+				CreateThreadPool(pool, GetDefaultThreadCount() - 1);
+			}
+
+			~SharedThreadPool()
+			{
+				CleanupThreadPool(pool);
+			}
+		};
+		static SharedThreadPool shared;
+
+		return shared.pool;
+	}
+
+	struct ParallelForState
+	{
+		std::function<void(uint64_t)> function;
+		uint64_t count = 0;
+		std::atomic<uint64_t> nextIndex = 0;
+		std::atomic<uint64_t> doneCount = 0;
+	};
+
+	// Workers only touch the function while indices are left, so a helper that starts after the
+	// caller returned finds nothing to do and only keeps the shared state alive
+	inline void RunParallelForIndices(ParallelForState &state)
+	{
+		for (uint64_t i = state.nextIndex++; i < state.count; i = state.nextIndex++)
+		{
+			state.function(i);
+			if (++state.doneCount == state.count)
+			{
+				state.doneCount.notify_all();
+			}
+		}
+	}
+
+	// Calls function(index) for every index in [0, count). Indices are handed out one by one through
+	// an atomic counter, so uneven work items still balance. The calling thread takes part in the work
+	// and up to threadCount - 1 workers of the shared pool help. The caller waits for the indices rather
+	// than for the helpers, so nested calls and calls from other pools' jobs can not deadlock.
+	template <typename Function>
+	inline void ParallelFor(uint32_t threadCount, uint64_t count, Function &&function)
+	{
+		uint32_t const workerCount = static_cast<uint32_t>(std::min<uint64_t>(std::max(threadCount, 1u), count));
+		if (workerCount <= 1 || GetParallelForPool().threads.empty())
+		{
+			for (uint64_t i = 0; i < count; ++i)
+			{
+				function(i);
+			}
+			return;
+		}
+
+		ThreadPool &pool = GetParallelForPool();
+		uint32_t const helperCount = std::min(workerCount - 1, static_cast<uint32_t>(pool.threads.size()));
+
+		auto state = std::make_shared<ParallelForState>();
+		state->function = std::ref(function);
+		state->count = count;
+		{
+			std::lock_guard lock(pool.mutex);
+			for (uint32_t i = 0; i < helperCount; ++i)
+			{
+				pool.jobs.emplace_back([state]() { RunParallelForIndices(*state); });
+			}
+		}
+		pool.jobAvailable.notify_all();
+
+		RunParallelForIndices(*state);
+
+		for (uint64_t done = state->doneCount.load(); done < count; done = state->doneCount.load())
+		{
+			state->doneCount.wait(done);
+		}
+	}
+
+	inline void CreateThreadPool(ThreadPool &pool, uint32_t threadCount)
+	{
+		pool.isStopping = false;
+		pool.threads.reserve(threadCount);
+		for (uint32_t i = 0; i < threadCount; ++i)
+		{
+			pool.threads.emplace_back([&pool]() {
+				while (true)
+				{
+					std::function<void()> job;
+					{
+						std::unique_lock lock(pool.mutex);
+						pool.jobAvailable.wait(lock, [&pool]() { return pool.isStopping || !pool.jobs.empty(); });
+						if (pool.jobs.empty())
+						{
+							return;
+						}
+						job = std::move(pool.jobs.front());
+						pool.jobs.pop_front();
+					}
+					job();
+				}
+			});
+		}
+	}
+
+	// Runs the jobs that are still queued before the workers exit
+	inline void CleanupThreadPool(ThreadPool &pool)
+	{
+		{
+			std::lock_guard lock(pool.mutex);
+			pool.isStopping = true;
+		}
+		pool.jobAvailable.notify_all();
+
+		for (auto &thread : pool.threads)
+		{
+			thread.join();
+		}
+		pool.threads.clear();
+	}
+
+	template <typename Job>
+	inline auto SubmitJob(ThreadPool &pool, Job &&job) -> std::future<std::invoke_result_t<Job>>
+	{
+		// std::function needs a copyable target, the task is shared to satisfy that
+		auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Job>()>>(std::forward<Job>(job));
+		auto future = task->get_future();
+		{
+			std::lock_guard lock(pool.mutex);
+			pool.jobs.emplace_back([task]() { (*task)(); });
+		}
+		pool.jobAvailable.notify_one();
+
+		return future;
+	}
+
+} // namespace h2r
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "RenderGraph.hpp"
+#include "RenderPipeline.hpp"
+#include <cstdio>
+
+namespace h2r
+{
+
+	// Declares and compiles the pipeline graph of every shading type without a device and prints which
+	// passes and textures survive, how the textures alias and the render target memory before and after
+	inline bool ReportRenderGraphMemory(uint32_t width = 1200, uint32_t height = 720)
+	{
+		static char const *s_shadingTypeNames[static_cast<uint32_t>(Application::eShadingType::Count)] = {
+			"Forward",
+			"Deferred",
+		};
+
+		for (uint32_t shadingType = 0; shadingType < static_cast<uint32_t>(Application::eShadingType::Count); ++shadingType)
+		{
+			Application::States states;
+			states.shadingType = static_cast<Application::eShadingType>(shadingType);
+
+			RenderGraph graph;
+			Pipeline::GraphTextures textures;
+			DeclarePipelineGraph(graph, textures, width, height, states);
+			CompileRenderGraph(graph);
+
+			printf("%s shading, %ux%u, %zu of %zu passes\n",
+				   s_shadingTypeNames[shadingType], width, height, graph.executionOrder.size(), graph.passes.size());
+			PrintRenderGraph(graph);
+		}
+
+		return true;
+	}
+
+} // namespace h2r
@@ -0,0 +1,333 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "Helpers/CullingBenchmark.hpp"
+#include "Helpers/FrustumCulling.hpp"
+#include "RenderObject.hpp"
+#include "ShadowCache.hpp"
+#include "ShadowCascades.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace h2r
+{
+
+	inline Camera CreateShadowCascadeBenchmarkCamera(XMVECTOR position, float yaw, float pitch)
+	{
+		Camera camera = CreateDefaultCamera();
+		camera.position = position;
+		camera.yaw = yaw;
+		camera.pitch = pitch;
+		camera.view = math::CreateViewMatrix(camera.position, camera.yaw, camera.pitch);
+		camera.inverseView = math::CreateCameraMatrix(camera.position, camera.yaw, camera.pitch);
+
+		return camera;
+	}
+
+	// One object per benchmark caster with the caster as its only opaque mesh, every tenth one is dynamic
+	inline RenderObjectStorage CreateShadowCasterBenchmarkStorage(CullingBounds const &bounds)
+	{
+		RenderObjectStorage storage;
+		for (size_t i = 0; i < bounds.centerX.size(); ++i)
+		{
+			DeviceMesh mesh;
+			mesh.bounds.center = {bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]};
+			mesh.bounds.extents = {bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]};
+			mesh.bounds.radius = bounds.radius[i];
+
+			RenderObject object;
+			object.model.opaqueMeshes = {mesh};
+			object.transform = CreateTransform({0.f, 0.f, 0.f}, {0.f, 0.f, 0.f}, 1.f);
+			object.isStatic = i % 10 != 0;
+			storage.opaque.push_back(object);
+		}
+		storage.opaqueBounds = CreateRenderObjectBounds(storage.opaque, eMeshList::Opaque);
+		storage.transparentBounds = CreateRenderObjectBounds(storage.opaque, eMeshList::Transparent);
+
+		return storage;
+	}
+
+	// A caster list has to hold exactly the static or dynamic casters in the frustum, as asked for. The bvh
+	// query of the list is compared against a linear scan of the current bounds.
+	inline bool IsShadowCasterListExact(
+		RenderObjectStorage const &storage, Frustum const &frustum, bool isStaticKept, bool isDynamicKept, VisibleMeshes const &visible)
+	{
+		std::vector<uint32_t> indices;
+		CullBounds(frustum, storage.opaqueBounds.bounds, indices);
+
+		std::vector<MeshReference> expected;
+		for (uint32_t index : indices)
+		{
+			MeshReference const &mesh = storage.opaqueBounds.meshes[index];
+			if (storage.opaque[mesh.objectIndex].isStatic ? isStaticKept : isDynamicKept)
+			{
+				expected.push_back(mesh);
+			}
+		}
+
+		return std::equal(
+			expected.begin(), expected.end(), visible.meshes.begin(), visible.meshes.end(),
+			[](MeshReference const &a, MeshReference const &b) {
+				return a.objectIndex == b.objectIndex && a.meshIndex == b.meshIndex;
+			});
+	}
+
+	// Every corner of the camera frustum slice of a cascade has to land inside its projection
+	inline bool IsShadowCascadeContainingSlice(Camera const &camera, ShadowCascade const &cascade)
+	{
+		constexpr float epsilon = 1e-4f;
+
+		float const tanY = std::tan(camera.fov * 0.5f);
+		float const tanX = tanY * camera.aspectRatio;
+		XMMATRIX const cameraToShadow = XMMatrixMultiply(camera.inverseView, cascade.viewProj);
+		for (float depth : {cascade.splitNear, cascade.splitFar})
+		{
+			for (float x : {-tanX, tanX})
+			{
+				for (float y : {-tanY, tanY})
+				{
+					XMFLOAT3 corner;
+					XMStoreFloat3(&corner, XMVector3TransformCoord(XMVectorSet(x * depth, y * depth, depth, 1.f), cameraToShadow));
+					if (std::abs(corner.x) > 1.f + epsilon || std::abs(corner.y) > 1.f + epsilon ||
+						corner.z < -epsilon || corner.z > 1.f + epsilon)
+					{
+						return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+	// Caster centers have to land on the same cache texel and cascade depth whether they are projected
+	// directly or reprojected from the cascade the way the composite shader does
+	inline bool IsShadowCacheReprojectionExact(
+		ShadowCache const &cache, ShadowCascade const &cascade, CullingBounds const &bounds)
+	{
+		constexpr float epsilon = 1e-4f;
+
+		XMMATRIX const reprojection = CalculateShadowCacheReprojection(cache, cascade);
+		for (size_t i = 0; i < bounds.centerX.size(); ++i)
+		{
+			XMVECTOR const center = XMVectorSet(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i], 1.f);
+			XMFLOAT3 cascadePos;
+			XMFLOAT3 cachePos;
+			XMStoreFloat3(&cascadePos, XMVector3TransformCoord(center, cascade.viewProj));
+			XMStoreFloat3(&cachePos, XMVector3TransformCoord(center, cache.viewProj));
+
+			XMFLOAT3 nearPos;
+			XMFLOAT3 farPos;
+			XMStoreFloat3(&nearPos, XMVector3TransformCoord(XMVectorSet(cascadePos.x, cascadePos.y, 0.f, 1.f), reprojection));
+			XMStoreFloat3(&farPos, XMVector3TransformCoord(XMVectorSet(cascadePos.x, cascadePos.y, 1.f, 1.f), reprojection));
+			float const depth = (cachePos.z - nearPos.z) / (farPos.z - nearPos.z);
+			if (std::abs(nearPos.x - cachePos.x) > epsilon || std::abs(nearPos.y - cachePos.y) > epsilon ||
+				std::abs(depth - cascadePos.z) > epsilon)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Light space boxes that overlap the cascade volume, the caster list has to hold every one of them
+	inline bool IsShadowCascadeCullingConservative(
+		ShadowCascade const &cascade, CullingBounds const &bounds, std::vector<uint32_t> const &visible)
+	{
+		std::vector<bool> isVisible(bounds.centerX.size(), false);
+		for (uint32_t index : visible)
+		{
+			isVisible[index] = true;
+		}
+
+		for (uint32_t i = 0; i < bounds.centerX.size(); ++i)
+		{
+			XMVECTOR minimum = XMVectorReplicate(FLT_MAX);
+			XMVECTOR maximum = XMVectorReplicate(-FLT_MAX);
+			for (float x : {-1.f, 1.f})
+			{
+				for (float y : {-1.f, 1.f})
+				{
+					for (float z : {-1.f, 1.f})
+					{
+						XMVECTOR const corner = XMVector3TransformCoord(
+							XMVectorSet(
+								bounds.centerX[i] + x * bounds.extentX[i],
+								bounds.centerY[i] + y * bounds.extentY[i],
+								bounds.centerZ[i] + z * bounds.extentZ[i],
+								1.f),
+							cascade.viewProj);
+						minimum = XMVectorMin(minimum, corner);
+						maximum = XMVectorMax(maximum, corner);
+					}
+				}
+			}
+
+			bool const isOverlapping =
+				XMVector3LessOrEqual(minimum, XMVectorSet(1.f, 1.f, 1.f, 0.f)) &&
+				XMVector3GreaterOrEqual(maximum, XMVectorSet(-1.f, -1.f, 0.f, 0.f));
+			if (isOverlapping && !isVisible[i])
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Headless check of the cascade math. Verifies the split scheme, that every cascade contains its
+	// slice of the camera frustum for a set of camera and light poses, that the projections keep their
+	// texel size and stay on the texel grid while the camera moves and turns, that the cascades filled
+	// from the shadow cache reproject it exactly, and that per cascade caster culling keeps every caster
+	// overlapping the cascade. Moving the dynamic casters has to keep the cache, which holds exactly the
+	// static casters, while cascades reading it draw exactly the dynamic ones. Moving a static caster has
+	// to redraw the cache. Reports fit and culling time and the casters drawn per cascade.
+	inline bool BenchmarkShadowCascades()
+	{
+		bool isCorrect = true;
+
+		for (float lambda : {0.f, 0.5f, 0.75f, 1.f})
+		{
+			float splits[g_shadowCascadeCount + 1];
+			CalculateShadowCascadeSplits(0.1f, 30.f, lambda, splits);
+
+			bool isValid = splits[0] == 0.1f && splits[g_shadowCascadeCount] == 30.f;
+			for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+			{
+				isValid &= splits[i] < splits[i + 1];
+			}
+			printf("Splits for lambda %.2f:", lambda);
+			for (float split : splits)
+			{
+				printf(" %.2f", split);
+			}
+			printf("%s\n", isValid ? "" : ", not increasing");
+			isCorrect &= isValid;
+		}
+
+		CullingBounds const bounds = CreateBenchmarkCullingBounds(10000, 50.f);
+		MeshBounds const casterBounds = CalculateShadowCasterBounds(bounds);
+		RenderObjectStorage storage = CreateShadowCasterBenchmarkStorage(bounds);
+
+		struct Pose
+		{
+			XMVECTOR position;
+			float yaw;
+			float pitch;
+		};
+		Pose const cameraPoses[] = {
+			{{-5.f, 1.5f, 0.f, 1.f}, XMConvertToRadians(90.f), 0.f},
+			{{10.f, 4.f, -20.f, 1.f}, XMConvertToRadians(-30.f), XMConvertToRadians(-25.f)},
+			{{0.f, 8.f, 0.f, 1.f}, XMConvertToRadians(200.f), XMConvertToRadians(80.f)},
+		};
+		XMVECTOR const lightDirections[] = {
+			XMVector3Normalize({0.f, 1.f, 0.f, 0.f}),
+			XMVector3Normalize({0.3f, 1.f, 0.2f, 0.f}),
+			XMVector3Normalize({-1.f, 0.5f, 0.f, 0.f}),
+		};
+
+		double fitMs = 0.0;
+		double cullMs = 0.0;
+		uint32_t frameCount = 0;
+		std::vector<uint32_t> visible;
+		VisibleMeshes casters;
+		for (Pose const &pose : cameraPoses)
+		{
+			for (XMVECTOR const &direction : lightDirections)
+			{
+				DirectionalLight const light{.direction{direction}};
+				ShadowCache cache;
+				UpdateShadowCache(cache, light, casterBounds, storage.staticRevision);
+				for (uint32_t i = 0; i < storage.opaque.size(); ++i)
+				{
+					if (!storage.opaque[i].isStatic)
+					{
+						MoveRenderObject(storage, i, CreateTransform({0.f, 0.1f * (frameCount + 1), 0.f}, {0.f, 0.f, 0.f}, 1.f));
+					}
+				}
+				bool const isCacheKept = UpdateShadowCache(cache, light, casterBounds, storage.staticRevision);
+				CullShadowCacheCasters(cache, storage.opaque, storage.opaqueBounds, true, casters);
+				bool const isCacheListExact = IsShadowCasterListExact(storage, CreateFrustum(cache.viewProj), true, false, casters);
+				if (!isCacheKept || !isCacheListExact)
+				{
+					printf("Shadow cache%s%s\n",
+						   isCacheKept ? "" : " redrawn for dynamic casters",
+						   isCacheListExact ? "" : " holds the wrong casters");
+				}
+				isCorrect &= isCacheKept && isCacheListExact;
+
+				Camera const camera = CreateShadowCascadeBenchmarkCamera(pose.position, pose.yaw, pose.pitch);
+
+				auto const fitStart = std::chrono::steady_clock::now();
+				ShadowCascades const cascades = CalculateShadowCascades(camera, light, casterBounds, 0.75f);
+				fitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - fitStart).count();
+
+				// Moving by a fraction of a texel and turning keeps the texel size and moves the grid by whole texels
+				Camera const movedCamera = CreateShadowCascadeBenchmarkCamera(
+					XMVectorAdd(pose.position, {0.0137f, 0.0071f, -0.0113f, 0.f}), pose.yaw + 0.3f, pose.pitch - 0.2f);
+				ShadowCascades const movedCascades = CalculateShadowCascades(movedCamera, light, casterBounds, 0.75f);
+
+				printf("Camera (%5.1f %5.1f %5.1f) light (%5.2f %5.2f %5.2f) casters:",
+					   XMVectorGetX(pose.position), XMVectorGetY(pose.position), XMVectorGetZ(pose.position),
+					   XMVectorGetX(direction), XMVectorGetY(direction), XMVectorGetZ(direction));
+				for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+				{
+					ShadowCascade const &cascade = cascades.cascades[i];
+					ShadowCascade const &moved = movedCascades.cascades[i];
+
+					bool const isContaining = IsShadowCascadeContainingSlice(camera, cascade);
+
+					bool isSnapped = moved.texelSize == cascade.texelSize;
+					for (ShadowCascade const *snapped : {&cascade, &moved})
+					{
+						// The light view keeps the world origin at the light space origin, so it sits on the grid
+						float const originTexel =
+							(XMVectorGetX(XMVector3TransformCoord(XMVectorZero(), snapped->viewProj)) + 1.f) * 0.5f *
+							g_shadowCascadeResolution;
+						isSnapped &= std::abs(originTexel - std::round(originTexel)) < 1e-2f;
+					}
+
+					auto const cullStart = std::chrono::steady_clock::now();
+					CullBounds(CreateFrustum(cascade.viewProj), storage.opaqueBounds.bounds, visible);
+					cullMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - cullStart).count();
+					bool const isConservative = IsShadowCascadeCullingConservative(cascade, storage.opaqueBounds.bounds, visible);
+					bool const isCached = IsShadowCascadeCached(cache, cascade);
+					bool const isReprojected = !isCached || IsShadowCacheReprojectionExact(cache, cascade, storage.opaqueBounds.bounds);
+					CullShadowCascadeCasters(cache, cascade, storage.opaque, storage.opaqueBounds, true, casters);
+					bool const isSplit = IsShadowCasterListExact(storage, CreateFrustum(cascade.viewProj), !isCached, true, casters);
+
+					printf(" %5zu/%5zu%s", casters.meshes.size(), visible.size(), isCached ? "*" : " ");
+					if (!isContaining || !isSnapped || !isConservative || !isReprojected || !isSplit)
+					{
+						printf(" (cascade %u%s%s%s%s%s)", i,
+							   isContaining ? "" : ", misses the frustum slice",
+							   isSnapped ? "" : ", off the texel grid",
+							   isConservative ? "" : ", culled a caster",
+							   isReprojected ? "" : ", misreads the cache",
+							   isSplit ? "" : ", draws the wrong casters");
+					}
+					isCorrect &= isContaining && isSnapped && isConservative && isReprojected && isSplit;
+				}
+				printf(" of %zu, drawn/overlapping, * reads the cache\n", bounds.centerX.size());
+
+				MoveRenderObject(storage, 1, storage.opaque[1].transform);
+				bool const isCacheRedrawn = !UpdateShadowCache(cache, light, casterBounds, storage.staticRevision);
+				if (!isCacheRedrawn)
+				{
+					printf("Shadow cache kept after a static caster moved\n");
+				}
+				isCorrect &= isCacheRedrawn;
+				++frameCount;
+			}
+		}
+
+		printf("Per frame: fit %.4f ms, caster culling of %u cascades %.3f ms\n",
+			   fitMs / frameCount, g_shadowCascadeCount, cullMs / frameCount);
+
+		return isCorrect;
+	}
+
+} // namespace h2r
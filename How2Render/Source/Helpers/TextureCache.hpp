@@ -1,78 +1,377 @@
 #pragma once
 
 #include "Wrapper/Texture.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <filesystem>
-#include <map>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
 
 namespace h2r
 {
 
+	// Host textures are shared between the cache and every material that uses them, lookups never copy pixels
+	using HostTextureHandle = std::shared_ptr<HostTexture const>;
+	using HostTextureFuture = std::shared_future<HostTextureHandle>;
+	using HostTexturePromise = std::shared_ptr<std::promise<HostTextureHandle>>;
+
+	constexpr size_t g_textureCacheShardCount = 16;
+	constexpr uint64_t g_textureCacheDefaultHostBudget = 512ull * 1024 * 1024;
+
+	// A file loaded with other flags or into another format is another texture, same as in the file cache
+	struct TextureCacheKey
+	{
+		std::filesystem::path path;
+		uint32_t flags = 0;
+		DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+
+		bool operator==(TextureCacheKey const &) const = default;
+	};
+
+	struct TextureCacheKeyHash
+	{
+		size_t operator()(TextureCacheKey const &key) const
+		{
+			// Formats fit into a byte, both stay in the low bits the shard and the bucket are picked from
+			size_t const hash = std::filesystem::hash_value(key.path);
+			size_t const encoding = size_t(key.flags) << 8 | static_cast<uint32_t>(key.format);
+			return hash ^ (encoding + 0x9e3779b97f4a7c15ull + (hash << 6) + (hash >> 2));
+		}
+	};
+
+	inline TextureCacheKey GetTextureCacheKey(HostTexture const &texture)
+	{
+		return {texture.path, texture.loadFlags, texture.loadFormat};
+	}
+
+	struct TextureCacheEntry
+	{
+		HostTextureHandle hostTexture;
+		// Valid while some thread is decoding the texture, other requests for the same key wait on it
+		HostTextureFuture pendingHostTexture;
+		std::optional<DeviceTexture> deviceTexture;
+		uint64_t hostByteSize = 0;
+		uint64_t lastUseTick = 0;
+	};
+
+	struct TextureCacheShard
+	{
+		std::mutex mutex;
+		std::unordered_map<TextureCacheKey, TextureCacheEntry, TextureCacheKeyHash> entries;
+	};
+
+	struct TextureCacheStats
+	{
+		uint64_t hostHits = 0;
+		uint64_t hostMisses = 0;
+		uint64_t deviceHits = 0;
+		uint64_t deviceMisses = 0;
+		uint64_t hostBytes = 0;
+		uint64_t hostBudgetBytes = 0;
+		uint64_t evictions = 0;
+		uint64_t evictedBytes = 0;
+	};
+
+	// Keys are spread over independently locked shards, so concurrent loads rarely contend.
+	// Host pixels of textures that already live on the GPU are evicted in LRU order once the
+	// host budget is exceeded, textures that were not uploaded yet are never evicted.
 	struct TextureCache
 	{
-		std::map<std::filesystem::path, HostTexture> hostTextureMap;
-		std::map<std::filesystem::path, DeviceTexture> deviceTextureMap;
+		std::array<TextureCacheShard, g_textureCacheShardCount> shards;
+		std::atomic<uint64_t> tick = 0;
+		std::atomic<uint64_t> hostBudgetBytes = g_textureCacheDefaultHostBudget;
+		std::atomic<uint64_t> hostBytes = 0;
+		std::atomic<uint64_t> hostHits = 0;
+		std::atomic<uint64_t> hostMisses = 0;
+		std::atomic<uint64_t> deviceHits = 0;
+		std::atomic<uint64_t> deviceMisses = 0;
+		std::atomic<uint64_t> evictions = 0;
+		std::atomic<uint64_t> evictedBytes = 0;
+		std::mutex evictionMutex;
 	};
 
-	inline bool CacheHostTexture(TextureCache &cache, HostTexture texture)
+	inline TextureCacheShard &GetTextureCacheShard(TextureCache &cache, TextureCacheKey const &key)
 	{
-		return cache.hostTextureMap.emplace(texture.path, texture).second;
+		return cache.shards[TextureCacheKeyHash{}(key) % g_textureCacheShardCount];
 	}
 
-	inline bool CacheDeviceTexture(TextureCache &cache, DeviceTexture texture)
+	inline void EvictHostTextures(TextureCache &cache)
 	{
-		return cache.deviceTextureMap.emplace(texture.path, texture).second;
+		uint64_t const budget = cache.hostBudgetBytes;
+		if (cache.hostBytes <= budget)
+		{
+			return;
+		}
+
+		std::lock_guard evictionLock(cache.evictionMutex);
+
+		struct Candidate
+		{
+			uint64_t lastUseTick;
+			size_t shardIndex;
+			TextureCacheKey key;
+		};
+		std::vector<Candidate> candidates;
+		for (size_t i = 0; i < cache.shards.size(); ++i)
+		{
+			std::lock_guard lock(cache.shards[i].mutex);
+			for (auto const &[key, entry] : cache.shards[i].entries)
+			{
+				if (entry.hostTexture && entry.deviceTexture)
+				{
+					candidates.push_back({entry.lastUseTick, i, key});
+				}
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(), [](Candidate const &a, Candidate const &b) {
+			return a.lastUseTick < b.lastUseTick;
+		});
+
+		for (auto const &candidate : candidates)
+		{
+			if (cache.hostBytes <= budget)
+			{
+				break;
+			}
+
+			std::lock_guard lock(cache.shards[candidate.shardIndex].mutex);
+			auto &entries = cache.shards[candidate.shardIndex].entries;
+			auto it = entries.find(candidate.key);
+			if (it == entries.end() || !it->second.hostTexture)
+			{
+				continue;
+			}
+
+			// Materials that still hold the handle keep the pixels alive until they let go of it
+			cache.hostBytes -= it->second.hostByteSize;
+			cache.evictedBytes += it->second.hostByteSize;
+			cache.evictions++;
+			it->second.hostTexture.reset();
+			it->second.hostByteSize = 0;
+		}
 	}
 
-	inline bool HasCachedHostTexture(TextureCache const &cache, std::filesystem::path const &path)
+	inline void SetTextureCacheHostBudget(TextureCache &cache, uint64_t budgetBytes)
 	{
-		return cache.hostTextureMap.contains(path);
+		cache.hostBudgetBytes = budgetBytes;
+		EvictHostTextures(cache);
 	}
 
-	inline bool HasCachedDeviceTexture(TextureCache const &cache, std::filesystem::path const &path)
+	inline bool CacheHostTexture(TextureCache &cache, HostTextureHandle texture)
 	{
-		return cache.deviceTextureMap.contains(path);
+		TextureCacheKey const key = GetTextureCacheKey(*texture);
+		auto &shard = GetTextureCacheShard(cache, key);
+		{
+			std::lock_guard lock(shard.mutex);
+			auto &entry = shard.entries[key];
+			if (entry.hostTexture)
+			{
+				return false;
+			}
+			entry.hostByteSize = texture->pixels.size();
+			entry.lastUseTick = cache.tick++;
+			entry.hostTexture = std::move(texture);
+			cache.hostBytes += entry.hostByteSize;
+		}
+		EvictHostTextures(cache);
+
+		return true;
 	}
 
-	inline std::tuple<bool, HostTexture> FindCachedHostTexture(TextureCache const &cache, std::filesystem::path const &path)
+	inline bool CacheDeviceTexture(TextureCache &cache, TextureCacheKey const &key, DeviceTexture texture)
 	{
-		auto it = cache.hostTextureMap.find(path);
-		if (it != cache.hostTextureMap.end())
+		auto &shard = GetTextureCacheShard(cache, key);
 		{
-			return {true, it->second};
+			std::lock_guard lock(shard.mutex);
+			auto &entry = shard.entries[key];
+			if (entry.deviceTexture)
+			{
+				return false;
+			}
+			entry.deviceTexture = texture;
 		}
+		// The upload makes the host copy of this texture evictable
+		EvictHostTextures(cache);
 
-		return {false, HostTexture{}};
+		return true;
 	}
 
-	inline std::tuple<bool, DeviceTexture> FindCachedDeviceTexture(TextureCache const &cache, std::filesystem::path const &path)
+	inline bool HasCachedHostTexture(TextureCache &cache, TextureCacheKey const &key)
 	{
-		auto it = cache.deviceTextureMap.find(path);
-		if (it != cache.deviceTextureMap.end())
+		auto &shard = GetTextureCacheShard(cache, key);
+		std::lock_guard lock(shard.mutex);
+		auto it = shard.entries.find(key);
+		return it != shard.entries.end() && it->second.hostTexture;
+	}
+
+	inline bool HasCachedDeviceTexture(TextureCache &cache, TextureCacheKey const &key)
+	{
+		auto &shard = GetTextureCacheShard(cache, key);
+		std::lock_guard lock(shard.mutex);
+		auto it = shard.entries.find(key);
+		return it != shard.entries.end() && it->second.deviceTexture;
+	}
+
+	// Returns the future of the texture for key. The promise is only set for the first caller,
+	// which then has to decode the texture and hand the result to ResolveHostTexture.
+	inline std::tuple<HostTextureFuture, HostTexturePromise> ReserveHostTexture(
+		TextureCache &cache, TextureCacheKey const &key)
+	{
+		auto &shard = GetTextureCacheShard(cache, key);
+		std::lock_guard lock(shard.mutex);
+
+		auto &entry = shard.entries[key];
+		entry.lastUseTick = cache.tick++;
+		if (entry.hostTexture)
+		{
+			cache.hostHits++;
+			std::promise<HostTextureHandle> ready;
+			ready.set_value(entry.hostTexture);
+			return {ready.get_future().share(), nullptr};
+		}
+		if (entry.pendingHostTexture.valid())
+		{
+			cache.hostHits++;
+			return {entry.pendingHostTexture, nullptr};
+		}
+
+		cache.hostMisses++;
+		auto promise = std::make_shared<std::promise<HostTextureHandle>>();
+		entry.pendingHostTexture = promise->get_future().share();
+
+		return {entry.pendingHostTexture, promise};
+	}
+
+	// Failed loads are not cached, so a later request tries to decode the file again
+	inline void ResolveHostTexture(
+		TextureCache &cache, TextureCacheKey const &key, HostTexturePromise const &promise, HostTextureHandle texture)
+	{
+		auto &shard = GetTextureCacheShard(cache, key);
 		{
-			return {true, it->second};
+			std::lock_guard lock(shard.mutex);
+			auto &entry = shard.entries[key];
+			entry.pendingHostTexture = HostTextureFuture();
+			if (texture)
+			{
+				entry.hostTexture = texture;
+				entry.hostByteSize = texture->pixels.size();
+				cache.hostBytes += entry.hostByteSize;
+			}
 		}
+		promise->set_value(std::move(texture));
+
+		EvictHostTextures(cache);
+	}
+
+	inline HostTextureHandle FindCachedHostTexture(TextureCache &cache, TextureCacheKey const &key)
+	{
+		auto &shard = GetTextureCacheShard(cache, key);
+		std::lock_guard lock(shard.mutex);
 
+		auto it = shard.entries.find(key);
+		if (it != shard.entries.end() && it->second.hostTexture)
+		{
+			cache.hostHits++;
+			it->second.lastUseTick = cache.tick++;
+			return it->second.hostTexture;
+		}
+
+		cache.hostMisses++;
+		return nullptr;
+	}
+
+	inline std::tuple<bool, DeviceTexture> FindCachedDeviceTexture(TextureCache &cache, TextureCacheKey const &key)
+	{
+		auto &shard = GetTextureCacheShard(cache, key);
+		std::lock_guard lock(shard.mutex);
+
+		auto it = shard.entries.find(key);
+		if (it != shard.entries.end() && it->second.deviceTexture)
+		{
+			cache.deviceHits++;
+			it->second.lastUseTick = cache.tick++;
+			return {true, it->second.deviceTexture.value()};
+		}
+
+		cache.deviceMisses++;
 		return {false, DeviceTexture{}};
 	}
 
+	inline TextureCacheStats GetTextureCacheStats(TextureCache const &cache)
+	{
+		TextureCacheStats stats;
+		stats.hostHits = cache.hostHits;
+		stats.hostMisses = cache.hostMisses;
+		stats.deviceHits = cache.deviceHits;
+		stats.deviceMisses = cache.deviceMisses;
+		stats.hostBytes = cache.hostBytes;
+		stats.hostBudgetBytes = cache.hostBudgetBytes;
+		stats.evictions = cache.evictions;
+		stats.evictedBytes = cache.evictedBytes;
+
+		return stats;
+	}
+
+	inline void PrintTextureCacheStats(TextureCache const &cache)
+	{
+		auto const stats = GetTextureCacheStats(cache);
+		printf("Texture cache: host %llu hits / %llu misses, device %llu hits / %llu misses, "
+			   "host %.1f / %.1f MB, %llu evictions (%.1f MB)\n",
+			   static_cast<unsigned long long>(stats.hostHits),
+			   static_cast<unsigned long long>(stats.hostMisses),
+			   static_cast<unsigned long long>(stats.deviceHits),
+			   static_cast<unsigned long long>(stats.deviceMisses),
+			   double(stats.hostBytes) / (1024.0 * 1024.0),
+			   double(stats.hostBudgetBytes) / (1024.0 * 1024.0),
+			   static_cast<unsigned long long>(stats.evictions),
+			   double(stats.evictedBytes) / (1024.0 * 1024.0));
+	}
+
 	inline void FlushHostTextureCache(TextureCache &cache)
 	{
-		cache.hostTextureMap.clear();
+		for (auto &shard : cache.shards)
+		{
+			std::lock_guard lock(shard.mutex);
+			for (auto &[key, entry] : shard.entries)
+			{
+				cache.hostBytes -= entry.hostByteSize;
+				entry.hostTexture.reset();
+				entry.hostByteSize = 0;
+			}
+		}
 	}
 
 	inline void FlushDeviceTextureCache(TextureCache &cache)
 	{
-		for (auto &tex : cache.deviceTextureMap)
+		for (auto &shard : cache.shards)
 		{
-			CleanupDeviceTexture(tex.second);
+			std::lock_guard lock(shard.mutex);
+			for (auto &[key, entry] : shard.entries)
+			{
+				if (entry.deviceTexture)
+				{
+					CleanupDeviceTexture(entry.deviceTexture.value());
+					entry.deviceTexture.reset();
+				}
+			}
 		}
-		cache.deviceTextureMap.clear();
 	}
 
 	inline void FlushTextureCache(TextureCache &cache)
 	{
 		FlushHostTextureCache(cache);
 		FlushDeviceTextureCache(cache);
+		for (auto &shard : cache.shards)
+		{
+			std::lock_guard lock(shard.mutex);
+			shard.entries.clear();
+		}
 	}
 
-} // namespace h2r
\ No newline at end of file
+} // namespace h2r
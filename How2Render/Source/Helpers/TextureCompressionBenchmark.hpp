@@ -0,0 +1,247 @@
+#pragma once
+
+#include "Helpers/TextureCompressor.hpp"
+#include "Helpers/TextureLoader.hpp"
+#include "Random.hpp"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+
+namespace h2r
+{
+
+	struct BlockBitReader
+	{
+		uint8_t const *bytes = nullptr;
+		uint32_t position = 0;
+	};
+
+	inline uint32_t ReadBlockBits(BlockBitReader &reader, uint32_t bitCount)
+	{
+		uint32_t value = 0;
+		for (uint32_t i = 0; i < bitCount; ++i, ++reader.position)
+		{
+			value |= ((reader.bytes[reader.position / 8] >> (reader.position % 8)) & 1u) << i;
+		}
+		return value;
+	}
+
+	// BC3 color blocks always use the four color mode and leave alpha to the alpha block
+	inline void DecodeBc1Block(uint8_t const *in, std::array<std::array<uint8_t, 4>, 16> &texels, bool isBc3)
+	{
+		BlockBitReader reader{in, 0};
+		auto const color0 = static_cast<uint16_t>(ReadBlockBits(reader, 16));
+		auto const color1 = static_cast<uint16_t>(ReadBlockBits(reader, 16));
+		auto const c0 = ExpandRgb565(color0);
+		auto const c1 = ExpandRgb565(color1);
+		bool const isFourColor = isBc3 || color0 > color1;
+
+		std::array<std::array<float, 4>, 4> palette = {c0, c1};
+		for (uint32_t c = 0; c < 3; ++c)
+		{
+			palette[2][c] = isFourColor ? (2.f * c0[c] + c1[c]) / 3.f : (c0[c] + c1[c]) / 2.f;
+			palette[3][c] = isFourColor ? (c0[c] + 2.f * c1[c]) / 3.f : 0.f;
+		}
+		palette[2][3] = 255.f;
+		palette[3][3] = isFourColor ? 255.f : 0.f;
+
+		for (auto &texel : texels)
+		{
+			auto const &entry = palette[ReadBlockBits(reader, 2)];
+			for (uint32_t c = 0; c < (isBc3 ? 3u : 4u); ++c)
+			{
+				texel[c] = static_cast<uint8_t>(entry[c] + 0.5f);
+			}
+		}
+	}
+
+	inline void DecodeBc4Block(uint8_t const *in, std::array<std::array<uint8_t, 4>, 16> &texels, uint32_t channel)
+	{
+		BlockBitReader reader{in, 0};
+		uint32_t const red0 = ReadBlockBits(reader, 8);
+		uint32_t const red1 = ReadBlockBits(reader, 8);
+
+		std::array<float, 8> palette = {float(red0), float(red1)};
+		for (uint32_t i = 2; i < 8; ++i)
+		{
+			palette[i] = red0 > red1 ? ((8 - i) * red0 + (i - 1) * red1) / 7.f
+									 : (i < 6 ? ((6 - i) * red0 + (i - 1) * red1) / 5.f : (i == 6 ? 0.f : 255.f));
+		}
+
+		for (auto &texel : texels)
+		{
+			texel[channel] = static_cast<uint8_t>(palette[ReadBlockBits(reader, 3)] + 0.5f);
+		}
+	}
+
+	// Only mode 6 is decoded since that is the only mode the encoder emits
+	inline bool DecodeBc7Block(uint8_t const *in, std::array<std::array<uint8_t, 4>, 16> &texels)
+	{
+		BlockBitReader reader{in, 0};
+		if (ReadBlockBits(reader, 7) != (1 << 6))
+		{
+			return false;
+		}
+
+		std::array<uint32_t, 4> e0, e1;
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			e0[c] = ReadBlockBits(reader, 7) << 1;
+			e1[c] = ReadBlockBits(reader, 7) << 1;
+		}
+		uint32_t const p0 = ReadBlockBits(reader, 1);
+		uint32_t const p1 = ReadBlockBits(reader, 1);
+
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			uint32_t const weight = g_bc7Weights4[ReadBlockBits(reader, i == 0 ? 3 : 4)];
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				texels[i][c] = static_cast<uint8_t>(((64 - weight) * (e0[c] | p0) + weight * (e1[c] | p1) + 32) >> 6);
+			}
+		}
+		return true;
+	}
+
+	// Decodes the top level and returns the PSNR of the channels the format stores
+	inline double MeasureCompressionPsnr(HostTexture const &source, HostTexture const &compressed, eTextureCompression compression)
+	{
+		uint32_t const channelCount = compression == eTextureCompression::BC5 ? 2 : (compression == eTextureCompression::BC1 ? 3 : 4);
+		uint32_t const blockByteSize = static_cast<uint32_t>(BitsPerPixel(compressed.format) * 2);
+		uint32_t const blockColumns = source.width / 4;
+		uint32_t const blockRows = source.height / 4;
+
+		double squaredError = 0.0;
+		std::array<std::array<uint8_t, 4>, 16> texels = {};
+		for (uint32_t by = 0; by < blockRows; ++by)
+		{
+			for (uint32_t bx = 0; bx < blockColumns; ++bx)
+			{
+				uint8_t const *block = compressed.pixels.data() + (static_cast<size_t>(by) * blockColumns + bx) * blockByteSize;
+				switch (compression)
+				{
+				case eTextureCompression::BC1:
+					DecodeBc1Block(block, texels, false);
+					break;
+				case eTextureCompression::BC3:
+					DecodeBc4Block(block, texels, 3);
+					DecodeBc1Block(block + 8, texels, true);
+					break;
+				case eTextureCompression::BC5:
+					DecodeBc4Block(block, texels, 0);
+					DecodeBc4Block(block + 8, texels, 1);
+					break;
+				case eTextureCompression::BC7:
+					DecodeBc7Block(block, texels);
+					break;
+				default:
+					assert(true);
+				}
+
+				for (uint32_t i = 0; i < 16; ++i)
+				{
+					uint32_t const x = bx * 4 + i % 4;
+					uint32_t const y = by * 4 + i / 4;
+					uint8_t const *original = source.pixels.data() + (static_cast<size_t>(y) * source.width + x) * 4;
+					for (uint32_t c = 0; c < channelCount; ++c)
+					{
+						double const d = double(texels[i][c]) - double(original[c]);
+						squaredError += d * d;
+					}
+				}
+			}
+		}
+
+		double const mse = squaredError / (double(source.width) * source.height * channelCount);
+		return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+	}
+
+	// Smooth gradients with some detail and noise, a stand in when no image is given
+	inline HostTexture CreateCompressionBenchmarkTexture(uint32_t size)
+	{
+		std::vector<uint8_t> pixels(static_cast<size_t>(size) * size * 4);
+		splitmix random(7);
+		for (uint32_t y = 0; y < size; ++y)
+		{
+			for (uint32_t x = 0; x < size; ++x)
+			{
+				float const u = float(x) / size;
+				float const v = float(y) / size;
+				float const detail = 0.5f + 0.5f * std::sin(u * 40.f) * std::cos(v * 23.f);
+				uint8_t *texel = pixels.data() + (static_cast<size_t>(y) * size + x) * 4;
+				texel[0] = static_cast<uint8_t>(std::clamp(255.f * u * detail + float(random() % 9) - 4.f, 0.f, 255.f));
+				texel[1] = static_cast<uint8_t>(std::clamp(255.f * v + float(random() % 9) - 4.f, 0.f, 255.f));
+				texel[2] = static_cast<uint8_t>(255.f * detail);
+				texel[3] = static_cast<uint8_t>(255.f * (1.f - u * v));
+			}
+		}
+
+		HostTexture::Descriptor desc;
+		desc.path = L"CompressionBenchmark";
+		desc.pixels = pixels.data();
+		desc.width = size;
+		desc.height = size;
+		desc.format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+		return CreateHostTexture(desc);
+	}
+
+	// Compresses the image at path, or a generated 2048x2048 image, to every supported format on one
+	// and on all threads. Reports throughput and the PSNR of the top level.
+	inline bool BenchmarkTextureCompression(std::filesystem::path const &path)
+	{
+		HostTextureHandle source;
+		if (path.empty())
+		{
+			source = std::make_shared<HostTexture>(CreateCompressionBenchmarkTexture(2048));
+		}
+		else
+		{
+			source = DecodeTextureFile(path, 0, DXGI_FORMAT_R8G8B8A8_UNORM, GetDefaultThreadCount());
+		}
+		if (!source || source->width % 4 != 0 || source->height % 4 != 0)
+		{
+			wprintf(L"Texture %s can not be block compressed\n", path.c_str());
+			return false;
+		}
+
+		struct Run
+		{
+			char const *name;
+			eTextureCompression compression;
+		};
+		std::array<Run, 4> const runs = {{
+			{"BC1", eTextureCompression::BC1},
+			{"BC3", eTextureCompression::BC3},
+			{"BC5", eTextureCompression::BC5},
+			{"BC7", eTextureCompression::BC7},
+		}};
+
+		double const megaPixels = double(source->width) * source->height / 1e6;
+		for (auto const &run : runs)
+		{
+			for (uint32_t threadCount : {1u, GetDefaultThreadCount()})
+			{
+				auto const start = std::chrono::steady_clock::now();
+				auto const compressed = CompressHostTexture(*source, run.compression, threadCount);
+				double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				if (!compressed)
+				{
+					return false;
+				}
+
+				printf("%s %ux%u %2u threads: %9.2f ms, %7.2f MPix/s, PSNR %.2f dB\n",
+					   run.name, source->width, source->height, threadCount, ms, megaPixels / (std::max(ms, 1e-3) / 1000.0),
+					   MeasureCompressionPsnr(*source, compressed.value(), run.compression));
+
+				if (GetDefaultThreadCount() == 1)
+				{
+					break;
+				}
+			}
+		}
+
+		return true;
+	}
+
+} // namespace h2r
@@ -0,0 +1,686 @@
+#pragma once
+
+#include "Helpers/Parallel.hpp"
+#include "Wrapper/Texture.hpp"
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_AMD64) || defined(__x86_64__)
+#define H2R_BLOCK_COMPRESSION_SIMD 1
+#include <immintrin.h>
+#else
+#define H2R_BLOCK_COMPRESSION_SIMD 0
+#endif
+
+namespace h2r
+{
+
+	// Block rows handed to one compression job
+	constexpr uint32_t g_compressionBandBlockRows = 8;
+	constexpr uint32_t g_compressionRefineIterations = 2;
+
+	enum class eTextureCompression : uint8_t
+	{
+		None,
+		// RGB, 4 bpp
+		BC1,
+		// RGB plus interpolated alpha, 8 bpp
+		BC3,
+		// Two independent channels for normal maps, 8 bpp
+		BC5,
+		// RGBA with 16 index levels, 8 bpp
+		BC7
+	};
+
+	// Channels of a 4x4 block stored as planes, so the SIMD paths handle four texels per instruction
+	struct ColorBlock
+	{
+		alignas(16) std::array<std::array<float, 16>, 4> channels;
+	};
+
+	inline DXGI_FORMAT GetCompressedFormat(DXGI_FORMAT format, eTextureCompression compression);
+
+	inline std::optional<HostTexture> CompressHostTexture(
+		HostTexture const &texture, eTextureCompression compression, uint32_t threadCount);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline DXGI_FORMAT GetCompressedFormat(DXGI_FORMAT format, eTextureCompression compression)
+	{
+		bool const isSrgb = format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+		switch (compression)
+		{
+		case eTextureCompression::BC1:
+			return isSrgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+		case eTextureCompression::BC3:
+			return isSrgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+		case eTextureCompression::BC5:
+			return DXGI_FORMAT_BC5_UNORM;
+		case eTextureCompression::BC7:
+			return isSrgb ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+		default:
+			assert(true);
+		}
+
+		return DXGI_FORMAT_UNKNOWN;
+	}
+
+	// Texels past the edge of small mips repeat the last row and column
+	inline void LoadColorBlock(
+		uint8_t const *pixels, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, ColorBlock &block)
+	{
+		for (uint32_t y = 0; y < 4; ++y)
+		{
+			uint32_t const row = std::min(blockY * 4 + y, height - 1);
+			for (uint32_t x = 0; x < 4; ++x)
+			{
+				uint32_t const column = std::min(blockX * 4 + x, width - 1);
+				uint8_t const *texel = pixels + (static_cast<size_t>(row) * width + column) * 4;
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					block.channels[c][y * 4 + x] = texel[c];
+				}
+			}
+		}
+	}
+
+	inline float SumOfProducts16(float const *a, float const *b)
+	{
+#if H2R_BLOCK_COMPRESSION_SIMD
+		__m128 sum = _mm_mul_ps(_mm_load_ps(a), _mm_load_ps(b));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(a + 4), _mm_load_ps(b + 4)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(a + 8), _mm_load_ps(b + 8)));
+		sum = _mm_add_ps(sum, _mm_mul_ps(_mm_load_ps(a + 12), _mm_load_ps(b + 12)));
+		sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+		sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+		return _mm_cvtss_f32(sum);
+#else
+		float sum = 0.f;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			sum += a[i] * b[i];
+		}
+		return sum;
+#endif
+	}
+
+	// dst = src - offset
+	inline void Subtract16(float *dst, float const *src, float offset)
+	{
+#if H2R_BLOCK_COMPRESSION_SIMD
+		__m128 const o = _mm_set1_ps(offset);
+		for (uint32_t i = 0; i < 16; i += 4)
+		{
+			_mm_store_ps(dst + i, _mm_sub_ps(_mm_load_ps(src + i), o));
+		}
+#else
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			dst[i] = src[i] - offset;
+		}
+#endif
+	}
+
+	// dst += src * scale
+	inline void MultiplyAdd16(float *dst, float const *src, float scale)
+	{
+#if H2R_BLOCK_COMPRESSION_SIMD
+		__m128 const s = _mm_set1_ps(scale);
+		for (uint32_t i = 0; i < 16; i += 4)
+		{
+			_mm_store_ps(dst + i, _mm_add_ps(_mm_load_ps(dst + i), _mm_mul_ps(_mm_load_ps(src + i), s)));
+		}
+#else
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			dst[i] += src[i] * scale;
+		}
+#endif
+	}
+
+	inline void MinMax16(float const *values, float &minValue, float &maxValue)
+	{
+#if H2R_BLOCK_COMPRESSION_SIMD
+		__m128 lo = _mm_load_ps(values);
+		__m128 hi = lo;
+		for (uint32_t i = 4; i < 16; i += 4)
+		{
+			__m128 const v = _mm_load_ps(values + i);
+			lo = _mm_min_ps(lo, v);
+			hi = _mm_max_ps(hi, v);
+		}
+		lo = _mm_min_ps(lo, _mm_movehl_ps(lo, lo));
+		hi = _mm_max_ps(hi, _mm_movehl_ps(hi, hi));
+		minValue = _mm_cvtss_f32(_mm_min_ss(lo, _mm_shuffle_ps(lo, lo, 1)));
+		maxValue = _mm_cvtss_f32(_mm_max_ss(hi, _mm_shuffle_ps(hi, hi, 1)));
+#else
+		minValue = maxValue = values[0];
+		for (uint32_t i = 1; i < 16; ++i)
+		{
+			minValue = std::min(minValue, values[i]);
+			maxValue = std::max(maxValue, values[i]);
+		}
+#endif
+	}
+
+	// Picks the nearest palette entry for every texel, returns the summed squared error
+	inline float FindNearestPaletteIndices(
+		ColorBlock const &block,
+		uint32_t channelCount,
+		std::array<std::array<float, 4>, 16> const &palette,
+		uint32_t paletteSize,
+		std::array<uint8_t, 16> &indices)
+	{
+#if H2R_BLOCK_COMPRESSION_SIMD
+		__m128 bestError[4] = {_mm_set1_ps(FLT_MAX), _mm_set1_ps(FLT_MAX), _mm_set1_ps(FLT_MAX), _mm_set1_ps(FLT_MAX)};
+		__m128 bestIndex[4] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+
+		for (uint32_t p = 0; p < paletteSize; ++p)
+		{
+			__m128 const index = _mm_set1_ps(static_cast<float>(p));
+			for (uint32_t i = 0; i < 4; ++i)
+			{
+				__m128 error = _mm_setzero_ps();
+				for (uint32_t c = 0; c < channelCount; ++c)
+				{
+					__m128 const d = _mm_sub_ps(_mm_load_ps(block.channels[c].data() + i * 4), _mm_set1_ps(palette[p][c]));
+					error = _mm_add_ps(error, _mm_mul_ps(d, d));
+				}
+				__m128 const isBetter = _mm_cmplt_ps(error, bestError[i]);
+				bestError[i] = _mm_min_ps(error, bestError[i]);
+				bestIndex[i] = _mm_or_ps(_mm_and_ps(isBetter, index), _mm_andnot_ps(isBetter, bestIndex[i]));
+			}
+		}
+
+		alignas(16) std::array<float, 16> errors;
+		alignas(16) std::array<float, 16> bestIndices;
+		for (uint32_t i = 0; i < 4; ++i)
+		{
+			_mm_store_ps(errors.data() + i * 4, bestError[i]);
+			_mm_store_ps(bestIndices.data() + i * 4, bestIndex[i]);
+		}
+
+		float totalError = 0.f;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			indices[i] = static_cast<uint8_t>(bestIndices[i]);
+			totalError += errors[i];
+		}
+		return totalError;
+#else
+		float totalError = 0.f;
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float bestError = FLT_MAX;
+			for (uint32_t p = 0; p < paletteSize; ++p)
+			{
+				float error = 0.f;
+				for (uint32_t c = 0; c < channelCount; ++c)
+				{
+					float const d = block.channels[c][i] - palette[p][c];
+					error += d * d;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					indices[i] = static_cast<uint8_t>(p);
+				}
+			}
+			totalError += bestError;
+		}
+		return totalError;
+#endif
+	}
+
+	// Endpoints at the extents of the block along its principal axis, found by power iteration
+	// on the covariance matrix of the channels
+	inline void FindPrincipalEndpoints(
+		ColorBlock const &block, uint32_t channelCount, std::array<float, 4> &endpoint0, std::array<float, 4> &endpoint1)
+	{
+		alignas(16) std::array<std::array<float, 16>, 4> centered;
+		std::array<float, 4> mean = {};
+		alignas(16) static constexpr std::array<float, 16> ones = {
+			1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f, 1.f};
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			mean[c] = SumOfProducts16(block.channels[c].data(), ones.data()) / 16.f;
+			Subtract16(centered[c].data(), block.channels[c].data(), mean[c]);
+		}
+
+		std::array<std::array<float, 4>, 4> covariance = {};
+		for (uint32_t i = 0; i < channelCount; ++i)
+		{
+			for (uint32_t j = i; j < channelCount; ++j)
+			{
+				covariance[i][j] = covariance[j][i] = SumOfProducts16(centered[i].data(), centered[j].data());
+			}
+		}
+
+		// Starting from the channel with the largest variance never starts orthogonal to the principal axis
+		uint32_t largestVariance = 0;
+		for (uint32_t c = 1; c < channelCount; ++c)
+		{
+			largestVariance = covariance[c][c] > covariance[largestVariance][largestVariance] ? c : largestVariance;
+		}
+		std::array<float, 4> axis = covariance[largestVariance];
+		if (covariance[largestVariance][largestVariance] < 1e-6f)
+		{
+			axis = {1.f, 1.f, 1.f, 1.f};
+		}
+		for (uint32_t iteration = 0; iteration < 8; ++iteration)
+		{
+			std::array<float, 4> next = {};
+			float length = 0.f;
+			for (uint32_t i = 0; i < channelCount; ++i)
+			{
+				for (uint32_t j = 0; j < channelCount; ++j)
+				{
+					next[i] += covariance[i][j] * axis[j];
+				}
+				length = std::max(length, std::abs(next[i]));
+			}
+			if (length < 1e-6f)
+			{
+				break;
+			}
+			for (uint32_t i = 0; i < channelCount; ++i)
+			{
+				axis[i] = next[i] / length;
+			}
+		}
+
+		float axisLengthSq = 0.f;
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			axisLengthSq += axis[c] * axis[c];
+		}
+
+		alignas(16) std::array<float, 16> projection = {};
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			MultiplyAdd16(projection.data(), centered[c].data(), axis[c] / axisLengthSq);
+		}
+		float minT, maxT;
+		MinMax16(projection.data(), minT, maxT);
+
+		for (uint32_t c = 0; c < channelCount; ++c)
+		{
+			endpoint0[c] = std::clamp(mean[c] + axis[c] * minT, 0.f, 255.f);
+			endpoint1[c] = std::clamp(mean[c] + axis[c] * maxT, 0.f, 255.f);
+		}
+	}
+
+	// Least squares endpoints for fixed indices, weights[i] is how far texel i sits towards endpoint1
+	inline bool RefineEndpoints(
+		ColorBlock const &block,
+		uint32_t channelCount,
+		std::array<float, 16> const &weights,
+		std::array<float, 4> &endpoint0,
+		std::array<float, 4> &endpoint1)
+	{
+		float a = 0.f, b = 0.f, c = 0.f;
+		std::array<float, 4> d = {};
+		std::array<float, 4> e = {};
+		for (uint32_t i = 0; i < 16; ++i)
+		{
+			float const w = weights[i];
+			a += (1.f - w) * (1.f - w);
+			b += w * (1.f - w);
+			c += w * w;
+			for (uint32_t ch = 0; ch < channelCount; ++ch)
+			{
+				d[ch] += (1.f - w) * block.channels[ch][i];
+				e[ch] += w * block.channels[ch][i];
+			}
+		}
+
+		float const determinant = a * c - b * b;
+		if (std::abs(determinant) < 1e-6f)
+		{
+			return false;
+		}
+
+		for (uint32_t ch = 0; ch < channelCount; ++ch)
+		{
+			endpoint0[ch] = std::clamp((c * d[ch] - b * e[ch]) / determinant, 0.f, 255.f);
+			endpoint1[ch] = std::clamp((a * e[ch] - b * d[ch]) / determinant, 0.f, 255.f);
+		}
+		return true;
+	}
+
+	struct BlockBitWriter
+	{
+		uint8_t *bytes = nullptr;
+		uint32_t position = 0;
+	};
+
+	inline void WriteBlockBits(BlockBitWriter &writer, uint32_t value, uint32_t bitCount)
+	{
+		for (uint32_t i = 0; i < bitCount; ++i, ++writer.position)
+		{
+			uint8_t const bit = static_cast<uint8_t>((value >> i) & 1);
+			writer.bytes[writer.position / 8] |= bit << (writer.position % 8);
+		}
+	}
+
+	inline uint16_t QuantizeRgb565(std::array<float, 4> const &color)
+	{
+		auto const r = static_cast<uint16_t>(std::lround(color[0] * 31.f / 255.f));
+		auto const g = static_cast<uint16_t>(std::lround(color[1] * 63.f / 255.f));
+		auto const b = static_cast<uint16_t>(std::lround(color[2] * 31.f / 255.f));
+		return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	inline std::array<float, 4> ExpandRgb565(uint16_t color)
+	{
+		uint32_t const r = (color >> 11) & 31;
+		uint32_t const g = (color >> 5) & 63;
+		uint32_t const b = color & 31;
+		return {float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)), float((b << 3) | (b >> 2)), 255.f};
+	}
+
+	// Always emits the four color mode, which is also the only mode BC3 color blocks support
+	inline void EncodeBc1Block(ColorBlock const &block, uint8_t *out)
+	{
+		std::array<float, 4> endpoint0 = {}, endpoint1 = {};
+		FindPrincipalEndpoints(block, 3, endpoint0, endpoint1);
+
+		float bestError = FLT_MAX;
+		uint16_t bestColor0 = 0, bestColor1 = 0;
+		std::array<uint8_t, 16> bestIndices = {};
+		for (uint32_t iteration = 0; iteration < g_compressionRefineIterations; ++iteration)
+		{
+			uint16_t color0 = QuantizeRgb565(endpoint1);
+			uint16_t color1 = QuantizeRgb565(endpoint0);
+			if (color0 < color1)
+			{
+				std::swap(color0, color1);
+			}
+
+			auto const c0 = ExpandRgb565(color0);
+			auto const c1 = ExpandRgb565(color1);
+			std::array<std::array<float, 4>, 16> palette;
+			palette[0] = c0;
+			palette[1] = c1;
+			for (uint32_t c = 0; c < 3; ++c)
+			{
+				palette[2][c] = (2.f * c0[c] + c1[c]) / 3.f;
+				palette[3][c] = (c0[c] + 2.f * c1[c]) / 3.f;
+			}
+
+			std::array<uint8_t, 16> indices;
+			uint32_t const paletteSize = color0 == color1 ? 1 : 4;
+			float const error = FindNearestPaletteIndices(block, 3, palette, paletteSize, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				bestColor0 = color0;
+				bestColor1 = color1;
+				bestIndices = indices;
+			}
+			if (paletteSize == 1)
+			{
+				break;
+			}
+
+			static constexpr std::array<float, 4> indexWeights = {0.f, 1.f, 1.f / 3.f, 2.f / 3.f};
+			std::array<float, 16> weights;
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				weights[i] = indexWeights[indices[i]];
+			}
+			if (!RefineEndpoints(block, 3, weights, endpoint1, endpoint0))
+			{
+				break;
+			}
+		}
+
+		std::fill(out, out + 8, uint8_t(0));
+		BlockBitWriter writer{out, 0};
+		WriteBlockBits(writer, bestColor0, 16);
+		WriteBlockBits(writer, bestColor1, 16);
+		for (uint8_t index : bestIndices)
+		{
+			WriteBlockBits(writer, index, 2);
+		}
+	}
+
+	// Single channel block with eight interpolated levels, used for BC3 alpha and both BC5 channels
+	inline void EncodeBc4Block(ColorBlock const &block, uint32_t channel, uint8_t *out)
+	{
+		float minValue, maxValue;
+		MinMax16(block.channels[channel].data(), minValue, maxValue);
+		auto const red0 = static_cast<uint8_t>(maxValue);
+		auto const red1 = static_cast<uint8_t>(minValue);
+
+		std::array<std::array<float, 4>, 16> palette = {};
+		palette[0][0] = red0;
+		palette[1][0] = red1;
+		for (uint32_t i = 2; i < 8; ++i)
+		{
+			palette[i][0] = ((8 - i) * red0 + (i - 1) * red1) / 7.f;
+		}
+
+		ColorBlock single;
+		single.channels[0] = block.channels[channel];
+		std::array<uint8_t, 16> indices;
+		FindNearestPaletteIndices(single, 1, palette, red0 == red1 ? 1 : 8, indices);
+
+		std::fill(out, out + 8, uint8_t(0));
+		BlockBitWriter writer{out, 0};
+		WriteBlockBits(writer, red0, 8);
+		WriteBlockBits(writer, red1, 8);
+		for (uint8_t index : indices)
+		{
+			WriteBlockBits(writer, index, 3);
+		}
+	}
+
+	constexpr std::array<uint32_t, 16> g_bc7Weights4 = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+	// Mode 6 endpoints are 7 bits per channel plus one shared low bit per endpoint
+	inline std::array<uint32_t, 4> QuantizeBc7Mode6Endpoint(std::array<float, 4> const &endpoint, uint32_t &pBit)
+	{
+		float bestError = FLT_MAX;
+		std::array<uint32_t, 4> best = {};
+		for (uint32_t p = 0; p < 2; ++p)
+		{
+			std::array<uint32_t, 4> quantized;
+			float error = 0.f;
+			for (uint32_t c = 0; c < 4; ++c)
+			{
+				quantized[c] = static_cast<uint32_t>(std::clamp(std::lround((endpoint[c] - p) / 2.f), 0l, 127l));
+				float const d = float((quantized[c] << 1) | p) - endpoint[c];
+				error += d * d;
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				best = quantized;
+				pBit = p;
+			}
+		}
+
+		return best;
+	}
+
+	// Encodes every block with mode 6, a single RGBA subset with 4 bit indices
+	inline void EncodeBc7Block(ColorBlock const &block, uint8_t *out)
+	{
+		std::array<float, 4> endpoint0 = {}, endpoint1 = {};
+		FindPrincipalEndpoints(block, 4, endpoint0, endpoint1);
+
+		float bestError = FLT_MAX;
+		std::array<uint32_t, 4> best0 = {}, best1 = {};
+		uint32_t bestP0 = 0, bestP1 = 0;
+		std::array<uint8_t, 16> bestIndices = {};
+		for (uint32_t iteration = 0; iteration < g_compressionRefineIterations; ++iteration)
+		{
+			uint32_t p0 = 0, p1 = 0;
+			auto const q0 = QuantizeBc7Mode6Endpoint(endpoint0, p0);
+			auto const q1 = QuantizeBc7Mode6Endpoint(endpoint1, p1);
+
+			std::array<std::array<float, 4>, 16> palette;
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				for (uint32_t c = 0; c < 4; ++c)
+				{
+					uint32_t const e0 = (q0[c] << 1) | p0;
+					uint32_t const e1 = (q1[c] << 1) | p1;
+					palette[i][c] = float(((64 - g_bc7Weights4[i]) * e0 + g_bc7Weights4[i] * e1 + 32) >> 6);
+				}
+			}
+
+			std::array<uint8_t, 16> indices;
+			float const error = FindNearestPaletteIndices(block, 4, palette, 16, indices);
+			if (error < bestError)
+			{
+				bestError = error;
+				best0 = q0;
+				best1 = q1;
+				bestP0 = p0;
+				bestP1 = p1;
+				bestIndices = indices;
+			}
+
+			std::array<float, 16> weights;
+			for (uint32_t i = 0; i < 16; ++i)
+			{
+				weights[i] = g_bc7Weights4[indices[i]] / 64.f;
+			}
+			if (!RefineEndpoints(block, 4, weights, endpoint0, endpoint1))
+			{
+				break;
+			}
+		}
+
+		// The most significant bit of the first index is implied to be zero
+		if (bestIndices[0] & 8)
+		{
+			std::swap(best0, best1);
+			std::swap(bestP0, bestP1);
+			for (uint8_t &index : bestIndices)
+			{
+				index = static_cast<uint8_t>(15 - index);
+			}
+		}
+
+		std::fill(out, out + 16, uint8_t(0));
+		BlockBitWriter writer{out, 0};
+		WriteBlockBits(writer, 1 << 6, 7);
+		for (uint32_t c = 0; c < 4; ++c)
+		{
+			WriteBlockBits(writer, best0[c], 7);
+			WriteBlockBits(writer, best1[c], 7);
+		}
+		WriteBlockBits(writer, bestP0, 1);
+		WriteBlockBits(writer, bestP1, 1);
+		WriteBlockBits(writer, bestIndices[0], 3);
+		for (uint32_t i = 1; i < 16; ++i)
+		{
+			WriteBlockBits(writer, bestIndices[i], 4);
+		}
+	}
+
+	inline void EncodeBlock(ColorBlock const &block, eTextureCompression compression, uint8_t *out)
+	{
+		switch (compression)
+		{
+		case eTextureCompression::BC1:
+			EncodeBc1Block(block, out);
+			break;
+		case eTextureCompression::BC3:
+			EncodeBc4Block(block, 3, out);
+			EncodeBc1Block(block, out + 8);
+			break;
+		case eTextureCompression::BC5:
+			EncodeBc4Block(block, 0, out);
+			EncodeBc4Block(block, 1, out + 8);
+			break;
+		case eTextureCompression::BC7:
+			EncodeBc7Block(block, out);
+			break;
+		default:
+			assert(true);
+		}
+	}
+
+	// Compresses every mip level of an R8G8B8A8 texture. Returns nullopt for other formats and
+	// for textures whose size is not a multiple of the block size, which D3D11 does not accept.
+	inline std::optional<HostTexture> CompressHostTexture(
+		HostTexture const &texture, eTextureCompression compression, uint32_t threadCount)
+	{
+		if (compression == eTextureCompression::None || texture.pixels.empty() ||
+			(texture.format != DXGI_FORMAT_R8G8B8A8_UNORM && texture.format != DXGI_FORMAT_R8G8B8A8_UNORM_SRGB) ||
+			texture.width % 4 != 0 || texture.height % 4 != 0)
+		{
+			return std::nullopt;
+		}
+
+		HostTexture result;
+		result.path = texture.path;
+		result.loadFlags = texture.loadFlags;
+		result.loadFormat = texture.loadFormat;
+		result.format = GetCompressedFormat(texture.format, compression);
+		result.width = texture.width;
+		result.height = texture.height;
+
+		uint32_t byteOffset = 0;
+		for (auto const &mip : texture.mipChain)
+		{
+			HostTexture::MipLevel level = mip;
+			level.byteSize = SurfaceByteSize(result.format, mip.width, mip.height);
+			level.byteOffset = byteOffset;
+			byteOffset += level.byteSize;
+			result.mipChain.push_back(level);
+		}
+		result.pixels.resize(byteOffset);
+
+		struct Band
+		{
+			size_t level;
+			uint32_t blockRowBegin;
+			uint32_t blockRowEnd;
+		};
+		std::vector<Band> bands;
+		for (size_t i = 0; i < result.mipChain.size(); ++i)
+		{
+			uint32_t const blockRows = (result.mipChain[i].height + 3) / 4;
+			for (uint32_t row = 0; row < blockRows; row += g_compressionBandBlockRows)
+			{
+				bands.push_back({i, row, std::min(row + g_compressionBandBlockRows, blockRows)});
+			}
+		}
+
+		uint32_t const blockByteSize = static_cast<uint32_t>(BitsPerPixel(result.format) * 2);
+		ParallelFor(threadCount, bands.size(), [&](uint64_t bandIndex) {
+			auto const &band = bands[bandIndex];
+			auto const &srcMip = texture.mipChain[band.level];
+			auto const &dstMip = result.mipChain[band.level];
+			uint8_t const *src = texture.pixels.data() + srcMip.byteOffset;
+			uint8_t *dst = result.pixels.data() + dstMip.byteOffset;
+			uint32_t const blockColumns = (srcMip.width + 3) / 4;
+
+			ColorBlock block;
+			for (uint32_t by = band.blockRowBegin; by < band.blockRowEnd; ++by)
+			{
+				for (uint32_t bx = 0; bx < blockColumns; ++bx)
+				{
+					LoadColorBlock(src, srcMip.width, srcMip.height, bx, by, block);
+					EncodeBlock(block, compression, dst + (static_cast<size_t>(by) * blockColumns + bx) * blockByteSize);
+				}
+			}
+		});
+
+		return result;
+	}
+
+} // namespace h2r
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "Helpers/ImageAllocator.hpp"
+#include "Helpers/TextureLoader.hpp"
+#include <chrono>
+#include <cstdio>
+#include <functional>
+
+namespace h2r
+{
+
+	// The original decode path, kept as the baseline for BenchmarkTextureDecode. The decoded image is
+	// copied into the texture and copied again when GenerateMipmap grows the allocation to the full chain.
+	inline HostTextureHandle DecodeTextureFileReference(std::filesystem::path const &path, DXGI_FORMAT format)
+	{
+		stbi_set_flip_vertically_on_load_thread(1);
+
+		int32_t width, height, comp;
+		auto *pixels = stbi_load(path.string().c_str(), &width, &height, &comp, STBI_rgb_alpha);
+		if (!pixels)
+		{
+			return nullptr;
+		}
+
+		HostTexture::Descriptor desc;
+		desc.path = path;
+		desc.pixels = (uint8_t *)pixels;
+		desc.width = width;
+		desc.height = height;
+		desc.format = format;
+
+		auto hostTexture = std::make_shared<HostTexture>(CreateHostTexture(desc));
+		uint64_t const imageByteSize = hostTexture->pixels.size();
+		TrackImageAllocation(imageByteSize);
+		stbi_image_free(desc.pixels);
+
+		// resize allocates the chain while level 0 is still alive, then releases level 0
+		TrackImageAllocation(CalculateMipChainByteSize(CalculateMipChain(*hostTexture)));
+		GenerateMipmap(*hostTexture, 1);
+		TrackImageFree(imageByteSize);
+		TrackImageFree(hostTexture->pixels.size());
+
+		return hostTexture;
+	}
+
+	// Decodes and mips the image at path with the original and the in place path. Reports the best time
+	// of several runs, the heap allocations made for pixels and their peak size, and checks both agree.
+	inline bool BenchmarkTextureDecode(std::filesystem::path const &path)
+	{
+		constexpr uint32_t runCount = 5;
+		constexpr DXGI_FORMAT format = DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+
+		using Decode = std::function<HostTextureHandle()>;
+		auto const measure = [](char const *name, Decode const &decode, HostTextureHandle &result) {
+			double bestMs = 0.0;
+			ImageAllocationStats stats;
+			for (uint32_t run = 0; run < runCount; ++run)
+			{
+				GetImageAllocationStats() = ImageAllocationStats{};
+				auto const start = std::chrono::steady_clock::now();
+				result = decode();
+				double const ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				bestMs = run == 0 ? ms : std::min(bestMs, ms);
+				stats = GetImageAllocationStats();
+			}
+			if (result)
+			{
+				double const imageByteSize = result->mipChain.front().byteSize;
+				printf("Decode %ux%u %-9s: %8.2f ms, %2llu allocations, peak %7.2f MB (%.2fx level 0)\n",
+					   result->width, result->height, name, bestMs,
+					   static_cast<unsigned long long>(stats.allocationCount),
+					   stats.peakByteSize / (1024.0 * 1024.0), stats.peakByteSize / imageByteSize);
+			}
+		};
+
+		HostTextureHandle reference;
+		measure("reference", [&]() {
+			return DecodeTextureFileReference(path, format);
+		}, reference);
+
+		HostTextureHandle inPlace;
+		measure("in place", [&]() {
+			return DecodeTextureFile(path, TEX_LOAD_FLAG_FLIP_VERTICALLY | TEX_LOAD_FLAG_GEN_CPU_MIPMAP, format, 1);
+		}, inPlace);
+
+		if (!reference || !inPlace)
+		{
+			wprintf(L"Failed to decode texture %s\n", path.c_str());
+			return false;
+		}
+
+		bool const isMatching = reference->pixels == inPlace->pixels;
+		if (!isMatching)
+		{
+			printf("In place decode differs from the reference decode\n");
+		}
+
+		return isMatching;
+	}
+
+} // namespace h2r
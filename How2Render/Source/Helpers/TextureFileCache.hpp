@@ -0,0 +1,262 @@
+#pragma once
+
+#include "Helpers/BinaryFile.hpp"
+#include "Helpers/MipmapGenerator.hpp"
+#include "Wrapper/Texture.hpp"
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+
+namespace h2r
+{
+
+	constexpr uint32_t g_textureFileCacheMagic = 0x54523248; // "H2RT"
+	constexpr uint32_t g_textureFileCacheVersion = 1;
+
+	// Cached textures are plain DDS files with the DX10 extension header, so they open in any DDS viewer.
+	// The flags and the requested format are part of the file name since they change the cached pixels.
+	inline std::filesystem::path GetTextureFileCachePath(
+		std::filesystem::path const &sourcePath, uint32_t flags, DXGI_FORMAT format);
+
+	inline std::optional<HostTexture> ReadTextureFileCache(
+		std::filesystem::path const &sourcePath, uint32_t flags, DXGI_FORMAT format);
+
+	inline bool WriteTextureFileCache(
+		std::filesystem::path const &sourcePath, uint32_t flags, DXGI_FORMAT format, HostTexture const &texture);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	constexpr uint32_t g_ddsMagic = 0x20534444; // "DDS "
+	constexpr uint32_t g_ddsFourCcDx10 = 0x30315844; // "DX10"
+
+	constexpr uint32_t g_ddsFlagCaps = 0x1;
+	constexpr uint32_t g_ddsFlagHeight = 0x2;
+	constexpr uint32_t g_ddsFlagWidth = 0x4;
+	constexpr uint32_t g_ddsFlagPitch = 0x8;
+	constexpr uint32_t g_ddsFlagPixelFormat = 0x1000;
+	constexpr uint32_t g_ddsFlagMipMapCount = 0x20000;
+	constexpr uint32_t g_ddsFlagLinearSize = 0x80000;
+	constexpr uint32_t g_ddsPixelFormatFourCc = 0x4;
+	constexpr uint32_t g_ddsCapsComplex = 0x8;
+	constexpr uint32_t g_ddsCapsTexture = 0x1000;
+	constexpr uint32_t g_ddsCapsMipMap = 0x400000;
+	constexpr uint32_t g_ddsDimensionTexture2D = 3;
+
+	struct DdsPixelFormat
+	{
+		uint32_t size = sizeof(DdsPixelFormat);
+		uint32_t flags = g_ddsPixelFormatFourCc;
+		uint32_t fourCC = g_ddsFourCcDx10;
+		uint32_t rgbBitCount = 0;
+		uint32_t rBitMask = 0;
+		uint32_t gBitMask = 0;
+		uint32_t bBitMask = 0;
+		uint32_t aBitMask = 0;
+	};
+
+	struct DdsHeader
+	{
+		uint32_t size = sizeof(DdsHeader);
+		uint32_t flags = 0;
+		uint32_t height = 0;
+		uint32_t width = 0;
+		uint32_t pitchOrLinearSize = 0;
+		uint32_t depth = 0;
+		uint32_t mipMapCount = 0;
+		uint32_t reserved1[11] = {};
+		DdsPixelFormat pixelFormat;
+		uint32_t caps = 0;
+		uint32_t caps2 = 0;
+		uint32_t caps3 = 0;
+		uint32_t caps4 = 0;
+		uint32_t reserved2 = 0;
+	};
+
+	struct DdsHeaderDx10
+	{
+		uint32_t dxgiFormat = DXGI_FORMAT_UNKNOWN;
+		uint32_t resourceDimension = g_ddsDimensionTexture2D;
+		uint32_t miscFlag = 0;
+		uint32_t arraySize = 1;
+		uint32_t miscFlags2 = 0;
+	};
+
+	// Lives in the reserved words of the DDS header, readers other than ours ignore it
+	struct TextureFileCacheStamp
+	{
+		uint32_t magic = g_textureFileCacheMagic;
+		uint32_t version = g_textureFileCacheVersion;
+		uint32_t flags = 0;
+		uint32_t format = DXGI_FORMAT_UNKNOWN;
+		SourceFileStamp source;
+		uint64_t sourceHash = 0;
+	};
+
+	static_assert(sizeof(DdsHeader) == 124);
+	static_assert(sizeof(TextureFileCacheStamp) <= sizeof(DdsHeader::reserved1));
+
+	constexpr uint64_t g_textureFileCacheStampOffset = sizeof(uint32_t) + offsetof(DdsHeader, reserved1);
+
+	inline std::optional<uint64_t> HashSourceFile(std::filesystem::path const &path)
+	{
+		auto mappedFile = CreateMappedFile(path);
+		if (!mappedFile)
+		{
+			return std::nullopt;
+		}
+		uint64_t const hash = HashBytesFnv1a(mappedFile->data, mappedFile->size);
+		CleanupMappedFile(mappedFile.value());
+
+		return hash;
+	}
+
+	inline std::filesystem::path GetTextureFileCachePath(
+		std::filesystem::path const &sourcePath, uint32_t flags, DXGI_FORMAT format)
+	{
+		char extension[32] = {};
+		snprintf(extension, sizeof(extension), ".%x_%u.dds", flags, static_cast<uint32_t>(format));
+		return GetCacheFilePath(sourcePath, extension);
+	}
+
+	// A cache is valid if the source size and write time match. A touched but unchanged source,
+	// e.g. after a fresh checkout, is recognized by its content hash and the stamp is refreshed.
+	inline bool IsTextureFileCacheStampValid(
+		TextureFileCacheStamp const &cached, SourceFileStamp const &source, std::filesystem::path const &sourcePath, bool &isTouched)
+	{
+		isTouched = false;
+		if (cached.source.size != source.size)
+		{
+			return false;
+		}
+		if (cached.source.lastWriteTime == source.lastWriteTime)
+		{
+			return true;
+		}
+
+		auto const hash = HashSourceFile(sourcePath);
+		isTouched = hash && hash.value() == cached.sourceHash;
+		return isTouched;
+	}
+
+	inline std::optional<HostTexture> ReadTextureFileCache(
+		std::filesystem::path const &sourcePath, uint32_t flags, DXGI_FORMAT format)
+	{
+		auto const stamp = GetSourceFileStamp(sourcePath);
+		if (!stamp)
+		{
+			return std::nullopt;
+		}
+
+		auto const cachePath = GetTextureFileCachePath(sourcePath, flags, format);
+		auto mappedFile = CreateMappedFile(cachePath);
+		if (!mappedFile)
+		{
+			return std::nullopt;
+		}
+
+		BinaryReader reader = CreateBinaryReader(mappedFile.value());
+		HostTexture texture;
+		bool isValid = false;
+		bool isTouched = false;
+
+		uint32_t magic = 0;
+		DdsHeader header;
+		DdsHeaderDx10 headerDx10;
+		TextureFileCacheStamp cacheStamp;
+		if (ReadBinary(reader, magic) && magic == g_ddsMagic &&
+			ReadBinary(reader, header) && header.size == sizeof(DdsHeader) &&
+			header.pixelFormat.fourCC == g_ddsFourCcDx10 &&
+			ReadBinary(reader, headerDx10))
+		{
+			std::memcpy(&cacheStamp, header.reserved1, sizeof(cacheStamp));
+			isValid = cacheStamp.magic == g_textureFileCacheMagic &&
+					  cacheStamp.version == g_textureFileCacheVersion &&
+					  cacheStamp.flags == flags &&
+					  cacheStamp.format == static_cast<uint32_t>(format) &&
+					  header.width > 0 && header.height > 0 && header.mipMapCount > 0 &&
+					  IsTextureFileCacheStampValid(cacheStamp, stamp.value(), sourcePath, isTouched);
+		}
+
+		if (isValid)
+		{
+			texture.path = sourcePath;
+			texture.format = static_cast<DXGI_FORMAT>(headerDx10.dxgiFormat);
+			texture.width = header.width;
+			texture.height = header.height;
+			texture.mipChain = CalculateMipChain(texture);
+			isValid = header.mipMapCount <= texture.mipChain.size();
+		}
+
+		if (isValid)
+		{
+			texture.mipChain.resize(header.mipMapCount);
+			auto const &lastMip = texture.mipChain.back();
+			isValid = ReadBinaryArray(reader, texture.pixels, uint64_t(lastMip.byteOffset) + lastMip.byteSize) &&
+					  reader.offset == reader.size;
+		}
+
+		CleanupMappedFile(mappedFile.value());
+
+		if (!isValid)
+		{
+			wprintf(L"Texture cache is stale or corrupted: '%s'\n", sourcePath.filename().c_str());
+			return std::nullopt;
+		}
+
+		if (isTouched)
+		{
+			cacheStamp.source = stamp.value();
+			std::ofstream stream(cachePath, std::ios::binary | std::ios::in);
+			stream.seekp(g_textureFileCacheStampOffset);
+			WriteBinary(stream, cacheStamp);
+		}
+
+		return texture;
+	}
+
+	inline bool WriteTextureFileCache(
+		std::filesystem::path const &sourcePath, uint32_t flags, DXGI_FORMAT format, HostTexture const &texture)
+	{
+		auto const stamp = GetSourceFileStamp(sourcePath);
+		auto const hash = HashSourceFile(sourcePath);
+		if (!stamp || !hash || texture.pixels.empty() || texture.mipChain.empty())
+		{
+			return false;
+		}
+
+		TextureFileCacheStamp cacheStamp;
+		cacheStamp.flags = flags;
+		cacheStamp.format = format;
+		cacheStamp.source = stamp.value();
+		cacheStamp.sourceHash = hash.value();
+
+		bool const isCompressed = IsBlockCompressed(texture.format);
+
+		DdsHeader header;
+		header.flags = g_ddsFlagCaps | g_ddsFlagHeight | g_ddsFlagWidth | g_ddsFlagPixelFormat | g_ddsFlagMipMapCount |
+					   (isCompressed ? g_ddsFlagLinearSize : g_ddsFlagPitch);
+		header.height = texture.height;
+		header.width = texture.width;
+		header.pitchOrLinearSize = isCompressed ? texture.mipChain.front().byteSize : RowPitch(texture.format, texture.width);
+		header.mipMapCount = static_cast<uint32_t>(texture.mipChain.size());
+		header.caps = g_ddsCapsTexture | (texture.mipChain.size() > 1 ? g_ddsCapsComplex | g_ddsCapsMipMap : 0);
+		std::memcpy(header.reserved1, &cacheStamp, sizeof(cacheStamp));
+
+		DdsHeaderDx10 headerDx10;
+		headerDx10.dxgiFormat = texture.format;
+
+		return WriteBinaryFile(GetTextureFileCachePath(sourcePath, flags, format), [&](std::ofstream &stream) {
+			WriteBinary(stream, g_ddsMagic);
+			WriteBinary(stream, header);
+			WriteBinary(stream, headerDx10);
+			WriteBinaryArray(stream, texture.pixels);
+		});
+	}
+
+} // namespace h2r
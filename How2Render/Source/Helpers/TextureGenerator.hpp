@@ -33,7 +33,7 @@ namespace h2r
 		devTexDesc.mipmapFlag = DeviceTexture::Descriptor::eMipMapFlag::NONE;
 		devTexDesc.textureFormat = hostTexture.format;
 		devTexDesc.srvFormat = hostTexture.format;
-		devTexDesc.hostTexture = hostTexture;
+		devTexDesc.hostTexture = &hostTexture;
 
 		return CreateDeviceTexture(context, devTexDesc).value();
 	}
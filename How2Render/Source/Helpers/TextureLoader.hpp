@@ -1,12 +1,20 @@
 #pragma once
 
+#include "Helpers/BinaryFile.hpp"
+#include "Helpers/CpuProfiler.hpp"
+#include "Helpers/ImageAllocator.hpp"
 #include "Helpers/MipmapGenerator.hpp"
+#include "Helpers/Parallel.hpp"
 #include "Helpers/TextureCache.hpp"
+#include "Helpers/TextureCompressor.hpp"
+#include "Helpers/TextureFileCache.hpp"
 #include "ThirdParty/stb_image.h"
 #include "Wrapper/Texture.hpp"
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
-#include <optional>
+#include <future>
+#include <memory>
 #include <string>
 
 namespace h2r
@@ -15,53 +23,203 @@ namespace h2r
 	using TextureLoadFlags = uint32_t;
 	constexpr TextureLoadFlags TEX_LOAD_FLAG_FLIP_VERTICALLY = 1;
 	constexpr TextureLoadFlags TEX_LOAD_FLAG_GEN_CPU_MIPMAP = 2;
+	// Block compresses every mip level after mip generation, at most one of these may be set
+	constexpr TextureLoadFlags TEX_LOAD_FLAG_COMPRESS_BC1 = 4;
+	constexpr TextureLoadFlags TEX_LOAD_FLAG_COMPRESS_BC3 = 8;
+	constexpr TextureLoadFlags TEX_LOAD_FLAG_COMPRESS_BC5 = 16;
+	constexpr TextureLoadFlags TEX_LOAD_FLAG_COMPRESS_BC7 = 32;
+	// Decodes the source even if a valid DDS cache exists, the cache is still rewritten
+	constexpr TextureLoadFlags TEX_LOAD_FLAG_IGNORE_FILE_CACHE = 64;
 
-	inline std::optional<HostTexture> LoadTextureFromFile(
-		TextureCache &cache,
-		std::filesystem::path path,
+	inline eTextureCompression GetTextureCompression(TextureLoadFlags flags)
+	{
+		if (flags & TEX_LOAD_FLAG_COMPRESS_BC1)
+		{
+			return eTextureCompression::BC1;
+		}
+		if (flags & TEX_LOAD_FLAG_COMPRESS_BC3)
+		{
+			return eTextureCompression::BC3;
+		}
+		if (flags & TEX_LOAD_FLAG_COMPRESS_BC5)
+		{
+			return eTextureCompression::BC5;
+		}
+		if (flags & TEX_LOAD_FLAG_COMPRESS_BC7)
+		{
+			return eTextureCompression::BC7;
+		}
+		return eTextureCompression::None;
+	}
+
+	// The image is decoded into an allocation sized for the whole mip chain and mipped in place, so level 0
+	// is neither copied out of the decoder nor moved when the chain grows. Mip generation and block
+	// compression of large textures are split over threadCount threads. Textures that can not be block
+	// compressed stay uncompressed.
+	inline HostTextureHandle DecodeTextureFile(
+		std::filesystem::path const &path,
 		TextureLoadFlags flags,
-		DXGI_FORMAT format)
+		DXGI_FORMAT format,
+		uint32_t threadCount)
 	{
-		if (path.empty() || !path.has_filename())
+		H2R_CPU_ZONE("DecodeTextureFile");
+
+		auto sourceFile = CreateMappedFile(path);
+		if (!sourceFile)
 		{
-			return std::nullopt;
+			wprintf(L"Failed to load texture: '%s'\n", path.c_str());
+			return nullptr;
 		}
+		auto const *sourceData = reinterpret_cast<stbi_uc const *>(sourceFile->data);
+		int32_t const sourceSize = static_cast<int32_t>(sourceFile->size);
 
-		auto [cacheFound, cachedTexture] = FindCachedHostTexture(cache, path);
-		if (HasCachedHostTexture(cache, path))
+		int32_t width, height, comp;
+		if (!stbi_info_from_memory(sourceData, sourceSize, &width, &height, &comp))
 		{
-			return cachedTexture;
+			wprintf(L"Failed to load texture: '%s'\n", path.c_str());
+			CleanupMappedFile(sourceFile.value());
+			return nullptr;
 		}
 
-		stbi_set_flip_vertically_on_load(flags & TEX_LOAD_FLAG_FLIP_VERTICALLY);
+		auto hostTexture = std::make_shared<HostTexture>();
+		hostTexture->path = path;
+		hostTexture->format = format;
+		hostTexture->loadFlags = flags & ~TEX_LOAD_FLAG_IGNORE_FILE_CACHE;
+		hostTexture->loadFormat = format;
+		hostTexture->width = width;
+		hostTexture->height = height;
+		hostTexture->mipChain = CalculateMipChain(*hostTexture);
+
+		bool const isMipmapped = (flags & TEX_LOAD_FLAG_GEN_CPU_MIPMAP) && CanGenerateMipmap(format);
+		if (!isMipmapped)
+		{
+			hostTexture->mipChain.resize(1);
+		}
+		hostTexture->pixels.resize(CalculateMipChainByteSize(hostTexture->mipChain));
+		// Counted while decoding only, the texture owns the allocation afterwards
+		TrackImageAllocation(hostTexture->pixels.size());
+
+		// The flip flag is thread local, so decoding jobs on other threads are not affected
+		stbi_set_flip_vertically_on_load_thread(flags & TEX_LOAD_FLAG_FLIP_VERTICALLY);
+
+		auto &decodeTarget = GetImageDecodeTarget();
+		decodeTarget = ImageDecodeTarget{hostTexture->pixels.data(), hostTexture->mipChain.front().byteSize};
+		auto *pixels = stbi_load_from_memory(sourceData, sourceSize, &width, &height, &comp, STBI_rgb_alpha);
+		if (pixels != nullptr && pixels != decodeTarget.pixels)
+		{
+			std::memcpy(hostTexture->pixels.data(), pixels, hostTexture->mipChain.front().byteSize);
+		}
+		stbi_image_free(pixels);
+		decodeTarget = ImageDecodeTarget{};
+
+		CleanupMappedFile(sourceFile.value());
+		TrackImageFree(hostTexture->pixels.size());
 
-		int32_t width, height, comp;
-		auto *pixels = stbi_load(path.string().c_str(), &width, &height, &comp, STBI_rgb_alpha);
 		if (!pixels)
 		{
 			wprintf(L"Failed to load texture: '%s'\n", path.c_str());
-			return std::nullopt;
+			return nullptr;
 		}
 		wprintf(L"Loaded texture %s\n", path.filename().c_str());
 
-		HostTexture::Descriptor desc;
-		desc.path = path;
-		desc.pixels = (uint8_t *)pixels;
-		desc.width = width;
-		desc.height = height;
-		desc.format = format;
+		if (isMipmapped)
+		{
+			GenerateMipmapInPlace(*hostTexture, threadCount);
+		}
+
+		auto const compression = GetTextureCompression(flags);
+		if (compression != eTextureCompression::None)
+		{
+			auto compressed = CompressHostTexture(*hostTexture, compression, threadCount);
+			if (compressed)
+			{
+				hostTexture = std::make_shared<HostTexture>(std::move(compressed.value()));
+			}
+		}
 
-		HostTexture hostTexture = CreateHostTexture(desc);
-		stbi_image_free(desc.pixels);
+		return hostTexture;
+	}
 
-		if (flags & TEX_LOAD_FLAG_GEN_CPU_MIPMAP)
+	// Reads the processed texture from its DDS cache, or decodes the source and writes the cache
+	inline HostTextureHandle ReadOrDecodeTextureFile(
+		std::filesystem::path const &path,
+		TextureLoadFlags flags,
+		DXGI_FORMAT format,
+		uint32_t threadCount)
+	{
+		H2R_CPU_ZONE("ReadOrDecodeTextureFile");
+
+		TextureLoadFlags const cacheFlags = flags & ~TEX_LOAD_FLAG_IGNORE_FILE_CACHE;
+		if (!(flags & TEX_LOAD_FLAG_IGNORE_FILE_CACHE))
 		{
-			GenerateMipmap(hostTexture);
+			if (auto texture = ReadTextureFileCache(path, cacheFlags, format); texture)
+			{
+				texture->loadFlags = cacheFlags;
+				texture->loadFormat = format;
+				return std::make_shared<HostTexture>(std::move(texture.value()));
+			}
 		}
 
-		CacheHostTexture(cache, hostTexture);
+		auto hostTexture = DecodeTextureFile(path, flags, format, threadCount);
+		if (hostTexture && !WriteTextureFileCache(path, cacheFlags, format, *hostTexture))
+		{
+			wprintf(L"Failed to write texture cache for %s\n", path.filename().c_str());
+		}
 
 		return hostTexture;
 	}
 
+	inline HostTextureHandle LoadTextureFromFile(
+		TextureCache &cache,
+		std::filesystem::path path,
+		TextureLoadFlags flags,
+		DXGI_FORMAT format)
+	{
+		H2R_CPU_ZONE("LoadTextureFromFile");
+
+		if (path.empty() || !path.has_filename())
+		{
+			return nullptr;
+		}
+
+		// Skipping the file cache does not change the pixels, so it does not make another texture
+		TextureCacheKey const key = {path, flags & ~TEX_LOAD_FLAG_IGNORE_FILE_CACHE, format};
+		auto [future, promise] = ReserveHostTexture(cache, key);
+		if (promise)
+		{
+			ResolveHostTexture(cache, key, promise, ReadOrDecodeTextureFile(path, flags, format, GetDefaultThreadCount()));
+		}
+
+		return future.get();
+	}
+
+	// Reads or decodes the texture on the pool. Every path is decoded once per flags and format, concurrent
+	// requests for a texture that is already queued or cached share the same future. The pool already runs
+	// one texture per worker, so each texture is mipped and compressed on a single thread.
+	inline HostTextureFuture LoadTextureFromFileAsync(
+		TextureCache &cache,
+		ThreadPool &pool,
+		std::filesystem::path path,
+		TextureLoadFlags flags,
+		DXGI_FORMAT format)
+	{
+		if (path.empty() || !path.has_filename())
+		{
+			std::promise<HostTextureHandle> empty;
+			empty.set_value(nullptr);
+			return empty.get_future().share();
+		}
+
+		TextureCacheKey const key = {path, flags & ~TEX_LOAD_FLAG_IGNORE_FILE_CACHE, format};
+		auto [future, promise] = ReserveHostTexture(cache, key);
+		if (promise)
+		{
+			SubmitJob(pool, [&cache, key, flags, format, promise = std::move(promise)]() {
+				ResolveHostTexture(cache, key, promise, ReadOrDecodeTextureFile(key.path, flags, format, 1));
+			});
+		}
+
+		return future;
+	}
+
 } // namespace h2r
@@ -19,10 +19,10 @@ namespace h2r
 
 	struct HostMaterial
 	{
-		HostTexture ambientTexture;
-		HostTexture albedoTexture;
-		HostTexture specularTexture;
-		HostTexture normalTexture;
+		HostTextureHandle ambientTexture;
+		HostTextureHandle albedoTexture;
+		HostTextureHandle specularTexture;
+		HostTextureHandle normalTexture;
 		XMFLOAT3 scalarAmbient = {};
 		XMFLOAT3 scalarDiffuse = {};
 		XMFLOAT3 scalarSpecular = {};
@@ -45,88 +45,55 @@ namespace h2r
 		eAlphaMask alphaMask = eAlphaMask::Opaque;
 	};
 
-	inline std::optional<DeviceMaterial> CreateDeviceMaterial(Context const &context, TextureCache &cache, HostMaterial const &hostMaterial)
+	// Uploads each host texture once, materials sharing a texture share the device texture
+	inline void AcquireDeviceTexture(
+		Context const &context, TextureCache &cache, HostTextureHandle const &hostTexture, DeviceTexture &deviceTexture)
 	{
-		DeviceMaterial deviceMaterial;
-		DeviceTexture::Descriptor desc;
-		desc.bindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-		desc.mipmapFlag = DeviceTexture::Descriptor::eMipMapFlag::USE_DX_GENERATED;
-
+		if (!hostTexture)
 		{
-			auto [isTextureCached, cachedTexture] = FindCachedDeviceTexture(cache, hostMaterial.albedoTexture.path);
-			if (isTextureCached)
-			{
-				deviceMaterial.albedoTexture = cachedTexture;
-			}
-			else if (!hostMaterial.albedoTexture.pixels.empty())
-			{
-				desc.hostTexture = hostMaterial.albedoTexture;
-				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture.format;
-				auto texture = CreateDeviceTexture(context, desc);
-				if (texture)
-				{
-					deviceMaterial.albedoTexture = texture.value();
-					CacheDeviceTexture(cache, texture.value());
-				}
-			}
+			return;
 		}
 
+		TextureCacheKey const key = GetTextureCacheKey(*hostTexture);
+		auto [isTextureCached, cachedTexture] = FindCachedDeviceTexture(cache, key);
+		if (isTextureCached)
 		{
-			auto [isTextureCached, cachedTexture] = FindCachedDeviceTexture(cache, hostMaterial.ambientTexture.path);
-			if (isTextureCached)
-			{
-				deviceMaterial.ambientTexture = cachedTexture;
-			}
-			else if (!hostMaterial.ambientTexture.pixels.empty())
-			{
-				desc.hostTexture = hostMaterial.ambientTexture;
-				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture.format;
-				auto texture = CreateDeviceTexture(context, desc);
-				if (texture)
-				{
-					deviceMaterial.ambientTexture = texture.value();
-					CacheDeviceTexture(cache, texture.value());
-				}
-			}
+			deviceTexture = cachedTexture;
 		}
-
+		else if (!hostTexture->pixels.empty())
 		{
-			auto [isTextureCached, cachedTexture] = FindCachedDeviceTexture(cache, hostMaterial.specularTexture.path);
-			if (isTextureCached)
+			DeviceTexture::Descriptor desc;
+			desc.hostTexture = hostTexture.get();
+			// Block compressed textures can not be render targets, their mips come from the host
+			if (IsBlockCompressed(hostTexture->format))
 			{
-				deviceMaterial.specularTexture = cachedTexture;
+				desc.bindFlags = D3D11_BIND_SHADER_RESOURCE;
+				desc.mipmapFlag = DeviceTexture::Descriptor::eMipMapFlag::USE_PRE_GENERATED;
+				desc.textureFormat = desc.srvFormat = hostTexture->format;
 			}
-			else if (!hostMaterial.specularTexture.pixels.empty())
+			else
 			{
-				desc.hostTexture = hostMaterial.specularTexture;
-				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture.format;
-				auto texture = CreateDeviceTexture(context, desc);
-				if (texture)
-				{
-					deviceMaterial.specularTexture = texture.value();
-					CacheDeviceTexture(cache, texture.value());
-				}
+				desc.bindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
+				desc.mipmapFlag = DeviceTexture::Descriptor::eMipMapFlag::USE_DX_GENERATED;
+				desc.textureFormat = desc.srvFormat = desc.rtvFormat = hostTexture->format;
 			}
-		}
-
-		{
-			auto [isTextureCached, cachedTexture] = FindCachedDeviceTexture(cache, hostMaterial.normalTexture.path);
-			if (isTextureCached)
+			auto texture = CreateDeviceTexture(context, desc);
+			if (texture)
 			{
-				deviceMaterial.normalTexture = cachedTexture;
-			}
-			else if (!hostMaterial.normalTexture.pixels.empty())
-			{
-				desc.hostTexture = hostMaterial.normalTexture;
-				desc.textureFormat = desc.srvFormat = desc.rtvFormat = desc.hostTexture.format;
-				auto texture = CreateDeviceTexture(context, desc);
-				if (texture)
-				{
-					deviceMaterial.normalTexture = texture.value();
-					CacheDeviceTexture(cache, texture.value());
-				}
+				deviceTexture = texture.value();
+				CacheDeviceTexture(cache, key, texture.value());
 			}
 		}
+	}
+
+	inline std::optional<DeviceMaterial> CreateDeviceMaterial(Context const &context, TextureCache &cache, HostMaterial const &hostMaterial)
+	{
+		DeviceMaterial deviceMaterial;
+
+		AcquireDeviceTexture(context, cache, hostMaterial.albedoTexture, deviceMaterial.albedoTexture);
+		AcquireDeviceTexture(context, cache, hostMaterial.ambientTexture, deviceMaterial.ambientTexture);
+		AcquireDeviceTexture(context, cache, hostMaterial.specularTexture, deviceMaterial.specularTexture);
+		AcquireDeviceTexture(context, cache, hostMaterial.normalTexture, deviceMaterial.normalTexture);
 
 		deviceMaterial.scalarAmbient = hostMaterial.scalarAmbient;
 		deviceMaterial.scalarDiffuse = hostMaterial.scalarDiffuse;
@@ -4,6 +4,8 @@
 #include "Wrapper/Context.hpp"
 #include "Wrapper/IndexBuffer.hpp"
 #include "Wrapper/VertexBuffer.hpp"
+#include <algorithm>
+#include <cmath>
 #include <vector>
 
 namespace h2r
@@ -23,14 +25,79 @@ namespace h2r
 		int32_t materialId = InvalidMaterialId;
 	};
 
+	// Axis aligned box and bounding sphere, both around the box center
+	struct MeshBounds
+	{
+		XMFLOAT3 center = {};
+		XMFLOAT3 extents = {};
+		float radius = 0.f;
+	};
+
 	struct DeviceMesh
 	{
 		VertexBuffer vertexBuffer;
 		IndexBuffer indexBuffer;
+		MeshBounds bounds;
 		int32_t materialId = InvalidMaterialId;
 		D3D11_PRIMITIVE_TOPOLOGY topology = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 	};
 
+	inline MeshBounds CalculateMeshBounds(std::vector<Vertex> const &vertices)
+	{
+		MeshBounds bounds;
+		if (vertices.empty())
+		{
+			return bounds;
+		}
+
+		XMVECTOR minimum = XMLoadFloat3(&vertices.front().position);
+		XMVECTOR maximum = minimum;
+		for (auto const &vertex : vertices)
+		{
+			XMVECTOR const position = XMLoadFloat3(&vertex.position);
+			minimum = XMVectorMin(minimum, position);
+			maximum = XMVectorMax(maximum, position);
+		}
+
+		XMVECTOR const center = XMVectorScale(XMVectorAdd(minimum, maximum), 0.5f);
+		XMStoreFloat3(&bounds.center, center);
+		XMStoreFloat3(&bounds.extents, XMVectorScale(XMVectorSubtract(maximum, minimum), 0.5f));
+
+		// The farthest vertex is usually well inside the box corner, which keeps the sphere tighter
+		XMVECTOR radiusSq = XMVectorZero();
+		for (auto const &vertex : vertices)
+		{
+			radiusSq = XMVectorMax(radiusSq, XMVector3LengthSq(XMVectorSubtract(XMLoadFloat3(&vertex.position), center)));
+		}
+		bounds.radius = std::sqrt(XMVectorGetX(radiusSq));
+
+		return bounds;
+	}
+
+	// The box stays axis aligned by taking the absolute rotation, the sphere grows with the largest axis scale
+	inline MeshBounds TransformMeshBounds(MeshBounds const &bounds, XMMATRIX const &world)
+	{
+		MeshBounds result;
+
+		XMStoreFloat3(&result.center, XMVector3Transform(XMLoadFloat3(&bounds.center), world));
+
+		XMVECTOR const extents = XMLoadFloat3(&bounds.extents);
+		XMVECTOR const worldExtents = XMVectorAdd(XMVectorAdd(
+			XMVectorMultiply(XMVectorSplatX(extents), XMVectorAbs(world.r[0])),
+			XMVectorMultiply(XMVectorSplatY(extents), XMVectorAbs(world.r[1]))),
+			XMVectorMultiply(XMVectorSplatZ(extents), XMVectorAbs(world.r[2])));
+		XMStoreFloat3(&result.extents, worldExtents);
+
+		float const maxScaleSq = std::max({
+			XMVectorGetX(XMVector3LengthSq(world.r[0])),
+			XMVectorGetX(XMVector3LengthSq(world.r[1])),
+			XMVectorGetX(XMVector3LengthSq(world.r[2])),
+		});
+		result.radius = bounds.radius * std::sqrt(maxScaleSq);
+
+		return result;
+	}
+
 	inline DeviceMesh CreateDeviceMesh(Context const &context, HostMesh const &hostMesh)
 	{
 		DeviceMesh mesh;
@@ -38,8 +105,18 @@ namespace h2r
 		mesh.vertexBuffer = CreateVertexBuffer(context, hostMesh.vertices);
 		if (!hostMesh.indices.empty())
 		{
-			mesh.indexBuffer = CreateIndexBuffer(context, hostMesh.indices);
+			// Halve index memory and bandwidth whenever every index fits into 16 bits
+			if (hostMesh.vertices.size() <= size_t(UINT16_MAX) + 1)
+			{
+				std::vector<uint16_t> const indices(hostMesh.indices.begin(), hostMesh.indices.end());
+				mesh.indexBuffer = CreateIndexBuffer(context, indices);
+			}
+			else
+			{
+				mesh.indexBuffer = CreateIndexBuffer(context, hostMesh.indices);
+			}
 		}
+		mesh.bounds = CalculateMeshBounds(hostMesh.vertices);
 		mesh.materialId = hostMesh.materialId;
 
 		return mesh;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "DirectionalLight.hpp"
+#include "Helpers/CpuProfiler.hpp"
 #include "Helpers/MeshGenerator.hpp"
 #include "Helpers/Random.hpp"
 #include "RenderObject.hpp"
@@ -8,6 +9,8 @@
 #include "Wrapper/Context.hpp"
 #include "Wrapper/Texture.hpp"
 #include "RenderPass.hpp"
+#include "ShadowCache.hpp"
+#include "ShadowCascades.hpp"
 
 namespace h2r
 {
@@ -19,38 +22,27 @@ namespace h2r
         DeviceConstBuffers const& cbuffersDevice,
         HostConstBuffers::Infrequent& cbuffersHost);
 
+    // Only called on frames the camera, the light, the states or the shadow cache projection changed
     inline void UpdatePerFrameConstantBuffer(
         Context const& context,
         Camera const& camera,
+        ShadowCascades const& shadowCascades,
+        ShadowCache const& shadowCache,
         DeviceConstBuffers const& cbuffersDevice,
         HostConstBuffers::PerFrame& cbuffersHost);
 
+    // Shadow passes draw every cascade into its own atlas tile, they update the buffer once per cascade.
+    // Most passes share the viewport size, the upload is skipped while the block stays the same.
     inline void UpdatePerPassConstantBuffer(
         Context const& context,
         Pass const& pass,
         DeviceConstBuffers const& cbuffersDevice,
-        HostConstBuffers::PerPass& cbuffersHost);
+        HostConstBuffers::PerPass& cbuffersHost,
+        uint32_t shadowCascade = 0);
 
-    inline void DrawOpaqueRenderObjects(
-        Context const &context,
-        Application::States const &states,
-        std::vector<RenderObject> const &objects,
-        DeviceConstBuffers const &cbuffersDevice,
-        HostConstBuffers &cbuffersHost);
-
-    inline void DrawTransparentRenderObjects(
-        Context const &context,
-        Application::States const &states,
-        std::vector<RenderObject> const &objects,
-        DeviceConstBuffers const &cbuffersDevice,
-        HostConstBuffers &cbuffersHost);
+    inline void BindMesh(Context const &context, DeviceMesh const &mesh);
 
-    inline void DrawTranslucentRenderObjects(
-        Context const &context,
-        Application::States const &states,
-        std::vector<RenderObject> const &objects,
-        DeviceConstBuffers const &cbuffersDevice,
-        HostConstBuffers &cbuffersHost);
+    inline void DrawMesh(Context const &context, DeviceMesh const &mesh);
 
     inline void DrawFullScreen(Context const &context);
 
@@ -66,6 +58,8 @@ namespace h2r
         DeviceConstBuffers const &cbuffersDevice,
         HostConstBuffers::Infrequent &cbuffersHost)
     {
+        H2R_CPU_ZONE("UpdateInfrequentConstantBuffer");
+
         cbuffersHost.ssao.kernelRadius = states.ssaoKernelRadius;
         cbuffersHost.ssao.kernelSize = states.ssaoKernelSize;
         cbuffersHost.ssao.bias = states.ssaoBias;
@@ -75,7 +69,6 @@ namespace h2r
         cbuffersHost.debug.shadowMappingEnabled = static_cast<uint32_t>(states.shadowMappingEnabled);
 
         cbuffersHost.lights.viewDir = XMVector3Normalize(lightData.direction);
-        cbuffersHost.lights.viewProj = lightData.viewProj;
 
         cbuffersHost.shadows.bias = states.shadowMappingBias;
         cbuffersHost.shadows.pcfEnabled = states.pcfEnabled;
@@ -88,16 +81,31 @@ namespace h2r
     inline void UpdatePerFrameConstantBuffer(
         Context const &context,
         Camera const &camera,
+        ShadowCascades const &shadowCascades,
+        ShadowCache const &shadowCache,
         DeviceConstBuffers const &cbuffersDevice,
         HostConstBuffers::PerFrame &cbuffersHost)
     {
+        H2R_CPU_ZONE("UpdatePerFrameConstantBuffer");
+
         cbuffersHost.camera.positionVector = camera.position;
         cbuffersHost.camera.projMatrix = camera.proj;
         cbuffersHost.camera.viewMatrix = camera.view;
+        // The camera builds its inverses alongside, only when they change
+        cbuffersHost.camera.invViewMatrix = camera.inverseView;
+        cbuffersHost.camera.invProjMatrix = camera.inverseProj;
 
-        XMVECTOR det;
-        cbuffersHost.camera.invViewMatrix = XMMatrixInverse(&det, camera.view);
-        cbuffersHost.camera.invProjMatrix = XMMatrixInverse(&det, camera.proj);
+        for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+        {
+            cbuffersHost.shadowCascades.viewProj[i] = shadowCascades.cascades[i].viewProj;
+            cbuffersHost.shadowCascades.splitFar[i] = shadowCascades.cascades[i].splitFar;
+            if (IsShadowCascadeCached(shadowCache, shadowCascades.cascades[i]))
+            {
+                cbuffersHost.shadowCascades.cacheReprojection[i] =
+                    CalculateShadowCacheReprojection(shadowCache, shadowCascades.cascades[i]);
+            }
+        }
+        cbuffersHost.shadowCascades.cacheViewProj = shadowCache.viewProj;
 
         context.pImmediateContext->UpdateSubresource(cbuffersDevice.pPerFrame, 0, nullptr, &cbuffersHost, 0, 0);
     }
@@ -106,20 +114,43 @@ namespace h2r
         Context const& context,
         Pass const& pass,
         DeviceConstBuffers const& cbuffersDevice,
-        HostConstBuffers::PerPass& cbuffersHost)
+        HostConstBuffers::PerPass& cbuffersHost,
+        uint32_t shadowCascade)
     {
-        cbuffersHost.renderTarget.width = pass.viewportSize.x;
-        cbuffersHost.renderTarget.height = pass.viewportSize.y;
+        HostConstBuffers::RenderTarget &renderTarget = cbuffersHost.renderTarget;
+        if (renderTarget.width == pass.viewportSize.x && renderTarget.height == pass.viewportSize.y &&
+            renderTarget.shadowCascade == shadowCascade)
+        {
+            return;
+        }
+
+        renderTarget.width = pass.viewportSize.x;
+        renderTarget.height = pass.viewportSize.y;
+        renderTarget.shadowCascade = shadowCascade;
 
         context.pImmediateContext->UpdateSubresource(cbuffersDevice.pPerPass, 0, nullptr, &cbuffersHost, 0, 0);
     }
 
-    inline void UpdatePerMaterialConstantBuffer(
-        Context const &context,
+    // Meshes without a material keep the previous material constants and bind no textures
+    inline void FillPerMaterialConstantBuffer(
         DeviceMesh const &mesh,
         std::vector<DeviceMaterial> const &materials,
-        DeviceConstBuffers const &cbuffersDevice,
         HostConstBuffers::PerMaterial &cbuffersHost)
+    {
+        if (mesh.materialId != InvalidMaterialId)
+        {
+            DeviceMaterial const &material = materials[mesh.materialId];
+
+            cbuffersHost.material.ambient = material.scalarAmbient;
+            cbuffersHost.material.diffuse = material.scalarDiffuse;
+            cbuffersHost.material.specular = material.scalarSpecular;
+            cbuffersHost.material.shininess = material.scalarShininess;
+            cbuffersHost.material.alpha = material.scalarAlpha;
+            cbuffersHost.material.normalMapAvailabled = material.normalTexture.texture ? 1 : 0;
+        }
+    }
+
+    inline void BindMaterialTextures(Context const &context, DeviceMesh const &mesh, std::vector<DeviceMaterial> const &materials)
     {
         ID3D11ShaderResourceView *shaderResourceViews[MaterialTextureCount] = {};
 
@@ -132,17 +163,21 @@ namespace h2r
             shaderResourceViews[2] = material.specularTexture.shaderResourceView;
             shaderResourceViews[3] = material.normalTexture.shaderResourceView;
             static_assert(MaterialTextureCount == 4);
-
-            cbuffersHost.material.ambient = material.scalarAmbient;
-            cbuffersHost.material.diffuse = material.scalarDiffuse;
-            cbuffersHost.material.specular = material.scalarSpecular;
-            cbuffersHost.material.shininess = material.scalarShininess;
-            cbuffersHost.material.alpha = material.scalarAlpha;
-            cbuffersHost.material.normalMapAvailabled = material.normalTexture.texture ? 1 : 0;
         }
 
+        SetCachedShaderResources(context, eShaderStage::Pixel, 0, _countof(shaderResourceViews), shaderResourceViews);
+    }
+
+    inline void UpdatePerMaterialConstantBuffer(
+        Context const &context,
+        DeviceMesh const &mesh,
+        std::vector<DeviceMaterial> const &materials,
+        DeviceConstBuffers const &cbuffersDevice,
+        HostConstBuffers::PerMaterial &cbuffersHost)
+    {
+        FillPerMaterialConstantBuffer(mesh, materials, cbuffersHost);
         context.pImmediateContext->UpdateSubresource(cbuffersDevice.pPerMaterial, 0, nullptr, &cbuffersHost, 0, 0);
-        context.pImmediateContext->PSSetShaderResources(0, _countof(shaderResourceViews), shaderResourceViews);
+        BindMaterialTextures(context, mesh, materials);
     }
 
     inline void UpdatePerInstanceConstantBuffer(
@@ -156,7 +191,7 @@ namespace h2r
         context.pImmediateContext->UpdateSubresource(cbuffersDevice.pPerInstance, 0, nullptr, &cbuffersHost, 0, 0);
     }
 
-    inline void Draw(Context const &context, DeviceMesh const &mesh)
+    inline void BindMesh(Context const &context, DeviceMesh const &mesh)
     {
         constexpr uint32_t stride = sizeof(Vertex);
         constexpr uint32_t offset = 0;
@@ -167,6 +202,13 @@ namespace h2r
         if (mesh.indexBuffer.pIndexBuffer)
         {
             context.pImmediateContext->IASetIndexBuffer(mesh.indexBuffer.pIndexBuffer, mesh.indexBuffer.indexFormat, offset);
+        }
+    }
+
+    inline void DrawMesh(Context const &context, DeviceMesh const &mesh)
+    {
+        if (mesh.indexBuffer.pIndexBuffer)
+        {
             context.pImmediateContext->DrawIndexed(mesh.indexBuffer.indexCount, 0, 0);
         }
         else
@@ -175,6 +217,12 @@ namespace h2r
         }
     }
 
+    inline void Draw(Context const &context, DeviceMesh const &mesh)
+    {
+        BindMesh(context, mesh);
+        DrawMesh(context, mesh);
+    }
+
     inline void DrawFullScreen(Context const &context)
     {
         static RenderObject const fullscreenTriangleRO = GenerateFullscreenTriangle(context);
@@ -182,91 +230,4 @@ namespace h2r
         Draw(context, mesh);
     }
 
-    inline void DrawOpaqueRenderObjects(
-        Context const &context,
-        Application::States const &states,
-        std::vector<RenderObject> const &objects,
-        DeviceConstBuffers const &cbuffersDevice,
-        HostConstBuffers &cbuffersHost)
-    {
-        if (states.drawOpaque)
-        {
-            for (auto const &object : objects)
-            {
-                int32_t currentMaterialId = InvalidMaterialId;
-
-                for (auto const &mesh : object.model.opaqueMeshes)
-                {
-                    if (currentMaterialId != mesh.materialId)
-                    {
-                        UpdatePerMaterialConstantBuffer(context, mesh, object.model.materials, cbuffersDevice, cbuffersHost.perMaterial);
-                        currentMaterialId = mesh.materialId;
-                    }
-
-                    UpdatePerInstanceConstantBuffer(context, mesh, object.transform, cbuffersDevice, cbuffersHost.perInstance);
-
-                    Draw(context, mesh);
-                }
-            }
-        }
-    }
-
-    inline void DrawTransparentRenderObjects(
-        Context const &context,
-        Application::States const &states,
-        std::vector<RenderObject> const &objects,
-        DeviceConstBuffers const &cbuffersDevice,
-        HostConstBuffers &cbuffersHost)
-    {
-        if (states.drawTransparent)
-        {
-            for (auto const &object : objects)
-            {
-                int32_t currentMaterialId = InvalidMaterialId;
-
-                for (auto const &mesh : object.model.transparentMeshes)
-                {
-                    if (currentMaterialId != mesh.materialId)
-                    {
-                        UpdatePerMaterialConstantBuffer(context, mesh, object.model.materials, cbuffersDevice, cbuffersHost.perMaterial);
-                        currentMaterialId = mesh.materialId;
-                    }
-
-                    UpdatePerInstanceConstantBuffer(context, mesh, object.transform, cbuffersDevice, cbuffersHost.perInstance);
-
-                    Draw(context, mesh);
-                }
-            }
-        }
-    }
-
-    inline void DrawTranslucentRenderObjects(
-        Context const &context,
-        Application::States const &states,
-        std::vector<RenderObject> const &objects,
-        DeviceConstBuffers const &cbuffersDevice,
-        HostConstBuffers &cbuffersHost)
-    {
-        if (states.drawTranslucent)
-        {
-            for (auto const &object : objects)
-            {
-                int32_t currentMaterialId = InvalidMaterialId;
-
-                for (auto const &mesh : object.model.transparentMeshes)
-                {
-                    if (currentMaterialId != mesh.materialId)
-                    {
-                        UpdatePerMaterialConstantBuffer(context, mesh, object.model.materials, cbuffersDevice, cbuffersHost.perMaterial);
-                        currentMaterialId = mesh.materialId;
-                    }
-
-                    UpdatePerInstanceConstantBuffer(context, mesh, object.transform, cbuffersDevice, cbuffersHost.perInstance);
-
-                    Draw(context, mesh);
-                }
-            }
-        }
-    }
-
 } // namespace h2r
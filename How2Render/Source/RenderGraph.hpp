@@ -0,0 +1,408 @@
+#pragma once
+
+#include "Helpers/CpuProfiler.hpp"
+#include "Wrapper/Context.hpp"
+#include "Wrapper/RenderTarget.hpp"
+#include "Wrapper/Texture.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <optional>
+#include <vector>
+
+namespace h2r
+{
+
+    constexpr uint32_t g_renderGraphInvalidId = UINT32_MAX;
+
+    enum class eGraphTextureType : uint8_t
+    {
+        // Owned outside of the graph, never culled or aliased
+        Imported = 0,
+        RenderTarget,
+        ComputeTarget,
+        DepthStencil,
+    };
+
+    struct GraphTextureDescriptor
+    {
+        eGraphTextureType type = eGraphTextureType::RenderTarget;
+        uint32_t width = 0;
+        uint32_t height = 0;
+        // Ignored for depth stencil textures, those take their format from the precision
+        DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+        eDepthPrecision depthPrecision = eDepthPrecision::Unorm16;
+    };
+
+    struct GraphTexture
+    {
+        char const *name = nullptr;
+        GraphTextureDescriptor desc;
+        // Outputs are read after the graph ran, they keep their writers alive and are never aliased
+        bool isOutput = false;
+    };
+
+    struct GraphPass
+    {
+        char const *name = nullptr;
+        std::vector<uint32_t> reads;
+        std::vector<uint32_t> writes;
+        std::function<void()> execute;
+    };
+
+    // Passes are declared in submission order, a read depends on the latest earlier pass writing the texture.
+    // Compiling culls the passes nothing depends on and packs the textures of the survivors into as few
+    // allocations as possible. D3D11 has no placed resources, so textures alias by sharing one allocation
+    // when their descriptors match and their lifetimes do not overlap. Contents do not survive the frame,
+    // textures that have to are imported.
+    struct RenderGraph
+    {
+        std::vector<GraphTexture> textures;
+        std::vector<GraphPass> passes;
+
+        std::vector<uint32_t> executionOrder;
+        // Index into allocations per texture, g_renderGraphInvalidId for culled and imported textures
+        std::vector<uint32_t> textureAllocations;
+        std::vector<GraphTextureDescriptor> allocations;
+        // Every declared texture with its own allocation, as if the graph was wired by hand
+        uint64_t declaredByteSize = 0;
+        uint64_t allocatedByteSize = 0;
+    };
+
+    inline uint32_t CreateGraphTexture(RenderGraph &graph, char const *name, GraphTextureDescriptor const &desc);
+
+    inline uint32_t ImportGraphTexture(RenderGraph &graph, char const *name);
+
+    inline void MarkGraphOutput(RenderGraph &graph, uint32_t texture);
+
+    inline uint32_t AddGraphPass(
+        RenderGraph &graph, char const *name, std::vector<uint32_t> reads, std::vector<uint32_t> writes);
+
+    // Ignores passes that were left out of the declaration
+    inline void SetGraphPassExecute(RenderGraph &graph, uint32_t pass, std::function<void()> execute);
+
+    // Needs no device, the result can be inspected without creating a single texture
+    inline void CompileRenderGraph(RenderGraph &graph);
+
+    inline bool IsGraphPassCulled(RenderGraph const &graph, uint32_t pass);
+
+    inline uint64_t GetGraphTextureByteSize(GraphTextureDescriptor const &desc);
+
+    inline std::optional<std::vector<DeviceTexture>> CreateRenderGraphTextures(Context const &context, RenderGraph const &graph);
+
+    inline void CleanupRenderGraphTextures(std::vector<DeviceTexture> &allocations);
+
+    // Returns an empty texture for culled and imported textures
+    inline DeviceTexture GetGraphDeviceTexture(
+        RenderGraph const &graph, std::vector<DeviceTexture> const &allocations, uint32_t texture);
+
+    inline void ExecuteRenderGraph(RenderGraph const &graph);
+
+    inline void PrintRenderGraph(RenderGraph const &graph);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+    inline uint32_t CreateGraphTexture(RenderGraph &graph, char const *name, GraphTextureDescriptor const &desc)
+    {
+        graph.textures.push_back(GraphTexture{.name{name}, .desc{desc}});
+        return static_cast<uint32_t>(graph.textures.size() - 1);
+    }
+
+    inline uint32_t ImportGraphTexture(RenderGraph &graph, char const *name)
+    {
+        GraphTextureDescriptor desc;
+        desc.type = eGraphTextureType::Imported;
+        return CreateGraphTexture(graph, name, desc);
+    }
+
+    inline void MarkGraphOutput(RenderGraph &graph, uint32_t texture)
+    {
+        graph.textures[texture].isOutput = true;
+    }
+
+    inline uint32_t AddGraphPass(
+        RenderGraph &graph, char const *name, std::vector<uint32_t> reads, std::vector<uint32_t> writes)
+    {
+        GraphPass pass;
+        pass.name = name;
+        pass.reads = std::move(reads);
+        pass.writes = std::move(writes);
+        graph.passes.push_back(std::move(pass));
+
+        return static_cast<uint32_t>(graph.passes.size() - 1);
+    }
+
+    inline void SetGraphPassExecute(RenderGraph &graph, uint32_t pass, std::function<void()> execute)
+    {
+        if (pass != g_renderGraphInvalidId)
+        {
+            graph.passes[pass].execute = std::move(execute);
+        }
+    }
+
+    inline DXGI_FORMAT GetGraphTextureFormat(GraphTextureDescriptor const &desc)
+    {
+        if (desc.type != eGraphTextureType::DepthStencil)
+        {
+            return desc.format;
+        }
+
+        switch (desc.depthPrecision)
+        {
+        case eDepthPrecision::Unorm16:
+            return DXGI_FORMAT_R16_TYPELESS;
+        case eDepthPrecision::Unorm24:
+            return DXGI_FORMAT_R24G8_TYPELESS;
+        case eDepthPrecision::Float32:
+            return DXGI_FORMAT_R32_TYPELESS;
+        default:
+            assert(true);
+            return DXGI_FORMAT_UNKNOWN;
+        }
+    }
+
+    inline uint64_t GetGraphTextureByteSize(GraphTextureDescriptor const &desc)
+    {
+        if (desc.type == eGraphTextureType::Imported)
+        {
+            return 0;
+        }
+
+        return SurfaceByteSize(GetGraphTextureFormat(desc), desc.width, desc.height);
+    }
+
+    inline bool IsSameGraphTextureDescriptor(GraphTextureDescriptor const &lhs, GraphTextureDescriptor const &rhs)
+    {
+        return lhs.type == rhs.type && lhs.width == rhs.width && lhs.height == rhs.height &&
+               GetGraphTextureFormat(lhs) == GetGraphTextureFormat(rhs);
+    }
+
+    inline void CompileRenderGraph(RenderGraph &graph)
+    {
+        uint32_t const textureCount = static_cast<uint32_t>(graph.textures.size());
+        uint32_t const passCount = static_cast<uint32_t>(graph.passes.size());
+
+        // Producers of every read, resolved in declaration order
+        std::vector<std::vector<uint32_t>> producers(passCount);
+        std::vector<uint32_t> lastWriters(textureCount, g_renderGraphInvalidId);
+        for (uint32_t pass = 0; pass < passCount; ++pass)
+        {
+            for (uint32_t texture : graph.passes[pass].reads)
+            {
+                if (lastWriters[texture] != g_renderGraphInvalidId)
+                {
+                    producers[pass].push_back(lastWriters[texture]);
+                }
+            }
+            for (uint32_t texture : graph.passes[pass].writes)
+            {
+                lastWriters[texture] = pass;
+            }
+        }
+
+        // Walk back from the final writers of the outputs, everything not reached is culled
+        std::vector<bool> isPassAlive(passCount, false);
+        std::vector<uint32_t> stack;
+        for (uint32_t texture = 0; texture < textureCount; ++texture)
+        {
+            if (graph.textures[texture].isOutput && lastWriters[texture] != g_renderGraphInvalidId)
+            {
+                stack.push_back(lastWriters[texture]);
+            }
+        }
+        while (!stack.empty())
+        {
+            uint32_t const pass = stack.back();
+            stack.pop_back();
+            if (isPassAlive[pass])
+            {
+                continue;
+            }
+            isPassAlive[pass] = true;
+            stack.insert(stack.end(), producers[pass].begin(), producers[pass].end());
+        }
+
+        graph.executionOrder.clear();
+        for (uint32_t pass = 0; pass < passCount; ++pass)
+        {
+            if (isPassAlive[pass])
+            {
+                graph.executionOrder.push_back(pass);
+            }
+        }
+
+        // Lifetimes in execution steps, outputs stay alive until the end of the frame
+        std::vector<uint32_t> firstUses(textureCount, g_renderGraphInvalidId);
+        std::vector<uint32_t> lastUses(textureCount, 0);
+        for (uint32_t step = 0; step < graph.executionOrder.size(); ++step)
+        {
+            GraphPass const &pass = graph.passes[graph.executionOrder[step]];
+            for (auto const *textures : {&pass.reads, &pass.writes})
+            {
+                for (uint32_t texture : *textures)
+                {
+                    firstUses[texture] = std::min(firstUses[texture], step);
+                    lastUses[texture] = std::max(lastUses[texture], step);
+                }
+            }
+        }
+        for (uint32_t texture = 0; texture < textureCount; ++texture)
+        {
+            if (graph.textures[texture].isOutput)
+            {
+                lastUses[texture] = UINT32_MAX;
+            }
+        }
+
+        // Greedy interval packing, textures take the first compatible allocation that is free by then
+        std::vector<uint32_t> sortedTextures;
+        for (uint32_t texture = 0; texture < textureCount; ++texture)
+        {
+            if (graph.textures[texture].desc.type != eGraphTextureType::Imported && firstUses[texture] != g_renderGraphInvalidId)
+            {
+                sortedTextures.push_back(texture);
+            }
+        }
+        std::stable_sort(sortedTextures.begin(), sortedTextures.end(), [&firstUses](uint32_t lhs, uint32_t rhs) {
+            return firstUses[lhs] < firstUses[rhs];
+        });
+
+        graph.textureAllocations.assign(textureCount, g_renderGraphInvalidId);
+        graph.allocations.clear();
+        std::vector<uint32_t> allocationLastUses;
+        for (uint32_t texture : sortedTextures)
+        {
+            GraphTextureDescriptor const &desc = graph.textures[texture].desc;
+
+            uint32_t allocation = 0;
+            while (allocation < graph.allocations.size() &&
+                   (allocationLastUses[allocation] >= firstUses[texture] ||
+                    !IsSameGraphTextureDescriptor(graph.allocations[allocation], desc)))
+            {
+                ++allocation;
+            }
+
+            if (allocation == graph.allocations.size())
+            {
+                graph.allocations.push_back(desc);
+                allocationLastUses.push_back(0);
+            }
+            allocationLastUses[allocation] = lastUses[texture];
+            graph.textureAllocations[texture] = allocation;
+        }
+
+        graph.declaredByteSize = 0;
+        for (GraphTexture const &texture : graph.textures)
+        {
+            graph.declaredByteSize += GetGraphTextureByteSize(texture.desc);
+        }
+        graph.allocatedByteSize = 0;
+        for (GraphTextureDescriptor const &desc : graph.allocations)
+        {
+            graph.allocatedByteSize += GetGraphTextureByteSize(desc);
+        }
+    }
+
+    inline bool IsGraphPassCulled(RenderGraph const &graph, uint32_t pass)
+    {
+        return std::find(graph.executionOrder.begin(), graph.executionOrder.end(), pass) == graph.executionOrder.end();
+    }
+
+    inline std::optional<std::vector<DeviceTexture>> CreateRenderGraphTextures(Context const &context, RenderGraph const &graph)
+    {
+        std::vector<DeviceTexture> allocations;
+        allocations.reserve(graph.allocations.size());
+
+        for (GraphTextureDescriptor const &desc : graph.allocations)
+        {
+            std::optional<DeviceTexture> texture;
+            switch (desc.type)
+            {
+            case eGraphTextureType::RenderTarget:
+                texture = CreateRenderTargetTexture(context, desc.width, desc.height, desc.format);
+                break;
+            case eGraphTextureType::ComputeTarget:
+                texture = CreateComputeTargetTexture(context, desc.width, desc.height, desc.format);
+                break;
+            case eGraphTextureType::DepthStencil:
+                texture = CreateDepthStencilTexture(context, desc.width, desc.height, desc.depthPrecision);
+                break;
+            default:
+                assert(true);
+                break;
+            }
+
+            if (!texture)
+            {
+                printf("Failed to create render graph texture\n");
+                CleanupRenderGraphTextures(allocations);
+                return std::nullopt;
+            }
+            allocations.push_back(texture.value());
+        }
+
+        return allocations;
+    }
+
+    inline void CleanupRenderGraphTextures(std::vector<DeviceTexture> &allocations)
+    {
+        for (DeviceTexture &texture : allocations)
+        {
+            CleanupDeviceTexture(texture);
+        }
+        allocations.clear();
+    }
+
+    inline DeviceTexture GetGraphDeviceTexture(
+        RenderGraph const &graph, std::vector<DeviceTexture> const &allocations, uint32_t texture)
+    {
+        uint32_t const allocation = graph.textureAllocations[texture];
+        return allocation != g_renderGraphInvalidId ? allocations[allocation] : DeviceTexture{};
+    }
+
+    inline void ExecuteRenderGraph(RenderGraph const &graph)
+    {
+        for (uint32_t pass : graph.executionOrder)
+        {
+            if (graph.passes[pass].execute)
+            {
+                H2R_CPU_ZONE(graph.passes[pass].name);
+                graph.passes[pass].execute();
+            }
+        }
+    }
+
+    inline void PrintRenderGraph(RenderGraph const &graph)
+    {
+        for (uint32_t pass = 0; pass < graph.passes.size(); ++pass)
+        {
+            printf("  %-28s %s\n", graph.passes[pass].name, IsGraphPassCulled(graph, pass) ? "culled" : "");
+        }
+        for (uint32_t texture = 0; texture < graph.textures.size(); ++texture)
+        {
+            GraphTexture const &graphTexture = graph.textures[texture];
+            if (graphTexture.desc.type == eGraphTextureType::Imported)
+            {
+                continue;
+            }
+            if (graph.textureAllocations[texture] == g_renderGraphInvalidId)
+            {
+                printf("  %-28s culled\n", graphTexture.name);
+            }
+            else
+            {
+                printf("  %-28s allocation %u\n", graphTexture.name, graph.textureAllocations[texture]);
+            }
+        }
+        printf("  Peak render target memory: %.2f MB declared, %.2f MB allocated in %zu textures\n",
+               graph.declaredByteSize / (1024.0 * 1024.0),
+               graph.allocatedByteSize / (1024.0 * 1024.0),
+               graph.allocations.size());
+    }
+
+} // namespace h2r
@@ -1,9 +1,13 @@
 #pragma once
 
+#include "Helpers/BoundingVolumeHierarchy.hpp"
+#include "Helpers/FrustumCulling.hpp"
 #include "Helpers/ModelLoader.hpp"
+#include "Helpers/OcclusionCulling.hpp"
 #include "Helpers/TextureCache.hpp"
 #include "Math.hpp"
 #include "Wrapper/Context.hpp"
+#include <algorithm>
 
 namespace h2r
 {
@@ -19,12 +23,57 @@ namespace h2r
 	{
 		DeviceModel model;
 		Transform transform;
+		// Shadows of static objects are rendered once into the shadow cache, moving one redraws it
+		bool isStatic = true;
+	};
+
+	enum class eMeshList : uint8_t
+	{
+		Opaque,
+		Transparent,
+	};
+
+	struct MeshReference
+	{
+		uint32_t objectIndex = 0;
+		uint32_t meshIndex = 0;
+	};
+
+	// Below this many meshes a linear SIMD scan beats traversing a hierarchy
+	constexpr size_t g_renderObjectBvhMinMeshCount = 64;
+
+	// World space bounds of one mesh list of every object, entry i belongs to meshes[i]. The meshes
+	// of object i start at entry objectFirstEntries[i]. Large lists are culled through the bvh.
+	struct RenderObjectBounds
+	{
+		eMeshList meshList = eMeshList::Opaque;
+		CullingBounds bounds;
+		Bvh bvh;
+		std::vector<MeshReference> meshes;
+		std::vector<uint32_t> objectFirstEntries;
+	};
+
+	// Meshes that passed culling for one pass, in object and mesh order so material changes stay grouped
+	struct VisibleMeshes
+	{
+		std::vector<uint32_t> indices;
+		std::vector<MeshReference> meshes;
+		uint32_t culledCount = 0;
 	};
 
 	struct RenderObjectStorage
 	{
 		std::vector<RenderObject> opaque;
 		std::vector<RenderObject> translucent;
+		RenderObjectBounds opaqueBounds;
+		RenderObjectBounds transparentBounds;
+		RenderObjectBounds translucentBounds;
+		// Large opaque meshes rasterized into the occlusion buffer, static so built once at load time
+		OccluderSet occluders;
+		// World box around the opaque meshes, the shadow cascades extend towards the light up to it
+		MeshBounds shadowCasterBounds;
+		// Bumped whenever static objects are added, removed or changed, invalidates the shadow cache
+		uint32_t staticRevision = 0;
 	};
 
 	inline Transform CreateTransform(XMFLOAT3 position, XMFLOAT3 orientation, float scale)
@@ -49,6 +98,149 @@ namespace h2r
 		return object;
 	}
 
+	inline std::vector<DeviceMesh> const &GetMeshList(DeviceModel const &model, eMeshList meshList)
+	{
+		return meshList == eMeshList::Opaque ? model.opaqueMeshes : model.transparentMeshes;
+	}
+
+	// Has to run again whenever objects are added, removed or reordered, moved objects only need RefitRenderObjectBounds
+	inline void UpdateRenderObjectBounds(std::vector<RenderObject> const &objects, RenderObjectBounds &bounds)
+	{
+		ClearCullingBounds(bounds.bounds);
+		bounds.meshes.clear();
+		bounds.objectFirstEntries.clear();
+
+		for (uint32_t objectIndex = 0; objectIndex < objects.size(); ++objectIndex)
+		{
+			auto const &object = objects[objectIndex];
+			auto const &meshes = GetMeshList(object.model, bounds.meshList);
+			bounds.objectFirstEntries.push_back(static_cast<uint32_t>(bounds.meshes.size()));
+			for (uint32_t meshIndex = 0; meshIndex < meshes.size(); ++meshIndex)
+			{
+				MeshBounds const world = TransformMeshBounds(meshes[meshIndex].bounds, object.transform.world);
+				AddCullingBounds(bounds.bounds, world.center, world.extents, world.radius);
+				bounds.meshes.push_back(MeshReference{objectIndex, meshIndex});
+			}
+		}
+
+		bounds.bvh = bounds.meshes.size() >= g_renderObjectBvhMinMeshCount ? CreateBvh(bounds.bounds) : Bvh{};
+	}
+
+	// Updates the world bounds of an object after its transform changed and refits the bvh above them
+	inline void RefitRenderObjectBounds(
+		std::vector<RenderObject> const &objects, uint32_t objectIndex, RenderObjectBounds &bounds)
+	{
+		auto const &object = objects[objectIndex];
+		auto const &meshes = GetMeshList(object.model, bounds.meshList);
+		uint32_t const firstEntry = bounds.objectFirstEntries[objectIndex];
+		for (uint32_t meshIndex = 0; meshIndex < meshes.size(); ++meshIndex)
+		{
+			MeshBounds const world = TransformMeshBounds(meshes[meshIndex].bounds, object.transform.world);
+			SetCullingBounds(bounds.bounds, firstEntry + meshIndex, world.center, world.extents, world.radius);
+			if (!bounds.bvh.nodes.empty())
+			{
+				RefitBvh(bounds.bvh, bounds.bounds, firstEntry + meshIndex);
+			}
+		}
+	}
+
+	inline RenderObjectBounds CreateRenderObjectBounds(std::vector<RenderObject> const &objects, eMeshList meshList)
+	{
+		RenderObjectBounds bounds;
+		bounds.meshList = meshList;
+		UpdateRenderObjectBounds(objects, bounds);
+
+		return bounds;
+	}
+
+	// Moves an opaque object and refits both of its mesh lists. Moving a static object redraws the shadow cache.
+	inline void MoveRenderObject(RenderObjectStorage &storage, uint32_t objectIndex, Transform const &transform)
+	{
+		storage.opaque[objectIndex].transform = transform;
+		RefitRenderObjectBounds(storage.opaque, objectIndex, storage.opaqueBounds);
+		RefitRenderObjectBounds(storage.opaque, objectIndex, storage.transparentBounds);
+		if (storage.opaque[objectIndex].isStatic)
+		{
+			++storage.staticRevision;
+		}
+	}
+
+	// With culling disabled every mesh is visible, which keeps the draw loops on a single path
+	inline void CullRenderObjects(
+		Frustum const &frustum, RenderObjectBounds const &bounds, bool isCullingEnabled, VisibleMeshes &visible)
+	{
+		visible.meshes.clear();
+		if (isCullingEnabled)
+		{
+			if (bounds.bvh.nodes.empty())
+			{
+				CullBounds(frustum, bounds.bounds, visible.indices);
+			}
+			else
+			{
+				// Keeps the list order, so material changes stay grouped
+				QueryBvh(bounds.bvh, bounds.bounds, frustum, visible.indices);
+				std::sort(visible.indices.begin(), visible.indices.end());
+			}
+			for (uint32_t index : visible.indices)
+			{
+				visible.meshes.push_back(bounds.meshes[index]);
+			}
+		}
+		else
+		{
+			visible.meshes = bounds.meshes;
+		}
+		visible.culledCount = static_cast<uint32_t>(bounds.meshes.size() - visible.meshes.size());
+	}
+
+	// Runs on what frustum culling left over, the indices are only there with culling enabled
+	inline uint32_t CullOccludedRenderObjects(
+		OcclusionBuffer const &buffer, RenderObjectBounds const &bounds, VisibleMeshes &visible)
+	{
+		uint32_t const occludedCount = CullOccludedBounds(buffer, bounds.bounds, visible.indices);
+
+		visible.meshes.clear();
+		for (uint32_t index : visible.indices)
+		{
+			visible.meshes.push_back(bounds.meshes[index]);
+		}
+		visible.culledCount += occludedCount;
+
+		return occludedCount;
+	}
+
+	// Keeps only the meshes of static objects, or only those of the others, in their order. Only the
+	// mesh references are filtered, the indices are left to the frustum and occlusion culling.
+	inline void FilterStaticRenderObjects(std::vector<RenderObject> const &objects, bool isStatic, VisibleMeshes &visible)
+	{
+		std::erase_if(visible.meshes, [&objects, isStatic](MeshReference const &mesh) {
+			return objects[mesh.objectIndex].isStatic != isStatic;
+		});
+	}
+
+	// Puts the visible meshes in the order of the given bounds entries, order holds every entry once
+	inline void OrderVisibleMeshes(
+		std::vector<uint32_t> const &order, RenderObjectBounds const &bounds, VisibleMeshes &visible)
+	{
+		std::vector<uint8_t> isVisible(bounds.meshes.size(), 0);
+		for (MeshReference const &mesh : visible.meshes)
+		{
+			isVisible[bounds.objectFirstEntries[mesh.objectIndex] + mesh.meshIndex] = 1;
+		}
+
+		visible.indices.clear();
+		visible.meshes.clear();
+		for (uint32_t entry : order)
+		{
+			if (isVisible[entry])
+			{
+				visible.indices.push_back(entry);
+				visible.meshes.push_back(bounds.meshes[entry]);
+			}
+		}
+	}
+
 	inline void CleanupRenderObject(RenderObject &renderObject)
 	{
 		CleanupDeviceModel(renderObject.model);
@@ -3,8 +3,10 @@
 #include "Wrapper/BlendState.hpp"
 #include "Wrapper/ConstantBuffer.hpp"
 #include "Wrapper/Context.hpp"
+#include "Wrapper/Query.hpp"
 #include "Wrapper/RenderTarget.hpp"
 #include "Wrapper/Shader.hpp"
+#include "Wrapper/StateCache.hpp"
 
 namespace h2r
 {
@@ -68,15 +70,15 @@ namespace h2r
     {
         if (countVS > 0)
         {
-            context.pImmediateContext->VSSetShaderResources(offsetVS, countVS, resourcesVS);
+            SetCachedShaderResources(context, eShaderStage::Vertex, offsetVS, countVS, resourcesVS);
         }
         if (countPS > 0)
         {
-            context.pImmediateContext->PSSetShaderResources(offsetPS, countPS, resourcesPS);
+            SetCachedShaderResources(context, eShaderStage::Pixel, offsetPS, countPS, resourcesPS);
         }
         if (countCS > 0)
         {
-            context.pImmediateContext->CSSetShaderResources(0, countCS, resourcesCS);
+            SetCachedShaderResources(context, eShaderStage::Compute, 0, countCS, resourcesCS);
         }
     }
 
@@ -93,36 +95,42 @@ namespace h2r
         if (countVS > 0)
         {
             nullResources.resize(countVS, nullptr);
-            context.pImmediateContext->VSSetShaderResources(offsetVS, countVS, nullResources.data());
+            SetCachedShaderResources(context, eShaderStage::Vertex, offsetVS, countVS, nullResources.data());
         }
         if (countPS > 0)
         {
             nullResources.resize(countPS, nullptr);
-            context.pImmediateContext->PSSetShaderResources(offsetPS, countPS, nullResources.data());
+            SetCachedShaderResources(context, eShaderStage::Pixel, offsetPS, countPS, nullResources.data());
         }
         if (countCS > 0)
         {
             nullResources.resize(countCS, nullptr);
-            context.pImmediateContext->CSSetShaderResources(0, countCS, nullResources.data());
+            SetCachedShaderResources(context, eShaderStage::Compute, 0, countCS, nullResources.data());
         }
     }
 
-    inline void BindViewport(Context const &context, uint32_t width, uint32_t height)
+    inline void BindViewport(Context const &context, uint32_t width, uint32_t height, uint32_t left = 0, uint32_t top = 0)
     {
         D3D11_VIEWPORT viewport;
         viewport.Width = (FLOAT)width;
         viewport.Height = (FLOAT)height;
         viewport.MinDepth = 0.0f;
         viewport.MaxDepth = 1.0f;
-        viewport.TopLeftX = 0;
-        viewport.TopLeftY = 0;
+        viewport.TopLeftX = (FLOAT)left;
+        viewport.TopLeftY = (FLOAT)top;
 
-        context.pImmediateContext->RSSetViewports(1, &viewport);
+        SetCachedViewport(context, viewport);
     }
 
     inline void BindRenderPass(Context const &context, Pass const &pass)
     {
         context.pAnnotation->BeginEvent(pass.name);
+        BeginGpuProfilerScope(context, pass.name);
+        // Outputs go first, so inputs still bound from the previous pass get dropped only when they alias them
+        BindRenderTargets(
+            context,
+            pass.targets.data(), (uint32_t)pass.targets.size(), pass.depthStencilView,
+            pass.targetsCS.data(), (uint32_t)pass.targetsCS.size());
         BindShaderResources(
             context,
             pass.resourcesVS.data(),
@@ -133,10 +141,6 @@ namespace h2r
             pass.resourceOffsetPS,
             pass.resourcesCS.data(),
             (uint32_t)pass.resourcesCS.size());
-        BindRenderTargets(
-            context,
-            pass.targets.data(), (uint32_t)pass.targets.size(), pass.depthStencilView,
-            pass.targetsCS.data(), (uint32_t)pass.targetsCS.size());
 
         if (pass.program)
         {
@@ -155,6 +159,10 @@ namespace h2r
         {
             BindBlendState(context, *pass.blendState);
         }
+        else
+        {
+            UnbindBlendState(context);
+        }
         if (pass.depthStencilView)
         {
             BindDepthStencilState(context, pass.depthStencilState);
@@ -163,7 +171,7 @@ namespace h2r
         BindViewport(context, pass.viewportSize.x, pass.viewportSize.y);
         if (pass.rasterizerState)
         {
-            context.pImmediateContext->RSSetState(pass.rasterizerState);
+            SetCachedRasterizerState(context, pass.rasterizerState);
         }
         ClearRenderTargets(
             context,
@@ -175,19 +183,25 @@ namespace h2r
 
     inline void UnbindRenderPass(Context const &context, Pass const &pass)
     {
-        UnbindShaderResources(
-            context,
-            (uint32_t)pass.resourcesVS.size(),
-            pass.resourceOffsetVS,
-            (uint32_t)pass.resourcesPS.size(),
-            pass.resourceOffsetPS,
-            (uint32_t)pass.resourcesCS.size());
-        UnbindRenderTargets(context, (uint32_t)pass.targetsCS.size());
-        UnbindShaders(context);
-        UnbindConstantBuffer(context);
-        UnbindSamplers(context, (uint32_t)pass.samplerStates.size());
-        UnbindBlendState(context);
-        UnbindDepthStencilState(context);
+        // With a state cache the bindings stay in place for the next pass, it only drops the ones that
+        // turn into hazards. Without one everything is reset, as nothing knows what the next pass reads.
+        if (context.pStateCache == nullptr)
+        {
+            UnbindShaderResources(
+                context,
+                (uint32_t)pass.resourcesVS.size(),
+                pass.resourceOffsetVS,
+                (uint32_t)pass.resourcesPS.size(),
+                pass.resourceOffsetPS,
+                (uint32_t)pass.resourcesCS.size());
+            UnbindRenderTargets(context, (uint32_t)pass.targetsCS.size());
+            UnbindShaders(context);
+            UnbindConstantBuffer(context);
+            UnbindSamplers(context, (uint32_t)pass.samplerStates.size());
+            UnbindBlendState(context);
+            UnbindDepthStencilState(context);
+        }
+        EndGpuProfilerScope(context);
         context.pAnnotation->EndEvent();
     }
 
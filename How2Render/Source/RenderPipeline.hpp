@@ -1,7 +1,9 @@
 #pragma once
 
 #include "Application.hpp"
+#include "RenderGraph.hpp"
 #include "RenderPass.hpp"
+#include "ShadowCascades.hpp"
 #include "Wrapper/RasterizerState.hpp"
 #include <cstdint>
 
@@ -22,6 +24,8 @@ namespace h2r
 
             TextureSamplers samplers;
 
+            // Owned by the shadow cache, it outlives the graph textures
+            DeviceTexture shadowCache;
             DeviceTexture shadowDepth;
             DeviceTexture ao1;
             DeviceTexture ao2;
@@ -33,6 +37,46 @@ namespace h2r
             DeviceTexture noiseTexture;
         };
 
+        // Render graph ids, the frame graph owns the textures behind them
+        struct GraphTextures
+        {
+            uint32_t depth = g_renderGraphInvalidId;
+            uint32_t shadowCache = g_renderGraphInvalidId;
+            uint32_t shadowDepth = g_renderGraphInvalidId;
+            uint32_t ao1 = g_renderGraphInvalidId;
+            uint32_t ao2 = g_renderGraphInvalidId;
+            uint32_t normalXY = g_renderGraphInvalidId;
+            uint32_t ambientRG = g_renderGraphInvalidId;
+            uint32_t diffuseAmbientB = g_renderGraphInvalidId;
+            uint32_t specularShininess = g_renderGraphInvalidId;
+            uint32_t basePass = g_renderGraphInvalidId;
+            uint32_t gammaCorrection = g_renderGraphInvalidId;
+            uint32_t debug = g_renderGraphInvalidId;
+        };
+
+        // Passes left out of the graph for the current states keep g_renderGraphInvalidId
+        struct GraphPasses
+        {
+            uint32_t depthPrePassOpaque = g_renderGraphInvalidId;
+            uint32_t depthPrePassTransparent = g_renderGraphInvalidId;
+            uint32_t shadowCacheOpaque = g_renderGraphInvalidId;
+            uint32_t shadowCacheTransparent = g_renderGraphInvalidId;
+            uint32_t shadowCacheComposite = g_renderGraphInvalidId;
+            uint32_t shadowDepthOpaque = g_renderGraphInvalidId;
+            uint32_t shadowDepthTransparent = g_renderGraphInvalidId;
+            uint32_t ssao = g_renderGraphInvalidId;
+            uint32_t ssaoVerticalBlurPass = g_renderGraphInvalidId;
+            uint32_t ssaoHorizontalBlurPass = g_renderGraphInvalidId;
+            uint32_t deferredGBufferPassOpaque = g_renderGraphInvalidId;
+            uint32_t deferredShadingOpaque = g_renderGraphInvalidId;
+            uint32_t forwardShadingOpaque = g_renderGraphInvalidId;
+            uint32_t forwardShadingTransparent = g_renderGraphInvalidId;
+            uint32_t forwardShadingTranclucent = g_renderGraphInvalidId;
+            uint32_t gammaCorrection = g_renderGraphInvalidId;
+            uint32_t debug = g_renderGraphInvalidId;
+            uint32_t ui = g_renderGraphInvalidId;
+        };
+
         struct Shaders
         {
             ShaderProgram depthPrePassOpaque;
@@ -40,6 +84,7 @@ namespace h2r
 
             ShaderProgram shadowDepthOpaque;
             ShaderProgram shadowDepthTransparent;
+            ShaderProgram shadowCacheComposite;
 
             ShaderProgram ssaoCompute;
             ShaderProgram ssaoVerticalBlur;
@@ -70,6 +115,9 @@ namespace h2r
 
         Pass depthPrePassOpaque;
         Pass depthPrePassTransparent;
+        Pass shadowCacheOpaque;
+        Pass shadowCacheTransparent;
+        Pass shadowCacheComposite;
         Pass shadowDepthOpaque;
         Pass shadowDepthTransparent;
         Pass ssao;
@@ -89,6 +137,21 @@ namespace h2r
 
     inline void CleanupPipelineTextures(Pipeline::Textures &textures);
 
+    // Only the shading path and debug output picked in the states are declared, the graph culls the passes
+    // and textures that fed the others
+    inline Pipeline::GraphPasses DeclarePipelineGraph(
+        RenderGraph &graph,
+        Pipeline::GraphTextures &textures,
+        uint32_t width,
+        uint32_t height,
+        Application::States const &states);
+
+    inline void ResolvePipelineGraphTextures(
+        RenderGraph const &graph,
+        std::vector<DeviceTexture> const &allocations,
+        Pipeline::GraphTextures const &ids,
+        Pipeline::Textures &textures);
+
     inline std::optional<Pipeline::Shaders> CreatePipelineShaders(Context const &context);
 
     inline void CleanupPipelineShaders(Pipeline::Shaders &shaders);
@@ -108,148 +171,168 @@ namespace h2r
         Pipeline::Shaders const &shaders,
         Pipeline::ConstBuffers const &cbuffers,
         Pipeline::States const &states,
-        Pipeline::Textures const &textures);
+        Pipeline::Textures const &textures,
+        Application::eFinalOutput finalOutput);
 
 } // namespace h2r
 
 namespace h2r
 {
 
-    inline std::optional<Pipeline::Textures::GBuffers> CreateGBuffers(
-        Context const &context, uint32_t width, uint32_t height)
-    {
-        Pipeline::Textures::GBuffers gbuffers;
-
-        {
-            auto texture = CreateRenderTargetTexture(context, width, height, DXGI_FORMAT_R8G8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create Normal GBuffer device texture\n");
-                return std::nullopt;
-            }
-            gbuffers.normalXY = texture.value();
-        }
-        {
-            auto texture = CreateRenderTargetTexture(context, width, height, DXGI_FORMAT_R8G8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create Ambient GBuffer device texture\n");
-                return std::nullopt;
-            }
-            gbuffers.ambientRG = texture.value();
-        }
-        {
-            auto texture = CreateRenderTargetTexture(context, width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create Diffuse GBuffer device texture\n");
-                return std::nullopt;
-            }
-            gbuffers.diffuseAmbientB = texture.value();
-        }
-        {
-            auto texture = CreateRenderTargetTexture(context, width, height, DXGI_FORMAT_R8G8B8A8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create Specular GBuffer device texture\n");
-                return std::nullopt;
-            }
-            gbuffers.specularShininess = texture.value();
-        }
-
-        return gbuffers;
-    }
-
     inline std::optional<Pipeline::Textures>
     CreatePipelineTextures(Context const &context, Swapchain const &swapchain)
     {
-        auto const windowSize = XMUINT2(swapchain.width, swapchain.height);
         Pipeline::Textures textures;
         textures.samplers = CreateTextureSamplers(context);
         textures.swapchain = swapchain;
-        textures.gbuffers = CreateGBuffers(context, windowSize.x, windowSize.y).value();
 
         {
-            auto texture = CreateDepthStencilTexture(context, 2048, 2048, eDepthPrecision::Unorm16);
-            if (!texture)
-            {
-                printf("Failed to create shadow depth texture!\n");
-                return std::nullopt;
-            }
-            textures.shadowDepth = texture.value();
+            textures.noiseTexture = GenerateNoiseTexture(context, 16, 16);
         }
 
-        {
-            auto texture = CreateComputeTargetTexture(context, windowSize.x, windowSize.y, DXGI_FORMAT_R8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create ao render target!\n");
-                return std::nullopt;
-            }
-            textures.ao1 = texture.value();
-        }
+        return textures;
+    }
 
-        {
-            auto texture = CreateComputeTargetTexture(context, windowSize.x, windowSize.y, DXGI_FORMAT_R8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create ao render target!\n");
-                return std::nullopt;
-            }
-            textures.ao2 = texture.value();
-        }
+    inline void CleanupPipelineTextures(Pipeline::Textures &textures)
+    {
+        CleanupTextureSamplers(textures.samplers);
+        CleanupDeviceTexture(textures.noiseTexture);
+    }
 
-        {
-            auto texture = CreateRenderTargetTexture(context, windowSize.x, windowSize.y, DXGI_FORMAT_R8G8B8A8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create shading pass render target!\n");
-                return std::nullopt;
-            }
-            textures.basePass = texture.value();
-        }
+    inline Pipeline::GraphPasses DeclarePipelineGraph(
+        RenderGraph &graph,
+        Pipeline::GraphTextures &textures,
+        uint32_t width,
+        uint32_t height,
+        Application::States const &states)
+    {
+        auto const renderTarget = [width, height](DXGI_FORMAT format) {
+            return GraphTextureDescriptor{
+                .type{eGraphTextureType::RenderTarget}, .width{width}, .height{height}, .format{format}};
+        };
+        auto const computeTarget = [width, height](DXGI_FORMAT format) {
+            return GraphTextureDescriptor{
+                .type{eGraphTextureType::ComputeTarget}, .width{width}, .height{height}, .format{format}};
+        };
 
+        textures.depth = ImportGraphTexture(graph, "Depth");
+        // Static casters around the whole scene, kept across frames while the light and the geometry stay
+        textures.shadowCache = ImportGraphTexture(graph, "Shadow cache");
+        // Atlas of every cascade side by side, the shadow passes move the viewport from tile to tile.
+        // Cascades filled from the cache start with its reprojected depth, the rest of the casters is
+        // drawn on top.
+        textures.shadowDepth = CreateGraphTexture(
+            graph,
+            "Shadow depth",
+            GraphTextureDescriptor{
+                .type{eGraphTextureType::DepthStencil},
+                .width{g_shadowCascadeResolution * g_shadowCascadeCount},
+                .height{g_shadowCascadeResolution},
+                .depthPrecision{eDepthPrecision::Unorm16},
+            });
+        textures.ao1 = CreateGraphTexture(graph, "AO 1", computeTarget(DXGI_FORMAT_R8_UNORM));
+        textures.ao2 = CreateGraphTexture(graph, "AO 2", computeTarget(DXGI_FORMAT_R8_UNORM));
+        textures.normalXY = CreateGraphTexture(graph, "GBuffer normal", renderTarget(DXGI_FORMAT_R8G8_UNORM));
+        textures.ambientRG = CreateGraphTexture(graph, "GBuffer ambient", renderTarget(DXGI_FORMAT_R8G8_UNORM));
+        textures.diffuseAmbientB = CreateGraphTexture(graph, "GBuffer diffuse", renderTarget(DXGI_FORMAT_R8G8B8A8_UNORM));
+        textures.specularShininess = CreateGraphTexture(graph, "GBuffer specular", renderTarget(DXGI_FORMAT_R8G8B8A8_UNORM));
+        textures.basePass = CreateGraphTexture(graph, "Base pass", renderTarget(DXGI_FORMAT_R8G8B8A8_UNORM));
+        textures.gammaCorrection = CreateGraphTexture(graph, "Gamma correction", renderTarget(DXGI_FORMAT_R8G8B8A8_UNORM));
+        textures.debug = CreateGraphTexture(graph, "Debug", renderTarget(DXGI_FORMAT_R8G8B8A8_UNORM));
+        MarkGraphOutput(graph, textures.debug);
+
+        auto const &t = textures;
+        Pipeline::GraphPasses passes;
+
+        passes.depthPrePassOpaque = AddGraphPass(graph, "Depth pre-pass opaque", {}, {t.depth, t.normalXY});
+        passes.depthPrePassTransparent = AddGraphPass(
+            graph, "Depth pre-pass transparent", {t.depth, t.normalXY}, {t.depth, t.normalXY});
+
+        if (states.shadowMappingEnabled)
         {
-            auto texture = CreateRenderTargetTexture(context, windowSize.x, windowSize.y, DXGI_FORMAT_R8G8B8A8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create gamma correction render target!\n");
-                return std::nullopt;
-            }
-            textures.gammaCorrection = texture.value();
+            passes.shadowCacheOpaque = AddGraphPass(graph, "Shadow cache opaque", {}, {t.shadowCache});
+            passes.shadowCacheTransparent = AddGraphPass(
+                graph, "Shadow cache transparent", {t.shadowCache}, {t.shadowCache});
+            passes.shadowCacheComposite = AddGraphPass(graph, "Shadow cache composite", {t.shadowCache}, {t.shadowDepth});
+            passes.shadowDepthOpaque = AddGraphPass(graph, "Shadow depth opaque", {t.shadowDepth}, {t.shadowDepth});
+            passes.shadowDepthTransparent = AddGraphPass(
+                graph, "Shadow depth transparent", {t.shadowDepth}, {t.shadowDepth});
         }
 
+        passes.ssao = AddGraphPass(graph, "SSAO", {t.depth, t.normalXY}, {t.ao1});
+        passes.ssaoVerticalBlurPass = AddGraphPass(graph, "SSAO blur vertical", {t.ao1}, {t.ao2});
+        passes.ssaoHorizontalBlurPass = AddGraphPass(graph, "SSAO blur horizontal", {t.ao2}, {t.ao1});
+
+        passes.deferredGBufferPassOpaque = AddGraphPass(
+            graph, "GBuffer pass opaque", {t.depth}, {t.ambientRG, t.diffuseAmbientB, t.specularShininess});
+        switch (states.shadingType)
         {
-            auto texture = CreateRenderTargetTexture(context, windowSize.x, windowSize.y, DXGI_FORMAT_R8G8B8A8_UNORM);
-            if (!texture)
-            {
-                printf("Failed to create debug render target!\n");
-                return std::nullopt;
-            }
-            textures.debug = texture.value();
+        case Application::eShadingType::Forward:
+            passes.forwardShadingOpaque = AddGraphPass(
+                graph, "Forward shading opaque", {t.depth, t.ao1, t.shadowDepth}, {t.basePass});
+            break;
+        case Application::eShadingType::Deferred:
+            passes.deferredShadingOpaque = AddGraphPass(
+                graph,
+                "Deferred shading opaque",
+                {t.depth, t.normalXY, t.ambientRG, t.diffuseAmbientB, t.specularShininess, t.ao1, t.shadowDepth},
+                {t.basePass});
+            break;
+        default:
+            printf("Invalid shading type\n");
+            assert(true);
+            break;
         }
 
+        passes.forwardShadingTransparent = AddGraphPass(
+            graph, "Transparent", {t.depth, t.ao1, t.shadowDepth, t.basePass}, {t.basePass});
+        passes.forwardShadingTranclucent = AddGraphPass(
+            graph, "Translucent", {t.depth, t.basePass}, {t.depth, t.basePass});
+        passes.gammaCorrection = AddGraphPass(graph, "Gamma correction", {t.basePass}, {t.gammaCorrection});
+
+        // Has to match what GetDebugPassResources binds
+        std::vector<uint32_t> debugReads;
+        switch (states.finalOutput)
         {
-            textures.noiseTexture = GenerateNoiseTexture(context, 16, 16);
+        case Application::eFinalOutput::FinalImage:
+            debugReads = {t.gammaCorrection};
+            break;
+        case Application::eFinalOutput::Depth:
+        case Application::eFinalOutput::ShadowMap:
+            debugReads = {t.depth};
+            break;
+        case Application::eFinalOutput::Normals:
+            debugReads = {t.normalXY};
+            break;
+        case Application::eFinalOutput::AO:
+            debugReads = {t.ao1};
+            break;
+        default:
+            debugReads = {t.ambientRG, t.diffuseAmbientB, t.specularShininess};
+            break;
         }
+        passes.debug = AddGraphPass(graph, "Debug", std::move(debugReads), {t.debug});
+        passes.ui = AddGraphPass(graph, "UI pass", {t.debug}, {t.debug});
 
-        return textures;
+        return passes;
     }
 
-    inline void CleanupPipelineTextures(Pipeline::Textures &textures)
+    inline void ResolvePipelineGraphTextures(
+        RenderGraph const &graph,
+        std::vector<DeviceTexture> const &allocations,
+        Pipeline::GraphTextures const &ids,
+        Pipeline::Textures &textures)
     {
-        CleanupTextureSamplers(textures.samplers);
-        CleanupDeviceTexture(textures.gbuffers.normalXY);
-        CleanupDeviceTexture(textures.gbuffers.ambientRG);
-        CleanupDeviceTexture(textures.gbuffers.diffuseAmbientB);
-        CleanupDeviceTexture(textures.gbuffers.specularShininess);
-        CleanupDeviceTexture(textures.shadowDepth);
-        CleanupDeviceTexture(textures.ao1);
-        CleanupDeviceTexture(textures.ao2);
-        CleanupDeviceTexture(textures.basePass);
-        CleanupDeviceTexture(textures.gammaCorrection);
-        CleanupDeviceTexture(textures.debug);
-        CleanupDeviceTexture(textures.noiseTexture);
+        textures.shadowDepth = GetGraphDeviceTexture(graph, allocations, ids.shadowDepth);
+        textures.ao1 = GetGraphDeviceTexture(graph, allocations, ids.ao1);
+        textures.ao2 = GetGraphDeviceTexture(graph, allocations, ids.ao2);
+        textures.gbuffers.normalXY = GetGraphDeviceTexture(graph, allocations, ids.normalXY);
+        textures.gbuffers.ambientRG = GetGraphDeviceTexture(graph, allocations, ids.ambientRG);
+        textures.gbuffers.diffuseAmbientB = GetGraphDeviceTexture(graph, allocations, ids.diffuseAmbientB);
+        textures.gbuffers.specularShininess = GetGraphDeviceTexture(graph, allocations, ids.specularShininess);
+        textures.basePass = GetGraphDeviceTexture(graph, allocations, ids.basePass);
+        textures.gammaCorrection = GetGraphDeviceTexture(graph, allocations, ids.gammaCorrection);
+        textures.debug = GetGraphDeviceTexture(graph, allocations, ids.debug);
     }
 
     inline std::optional<Pipeline::Shaders> CreatePipelineShaders(Context const &context)
@@ -308,6 +391,19 @@ namespace h2r
             return std::nullopt;
         }
 
+        ShaderProgramDescriptor shadowCacheCompositeDesc;
+        shadowCacheCompositeDesc.vertexShaderPath = "Shaders/ShadowCacheComposite.fx";
+        shadowCacheCompositeDesc.pixelShaderPath = "Shaders/ShadowCacheComposite.fx";
+        if (auto shader = CreateShaderProgram(context, shadowCacheCompositeDesc); shader)
+        {
+            shaders.shadowCacheComposite = shader.value();
+        }
+        else
+        {
+            CleanupPipelineShaders(shaders);
+            return std::nullopt;
+        }
+
         ShaderProgramDescriptor ssaoComputeDescriptor;
         ssaoComputeDescriptor.computeShaderPath = "Shaders/SSAO.fx";
         ssaoComputeDescriptor.computeShaderEntryPoint = "ComputeSSAO";
@@ -431,6 +527,7 @@ namespace h2r
         CleanupShaderProgram(shaders.depthPrePassTransparent);
         CleanupShaderProgram(shaders.shadowDepthOpaque);
         CleanupShaderProgram(shaders.shadowDepthTransparent);
+        CleanupShaderProgram(shaders.shadowCacheComposite);
         CleanupShaderProgram(shaders.ssaoCompute);
         CleanupShaderProgram(shaders.ssaoVerticalBlur);
         CleanupShaderProgram(shaders.ssaoHorizontalBlur);
@@ -527,12 +624,44 @@ namespace h2r
         CleanupDepthStencilStates(states.depthStencil);
     }
 
+    // Aliased textures share views, so the debug pass only binds what it shows
+    inline std::vector<ID3D11ShaderResourceView *> GetDebugPassResources(
+        Swapchain const &swapchain, Pipeline::Textures const &textures, Application::eFinalOutput finalOutput)
+    {
+        std::vector<ID3D11ShaderResourceView *> resources(8, nullptr);
+
+        switch (finalOutput)
+        {
+        case Application::eFinalOutput::FinalImage:
+            resources[0] = textures.gammaCorrection.shaderResourceView;
+            break;
+        case Application::eFinalOutput::Depth:
+        case Application::eFinalOutput::ShadowMap:
+            resources[1] = swapchain.depthStencilShaderResourceView;
+            break;
+        case Application::eFinalOutput::AO:
+            resources[2] = textures.ao1.shaderResourceView;
+            break;
+        case Application::eFinalOutput::Normals:
+            resources[4] = textures.gbuffers.normalXY.shaderResourceView;
+            break;
+        default:
+            resources[5] = textures.gbuffers.ambientRG.shaderResourceView;
+            resources[6] = textures.gbuffers.diffuseAmbientB.shaderResourceView;
+            resources[7] = textures.gbuffers.specularShininess.shaderResourceView;
+            break;
+        }
+
+        return resources;
+    }
+
     inline Pipeline CreateRenderPipeline(
         Swapchain const &swapchain,
         Pipeline::Shaders const &shaders,
         Pipeline::ConstBuffers const &cbuffers,
         Pipeline::States const &states,
-        Pipeline::Textures const &textures)
+        Pipeline::Textures const &textures,
+        Application::eFinalOutput finalOutput)
     {
         return Pipeline{
             .depthPrePassOpaque{
@@ -577,6 +706,70 @@ namespace h2r
                 .clearFlags{RENDER_PASS_CLEAR_FLAG_NONE},
                 .clearValue{DirectX::Colors::Black},
             },
+            .shadowCacheOpaque{
+                .name{L"Shadow cache opaque"},
+                .type{ePassType::Regular},
+                .viewportSize{textures.shadowCache.width, textures.shadowCache.height},
+                .program{&shaders.shadowDepthOpaque},
+                .blendState{&states.blend.none},
+                .rasterizerState{states.rasterizer.shadowDepth},
+                .samplerStates{textures.samplers.pPointSampler},
+                .cbuffers{&cbuffers.device},
+                .resourcesVS{},
+                .resourceOffsetVS{0},
+                .resourcesPS{},
+                .resourceOffsetPS{0},
+                .resourcesCS{},
+                .depthStencilState{states.depthStencil.pLessReadWrite},
+                .depthStencilView{textures.shadowCache.depthStencilView},
+                .targets{},
+                .targetsCS{},
+                .clearFlags{RENDER_PASS_CLEAR_FLAG_DEPTH_STENCIL},
+                .clearValue{DirectX::Colors::Black},
+            },
+            .shadowCacheTransparent{
+                .name{L"Shadow cache transparent"},
+                .type{ePassType::Regular},
+                .viewportSize{textures.shadowCache.width, textures.shadowCache.height},
+                .program{&shaders.shadowDepthTransparent},
+                .blendState{&states.blend.none},
+                .rasterizerState{states.rasterizer.shadowDepth},
+                .samplerStates{textures.samplers.pPointSampler},
+                .cbuffers{&cbuffers.device},
+                .resourcesVS{},
+                .resourceOffsetVS{0},
+                .resourcesPS{},
+                .resourceOffsetPS{0},
+                .resourcesCS{},
+                .depthStencilState{states.depthStencil.pLessReadWrite},
+                .depthStencilView{textures.shadowCache.depthStencilView},
+                .targets{},
+                .targetsCS{},
+                .clearFlags{RENDER_PASS_CLEAR_FLAG_NONE},
+                .clearValue{DirectX::Colors::Black},
+            },
+            // Clears the atlas, then fills the tiles of the cascades that read the cache one by one
+            .shadowCacheComposite{
+                .name{L"Shadow cache composite"},
+                .type{ePassType::FullScreen},
+                .viewportSize{textures.shadowDepth.width, textures.shadowDepth.height},
+                .program{&shaders.shadowCacheComposite},
+                .blendState{&states.blend.none},
+                .rasterizerState{states.rasterizer.defaultRS},
+                .samplerStates{},
+                .cbuffers{&cbuffers.device},
+                .resourcesVS{},
+                .resourceOffsetVS{0},
+                .resourcesPS{textures.shadowCache.shaderResourceView},
+                .resourceOffsetPS{0},
+                .resourcesCS{},
+                .depthStencilState{states.depthStencil.pAlwaysWrite},
+                .depthStencilView{textures.shadowDepth.depthStencilView},
+                .targets{},
+                .targetsCS{},
+                .clearFlags{RENDER_PASS_CLEAR_FLAG_DEPTH_STENCIL},
+                .clearValue{DirectX::Colors::Black},
+            },
             .shadowDepthOpaque{
                 .name{L"Shadow depth opaque"},
                 .type{ePassType::Regular},
@@ -595,7 +788,7 @@ namespace h2r
                 .depthStencilView{textures.shadowDepth.depthStencilView},
                 .targets{},
                 .targetsCS{},
-                .clearFlags{RENDER_PASS_CLEAR_FLAG_DEPTH_STENCIL},
+                .clearFlags{RENDER_PASS_CLEAR_FLAG_NONE},
                 .clearValue{DirectX::Colors::Black},
             },
             .shadowDepthTransparent{
@@ -851,16 +1044,7 @@ namespace h2r
                 .cbuffers{&cbuffers.device},
                 .resourcesVS{},
                 .resourceOffsetVS{0},
-                .resourcesPS{
-                    textures.gammaCorrection.shaderResourceView,
-                    swapchain.depthStencilShaderResourceView,
-                    textures.ao1.shaderResourceView,
-                    textures.shadowDepth.shaderResourceView,
-                    textures.gbuffers.normalXY.shaderResourceView,
-                    textures.gbuffers.ambientRG.shaderResourceView,
-                    textures.gbuffers.diffuseAmbientB.shaderResourceView,
-                    textures.gbuffers.specularShininess.shaderResourceView,
-                },
+                .resourcesPS{GetDebugPassResources(swapchain, textures, finalOutput)},
                 .resourceOffsetPS{0},
                 .resourcesCS{},
                 .depthStencilState{states.depthStencil.pDisable},
@@ -2,27 +2,61 @@
 
 #include "Camera.hpp"
 #include "DirectionalLight.hpp"
+#include "DrawPacket.hpp"
+#include "Helpers/CpuProfiler.hpp"
+#include "Helpers/DepthSort.hpp"
 #include "Helpers/MeshGenerator.hpp"
 #include "RenderCommon.hpp"
 #include "RenderObject.hpp"
 #include "RenderPipeline.hpp"
+#include "ShadowCache.hpp"
+#include "ShadowCascades.hpp"
 #include "UserInterface.hpp"
+#include "Wrapper/FramePacer.hpp"
 #include "Wrapper/Query.hpp"
 #include "Wrapper/Shader.hpp"
+#include "Wrapper/StateCache.hpp"
+#include <cmath>
 
 namespace h2r
 {
 
     inline RenderObjectStorage LoadRenderObjectStorage(Context const &context, TextureCache &cache)
     {
+        H2R_CPU_ZONE("LoadRenderObjectStorage");
+
         HostModel const sponzaHostModel = LoadObjModel("Data\\Models\\sponza\\sponza.obj", cache).value();
         DeviceModel const sponzaDeviceModel = CreateDeviceModel(context, cache, sponzaHostModel);
         RenderObject const sponzaRenderObject = CreateRenderObject(sponzaDeviceModel, {0, 0, 0}, {0, 0, 0}, 0.01f);
 
-        std::vector<RenderObject> opaqueObjects = {sponzaRenderObject};
-        std::vector<RenderObject> translucentObjects = GenerateSpheres(context, cache);
+        RenderObjectStorage storage;
+        storage.opaque = {sponzaRenderObject, GenerateDynamicSphere(context, cache)};
+        storage.translucent = GenerateSpheres(context, cache);
+        storage.opaqueBounds = CreateRenderObjectBounds(storage.opaque, eMeshList::Opaque);
+        storage.transparentBounds = CreateRenderObjectBounds(storage.opaque, eMeshList::Transparent);
+        storage.translucentBounds = CreateRenderObjectBounds(storage.translucent, eMeshList::Transparent);
+        SelectOccluderMeshes(
+            storage.occluders, sponzaHostModel.opaqueMeshes, sponzaRenderObject.transform.world, g_occluderTriangleBudget);
+        printf("Occluders: %zu triangles\n", storage.occluders.indices.size() / 3);
+        storage.shadowCasterBounds = CalculateShadowCasterBounds(storage.opaqueBounds.bounds);
+        PrintTextureCacheStats(cache);
+
+        return storage;
+    }
+
+    // Dynamic objects circle the middle of the atrium, the shadow cache keeps the static scene meanwhile
+    inline void AnimateDynamicRenderObjects(RenderObjectStorage &storage, float angle)
+    {
+        H2R_CPU_ZONE("AnimateDynamicRenderObjects");
 
-        return RenderObjectStorage{opaqueObjects, translucentObjects};
+        for (uint32_t i = 0; i < storage.opaque.size(); ++i)
+        {
+            if (!storage.opaque[i].isStatic)
+            {
+                XMFLOAT3 const position = {2.5f * std::cos(angle), 1.5f, 2.5f * std::sin(angle)};
+                MoveRenderObject(storage, i, CreateTransform(position, {0, -angle, 0}, 1.f));
+            }
+        }
     }
 
     inline void CleanupRenderObjectStorage(RenderObjectStorage &storage)
@@ -53,13 +87,217 @@ namespace h2r
         }
     }
 
-    inline void SortTranslucentRenderObjects(Camera const &camera, std::vector<RenderObject> &translucentObjects)
+    struct FrameVisibility
+    {
+        VisibleMeshes cameraOpaque;
+        VisibleMeshes cameraTransparent;
+        VisibleMeshes cameraTranslucent;
+        // Static casters drawn into the shadow cache, left empty while it is current
+        VisibleMeshes shadowCacheOpaque;
+        VisibleMeshes shadowCacheTransparent;
+        // One list per cascade, each only holds the casters that intersect the volume of its cascade.
+        // Cascades filled from the shadow cache only keep the dynamic ones.
+        std::array<VisibleMeshes, g_shadowCascadeCount> shadowOpaque;
+        std::array<VisibleMeshes, g_shadowCascadeCount> shadowTransparent;
+        // Camera view depth of the occluders, shadow lists are only frustum culled
+        OcclusionBuffer occlusion = CreateOcclusionBuffer();
+        // Every translucent mesh back to front, only resorted when the camera moved
+        DepthSort translucentDepthSort;
+    };
+
+    // Culls every mesh list against the camera and every shadow cascade and publishes the counters to the UI
+    inline void CullRenderObjectStorage(
+        Camera const &camera,
+        ShadowCascades const &shadowCascades,
+        ShadowCache const &shadowCache,
+        bool isShadowCacheCurrent,
+        RenderObjectStorage const &storage,
+        Application::States &states,
+        FrameVisibility &visibility)
+    {
+        H2R_CPU_ZONE("CullRenderObjectStorage");
+
+        bool const isEnabled = states.frustumCullingEnabled;
+
+        Frustum const cameraFrustum = CreateFrustum(camera.viewProj);
+        CullRenderObjects(cameraFrustum, storage.opaqueBounds, isEnabled, visibility.cameraOpaque);
+        CullRenderObjects(cameraFrustum, storage.transparentBounds, isEnabled, visibility.cameraTransparent);
+        CullRenderObjects(cameraFrustum, storage.translucentBounds, isEnabled, visibility.cameraTranslucent);
+
+        states.occlusionCulledMeshCount = 0;
+        if (isEnabled && states.occlusionCullingEnabled)
+        {
+            H2R_CPU_ZONE("OcclusionCulling");
+            ClearOcclusionBuffer(visibility.occlusion, camera.viewProj);
+            RasterizeOccluders(visibility.occlusion, storage.occluders);
+            states.occlusionCulledMeshCount =
+                CullOccludedRenderObjects(visibility.occlusion, storage.opaqueBounds, visibility.cameraOpaque) +
+                CullOccludedRenderObjects(visibility.occlusion, storage.transparentBounds, visibility.cameraTransparent) +
+                CullOccludedRenderObjects(visibility.occlusion, storage.translucentBounds, visibility.cameraTranslucent);
+        }
+        OrderVisibleMeshes(visibility.translucentDepthSort.order, storage.translucentBounds, visibility.cameraTranslucent);
+
+        VisibleMeshes &cacheOpaque = visibility.shadowCacheOpaque;
+        VisibleMeshes &cacheTransparent = visibility.shadowCacheTransparent;
+        if (shadowCache.isValid && !isShadowCacheCurrent)
+        {
+            CullShadowCacheCasters(shadowCache, storage.opaque, storage.opaqueBounds, isEnabled, cacheOpaque);
+            CullShadowCacheCasters(shadowCache, storage.opaque, storage.transparentBounds, isEnabled, cacheTransparent);
+        }
+        else
+        {
+            cacheOpaque.meshes.clear();
+            cacheOpaque.culledCount = 0;
+            cacheTransparent.meshes.clear();
+            cacheTransparent.culledCount = 0;
+        }
+        states.shadowDrawnMeshCount = static_cast<uint32_t>(cacheOpaque.meshes.size() + cacheTransparent.meshes.size());
+        states.shadowCulledMeshCount = cacheOpaque.culledCount + cacheTransparent.culledCount;
+
+        states.shadowCacheCascadeCount = 0;
+        for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+        {
+            ShadowCascade const &cascade = shadowCascades.cascades[i];
+            VisibleMeshes &opaque = visibility.shadowOpaque[i];
+            VisibleMeshes &transparent = visibility.shadowTransparent[i];
+            CullShadowCascadeCasters(shadowCache, cascade, storage.opaque, storage.opaqueBounds, isEnabled, opaque);
+            CullShadowCascadeCasters(shadowCache, cascade, storage.opaque, storage.transparentBounds, isEnabled, transparent);
+            states.shadowCacheCascadeCount += IsShadowCascadeCached(shadowCache, cascade) ? 1 : 0;
+
+            states.shadowDrawnMeshCount += static_cast<uint32_t>(opaque.meshes.size() + transparent.meshes.size());
+            states.shadowCulledMeshCount += opaque.culledCount + transparent.culledCount;
+        }
+
+        states.cameraDrawnMeshCount = static_cast<uint32_t>(
+            visibility.cameraOpaque.meshes.size() + visibility.cameraTransparent.meshes.size() + visibility.cameraTranslucent.meshes.size());
+        states.cameraCulledMeshCount =
+            visibility.cameraOpaque.culledCount + visibility.cameraTransparent.culledCount + visibility.cameraTranslucent.culledCount;
+    }
+
+    // Cascades of a shadow pass share its id, each one gets its own queue
+    inline std::array<DrawPacketQueue, g_shadowCascadeCount> CreateShadowDrawPacketQueues(uint8_t pass, eMeshList meshList)
     {
-        std::sort(translucentObjects.begin(), translucentObjects.end(), [&camera](auto const &a, auto const &b) {
-            auto const aLengthSq = std::abs(XMVector3LengthSq(a.transform.position - camera.position).m128_f32[0]);
-            auto const bLengthSq = std::abs(XMVector3LengthSq(b.transform.position - camera.position).m128_f32[0]);
-            return aLengthSq > bLengthSq;
-        });
+        std::array<DrawPacketQueue, g_shadowCascadeCount> queues;
+        for (DrawPacketQueue &queue : queues)
+        {
+            queue = CreateDrawPacketQueue(pass, meshList, eDrawDepthOrder::None);
+        }
+
+        return queues;
+    }
+
+    // One queue per pass that draws meshes, queues are indexed in submission order
+    struct FrameDrawPackets
+    {
+        DrawKeyTable opaqueKeys;
+        DrawKeyTable transparentKeys;
+        DrawKeyTable translucentKeys;
+
+        DrawPacketQueue depthPrePassOpaque = CreateDrawPacketQueue(0, eMeshList::Opaque, eDrawDepthOrder::FrontToBack);
+        DrawPacketQueue depthPrePassTransparent = CreateDrawPacketQueue(1, eMeshList::Transparent, eDrawDepthOrder::FrontToBack);
+        DrawPacketQueue shadowCacheOpaque = CreateDrawPacketQueue(2, eMeshList::Opaque, eDrawDepthOrder::None);
+        DrawPacketQueue shadowCacheTransparent = CreateDrawPacketQueue(3, eMeshList::Transparent, eDrawDepthOrder::None);
+        std::array<DrawPacketQueue, g_shadowCascadeCount> shadowDepthOpaque = CreateShadowDrawPacketQueues(4, eMeshList::Opaque);
+        std::array<DrawPacketQueue, g_shadowCascadeCount> shadowDepthTransparent = CreateShadowDrawPacketQueues(5, eMeshList::Transparent);
+        // Shading passes test depth for equality against the pre pass, so only state order matters
+        DrawPacketQueue shadingOpaque = CreateDrawPacketQueue(6, eMeshList::Opaque, eDrawDepthOrder::None);
+        DrawPacketQueue shadingTransparent = CreateDrawPacketQueue(7, eMeshList::Transparent, eDrawDepthOrder::None);
+        DrawPacketQueue shadingTranslucent = CreateDrawPacketQueue(8, eMeshList::Transparent, eDrawDepthOrder::BackToFront);
+
+        DrawStateCounters counters;
+    };
+
+    inline void UpdateFrameDrawKeyTables(RenderObjectStorage const &storage, FrameDrawPackets &packets)
+    {
+        UpdateDrawKeyTable(storage.opaque, storage.opaqueBounds, packets.opaqueKeys);
+        UpdateDrawKeyTable(storage.opaque, storage.transparentBounds, packets.transparentKeys);
+        UpdateDrawKeyTable(storage.translucent, storage.translucentBounds, packets.translucentKeys);
+    }
+
+    // Emits and sorts the packets of every pass from this frame's visibility lists
+    inline void BuildFrameDrawPackets(
+        Camera const &camera,
+        RenderObjectStorage const &storage,
+        Application::States const &states,
+        FrameVisibility const &visibility,
+        FrameDrawPackets &packets)
+    {
+        H2R_CPU_ZONE("BuildFrameDrawPackets");
+
+        auto const build = [&camera](
+            DrawPacketQueue &queue, bool isEnabled, DrawKeyTable const &table, RenderObjectBounds const &bounds, VisibleMeshes const &visible) {
+            queue.packets.clear();
+            if (isEnabled)
+            {
+                EmitDrawPackets(queue, table, bounds, visible, camera);
+                SortDrawPackets(queue);
+            }
+        };
+
+        build(packets.depthPrePassOpaque, states.drawOpaque, packets.opaqueKeys, storage.opaqueBounds, visibility.cameraOpaque);
+        build(packets.depthPrePassTransparent, states.drawTransparent, packets.transparentKeys, storage.transparentBounds, visibility.cameraTransparent);
+        build(packets.shadowCacheOpaque, states.drawOpaque, packets.opaqueKeys, storage.opaqueBounds, visibility.shadowCacheOpaque);
+        build(packets.shadowCacheTransparent, states.drawTransparent, packets.transparentKeys, storage.transparentBounds, visibility.shadowCacheTransparent);
+        for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+        {
+            build(packets.shadowDepthOpaque[i], states.drawOpaque, packets.opaqueKeys, storage.opaqueBounds, visibility.shadowOpaque[i]);
+            build(packets.shadowDepthTransparent[i], states.drawTransparent, packets.transparentKeys, storage.transparentBounds, visibility.shadowTransparent[i]);
+        }
+        build(packets.shadingOpaque, states.drawOpaque, packets.opaqueKeys, storage.opaqueBounds, visibility.cameraOpaque);
+        build(packets.shadingTransparent, states.drawTransparent, packets.transparentKeys, storage.transparentBounds, visibility.cameraTransparent);
+        build(packets.shadingTranslucent, states.drawTranslucent, packets.translucentKeys, storage.translucentBounds, visibility.cameraTranslucent);
+
+        packets.counters = DrawStateCounters{};
+    }
+
+    // The pipeline graph together with the states it was declared for
+    struct FrameRenderGraph
+    {
+        RenderGraph graph;
+        Pipeline::GraphTextures textures;
+        Pipeline::GraphPasses passes;
+        std::vector<DeviceTexture> allocations;
+
+        Application::eShadingType shadingType = Application::eShadingType::Count;
+        Application::eFinalOutput finalOutput = Application::eFinalOutput::Count;
+        bool shadowMappingEnabled = false;
+    };
+
+    inline bool IsFrameRenderGraphOutdated(FrameRenderGraph const &frameGraph, Application::States const &states)
+    {
+        return frameGraph.shadingType != states.shadingType ||
+               frameGraph.finalOutput != states.finalOutput ||
+               frameGraph.shadowMappingEnabled != states.shadowMappingEnabled;
+    }
+
+    // Declares and compiles the graph for the current states and recreates its textures, pass bodies are
+    // attached by the caller
+    inline bool BuildFrameRenderGraph(
+        Context const &context, Swapchain const &swapchain, Application::States &states, FrameRenderGraph &frameGraph)
+    {
+        CleanupRenderGraphTextures(frameGraph.allocations);
+
+        frameGraph.graph = RenderGraph{};
+        frameGraph.passes = DeclarePipelineGraph(frameGraph.graph, frameGraph.textures, swapchain.width, swapchain.height, states);
+        CompileRenderGraph(frameGraph.graph);
+
+        auto allocations = CreateRenderGraphTextures(context, frameGraph.graph);
+        if (!allocations)
+        {
+            printf("Failed to create render graph textures\n");
+            return false;
+        }
+        frameGraph.allocations = allocations.value();
+        frameGraph.shadingType = states.shadingType;
+        frameGraph.finalOutput = states.finalOutput;
+        frameGraph.shadowMappingEnabled = states.shadowMappingEnabled;
+
+        states.renderTargetDeclaredByteSize = frameGraph.graph.declaredByteSize;
+        states.renderTargetAllocatedByteSize = frameGraph.graph.allocatedByteSize;
+        printf("Render graph compiled\n");
+        PrintRenderGraph(frameGraph.graph);
+
+        return true;
     }
 
     inline void Present(
@@ -68,6 +306,8 @@ namespace h2r
         ID3D11Resource *sourceTexture,
         ID3D11Resource *presentTexture)
     {
+        H2R_CPU_ZONE("Present");
+
         // Blit off screen texture to back buffer
         context.pImmediateContext->CopyResource(presentTexture, sourceTexture);
         swapchain.pSwapChain->Present(0, 0);
@@ -81,140 +321,282 @@ namespace h2r
         Application app = CreateApplication(window);
         InitUI(window, app.context);
 
-        PerformaceQueries queries = CreatePerformanceQueries(app.context);
+        // The profiler reads a frame back once its queries come around again, by then the pacer waited for it
+        static_assert(g_gpuProfilerFrameCount > g_maxFramesInFlight);
+        GpuProfiler gpuProfiler = CreateGpuProfiler(app.context).value();
         auto cbuffers = CreatePipelineConstBuffers(app.context).value();
         auto states = CreatePipelineStates(app.context).value();
         auto textures = CreatePipelineTextures(app.context, app.swapchain).value();
         auto shaders = CreatePipelineShaders(app.context).value();
+        ShadowCache shadowCache = CreateShadowCache(app.context).value();
+        textures.shadowCache = shadowCache.depth;
+        bool isShadowCacheCurrent = false;
+        ShadowCascades shadowCascades;
+        // Changes made while drawing the UI apply to the next frame, the first one sees everything changed
+        FrameChangeFlags pendingChanges = FRAME_CHANGE_FLAG_ALL;
+        float dynamicObjectAngle = 0.f;
 
-        Pipeline pipeline = CreateRenderPipeline(app.swapchain, shaders, cbuffers, states, textures);
+        FrameRenderGraph frameGraph;
+        Pipeline pipeline;
 
         TextureCache textureCache;
         RenderObjectStorage storage = LoadRenderObjectStorage(app.context, textureCache);
         DirectionalLight light = CreateDirectionalLight(app.context);
         UpdateInfrequentConstantBuffer(app.context, app.states, light, cbuffers.device, cbuffers.host.infrequent);
+        FrameVisibility visibility;
+        FrameDrawPackets packets;
+        UpdateFrameDrawKeyTables(storage, packets);
+        FramePacer framePacer = CreateFramePacer(app.context, app.states.framesInFlight).value();
+        // One ring per frame in flight, each is only rewritten once the GPU finished the frame that used it
+        std::vector<ConstantRing> constantRings;
+        for (uint32_t i = 0; i < g_maxFramesInFlight; ++i)
+        {
+            auto ring = CreateConstantRing(app.context, g_constantRingByteSize);
+            if (!ring)
+            {
+                break;
+            }
+            constantRings.push_back(ring.value());
+        }
+        if (constantRings.size() != g_maxFramesInFlight)
+        {
+            for (ConstantRing &ring : constantRings)
+            {
+                CleanupConstantRing(ring);
+            }
+            constantRings.clear();
+        }
+        ConstantRing *constantRing = nullptr;
+        StateCache stateCache;
+        app.context.pStateCache = &stateCache;
+        app.context.pGpuProfiler = &gpuProfiler;
+
+        // Pass bodies, the passes live in pipeline which keeps its address when it is recreated
+        auto const drawPass = [&](Pass const &pass, DrawPacketQueue &queue, std::vector<RenderObject> const &objects) {
+            return [&, &pass = pass, &queue = queue, &objects = objects]() {
+                BindRenderPass(app.context, pass);
+                UpdatePerPassConstantBuffer(app.context, pass, cbuffers.device, cbuffers.host.perPass);
+                SubmitDrawPackets(app.context, queue, objects, constantRing, cbuffers.device, cbuffers.host, packets.counters);
+                UnbindRenderPass(app.context, pass);
+            };
+        };
+        // Draws every cascade into its tile of the atlas, the pass binds the whole atlas and clears it once
+        auto const shadowPass = [&](
+            Pass const &pass, std::array<DrawPacketQueue, g_shadowCascadeCount> &queues, std::vector<RenderObject> const &objects) {
+            return [&, &pass = pass, &queues = queues, &objects = objects]() {
+                BindRenderPass(app.context, pass);
+                for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+                {
+                    BindViewport(app.context, g_shadowCascadeResolution, g_shadowCascadeResolution, i * g_shadowCascadeResolution, 0);
+                    UpdatePerPassConstantBuffer(app.context, pass, cbuffers.device, cbuffers.host.perPass, i);
+                    SubmitDrawPackets(app.context, queues[i], objects, constantRing, cbuffers.device, cbuffers.host, packets.counters);
+                }
+                UnbindRenderPass(app.context, pass);
+            };
+        };
+        // Static casters only change the cache when it went stale, otherwise it is kept from an earlier frame
+        auto const shadowCachePass = [&](Pass const &pass, DrawPacketQueue &queue, std::vector<RenderObject> const &objects) {
+            return [&, &pass = pass, &queue = queue, &objects = objects]() {
+                if (shadowCache.isValid && !isShadowCacheCurrent)
+                {
+                    BindRenderPass(app.context, pass);
+                    UpdatePerPassConstantBuffer(app.context, pass, cbuffers.device, cbuffers.host.perPass, g_shadowCacheCascadeIndex);
+                    SubmitDrawPackets(app.context, queue, objects, constantRing, cbuffers.device, cbuffers.host, packets.counters);
+                    UnbindRenderPass(app.context, pass);
+                }
+            };
+        };
+        // Graph textures do not keep their contents, every frame starts its shadow atlas from the cache
+        auto const shadowCacheCompositePass = [&]() {
+            Pass const &pass = pipeline.shadowCacheComposite;
+            BindRenderPass(app.context, pass);
+            for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+            {
+                if (IsShadowCascadeCached(shadowCache, shadowCascades.cascades[i]))
+                {
+                    BindViewport(app.context, g_shadowCascadeResolution, g_shadowCascadeResolution, i * g_shadowCascadeResolution, 0);
+                    UpdatePerPassConstantBuffer(app.context, pass, cbuffers.device, cbuffers.host.perPass, i);
+                    DrawFullScreen(app.context);
+                }
+            }
+            UnbindRenderPass(app.context, pass);
+        };
+        auto const computePass = [&](Pass const &pass, auto dispatch) {
+            return [&, &pass = pass, dispatch]() {
+                BindRenderPass(app.context, pass);
+                UpdatePerPassConstantBuffer(app.context, pass, cbuffers.device, cbuffers.host.perPass);
+                dispatch(app.context, app.states, app.swapchain);
+                UnbindRenderPass(app.context, pass);
+            };
+        };
+        auto const fullScreenPass = [&](Pass const &pass) {
+            return [&, &pass = pass]() {
+                BindRenderPass(app.context, pass);
+                UpdatePerPassConstantBuffer(app.context, pass, cbuffers.device, cbuffers.host.perPass);
+                DrawFullScreen(app.context);
+                UnbindRenderPass(app.context, pass);
+            };
+        };
+        auto const uiPass = [&]() {
+            BindRenderPass(app.context, pipeline.ui);
+            UpdatePerPassConstantBuffer(app.context, pipeline.ui, cbuffers.device, cbuffers.host.perPass);
+            FrameChangeFlags const uiChanges =
+                DrawUI(window, app.context, cbuffers.device, cbuffers.host, app.states, gpuProfiler, camera, light);
+            if (uiChanges != FRAME_CHANGE_FLAG_NONE)
+            {
+                UpdateInfrequentConstantBuffer(app.context, app.states, light, cbuffers.device, cbuffers.host.infrequent);
+                pendingChanges |= uiChanges;
+            }
+            // The ImGui backend restores what it binds except for the compute shader, which it nulls
+            stateCache.pComputeShader = nullptr;
+            UnbindRenderPass(app.context, pipeline.ui);
+        };
+
+        auto const attachGraphPasses = [&]() {
+            RenderGraph &graph = frameGraph.graph;
+            Pipeline::GraphPasses const &passes = frameGraph.passes;
+
+            SetGraphPassExecute(graph, passes.depthPrePassOpaque, drawPass(pipeline.depthPrePassOpaque, packets.depthPrePassOpaque, storage.opaque));
+            SetGraphPassExecute(graph, passes.depthPrePassTransparent, drawPass(pipeline.depthPrePassTransparent, packets.depthPrePassTransparent, storage.opaque));
+            SetGraphPassExecute(graph, passes.shadowCacheOpaque, shadowCachePass(pipeline.shadowCacheOpaque, packets.shadowCacheOpaque, storage.opaque));
+            SetGraphPassExecute(graph, passes.shadowCacheTransparent, shadowCachePass(pipeline.shadowCacheTransparent, packets.shadowCacheTransparent, storage.opaque));
+            SetGraphPassExecute(graph, passes.shadowCacheComposite, shadowCacheCompositePass);
+            SetGraphPassExecute(graph, passes.shadowDepthOpaque, shadowPass(pipeline.shadowDepthOpaque, packets.shadowDepthOpaque, storage.opaque));
+            SetGraphPassExecute(graph, passes.shadowDepthTransparent, shadowPass(pipeline.shadowDepthTransparent, packets.shadowDepthTransparent, storage.opaque));
+            SetGraphPassExecute(graph, passes.ssao, computePass(pipeline.ssao, DispatchSSAO));
+            SetGraphPassExecute(graph, passes.ssaoVerticalBlurPass, computePass(pipeline.ssaoVerticalBlurPass, DispatchSsaoBlur));
+            SetGraphPassExecute(graph, passes.ssaoHorizontalBlurPass, computePass(pipeline.ssaoHorizontalBlurPass, DispatchSsaoBlur));
+            SetGraphPassExecute(graph, passes.deferredGBufferPassOpaque, drawPass(pipeline.deferredGBufferPassOpaque, packets.shadingOpaque, storage.opaque));
+            SetGraphPassExecute(graph, passes.deferredShadingOpaque, fullScreenPass(pipeline.deferredShadingOpaque));
+            SetGraphPassExecute(graph, passes.forwardShadingOpaque, drawPass(pipeline.forwardShadingOpaque, packets.shadingOpaque, storage.opaque));
+            SetGraphPassExecute(graph, passes.forwardShadingTransparent, drawPass(pipeline.forwardShadingTransparent, packets.shadingTransparent, storage.opaque));
+            SetGraphPassExecute(graph, passes.forwardShadingTranclucent, drawPass(pipeline.forwardShadingTranclucent, packets.shadingTranslucent, storage.translucent));
+            SetGraphPassExecute(graph, passes.gammaCorrection, fullScreenPass(pipeline.gammaCorrection));
+            SetGraphPassExecute(graph, passes.debug, fullScreenPass(pipeline.debug));
+            SetGraphPassExecute(graph, passes.ui, uiPass);
+        };
 
         while (!inputs.quit)
         {
+            if (framePacer.latency != static_cast<uint32_t>(app.states.framesInFlight))
+            {
+                SetFramePacerLatency(app.context, framePacer, app.states.framesInFlight);
+            }
+            uint32_t const frameSlot = BeginFramePacerFrame(app.context, framePacer);
+
+            H2R_CPU_ZONE("Frame");
+
             UpdateInput(inputs);
+            ResetStateCacheCounters(stateCache);
+            FrameChangeFlags changes = pendingChanges;
+            pendingChanges = FRAME_CHANGE_FLAG_NONE;
+            if (!constantRings.empty())
+            {
+                constantRing = &constantRings[frameSlot];
+                BeginConstantRingFrame(*constantRing, framePacer.frameIndex >= g_maxFramesInFlight);
+            }
             if (ReloadePipelineShaders(app.context, inputs, shaders))
             {
                 UpdateInfrequentConstantBuffer(app.context, app.states, light, cbuffers.device, cbuffers.host.infrequent);
+                changes |= FRAME_CHANGE_FLAG_SHADERS;
             }
-            UpdateCamera(camera, inputs, window);
-            UpdatePerFrameConstantBuffer(app.context, camera, cbuffers.device, cbuffers.host.perFrame);
-
-            BeginQueryGpuTime(app.context, queries);
-
-            // Pre pass
+            if (IsFrameRenderGraphOutdated(frameGraph, app.states))
             {
-                BindRenderPass(app.context, pipeline.depthPrePassOpaque);
-                UpdatePerPassConstantBuffer(app.context, pipeline.depthPrePassOpaque, cbuffers.device, cbuffers.host.perPass);
-                DrawOpaqueRenderObjects(app.context, app.states, storage.opaque, cbuffers.device, cbuffers.host);
-                UnbindRenderPass(app.context, pipeline.depthPrePassOpaque);
-
-                BindRenderPass(app.context, pipeline.depthPrePassTransparent);
-                UpdatePerPassConstantBuffer(app.context, pipeline.depthPrePassTransparent, cbuffers.device, cbuffers.host.perPass);
-                DrawTransparentRenderObjects(app.context, app.states, storage.opaque, cbuffers.device, cbuffers.host);
-                UnbindRenderPass(app.context, pipeline.depthPrePassTransparent);
+                if (!BuildFrameRenderGraph(app.context, app.swapchain, app.states, frameGraph))
+                {
+                    break;
+                }
+                ResolvePipelineGraphTextures(frameGraph.graph, frameGraph.allocations, frameGraph.textures, textures);
+                pipeline = CreateRenderPipeline(app.swapchain, shaders, cbuffers, states, textures, app.states.finalOutput);
+                attachGraphPasses();
             }
-
-            // Shadow depths
-            if (app.states.shadowMappingEnabled)
+            if (UpdateCamera(camera, inputs, window))
             {
-                BindRenderPass(app.context, pipeline.shadowDepthOpaque);
-                UpdatePerPassConstantBuffer(app.context, pipeline.shadowDepthOpaque, cbuffers.device, cbuffers.host.perPass);
-                DrawOpaqueRenderObjects(app.context, app.states, storage.opaque, cbuffers.device, cbuffers.host);
-                UnbindRenderPass(app.context, pipeline.shadowDepthOpaque);
-
-                BindRenderPass(app.context, pipeline.shadowDepthTransparent);
-                UpdatePerPassConstantBuffer(app.context, pipeline.shadowDepthTransparent, cbuffers.device, cbuffers.host.perPass);
-                DrawTransparentRenderObjects(app.context, app.states, storage.opaque, cbuffers.device, cbuffers.host);
-                UnbindRenderPass(app.context, pipeline.shadowDepthTransparent);
+                changes |= FRAME_CHANGE_FLAG_CAMERA;
             }
-
-            // SSAO
+            // Moves are refits of the object bounds, only moved static objects invalidate the shadow cache
+            if (app.states.dynamicObjectsAnimated)
             {
-                BindRenderPass(app.context, pipeline.ssao);
-                UpdatePerPassConstantBuffer(app.context, pipeline.ssao, cbuffers.device, cbuffers.host.perPass);
-                DispatchSSAO(app.context, app.states, app.swapchain);
-                UnbindRenderPass(app.context, pipeline.ssao);
-
-                BindRenderPass(app.context, pipeline.ssaoVerticalBlurPass);
-                UpdatePerPassConstantBuffer(app.context, pipeline.ssaoVerticalBlurPass, cbuffers.device, cbuffers.host.perPass);
-                DispatchSsaoBlur(app.context, app.states, app.swapchain);
-                UnbindRenderPass(app.context, pipeline.ssaoVerticalBlurPass);
-
-                BindRenderPass(app.context, pipeline.ssaoHorizontalBlurPass);
-                UpdatePerPassConstantBuffer(app.context, pipeline.ssaoHorizontalBlurPass, cbuffers.device, cbuffers.host.perPass);
-                DispatchSsaoBlur(app.context, app.states, app.swapchain);
-                UnbindRenderPass(app.context, pipeline.ssaoHorizontalBlurPass);
+                dynamicObjectAngle += 0.01f;
+                AnimateDynamicRenderObjects(storage, dynamicObjectAngle);
             }
-
-            switch (app.states.shadingType)
+            // The cascades follow the camera, the light and their split lambda
+            bool const isCascadeChanged =
+                (changes & (FRAME_CHANGE_FLAG_CAMERA | FRAME_CHANGE_FLAG_LIGHT | FRAME_CHANGE_FLAG_SHADOW_CASCADES)) != 0;
+            if (isCascadeChanged)
             {
-            case Application::eShadingType::Forward:
-                BindRenderPass(app.context, pipeline.forwardShadingOpaque);
-                UpdatePerPassConstantBuffer(app.context, pipeline.forwardShadingOpaque, cbuffers.device, cbuffers.host.perPass);
-                DrawOpaqueRenderObjects(app.context, app.states, storage.opaque, cbuffers.device, cbuffers.host);
-                UnbindRenderPass(app.context, pipeline.forwardShadingOpaque);
-                break;
-            case Application::eShadingType::Deferred:
-                BindRenderPass(app.context, pipeline.deferredGBufferPassOpaque);
-                UpdatePerPassConstantBuffer(app.context, pipeline.deferredGBufferPassOpaque, cbuffers.device, cbuffers.host.perPass);
-                DrawOpaqueRenderObjects(app.context, app.states, storage.opaque, cbuffers.device, cbuffers.host);
-                UnbindRenderPass(app.context, pipeline.deferredGBufferPassOpaque);
-
-                BindRenderPass(app.context, pipeline.deferredShadingOpaque);
-                UpdatePerPassConstantBuffer(app.context, pipeline.deferredShadingOpaque, cbuffers.device, cbuffers.host.perPass);
-                DrawFullScreen(app.context);
-                UnbindRenderPass(app.context, pipeline.deferredShadingOpaque);
-                break;
-            default:
-                printf("Invalid shading type\n");
-                assert(true);
-                break;
+                shadowCascades = CalculateShadowCascades(
+                    camera, light, storage.shadowCasterBounds, app.states.shadowCascadeSplitLambda);
+            }
+            // Caster settings and shaders the cache was drawn with are not part of its key, shading
+            // settings and the cascade split never reach it
+            if (changes & (FRAME_CHANGE_FLAG_SHADOW_CASTERS | FRAME_CHANGE_FLAG_SHADERS))
+            {
+                InvalidateShadowCache(shadowCache);
+            }
+            // The cache does not follow the camera, only the light and the static geometry redraw it. While it
+            // is off the cascades draw every caster, and as nothing is drawn into it then it can not be
+            // trusted afterwards.
+            isShadowCacheCurrent = false;
+            if (app.states.shadowCacheEnabled && app.states.shadowMappingEnabled)
+            {
+                isShadowCacheCurrent = UpdateShadowCache(shadowCache, light, storage.shadowCasterBounds, storage.staticRevision);
+            }
+            else
+            {
+                InvalidateShadowCache(shadowCache);
+            }
+            // A redrawn or disabled cache may change which cascades read it
+            if (isCascadeChanged || !isShadowCacheCurrent)
+            {
+                UpdatePerFrameConstantBuffer(app.context, camera, shadowCascades, shadowCache, cbuffers.device, cbuffers.host.perFrame);
             }
 
-            BindRenderPass(app.context, pipeline.forwardShadingTransparent);
-            UpdatePerPassConstantBuffer(app.context, pipeline.forwardShadingTransparent, cbuffers.device, cbuffers.host.perPass);
-            DrawTransparentRenderObjects(app.context, app.states, storage.opaque, cbuffers.device, cbuffers.host);
-            UnbindRenderPass(app.context, pipeline.forwardShadingTransparent);
-
-            SortTranslucentRenderObjects(camera, storage.translucent);
-            BindRenderPass(app.context, pipeline.forwardShadingTranclucent);
-            UpdatePerPassConstantBuffer(app.context, pipeline.forwardShadingTranclucent, cbuffers.device, cbuffers.host.perPass);
-            DrawTranslucentRenderObjects(app.context, app.states, storage.translucent, cbuffers.device, cbuffers.host);
-            UnbindRenderPass(app.context, pipeline.forwardShadingTranclucent);
-
-            BindRenderPass(app.context, pipeline.gammaCorrection);
-            UpdatePerPassConstantBuffer(app.context, pipeline.gammaCorrection, cbuffers.device, cbuffers.host.perPass);
-            DrawFullScreen(app.context);
-            UnbindRenderPass(app.context, pipeline.gammaCorrection);
-
-            EndQueryGpuTime(app.context, queries);
-            app.states.shadingGPUTimeMs = BlockAndGetGpuTimeMs(app.context, queries);
-
-            BindRenderPass(app.context, pipeline.debug);
-            UpdatePerPassConstantBuffer(app.context, pipeline.debug, cbuffers.device, cbuffers.host.perPass);
-            DrawFullScreen(app.context);
-            UnbindRenderPass(app.context, pipeline.debug);
+            // Translucent objects do not move, their order only depends on the camera
+            if (changes & FRAME_CHANGE_FLAG_CAMERA)
+            {
+                H2R_CPU_ZONE("SortTranslucentMeshes");
+                SortByViewDepth(visibility.translucentDepthSort, camera.view, storage.translucentBounds.bounds);
+            }
+            CullRenderObjectStorage(camera, shadowCascades, shadowCache, isShadowCacheCurrent, storage, app.states, visibility);
+            BuildFrameDrawPackets(camera, storage, app.states, visibility, packets);
 
-            BindRenderPass(app.context, pipeline.ui);
-            UpdatePerPassConstantBuffer(app.context, pipeline.ui, cbuffers.device, cbuffers.host.perPass);
-            if (DrawUI(window, app.context, cbuffers.device, cbuffers.host, app.states, camera, light))
             {
-                UpdateInfrequentConstantBuffer(app.context, app.states, light, cbuffers.device, cbuffers.host.infrequent);
+                H2R_CPU_ZONE("ExecuteRenderGraph");
+                BeginGpuProfilerFrame(app.context, gpuProfiler);
+                ExecuteRenderGraph(frameGraph.graph);
+                EndGpuProfilerFrame(app.context, gpuProfiler);
             }
-            UnbindRenderPass(app.context, pipeline.ui);
+
+            app.states.drawPacketCount = packets.counters.packetCount;
+            app.states.stateChangeCount = packets.counters.stateChangeCount;
+            app.states.stateChangesSaved = packets.counters.stateChangesSaved;
+            app.states.stateCallsIssued = stateCache.issuedCallCount;
+            app.states.stateCallsElided = stateCache.elidedCallCount;
+
+            app.states.cpuFrameTimeMs = framePacer.cpuFrameMs;
+            app.states.frameWaitTimeMs = framePacer.waitMs;
+            app.states.inputLatencyMs = framePacer.inputToGpuDoneMs;
+            app.states.shadowCacheSkippedFrameCount = shadowCache.skippedFrameCount;
+            app.states.shadowCacheRenderedFrameCount = shadowCache.renderedFrameCount;
 
             Present(app.context, app.swapchain, textures.debug.texture, app.swapchain.renderTargetTexture);
+            EndFramePacerFrame(app.context, framePacer);
         }
 
+        app.context.pStateCache = nullptr;
+        app.context.pGpuProfiler = nullptr;
         CleanupUI();
-        CleanupPerformanceQueries(queries);
+        CleanupGpuProfiler(gpuProfiler);
+        for (ConstantRing &ring : constantRings)
+        {
+            CleanupConstantRing(ring);
+        }
+        CleanupFramePacer(framePacer);
         CleanupPipelineShaders(shaders);
+        CleanupRenderGraphTextures(frameGraph.allocations);
         CleanupPipelineTextures(textures);
+        CleanupShadowCache(shadowCache);
         CleanupRenderObjectStorage(storage);
         FlushTextureCache(textureCache);
         CleanupApplication(app);
@@ -0,0 +1,203 @@
+#pragma once
+
+#include "DirectionalLight.hpp"
+#include "RenderObject.hpp"
+#include "ShadowCascades.hpp"
+#include "Wrapper/Context.hpp"
+#include "Wrapper/RenderTarget.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <optional>
+
+namespace h2r
+{
+
+	// The cache covers every static caster at once, so it needs more texels than a cascade tile
+	constexpr uint32_t g_shadowCacheResolution = 4096;
+
+	// Passed as the shadow cascade of a pass, the shadow depth shaders then project with the cache
+	constexpr uint32_t g_shadowCacheCascadeIndex = g_shadowCascadeCount;
+
+	// Depth of the static casters in a light space projection around all of them, kept across frames and
+	// imported into the render graph. It does not follow the camera, so only a new light direction or
+	// changed static geometry redraw it. Each frame the cascades that are not finer than the cache get
+	// their static depth reprojected from it, the others draw their static casters themselves.
+	struct ShadowCache
+	{
+		DeviceTexture depth;
+
+		XMMATRIX viewProj = {};
+		// World size of a cache texel, texels are square
+		float texelSize = 0.f;
+
+		// What the cached depth was rendered with
+		XMVECTOR lightDirection = {};
+		uint32_t staticRevision = 0;
+		bool isValid = false;
+
+		uint32_t skippedFrameCount = 0;
+		uint32_t renderedFrameCount = 0;
+	};
+
+	inline std::optional<ShadowCache> CreateShadowCache(Context const &context);
+
+	inline void CleanupShadowCache(ShadowCache &cache);
+
+	// For changes the cache can not see, such as shader reloads or edited settings
+	inline void InvalidateShadowCache(ShadowCache &cache);
+
+	// Returns true when the cached depth still matches the light and the static geometry and the cache
+	// pass can be skipped, otherwise refits the projection to the casters and takes them as the new key
+	inline bool UpdateShadowCache(
+		ShadowCache &cache, DirectionalLight const &light, MeshBounds const &casterBounds, uint32_t staticRevision);
+
+	// A cascade reads the cache only where that does not lose resolution
+	inline bool IsShadowCascadeCached(ShadowCache const &cache, ShadowCascade const &cascade);
+
+	// Maps the clip space of the cascade to the one of the cache. Both share the light view, so the
+	// mapping is affine and a cache depth turns back into a cascade depth along the same line.
+	inline XMMATRIX CalculateShadowCacheReprojection(ShadowCache const &cache, ShadowCascade const &cascade);
+
+	// Static casters to draw into the cache
+	inline void CullShadowCacheCasters(
+		ShadowCache const &cache,
+		std::vector<RenderObject> const &objects,
+		RenderObjectBounds const &bounds,
+		bool isCullingEnabled,
+		VisibleMeshes &visible);
+
+	// Casters to draw into a cascade, the static ones are left out where the cascade reads them from the cache
+	inline void CullShadowCascadeCasters(
+		ShadowCache const &cache,
+		ShadowCascade const &cascade,
+		std::vector<RenderObject> const &objects,
+		RenderObjectBounds const &bounds,
+		bool isCullingEnabled,
+		VisibleMeshes &visible);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline std::optional<ShadowCache> CreateShadowCache(Context const &context)
+	{
+		// Same precision as the shadow depth atlas the cache is reprojected into
+		auto depth = CreateDepthStencilTexture(
+			context, g_shadowCacheResolution, g_shadowCacheResolution, eDepthPrecision::Unorm16);
+		if (!depth)
+		{
+			printf("Failed to create shadow cache texture\n");
+			return std::nullopt;
+		}
+
+		ShadowCache cache;
+		cache.depth = depth.value();
+
+		return cache;
+	}
+
+	inline void CleanupShadowCache(ShadowCache &cache)
+	{
+		CleanupDeviceTexture(cache.depth);
+		cache.isValid = false;
+	}
+
+	inline void InvalidateShadowCache(ShadowCache &cache)
+	{
+		cache.isValid = false;
+	}
+
+	inline bool UpdateShadowCache(
+		ShadowCache &cache, DirectionalLight const &light, MeshBounds const &casterBounds, uint32_t staticRevision)
+	{
+		if (cache.isValid && cache.staticRevision == staticRevision && XMVector4Equal(cache.lightDirection, light.direction))
+		{
+			++cache.skippedFrameCount;
+			return true;
+		}
+
+		XMMATRIX const lightView = CreateShadowLightView(light.direction);
+		XMVECTOR minimum = XMVectorReplicate(FLT_MAX);
+		XMVECTOR maximum = XMVectorReplicate(-FLT_MAX);
+		for (float x : {-1.f, 1.f})
+		{
+			for (float y : {-1.f, 1.f})
+			{
+				for (float z : {-1.f, 1.f})
+				{
+					XMVECTOR const corner = XMVector3TransformCoord(
+						XMVectorSet(
+							casterBounds.center.x + x * casterBounds.extents.x,
+							casterBounds.center.y + y * casterBounds.extents.y,
+							casterBounds.center.z + z * casterBounds.extents.z,
+							1.f),
+						lightView);
+					minimum = XMVectorMin(minimum, corner);
+					maximum = XMVectorMax(maximum, corner);
+				}
+			}
+		}
+
+		// Square texels keep the comparison against the cascade texel size meaningful on both axes
+		float const extent = std::max(
+			XMVectorGetX(maximum) - XMVectorGetX(minimum), XMVectorGetY(maximum) - XMVectorGetY(minimum));
+		cache.texelSize = std::max(extent, 1e-3f) / g_shadowCacheResolution;
+		float const left = XMVectorGetX(minimum);
+		float const bottom = XMVectorGetY(minimum);
+		float const nearZ = XMVectorGetZ(minimum);
+		float const farZ = std::max(XMVectorGetZ(maximum), nearZ + 1e-3f);
+		cache.viewProj = XMMatrixMultiply(
+			lightView,
+			XMMatrixOrthographicOffCenterLH(
+				left, left + cache.texelSize * g_shadowCacheResolution,
+				bottom, bottom + cache.texelSize * g_shadowCacheResolution,
+				nearZ, farZ));
+
+		cache.lightDirection = light.direction;
+		cache.staticRevision = staticRevision;
+		cache.isValid = true;
+		++cache.renderedFrameCount;
+
+		return false;
+	}
+
+	inline bool IsShadowCascadeCached(ShadowCache const &cache, ShadowCascade const &cascade)
+	{
+		return cache.isValid && cascade.texelSize >= cache.texelSize;
+	}
+
+	inline XMMATRIX CalculateShadowCacheReprojection(ShadowCache const &cache, ShadowCascade const &cascade)
+	{
+		return XMMatrixMultiply(XMMatrixInverse(nullptr, cascade.viewProj), cache.viewProj);
+	}
+
+	inline void CullShadowCacheCasters(
+		ShadowCache const &cache,
+		std::vector<RenderObject> const &objects,
+		RenderObjectBounds const &bounds,
+		bool isCullingEnabled,
+		VisibleMeshes &visible)
+	{
+		CullRenderObjects(CreateFrustum(cache.viewProj), bounds, isCullingEnabled, visible);
+		FilterStaticRenderObjects(objects, true, visible);
+	}
+
+	inline void CullShadowCascadeCasters(
+		ShadowCache const &cache,
+		ShadowCascade const &cascade,
+		std::vector<RenderObject> const &objects,
+		RenderObjectBounds const &bounds,
+		bool isCullingEnabled,
+		VisibleMeshes &visible)
+	{
+		// The cascade projection reaches back to the casters, so its frustum is the caster volume
+		CullRenderObjects(CreateFrustum(cascade.viewProj), bounds, isCullingEnabled, visible);
+		if (IsShadowCascadeCached(cache, cascade))
+		{
+			FilterStaticRenderObjects(objects, false, visible);
+		}
+	}
+
+} // namespace h2r
@@ -0,0 +1,194 @@
+#pragma once
+
+#include "Camera.hpp"
+#include "DirectionalLight.hpp"
+#include "Helpers/FrustumCulling.hpp"
+#include "Math.hpp"
+#include "Mesh.hpp"
+#include "Wrapper/ConstantBuffer.hpp"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace h2r
+{
+
+	// Cascades sit side by side in one shadow atlas, each gets a square tile of this size
+	constexpr uint32_t g_shadowCascadeResolution = 2048;
+
+	struct ShadowCascade
+	{
+		XMMATRIX viewProj = {};
+		// Camera view depth range of the receivers the cascade covers
+		float splitNear = 0.f;
+		float splitFar = 0.f;
+		// World size of a shadow map texel, texels are square
+		float texelSize = 0.f;
+	};
+
+	struct ShadowCascades
+	{
+		ShadowCascade cascades[g_shadowCascadeCount] = {};
+	};
+
+	// Practical split scheme, lambda blends uniform splits (0) with logarithmic ones (1).
+	// splits[0] is zNear and splits[g_shadowCascadeCount] is zFar.
+	inline void CalculateShadowCascadeSplits(
+		float zNear, float zFar, float lambda, float (&splits)[g_shadowCascadeCount + 1]);
+
+	// Rotation only, so a texel grid snapped in light space stays put while the camera moves
+	inline XMMATRIX CreateShadowLightView(XMVECTOR direction);
+
+	// World box around every caster, the cascades reach towards the light up to it
+	inline MeshBounds CalculateShadowCasterBounds(CullingBounds const &bounds);
+
+	// Fits the projection around the bounding sphere of the camera frustum slice. Its size only depends on
+	// the split distances and the field of view, so the texel size stays fixed while the camera turns, and
+	// with the origin snapped to whole texels shadow edges do not crawl while it moves either.
+	inline ShadowCascade CalculateShadowCascade(
+		Camera const &camera,
+		XMMATRIX const &lightView,
+		MeshBounds const &casterBounds,
+		float splitNear,
+		float splitFar,
+		uint32_t resolution);
+
+	inline ShadowCascades CalculateShadowCascades(
+		Camera const &camera, DirectionalLight const &light, MeshBounds const &casterBounds, float splitLambda);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline void CalculateShadowCascadeSplits(
+		float zNear, float zFar, float lambda, float (&splits)[g_shadowCascadeCount + 1])
+	{
+		for (uint32_t i = 0; i <= g_shadowCascadeCount; ++i)
+		{
+			float const t = static_cast<float>(i) / g_shadowCascadeCount;
+			float const logarithmic = zNear * std::pow(zFar / zNear, t);
+			float const uniform = zNear + (zFar - zNear) * t;
+			splits[i] = std::lerp(uniform, logarithmic, lambda);
+		}
+		splits[0] = zNear;
+		splits[g_shadowCascadeCount] = zFar;
+	}
+
+	inline XMMATRIX CreateShadowLightView(XMVECTOR direction)
+	{
+		// The direction points towards the light
+		XMVECTOR const forward = XMVector3Normalize(XMVectorNegate(direction));
+		XMVECTOR const up = std::abs(XMVectorGetY(forward)) > 0.99f ? XMVectorSet(0.f, 0.f, 1.f, 0.f) : XMVectorSet(0.f, 1.f, 0.f, 0.f);
+
+		return XMMatrixLookToLH(XMVectorZero(), forward, up);
+	}
+
+	inline MeshBounds CalculateShadowCasterBounds(CullingBounds const &bounds)
+	{
+		MeshBounds casterBounds;
+		if (bounds.centerX.empty())
+		{
+			return casterBounds;
+		}
+
+		XMFLOAT3 minimum = {FLT_MAX, FLT_MAX, FLT_MAX};
+		XMFLOAT3 maximum = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+		for (size_t i = 0; i < bounds.centerX.size(); ++i)
+		{
+			minimum.x = std::min(minimum.x, bounds.centerX[i] - bounds.extentX[i]);
+			minimum.y = std::min(minimum.y, bounds.centerY[i] - bounds.extentY[i]);
+			minimum.z = std::min(minimum.z, bounds.centerZ[i] - bounds.extentZ[i]);
+			maximum.x = std::max(maximum.x, bounds.centerX[i] + bounds.extentX[i]);
+			maximum.y = std::max(maximum.y, bounds.centerY[i] + bounds.extentY[i]);
+			maximum.z = std::max(maximum.z, bounds.centerZ[i] + bounds.extentZ[i]);
+		}
+
+		casterBounds.center = {
+			(minimum.x + maximum.x) * 0.5f, (minimum.y + maximum.y) * 0.5f, (minimum.z + maximum.z) * 0.5f};
+		casterBounds.extents = {
+			(maximum.x - minimum.x) * 0.5f, (maximum.y - minimum.y) * 0.5f, (maximum.z - minimum.z) * 0.5f};
+		casterBounds.radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&casterBounds.extents)));
+
+		return casterBounds;
+	}
+
+	inline ShadowCascade CalculateShadowCascade(
+		Camera const &camera,
+		XMMATRIX const &lightView,
+		MeshBounds const &casterBounds,
+		float splitNear,
+		float splitFar,
+		uint32_t resolution)
+	{
+		float const tanY = std::tan(camera.fov * 0.5f);
+		float const tanX = tanY * camera.aspectRatio;
+		XMMATRIX const cameraToLight = XMMatrixMultiply(camera.inverseView, lightView);
+
+		// The center sits on the view axis, equally far from the near and far corners unless that is past the
+		// far plane, then the far corners alone bound the slice
+		float const cornerSlopeSq = tanX * tanX + tanY * tanY;
+		float const centerDepth = std::min((splitNear + splitFar) * (1.f + cornerSlopeSq) * 0.5f, splitFar);
+		float const radius = std::sqrt(
+			(splitFar - centerDepth) * (splitFar - centerDepth) + splitFar * splitFar * cornerSlopeSq);
+		XMVECTOR const center = XMVector3TransformCoord(XMVectorSet(0.f, 0.f, centerDepth, 1.f), cameraToLight);
+		XMVECTOR const minimum = XMVectorSubtract(center, XMVectorReplicate(radius));
+		XMVECTOR const maximum = XMVectorAdd(center, XMVectorReplicate(radius));
+
+		// Casters between the light and the slice throw shadows into it, so the near plane moves back to them
+		float nearZ = XMVectorGetZ(minimum);
+		for (float x : {-1.f, 1.f})
+		{
+			for (float y : {-1.f, 1.f})
+			{
+				for (float z : {-1.f, 1.f})
+				{
+					XMVECTOR const corner = XMVector3TransformCoord(
+						XMVectorSet(
+							casterBounds.center.x + x * casterBounds.extents.x,
+							casterBounds.center.y + y * casterBounds.extents.y,
+							casterBounds.center.z + z * casterBounds.extents.z,
+							1.f),
+						lightView);
+					nearZ = std::min(nearZ, XMVectorGetZ(corner));
+				}
+			}
+		}
+		float const farZ = std::max(XMVectorGetZ(maximum), nearZ + 1e-3f);
+
+		// One spare texel absorbs the snapping, the slice always stays inside the projection
+		float const texelSize = std::max(2.f * radius, 1e-3f) / (resolution - 1);
+		float const left = std::floor(XMVectorGetX(minimum) / texelSize) * texelSize;
+		float const bottom = std::floor(XMVectorGetY(minimum) / texelSize) * texelSize;
+		float const right = left + texelSize * resolution;
+		float const top = bottom + texelSize * resolution;
+
+		ShadowCascade cascade;
+		cascade.viewProj = XMMatrixMultiply(
+			lightView, XMMatrixOrthographicOffCenterLH(left, right, bottom, top, nearZ, farZ));
+		cascade.splitNear = splitNear;
+		cascade.splitFar = splitFar;
+		cascade.texelSize = texelSize;
+
+		return cascade;
+	}
+
+	inline ShadowCascades CalculateShadowCascades(
+		Camera const &camera, DirectionalLight const &light, MeshBounds const &casterBounds, float splitLambda)
+	{
+		float splits[g_shadowCascadeCount + 1];
+		CalculateShadowCascadeSplits(camera.zNear, camera.zFar, splitLambda, splits);
+
+		XMMATRIX const lightView = CreateShadowLightView(light.direction);
+
+		ShadowCascades cascades;
+		for (uint32_t i = 0; i < g_shadowCascadeCount; ++i)
+		{
+			cascades.cascades[i] = CalculateShadowCascade(
+				camera, lightView, casterBounds, splits[i], splits[i + 1], g_shadowCascadeResolution);
+		}
+
+		return cascades;
+	}
+
+} // namespace h2r
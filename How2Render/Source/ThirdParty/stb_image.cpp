@@ -1,5 +1,12 @@
 #ifndef STB_IMAGE_IMPLEMENTATION
 
+#include "Helpers/ImageAllocator.hpp"
+
+// Routes decoder allocations through the image allocator, so textures can decode in place and are counted
+#define STBI_MALLOC(size) h2r::AllocateImageMemory(size)
+#define STBI_REALLOC_SIZED(memory, oldSize, newSize) h2r::ReallocateImageMemory(memory, oldSize, newSize)
+#define STBI_FREE(memory) h2r::FreeImageMemory(memory)
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "ThirdParty/stb_image.h"
 
@@ -3,24 +3,29 @@
 #include "Application.hpp"
 #include "Camera.hpp"
 #include "DirectionalLight.hpp"
+#include "Helpers/CpuProfiler.hpp"
 #include "ThirdParty/imgui/imgui.h"
 #include "ThirdParty/imgui/imgui_impl_dx11.h"
 #include "ThirdParty/imgui/imgui_impl_sdl.h"
 #include "Window.hpp"
 #include "Wrapper/ConstantBuffer.hpp"
 #include "Wrapper/Context.hpp"
+#include "Wrapper/FramePacer.hpp"
+#include "Wrapper/Query.hpp"
 
 namespace h2r
 {
 
     inline void InitUI(Window const &window, Context const &context);
 
-    inline bool DrawUI(
+    // Returns what the edits made this frame changed, camera edits are picked up by its next update instead
+    inline FrameChangeFlags DrawUI(
         Window const &window,
         Context const &context,
         DeviceConstBuffers const &cbuffersDevice,
         HostConstBuffers &cbuffersHost,
         Application::States &states,
+        GpuProfiler const &gpuProfiler,
         Camera &camera,
         DirectionalLight &light);
 
@@ -58,6 +63,53 @@ namespace h2r
         ImGui_ImplDX11_RenderDrawData(ImGui::GetDrawData());
     }
 
+    inline void DrawGpuProfiler(GpuProfiler const &gpuProfiler)
+    {
+        ImGui::Text(
+            "GPU frame time: %0.2f ms, %u frames behind, %u dropped",
+            gpuProfiler.frameMs,
+            g_gpuProfilerFrameCount,
+            gpuProfiler.droppedFrameCount);
+        ImGui::PlotLines(
+            "##GPU frame time",
+            gpuProfiler.frameHistoryMs,
+            g_gpuProfilerHistoryLength,
+            gpuProfiler.historyOffset,
+            nullptr,
+            0.f,
+            FLT_MAX,
+            ImVec2(0.f, 40.f));
+
+        ImGui::Columns(3, "GPU passes");
+        ImGui::Text("Pass");
+        ImGui::NextColumn();
+        ImGui::Text("ms");
+        ImGui::NextColumn();
+        ImGui::Text("History");
+        ImGui::NextColumn();
+        ImGui::Separator();
+        for (GpuScopeTiming const &timing : gpuProfiler.timings)
+        {
+            ImGui::Text("%s", timing.name);
+            ImGui::NextColumn();
+            ImGui::Text("%0.3f", timing.ms);
+            ImGui::NextColumn();
+            ImGui::PushID(timing.name);
+            ImGui::PlotLines(
+                "##history",
+                timing.historyMs,
+                g_gpuProfilerHistoryLength,
+                gpuProfiler.historyOffset,
+                nullptr,
+                0.f,
+                FLT_MAX,
+                ImVec2(0.f, ImGui::GetTextLineHeight()));
+            ImGui::PopID();
+            ImGui::NextColumn();
+        }
+        ImGui::Columns(1);
+    }
+
     inline void CleanupUI()
     {
         ImGui_ImplDX11_Shutdown();
@@ -65,12 +117,13 @@ namespace h2r
         ImGui::DestroyContext();
     }
 
-    inline bool DrawUI(
+    inline FrameChangeFlags DrawUI(
         Window const &window,
         Context const &context,
         DeviceConstBuffers const &cbuffersDevice,
         HostConstBuffers &cbuffersHost,
         Application::States &states,
+        GpuProfiler const &gpuProfiler,
         Camera &camera,
         DirectionalLight &light)
     {
@@ -92,40 +145,51 @@ namespace h2r
 
         BeginDrawUI(window);
 
-        bool isInputChanged = false;
+        bool isLightChanged = false;
+        bool isCasterChanged = false;
+        bool isCascadeChanged = false;
+        bool isShadingChanged = false;
         if (states.showSideBarWindow)
         {
             ImGui::Begin("Settings", &states.showSideBarWindow);
             ImGui::Text("Camera position");
-            isInputChanged |= ImGui::InputFloat3("Position", camera.position.m128_f32, 2);
+            if (ImGui::InputFloat3("Position", camera.position.m128_f32, 2))
+            {
+                camera.isViewDirty = true;
+            }
             ImGui::Text("Direct light");
-            isInputChanged |= ImGui::InputFloat3("Direction", light.direction.m128_f32, 2);
+            isLightChanged |= ImGui::InputFloat3("Direction", light.direction.m128_f32, 2);
             ImGui::Spacing();
             ImGui::Separator();
             ImGui::Spacing();
-            isInputChanged |= ImGui::Checkbox("Draw opaque", &states.drawOpaque);
-            isInputChanged |= ImGui::Checkbox("Draw transparent", &states.drawTransparent);
-            isInputChanged |= ImGui::Checkbox("Draw translucent", &states.drawTranslucent);
+            isCasterChanged |= ImGui::Checkbox("Draw opaque", &states.drawOpaque);
+            isCasterChanged |= ImGui::Checkbox("Draw transparent", &states.drawTransparent);
+            isShadingChanged |= ImGui::Checkbox("Draw translucent", &states.drawTranslucent);
+            isShadingChanged |= ImGui::Checkbox("Frustum culling", &states.frustumCullingEnabled);
+            isShadingChanged |= ImGui::Checkbox("Occlusion culling", &states.occlusionCullingEnabled);
+            ImGui::Checkbox("Animate dynamic objects", &states.dynamicObjectsAnimated);
             ImGui::Spacing();
             ImGui::Separator();
             ImGui::Spacing();
-            isInputChanged |= ImGui::Checkbox("Normal Mapping", &states.normalMappingEnabled);
-
-            isInputChanged |= ImGui::Checkbox("SSAO", &states.ssaoEnabled);
-            isInputChanged |= ImGui::Checkbox("SSAO blur", &states.ssaoBlurEnabled);
-            isInputChanged |= ImGui::SliderInt("SSAO kernel", &states.ssaoKernelSize, 1, g_ssaoKernelSize);
-            isInputChanged |= ImGui::SliderFloat("SSAO radius", &states.ssaoKernelRadius, 0.1f, 3.f, "%.2f", 1);
-            isInputChanged |= ImGui::InputFloat("SSAO bias", &states.ssaoBias, 1e-5f, 1e-2f, 5);
-
-            isInputChanged |= ImGui::Checkbox("Shadow Mapping", &states.shadowMappingEnabled);
-            isInputChanged |= ImGui::InputFloat("Shadow bias", &states.shadowMappingBias, 1e-2f, 1e-1f, 3);
-            isInputChanged |= ImGui::Checkbox("PCF", &states.pcfEnabled);
-            isInputChanged |= ImGui::SliderInt("PCF kernel", &states.pcfKernelSize, 1, g_pcfKernelSize);
-            isInputChanged |= ImGui::SliderFloat("PCF radius", &states.pcfRadius, 0.1f, 10.f, "%.2f", 1);
+            isShadingChanged |= ImGui::Checkbox("Normal Mapping", &states.normalMappingEnabled);
+
+            isShadingChanged |= ImGui::Checkbox("SSAO", &states.ssaoEnabled);
+            isShadingChanged |= ImGui::Checkbox("SSAO blur", &states.ssaoBlurEnabled);
+            isShadingChanged |= ImGui::SliderInt("SSAO kernel", &states.ssaoKernelSize, 1, g_ssaoKernelSize);
+            isShadingChanged |= ImGui::SliderFloat("SSAO radius", &states.ssaoKernelRadius, 0.1f, 3.f, "%.2f", 1);
+            isShadingChanged |= ImGui::InputFloat("SSAO bias", &states.ssaoBias, 1e-5f, 1e-2f, 5);
+
+            isCasterChanged |= ImGui::Checkbox("Shadow Mapping", &states.shadowMappingEnabled);
+            isShadingChanged |= ImGui::InputFloat("Shadow bias", &states.shadowMappingBias, 1e-2f, 1e-1f, 3);
+            isCascadeChanged |= ImGui::SliderFloat("Cascade split lambda", &states.shadowCascadeSplitLambda, 0.f, 1.f, "%.2f", 1);
+            ImGui::Checkbox("Shadow cache", &states.shadowCacheEnabled);
+            isShadingChanged |= ImGui::Checkbox("PCF", &states.pcfEnabled);
+            isShadingChanged |= ImGui::SliderInt("PCF kernel", &states.pcfKernelSize, 1, g_pcfKernelSize);
+            isShadingChanged |= ImGui::SliderFloat("PCF radius", &states.pcfRadius, 0.1f, 10.f, "%.2f", 1);
             ImGui::Spacing();
             ImGui::Separator();
             ImGui::Spacing();
-            isInputChanged |= ImGui::Combo(
+            isShadingChanged |= ImGui::Combo(
                 "Shading Type",
                 reinterpret_cast<int *>(&states.shadingType),
                 s_shadingTypeNames,
@@ -133,7 +197,7 @@ namespace h2r
             ImGui::Spacing();
             ImGui::Separator();
             ImGui::Spacing();
-            isInputChanged |= ImGui::Combo(
+            isShadingChanged |= ImGui::Combo(
                 "Output",
                 reinterpret_cast<int *>(&states.finalOutput),
                 s_outputTypeNames,
@@ -144,13 +208,42 @@ namespace h2r
             ImGui::Spacing();
             ImGui::Separator();
             ImGui::Spacing();
-            ImGui::Text("Shading GPU time: %0.2f ms", states.shadingGPUTimeMs);
+            ImGui::Text("Camera meshes: %u drawn, %u culled", states.cameraDrawnMeshCount, states.cameraCulledMeshCount);
+            ImGui::Text("Occluded meshes: %u", states.occlusionCulledMeshCount);
+            ImGui::Text(
+                "Shadow meshes: %u drawn, %u culled in %u cascades",
+                states.shadowDrawnMeshCount, states.shadowCulledMeshCount, g_shadowCascadeCount);
+            ImGui::Text(
+                "Shadow cache: %u frames skipped, %u rendered, read by %u cascades",
+                states.shadowCacheSkippedFrameCount, states.shadowCacheRenderedFrameCount, states.shadowCacheCascadeCount);
+            ImGui::Text("Draw packets: %u, state changes %u, saved %u", states.drawPacketCount, states.stateChangeCount, states.stateChangesSaved);
+            ImGui::Text("State calls: %u issued, %u elided", states.stateCallsIssued, states.stateCallsElided);
+            ImGui::Text(
+                "Render targets: %.1f MB, %.1f MB without aliasing",
+                states.renderTargetAllocatedByteSize / (1024.0 * 1024.0),
+                states.renderTargetDeclaredByteSize / (1024.0 * 1024.0));
+            ImGui::Spacing();
+            ImGui::Separator();
+            ImGui::Spacing();
+            ImGui::SliderInt("Frames in flight", &states.framesInFlight, 1, g_maxFramesInFlight);
+            ImGui::Text("CPU frame time: %0.2f ms, waited %0.2f ms for the GPU", states.cpuFrameTimeMs, states.frameWaitTimeMs);
+            ImGui::Text("Input to GPU done: %0.2f ms", states.inputLatencyMs);
+            DrawGpuProfiler(gpuProfiler);
+            if (ImGui::Button("Write CPU trace"))
+            {
+                WriteCpuTrace("How2Render.trace.json");
+            }
             ImGui::End();
         }
 
         EndDrawUI();
 
-        return isInputChanged;
+        FrameChangeFlags changes = FRAME_CHANGE_FLAG_NONE;
+        changes |= isLightChanged ? FRAME_CHANGE_FLAG_LIGHT : FRAME_CHANGE_FLAG_NONE;
+        changes |= isCasterChanged ? FRAME_CHANGE_FLAG_SHADOW_CASTERS : FRAME_CHANGE_FLAG_NONE;
+        changes |= isCascadeChanged ? FRAME_CHANGE_FLAG_SHADOW_CASCADES : FRAME_CHANGE_FLAG_NONE;
+        changes |= isShadingChanged ? FRAME_CHANGE_FLAG_SHADING : FRAME_CHANGE_FLAG_NONE;
+        return changes;
     }
 
 } // namespace h2r
\ No newline at end of file
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Wrapper/Context.hpp"
+#include "Wrapper/StateCache.hpp"
 #include <cstdio>
 #include <d3d11.h>
 #include <optional>
@@ -55,13 +56,12 @@ namespace h2r
 
     inline void BindBlendState(Context const &context, BlendState const &blendState)
     {
-        context.pImmediateContext->OMSetBlendState(
-            blendState.pBlendState, blendState.pBlendFactor, blendState.sampleMask);
+        SetCachedBlendState(context, blendState.pBlendState, blendState.pBlendFactor, blendState.sampleMask);
     }
 
     inline void UnbindBlendState(Context const &context)
     {
-        context.pImmediateContext->OMSetBlendState(nullptr, nullptr, 0xFFFFFFFF);
+        SetCachedBlendState(context, nullptr, nullptr, 0xFFFFFFFF);
     }
 
     inline std::optional<BlendState> CreateBlendState(Context const &context, BlendStateDescriptor desc)
@@ -3,6 +3,7 @@
 #include "Math.hpp"
 #include "Random.hpp"
 #include "Wrapper/Context.hpp"
+#include "Wrapper/StateCache.hpp"
 #include <cassert>
 
 namespace h2r
@@ -10,6 +11,11 @@ namespace h2r
 
     constexpr uint32_t g_ssaoKernelSize = 64;
     constexpr uint32_t g_pcfKernelSize = 16;
+    constexpr uint32_t g_shadowCascadeCount = 4;
+
+    // Shader register slots of the buffers that change between draws
+    constexpr uint32_t g_perInstanceConstantBufferSlot = 0;
+    constexpr uint32_t g_perMaterialConstantBufferSlot = 1;
 
     struct HostConstBuffers
     {
@@ -36,7 +42,8 @@ namespace h2r
         {
             uint32_t width = 0;
             uint32_t height = 0;
-            XMFLOAT2 padd = {};
+            uint32_t shadowCascade = 0;
+            float padd = 0;
         };
 
         struct Camera
@@ -48,9 +55,19 @@ namespace h2r
             XMVECTOR positionVector = {};
         };
 
+        struct ShadowCascades
+        {
+            XMMATRIX viewProj[g_shadowCascadeCount] = {};
+            // Camera view depth each cascade reaches to
+            float splitFar[g_shadowCascadeCount] = {};
+            // Cascade clip space to shadow cache clip space, only set for cascades filled from the cache
+            XMMATRIX cacheReprojection[g_shadowCascadeCount] = {};
+            XMMATRIX cacheViewProj = {};
+        };
+        static_assert(g_shadowCascadeCount == 4, "Split depths are a single float4 in CBuffers.fx");
+
         struct Lights
         {
-            XMMATRIX viewProj = {};
             XMVECTOR viewDir = {};
         };
 
@@ -96,6 +113,7 @@ namespace h2r
         struct PerFrame
         {
             HostConstBuffers::Camera camera;
+            HostConstBuffers::ShadowCascades shadowCascades;
         };
 
         struct Infrequent
@@ -169,7 +187,6 @@ namespace h2r
     {
         HostConstBuffers::Lights lights;
 
-        lights.viewProj = XMMatrixIdentity();
         lights.viewDir = {0, -1, 0};
 
         return lights;
@@ -336,46 +353,26 @@ namespace h2r
 
     inline void BindConstantBuffers(Context const &context, DeviceConstBuffers const &cbuffers)
     {
-        context.pImmediateContext->VSSetConstantBuffers(0, 1, &cbuffers.pPerInstance);
-        context.pImmediateContext->VSSetConstantBuffers(1, 1, &cbuffers.pPerMaterial);
-        context.pImmediateContext->VSSetConstantBuffers(2, 1, &cbuffers.pPerPass);
-        context.pImmediateContext->VSSetConstantBuffers(3, 1, &cbuffers.pPerFrame);
-        context.pImmediateContext->VSSetConstantBuffers(4, 1, &cbuffers.pInfrequent);
-
-        context.pImmediateContext->PSSetConstantBuffers(0, 1, &cbuffers.pPerInstance);
-        context.pImmediateContext->PSSetConstantBuffers(1, 1, &cbuffers.pPerMaterial);
-        context.pImmediateContext->PSSetConstantBuffers(2, 1, &cbuffers.pPerPass);
-        context.pImmediateContext->PSSetConstantBuffers(3, 1, &cbuffers.pPerFrame);
-        context.pImmediateContext->PSSetConstantBuffers(4, 1, &cbuffers.pInfrequent);
-
-        context.pImmediateContext->CSSetConstantBuffers(0, 1, &cbuffers.pPerInstance);
-        context.pImmediateContext->CSSetConstantBuffers(1, 1, &cbuffers.pPerMaterial);
-        context.pImmediateContext->CSSetConstantBuffers(2, 1, &cbuffers.pPerPass);
-        context.pImmediateContext->CSSetConstantBuffers(3, 1, &cbuffers.pPerFrame);
-        context.pImmediateContext->CSSetConstantBuffers(4, 1, &cbuffers.pInfrequent);
+        ID3D11Buffer *const buffers[] = {
+            cbuffers.pPerInstance,
+            cbuffers.pPerMaterial,
+            cbuffers.pPerPass,
+            cbuffers.pPerFrame,
+            cbuffers.pInfrequent,
+        };
+
+        SetCachedConstantBuffers(context, eShaderStage::Vertex, 0, _countof(buffers), buffers);
+        SetCachedConstantBuffers(context, eShaderStage::Pixel, 0, _countof(buffers), buffers);
+        SetCachedConstantBuffers(context, eShaderStage::Compute, 0, _countof(buffers), buffers);
     }
 
     inline void UnbindConstantBuffer(Context const &context)
     {
-        ID3D11Buffer *nullBuffer[1] = {nullptr};
-
-        context.pImmediateContext->VSSetConstantBuffers(0, 1, nullBuffer);
-        context.pImmediateContext->VSSetConstantBuffers(1, 1, nullBuffer);
-        context.pImmediateContext->VSSetConstantBuffers(2, 1, nullBuffer);
-        context.pImmediateContext->VSSetConstantBuffers(3, 1, nullBuffer);
-        context.pImmediateContext->VSSetConstantBuffers(4, 1, nullBuffer);
-
-        context.pImmediateContext->PSSetConstantBuffers(0, 1, nullBuffer);
-        context.pImmediateContext->PSSetConstantBuffers(1, 1, nullBuffer);
-        context.pImmediateContext->PSSetConstantBuffers(2, 1, nullBuffer);
-        context.pImmediateContext->PSSetConstantBuffers(3, 1, nullBuffer);
-        context.pImmediateContext->PSSetConstantBuffers(4, 1, nullBuffer);
-
-        context.pImmediateContext->CSSetConstantBuffers(0, 1, nullBuffer);
-        context.pImmediateContext->CSSetConstantBuffers(1, 1, nullBuffer);
-        context.pImmediateContext->CSSetConstantBuffers(2, 1, nullBuffer);
-        context.pImmediateContext->CSSetConstantBuffers(3, 1, nullBuffer);
-        context.pImmediateContext->CSSetConstantBuffers(4, 1, nullBuffer);
+        ID3D11Buffer *const nullBuffers[5] = {};
+
+        SetCachedConstantBuffers(context, eShaderStage::Vertex, 0, _countof(nullBuffers), nullBuffers);
+        SetCachedConstantBuffers(context, eShaderStage::Pixel, 0, _countof(nullBuffers), nullBuffers);
+        SetCachedConstantBuffers(context, eShaderStage::Compute, 0, _countof(nullBuffers), nullBuffers);
     }
 
 } // namespace h2r
@@ -0,0 +1,165 @@
+#pragma once
+
+#include "Wrapper/Context.hpp"
+#include "Wrapper/StateCache.hpp"
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <d3d11_1.h>
+#include <optional>
+
+namespace h2r
+{
+
+	// Constant buffer offsets are counted in 16 byte constants and have to be multiples of 16 constants
+	constexpr uint32_t g_constantRingAlignment = 256;
+	constexpr uint32_t g_constantRingConstantSize = 16;
+	constexpr uint32_t g_constantRingByteSize = 4 * 1024 * 1024;
+
+	// One large dynamic constant buffer that hands out 256 byte aligned slices. Writes go through a single
+	// map per batch, the first map of a frame discards so the driver renames the buffer under the GPU.
+	struct ConstantRing
+	{
+		ID3D11Buffer *pBuffer = nullptr;
+		uint32_t byteSize = 0;
+		uint32_t head = 0;
+		uint8_t *mapped = nullptr;
+		bool isDiscardPending = true;
+	};
+
+	// Offset and size of a slice in constants, as VSSetConstantBuffers1 takes them
+	struct ConstantRingSlice
+	{
+		uint32_t firstConstant = 0;
+		uint32_t constantCount = 0;
+	};
+
+	// Returns std::nullopt when the device can not bind constant buffers with offsets
+	inline std::optional<ConstantRing> CreateConstantRing(Context const &context, uint32_t byteSize);
+
+	inline void CleanupConstantRing(ConstantRing &ring);
+
+	// A retired ring is one the GPU is known to be done with, it restarts at the front without a discard
+	inline void BeginConstantRingFrame(ConstantRing &ring, bool isRetired = false);
+
+	// Maps room for at least byteSize bytes of slices, wrapping around with a discard when the frame ran out
+	inline bool MapConstantRing(Context const &context, ConstantRing &ring, uint32_t byteSize);
+
+	inline ConstantRingSlice WriteConstantRing(ConstantRing &ring, void const *data, uint32_t byteSize);
+
+	inline void UnmapConstantRing(Context const &context, ConstantRing &ring);
+
+	inline void BindConstantRingSlice(Context const &context, ConstantRing const &ring, uint32_t slot, ConstantRingSlice slice);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline uint32_t AlignConstantRingSize(uint32_t byteSize)
+	{
+		return (byteSize + g_constantRingAlignment - 1) & ~(g_constantRingAlignment - 1);
+	}
+
+	inline std::optional<ConstantRing> CreateConstantRing(Context const &context, uint32_t byteSize)
+	{
+		if (context.pImmediateContext1 == nullptr)
+		{
+			printf("Constant ring requires the D3D 11.1 runtime\n");
+			return std::nullopt;
+		}
+
+		D3D11_FEATURE_DATA_D3D11_OPTIONS options = {};
+		if (FAILED(context.pd3dDevice->CheckFeatureSupport(D3D11_FEATURE_D3D11_OPTIONS, &options, sizeof(options))) ||
+			!options.ConstantBufferOffsetting || !options.MapNoOverwriteOnDynamicConstantBuffer)
+		{
+			printf("Constant buffer offsetting is not supported\n");
+			return std::nullopt;
+		}
+
+		ConstantRing ring;
+		ring.byteSize = AlignConstantRingSize(byteSize);
+
+		D3D11_BUFFER_DESC desc = {};
+		desc.ByteWidth = ring.byteSize;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		if (FAILED(context.pd3dDevice->CreateBuffer(&desc, nullptr, &ring.pBuffer)))
+		{
+			printf("Failed to create constant ring buffer\n");
+			return std::nullopt;
+		}
+
+		return ring;
+	}
+
+	inline void CleanupConstantRing(ConstantRing &ring)
+	{
+		if (ring.pBuffer != nullptr)
+		{
+			ring.pBuffer->Release();
+			ring.pBuffer = nullptr;
+		}
+	}
+
+	inline void BeginConstantRingFrame(ConstantRing &ring, bool isRetired)
+	{
+		ring.head = 0;
+		ring.isDiscardPending = !isRetired;
+	}
+
+	inline bool MapConstantRing(Context const &context, ConstantRing &ring, uint32_t byteSize)
+	{
+		if (ring.head + byteSize > ring.byteSize)
+		{
+			ring.isDiscardPending = true;
+		}
+		if (ring.isDiscardPending)
+		{
+			ring.head = 0;
+		}
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		D3D11_MAP const mapType = ring.isDiscardPending ? D3D11_MAP_WRITE_DISCARD : D3D11_MAP_WRITE_NO_OVERWRITE;
+		if (FAILED(context.pImmediateContext->Map(ring.pBuffer, 0, mapType, 0, &mapped)))
+		{
+			printf("Failed to map constant ring buffer\n");
+			return false;
+		}
+
+		ring.mapped = static_cast<uint8_t *>(mapped.pData);
+		ring.isDiscardPending = false;
+
+		return true;
+	}
+
+	inline ConstantRingSlice WriteConstantRing(ConstantRing &ring, void const *data, uint32_t byteSize)
+	{
+		uint32_t const alignedSize = AlignConstantRingSize(byteSize);
+		assert(ring.mapped != nullptr && ring.head + alignedSize <= ring.byteSize);
+
+		std::memcpy(ring.mapped + ring.head, data, byteSize);
+
+		ConstantRingSlice slice;
+		slice.firstConstant = ring.head / g_constantRingConstantSize;
+		slice.constantCount = alignedSize / g_constantRingConstantSize;
+		ring.head += alignedSize;
+
+		return slice;
+	}
+
+	inline void UnmapConstantRing(Context const &context, ConstantRing &ring)
+	{
+		context.pImmediateContext->Unmap(ring.pBuffer, 0);
+		ring.mapped = nullptr;
+	}
+
+	inline void BindConstantRingSlice(Context const &context, ConstantRing const &ring, uint32_t slot, ConstantRingSlice slice)
+	{
+		SetCachedConstantBufferSlice(context, eShaderStage::Vertex, slot, ring.pBuffer, slice.firstConstant, slice.constantCount);
+		SetCachedConstantBufferSlice(context, eShaderStage::Pixel, slot, ring.pBuffer, slice.firstConstant, slice.constantCount);
+	}
+
+} // namespace h2r
@@ -7,13 +7,22 @@
 namespace h2r
 {
 
+	struct GpuProfiler;
+	struct StateCache;
+
 	struct Context
 	{
 		D3D_DRIVER_TYPE driverType = D3D_DRIVER_TYPE_NULL;
 		D3D_FEATURE_LEVEL featureLevel = D3D_FEATURE_LEVEL_11_0;
 		ID3D11Device *pd3dDevice = nullptr;
 		ID3D11DeviceContext *pImmediateContext = nullptr;
+		// Null without the D3D 11.1 runtime
+		ID3D11DeviceContext1 *pImmediateContext1 = nullptr;
 		ID3DUserDefinedAnnotation *pAnnotation = nullptr;
+		// Null when binds go straight to the immediate context, owned by whoever renders with it
+		StateCache *pStateCache = nullptr;
+		// Null when passes are not timed, owned by whoever renders with it
+		GpuProfiler *pGpuProfiler = nullptr;
 	};
 
 	inline Context CreateContext()
@@ -57,6 +66,8 @@ namespace h2r
 			{
 				context.pImmediateContext->QueryInterface(
 					__uuidof(context.pAnnotation), reinterpret_cast<void **>(&context.pAnnotation));
+				context.pImmediateContext->QueryInterface(
+					__uuidof(context.pImmediateContext1), reinterpret_cast<void **>(&context.pImmediateContext1));
 				break;
 			}
 		}
@@ -71,6 +82,10 @@ namespace h2r
 		{
 			context.pd3dDevice->Release();
 		}
+		if (context.pImmediateContext1 != nullptr)
+		{
+			context.pImmediateContext1->Release();
+		}
 		if (context.pImmediateContext != nullptr)
 		{
 			context.pImmediateContext->Release();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Wrapper/Context.hpp"
+#include "Wrapper/StateCache.hpp"
 #include <d3d11_1.h>
 
 namespace h2r
@@ -11,6 +12,8 @@ namespace h2r
 		ID3D11DepthStencilState *pLessReadWrite = nullptr;
 		ID3D11DepthStencilState *pEqualRead = nullptr;
 		ID3D11DepthStencilState *pDisable = nullptr;
+		// Overwrites depth without testing, for passes that write SV_Depth into a whole target
+		ID3D11DepthStencilState *pAlwaysWrite = nullptr;
 	};
 
 	inline void BindDepthStencilState(Context const &context, ID3D11DepthStencilState *state);
@@ -25,12 +28,12 @@ namespace h2r
 
 	inline void BindDepthStencilState(Context const &context, ID3D11DepthStencilState *state)
 	{
-		context.pImmediateContext->OMSetDepthStencilState(state, 0);
+		SetCachedDepthStencilState(context, state);
 	}
 
 	inline void UnbindDepthStencilState(Context const& context)
 	{
-		context.pImmediateContext->OMSetDepthStencilState(nullptr, 0);
+		SetCachedDepthStencilState(context, nullptr);
 	}
 
 	inline std::optional<DepthStencilStates> CreateDepthStencilStates(Context const &context)
@@ -71,6 +74,17 @@ namespace h2r
 			}
 		}
 
+		{
+			D3D11_DEPTH_STENCIL_DESC desc = CD3D11_DEPTH_STENCIL_DESC(D3D11_DEFAULT);
+			desc.DepthFunc = D3D11_COMPARISON_ALWAYS;
+
+			if (FAILED(context.pd3dDevice->CreateDepthStencilState(&desc, &states.pAlwaysWrite)))
+			{
+				printf("Failed to create depth stencil state\n");
+				return std::nullopt;
+			}
+		}
+
 		return states;
 	}
 
@@ -91,6 +105,11 @@ namespace h2r
 			states.pDisable->Release();
 			states.pDisable = nullptr;
 		}
+		if (states.pAlwaysWrite != nullptr)
+		{
+			states.pAlwaysWrite->Release();
+			states.pAlwaysWrite = nullptr;
+		}
 	}
 
 } // namespace h2r
\ No newline at end of file
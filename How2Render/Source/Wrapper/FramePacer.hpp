@@ -0,0 +1,181 @@
+#pragma once
+
+#include "Wrapper/Context.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <d3d11.h>
+#include <optional>
+#include <thread>
+
+namespace h2r
+{
+
+	// Upper bound of the frames the CPU may record ahead of the GPU, per frame resources come in as many copies
+	constexpr uint32_t g_maxFramesInFlight = 3;
+
+	struct FrameSlot
+	{
+		// Event query ended after the frame was presented, it signals once the GPU finished the frame
+		ID3D11Query *pFenceQuery = nullptr;
+		bool isFenceIssued = false;
+		bool isFenceSignaled = false;
+		uint64_t inputTimeNs = 0;
+	};
+
+	struct FramePacer
+	{
+		FrameSlot slots[g_maxFramesInFlight] = {};
+		uint32_t frameIndex = 0;
+		uint32_t latency = 2;
+
+		std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		uint64_t frameBeginNs = 0;
+
+		// CPU time spent on the frame, without the time spent waiting for the GPU to catch up
+		float cpuFrameMs = 0.f;
+		float waitMs = 0.f;
+		// From sampling the input to the CPU seeing the frame done on the GPU. Scan out is not included,
+		// and fences are only polled once a frame, so this is rounded up to the next frame begin.
+		float inputToGpuDoneMs = 0.f;
+	};
+
+	// Latency is clamped to [1, g_maxFramesInFlight]
+	inline std::optional<FramePacer> CreateFramePacer(Context const &context, uint32_t latency);
+
+	inline void CleanupFramePacer(FramePacer &pacer);
+
+	inline void SetFramePacerLatency(Context const &context, FramePacer &pacer, uint32_t latency);
+
+	// Waits until the GPU finished the frame recorded latency frames ago. Returns the slot of the frame
+	// about to be recorded, the GPU is done with every resource used the last time the slot came around.
+	inline uint32_t BeginFramePacerFrame(Context const &context, FramePacer &pacer);
+
+	// Called after present, fences the frame and marks the time its input was sampled at
+	inline void EndFramePacerFrame(Context const &context, FramePacer &pacer);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline uint64_t GetFramePacerTimeNs(FramePacer const &pacer)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+										 std::chrono::steady_clock::now() - pacer.epoch)
+										 .count());
+	}
+
+	inline std::optional<FramePacer> CreateFramePacer(Context const &context, uint32_t latency)
+	{
+		FramePacer pacer;
+
+		D3D11_QUERY_DESC desc;
+		desc.Query = D3D11_QUERY_EVENT;
+		desc.MiscFlags = 0;
+		for (FrameSlot &slot : pacer.slots)
+		{
+			if (FAILED(context.pd3dDevice->CreateQuery(&desc, &slot.pFenceQuery)))
+			{
+				printf("Failed to create frame fence query\n");
+				CleanupFramePacer(pacer);
+				return std::nullopt;
+			}
+		}
+
+		SetFramePacerLatency(context, pacer, latency);
+
+		return pacer;
+	}
+
+	inline void CleanupFramePacer(FramePacer &pacer)
+	{
+		for (FrameSlot &slot : pacer.slots)
+		{
+			if (slot.pFenceQuery != nullptr)
+			{
+				slot.pFenceQuery->Release();
+				slot.pFenceQuery = nullptr;
+			}
+		}
+	}
+
+	inline void SetFramePacerLatency(Context const &context, FramePacer &pacer, uint32_t latency)
+	{
+		pacer.latency = std::clamp(latency, 1u, g_maxFramesInFlight);
+
+		// DXGI queues up to three frames by default regardless of the fences, keep it in line with them
+		IDXGIDevice1 *dxgiDevice = nullptr;
+		if (SUCCEEDED(context.pd3dDevice->QueryInterface(__uuidof(IDXGIDevice1), reinterpret_cast<void **>(&dxgiDevice))))
+		{
+			dxgiDevice->SetMaximumFrameLatency(pacer.latency);
+			dxgiDevice->Release();
+		}
+	}
+
+	inline bool PollFrameFence(Context const &context, FramePacer &pacer, FrameSlot &slot)
+	{
+		if (!slot.isFenceIssued || slot.isFenceSignaled)
+		{
+			return true;
+		}
+
+		BOOL isDone = FALSE;
+		if (context.pImmediateContext->GetData(slot.pFenceQuery, &isDone, sizeof(isDone), 0) != S_OK || !isDone)
+		{
+			return false;
+		}
+
+		slot.isFenceSignaled = true;
+		pacer.inputToGpuDoneMs = (GetFramePacerTimeNs(pacer) - slot.inputTimeNs) / 1e6f;
+
+		return true;
+	}
+
+	inline uint32_t BeginFramePacerFrame(Context const &context, FramePacer &pacer)
+	{
+		uint64_t const waitBeginNs = GetFramePacerTimeNs(pacer);
+
+		// Frames finish in order, polling from the oldest keeps the latency reading of the newest one done
+		for (uint32_t age = g_maxFramesInFlight; age > 0; --age)
+		{
+			if (age > pacer.frameIndex)
+			{
+				continue;
+			}
+
+			FrameSlot &slot = pacer.slots[(pacer.frameIndex - age) % g_maxFramesInFlight];
+			if (age < pacer.latency)
+			{
+				PollFrameFence(context, pacer, slot);
+				continue;
+			}
+			// The first GetData flushes, the GPU may otherwise never get to the frame we wait on
+			while (!PollFrameFence(context, pacer, slot))
+			{
+				std::this_thread::yield();
+			}
+		}
+
+		pacer.frameBeginNs = GetFramePacerTimeNs(pacer);
+		pacer.waitMs = (pacer.frameBeginNs - waitBeginNs) / 1e6f;
+
+		uint32_t const slotIndex = pacer.frameIndex % g_maxFramesInFlight;
+		pacer.slots[slotIndex].inputTimeNs = pacer.frameBeginNs;
+
+		return slotIndex;
+	}
+
+	inline void EndFramePacerFrame(Context const &context, FramePacer &pacer)
+	{
+		FrameSlot &slot = pacer.slots[pacer.frameIndex % g_maxFramesInFlight];
+		context.pImmediateContext->End(slot.pFenceQuery);
+		slot.isFenceIssued = true;
+		slot.isFenceSignaled = false;
+
+		pacer.cpuFrameMs = (GetFramePacerTimeNs(pacer) - pacer.frameBeginNs) / 1e6f;
+		++pacer.frameIndex;
+	}
+
+} // namespace h2r
@@ -2,18 +2,85 @@
 
 #include "Wrapper/Context.hpp"
 #include <cstdio>
+#include <cstring>
 #include <d3d11.h>
+#include <optional>
+#include <vector>
 
 namespace h2r
 {
 
-	struct PerformaceQueries
+	// Frames recorded before the oldest one is read back, the timings lag the rendered frame by as much
+	constexpr uint32_t g_gpuProfilerFrameCount = 4;
+	constexpr uint32_t g_gpuProfilerMaxScopeCount = 32;
+	constexpr uint32_t g_gpuProfilerHistoryLength = 128;
+	constexpr uint32_t g_gpuProfilerNameLength = 48;
+
+	struct GpuProfilerScope
+	{
+		wchar_t const *name = nullptr;
+		ID3D11Query *pBeginQuery = nullptr;
+		ID3D11Query *pEndQuery = nullptr;
+	};
+
+	struct GpuProfilerFrame
+	{
+		ID3D11Query *pDisjointQuery = nullptr;
+		ID3D11Query *pBeginQuery = nullptr;
+		ID3D11Query *pEndQuery = nullptr;
+		GpuProfilerScope scopes[g_gpuProfilerMaxScopeCount] = {};
+		uint32_t scopeCount = 0;
+		bool isIssued = false;
+	};
+
+	struct GpuScopeTiming
+	{
+		char name[g_gpuProfilerNameLength] = {};
+		float ms = 0.f;
+		float historyMs[g_gpuProfilerHistoryLength] = {};
+	};
+
+	struct GpuProfiler
 	{
-		ID3D11Query *timestampStartQuery = nullptr;
-		ID3D11Query *timestampEndQuery = nullptr;
-		ID3D11Query *disjointQuery = nullptr;
+		GpuProfilerFrame frames[g_gpuProfilerFrameCount] = {};
+		uint32_t frameIndex = 0;
+		bool isRecording = false;
+		bool isScopeOpen = false;
+
+		// Results of the last frame read back, one row per scope in the order the scopes were recorded
+		std::vector<GpuScopeTiming> timings;
+		float frameMs = 0.f;
+		float frameHistoryMs[g_gpuProfilerHistoryLength] = {};
+		// Next history entry written, the oldest entry of every history
+		uint32_t historyOffset = 0;
+		// Frames whose results were not there yet when their queries got reused, or were disjoint
+		uint32_t droppedFrameCount = 0;
 	};
 
+	inline ID3D11Query *CreateQuery(Context const &context, D3D11_QUERY queryType);
+
+	inline void CleanupQuery(ID3D11Query *query);
+
+	inline std::optional<GpuProfiler> CreateGpuProfiler(Context const &context);
+
+	inline void CleanupGpuProfiler(GpuProfiler &profiler);
+
+	// Reads back the frame recorded g_gpuProfilerFrameCount frames ago, if the GPU got to it, and starts
+	// recording a new one into its queries
+	inline void BeginGpuProfilerFrame(Context const &context, GpuProfiler &profiler);
+
+	inline void EndGpuProfilerFrame(Context const &context, GpuProfiler &profiler);
+
+	// Scopes go to the profiler of the context, they do nothing without one or outside of a frame
+	inline void BeginGpuProfilerScope(Context const &context, wchar_t const *name);
+
+	inline void EndGpuProfilerScope(Context const &context);
+
+} // namespace h2r
+
+namespace h2r
+{
+
 	inline ID3D11Query *CreateQuery(Context const &context, D3D11_QUERY queryType)
 	{
 		ID3D11Query *query = nullptr;
@@ -39,57 +106,185 @@ namespace h2r
 		}
 	}
 
-	inline PerformaceQueries CreatePerformanceQueries(Context const &context)
+	inline std::optional<GpuProfiler> CreateGpuProfiler(Context const &context)
 	{
-		PerformaceQueries queries;
+		GpuProfiler profiler;
+
+		bool isCreated = true;
+		for (GpuProfilerFrame &frame : profiler.frames)
+		{
+			frame.pDisjointQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP_DISJOINT);
+			frame.pBeginQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP);
+			frame.pEndQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP);
+			isCreated &= frame.pDisjointQuery != nullptr && frame.pBeginQuery != nullptr && frame.pEndQuery != nullptr;
+
+			for (GpuProfilerScope &scope : frame.scopes)
+			{
+				scope.pBeginQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP);
+				scope.pEndQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP);
+				isCreated &= scope.pBeginQuery != nullptr && scope.pEndQuery != nullptr;
+			}
+		}
 
-		queries.disjointQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP_DISJOINT);
-		queries.timestampStartQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP);
-		queries.timestampEndQuery = CreateQuery(context, D3D11_QUERY_TIMESTAMP);
+		if (!isCreated)
+		{
+			printf("Failed to create GPU profiler\n");
+			CleanupGpuProfiler(profiler);
+			return std::nullopt;
+		}
 
-		return queries;
+		return profiler;
 	}
 
-	inline void CleanupPerformanceQueries(PerformaceQueries &queries)
+	inline void CleanupGpuProfiler(GpuProfiler &profiler)
 	{
-		CleanupQuery(queries.disjointQuery);
-		queries.disjointQuery = nullptr;
-		CleanupQuery(queries.timestampStartQuery);
-		queries.timestampStartQuery = nullptr;
-		CleanupQuery(queries.timestampEndQuery);
-		queries.timestampEndQuery = nullptr;
+		for (GpuProfilerFrame &frame : profiler.frames)
+		{
+			CleanupQuery(frame.pDisjointQuery);
+			frame.pDisjointQuery = nullptr;
+			CleanupQuery(frame.pBeginQuery);
+			frame.pBeginQuery = nullptr;
+			CleanupQuery(frame.pEndQuery);
+			frame.pEndQuery = nullptr;
+
+			for (GpuProfilerScope &scope : frame.scopes)
+			{
+				CleanupQuery(scope.pBeginQuery);
+				scope.pBeginQuery = nullptr;
+				CleanupQuery(scope.pEndQuery);
+				scope.pEndQuery = nullptr;
+			}
+		}
 	}
 
-	inline void BeginQueryGpuTime(Context const &context, PerformaceQueries const &queries)
+	inline bool GetTimestamp(Context const &context, ID3D11Query *query, uint64_t &timestamp)
 	{
-		context.pImmediateContext->Begin(queries.disjointQuery);
-		context.pImmediateContext->End(queries.timestampStartQuery);
+		return context.pImmediateContext->GetData(
+				   query, &timestamp, sizeof(timestamp), D3D11_ASYNC_GETDATA_DONOTFLUSH) == S_OK;
 	}
 
-	inline void EndQueryGpuTime(Context const &context, PerformaceQueries const &queries)
+	inline void CopyScopeName(char (&dst)[g_gpuProfilerNameLength], wchar_t const *src)
 	{
-		context.pImmediateContext->End(queries.disjointQuery);
-		context.pImmediateContext->End(queries.timestampEndQuery);
+		uint32_t i = 0;
+		for (; src != nullptr && src[i] != L'\0' && i + 1 < g_gpuProfilerNameLength; ++i)
+		{
+			dst[i] = src[i] < 128 ? static_cast<char>(src[i]) : '?';
+		}
+		dst[i] = '\0';
 	}
 
-	inline double BlockAndGetGpuTimeMs(Context const &context, PerformaceQueries const &queries)
+	inline bool ReadGpuProfilerFrame(Context const &context, GpuProfilerFrame const &frame, GpuProfiler &profiler)
 	{
-		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjointData;
-		while (context.pImmediateContext->GetData(queries.disjointQuery, &disjointData, queries.disjointQuery->GetDataSize(), 0) != S_OK)
-			;
+		// The disjoint query ends last, once it is available every timestamp of the frame is too
+		D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+		if (context.pImmediateContext->GetData(
+				frame.pDisjointQuery, &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+			disjoint.Disjoint)
+		{
+			return false;
+		}
+
+		double const msPerTick = 1000.0 / static_cast<double>(disjoint.Frequency);
+
+		uint64_t frameBegin = 0;
+		uint64_t frameEnd = 0;
+		if (!GetTimestamp(context, frame.pBeginQuery, frameBegin) || !GetTimestamp(context, frame.pEndQuery, frameEnd))
+		{
+			return false;
+		}
+
+		profiler.timings.resize(frame.scopeCount);
+		for (uint32_t i = 0; i < frame.scopeCount; ++i)
+		{
+			GpuProfilerScope const &scope = frame.scopes[i];
+			GpuScopeTiming &timing = profiler.timings[i];
+
+			// A different pass in this row, the graph changed and the history belongs to something else
+			char name[g_gpuProfilerNameLength];
+			CopyScopeName(name, scope.name);
+			if (strcmp(name, timing.name) != 0)
+			{
+				timing = GpuScopeTiming{};
+				memcpy(timing.name, name, sizeof(name));
+			}
+
+			uint64_t begin = 0;
+			uint64_t end = 0;
+			GetTimestamp(context, scope.pBeginQuery, begin);
+			GetTimestamp(context, scope.pEndQuery, end);
+			timing.ms = static_cast<float>((end - begin) * msPerTick);
+			timing.historyMs[profiler.historyOffset] = timing.ms;
+		}
+
+		profiler.frameMs = static_cast<float>((frameEnd - frameBegin) * msPerTick);
+		profiler.frameHistoryMs[profiler.historyOffset] = profiler.frameMs;
+		profiler.historyOffset = (profiler.historyOffset + 1) % g_gpuProfilerHistoryLength;
 
-		uint64_t startTime = 0;
-		while (context.pImmediateContext->GetData(queries.timestampStartQuery, &startTime, queries.timestampStartQuery->GetDataSize(), 0) != S_OK)
-			;
+		return true;
+	}
 
-		uint64_t endTime = 0;
-		while (context.pImmediateContext->GetData(queries.timestampEndQuery, &endTime, queries.timestampEndQuery->GetDataSize(), 0) != S_OK)
-			;
+	inline void BeginGpuProfilerFrame(Context const &context, GpuProfiler &profiler)
+	{
+		GpuProfilerFrame &frame = profiler.frames[profiler.frameIndex % g_gpuProfilerFrameCount];
+		// Never waits, results that are not there yet are dropped when the queries get issued again
+		if (frame.isIssued && !ReadGpuProfilerFrame(context, frame, profiler))
+		{
+			++profiler.droppedFrameCount;
+		}
+
+		frame.scopeCount = 0;
+		frame.isIssued = false;
+		profiler.isRecording = true;
+		profiler.isScopeOpen = false;
+
+		context.pImmediateContext->Begin(frame.pDisjointQuery);
+		context.pImmediateContext->End(frame.pBeginQuery);
+	}
 
-		uint64_t const delta = endTime - startTime;
-		double const freq = static_cast<double>(disjointData.Frequency);
+	inline void EndGpuProfilerFrame(Context const &context, GpuProfiler &profiler)
+	{
+		GpuProfilerFrame &frame = profiler.frames[profiler.frameIndex % g_gpuProfilerFrameCount];
+
+		context.pImmediateContext->End(frame.pEndQuery);
+		context.pImmediateContext->End(frame.pDisjointQuery);
+
+		frame.isIssued = true;
+		profiler.isRecording = false;
+		++profiler.frameIndex;
+	}
+
+	inline void BeginGpuProfilerScope(Context const &context, wchar_t const *name)
+	{
+		GpuProfiler *profiler = context.pGpuProfiler;
+		if (profiler == nullptr || !profiler->isRecording)
+		{
+			return;
+		}
+
+		GpuProfilerFrame &frame = profiler->frames[profiler->frameIndex % g_gpuProfilerFrameCount];
+		if (frame.scopeCount == g_gpuProfilerMaxScopeCount)
+		{
+			return;
+		}
+
+		GpuProfilerScope &scope = frame.scopes[frame.scopeCount];
+		scope.name = name;
+		context.pImmediateContext->End(scope.pBeginQuery);
+		profiler->isScopeOpen = true;
+	}
+
+	inline void EndGpuProfilerScope(Context const &context)
+	{
+		GpuProfiler *profiler = context.pGpuProfiler;
+		if (profiler == nullptr || !profiler->isScopeOpen)
+		{
+			return;
+		}
 
-		return (delta / freq) * 1000.;
+		GpuProfilerFrame &frame = profiler->frames[profiler->frameIndex % g_gpuProfilerFrameCount];
+		context.pImmediateContext->End(frame.scopes[frame.scopeCount].pEndQuery);
+		++frame.scopeCount;
+		profiler->isScopeOpen = false;
 	}
 
 } // namespace h2r
@@ -3,6 +3,7 @@
 #include "Helpers/TextureGenerator.hpp"
 #include "Swapchain.hpp"
 #include "Wrapper/Context.hpp"
+#include "Wrapper/StateCache.hpp"
 #include "Wrapper/Texture.hpp"
 #include <DirectXColors.h>
 #include <d3d11.h>
@@ -65,11 +66,11 @@ namespace h2r
 	{
 		if (omViewCount > 0 || depthStencilView)
 		{
-			context.pImmediateContext->OMSetRenderTargets(omViewCount, omViews, depthStencilView);
+			SetCachedRenderTargets(context, omViews, omViewCount, depthStencilView);
 		}
 		if (csViewCount > 0)
 		{
-			context.pImmediateContext->CSSetUnorderedAccessViews(0, csViewCount, csViews, nullptr);
+			SetCachedUnorderedAccessViews(context, 0, csViewCount, csViews);
 		}
 	}
 
@@ -109,12 +110,12 @@ namespace h2r
 
 	inline void UnbindRenderTargets(Context const &context, uint32_t csViewCount)
 	{
-		context.pImmediateContext->OMSetRenderTargets(0, nullptr, nullptr);
+		SetCachedRenderTargets(context, nullptr, 0, nullptr);
 
 		if (csViewCount > 0)
 		{
-			std::vector<ID3D11UnorderedAccessView *> nullUAVs(csViewCount, nullptr);
-			context.pImmediateContext->CSSetUnorderedAccessViews(0, csViewCount, nullUAVs.data(), nullptr);
+			ID3D11UnorderedAccessView *const nullViews[g_stateCacheUnorderedAccessSlotCount] = {};
+			SetCachedUnorderedAccessViews(context, 0, csViewCount, nullViews);
 		}
 	}
 
@@ -136,7 +137,7 @@ namespace h2r
 		desc.srvFormat = hostTexture.format;
 		desc.rtvFormat = hostTexture.format;
 		desc.uavFormat = DXGI_FORMAT_UNKNOWN;
-		desc.hostTexture = hostTexture;
+		desc.hostTexture = &hostTexture;
 
 		return CreateDeviceTexture(context, desc);
 	}
@@ -159,7 +160,7 @@ namespace h2r
 		desc.srvFormat = hostTexture.format;
 		desc.rtvFormat = hostTexture.format;
 		desc.uavFormat = DXGI_FORMAT_UNKNOWN;
-		desc.hostTexture = hostTexture;
+		desc.hostTexture = &hostTexture;
 
 		return CreateDeviceTexture(context, desc);
 	}
@@ -203,7 +204,7 @@ namespace h2r
 		desc.textureFormat = texFormat;
 		desc.srvFormat = srvFormat;
 		desc.dsvFormat = dsvFormat;
-		desc.hostTexture = hostTexture;
+		desc.hostTexture = &hostTexture;
 
 		return CreateDeviceTexture(context, desc);
 	}
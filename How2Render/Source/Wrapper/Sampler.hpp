@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Wrapper/Context.hpp"
+#include "Wrapper/StateCache.hpp"
 #include <d3d11.h>
 #include <vector>
 
@@ -26,21 +27,15 @@ namespace h2r
 
 	inline void BindSamplers(Context const &context, ID3D11SamplerState *const *samplers, uint32_t samplerCount)
 	{
-		for (uint32_t i = 0; i < samplerCount; ++i)
-		{
-			context.pImmediateContext->PSSetSamplers(i, 1, &samplers[i]);
-			context.pImmediateContext->CSSetSamplers(i, 1, &samplers[i]);
-		}
+		SetCachedSamplers(context, eShaderStage::Pixel, 0, samplerCount, samplers);
+		SetCachedSamplers(context, eShaderStage::Compute, 0, samplerCount, samplers);
 	}
 
 	inline void UnbindSamplers(Context const &context, uint32_t samplerCount)
 	{
-		ID3D11SamplerState *nullSampler[1] = {nullptr};
-		for (uint32_t i = 0; i < samplerCount; ++i)
-		{
-			context.pImmediateContext->PSSetSamplers(i, 1, nullSampler);
-			context.pImmediateContext->CSSetSamplers(i, 1, nullSampler);
-		}
+		ID3D11SamplerState *const nullSamplers[g_stateCacheSamplerSlotCount] = {};
+		SetCachedSamplers(context, eShaderStage::Pixel, 0, samplerCount, nullSamplers);
+		SetCachedSamplers(context, eShaderStage::Compute, 0, samplerCount, nullSamplers);
 	}
 
 	inline ID3D11SamplerState *CreateSampler(Context const &context, eTextureSamplerFilterType filterType)
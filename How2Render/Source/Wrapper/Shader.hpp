@@ -6,6 +6,7 @@
 #include "Wrapper/ConstantBuffer.hpp"
 #include "Wrapper/DepthStencilState.hpp"
 #include "Wrapper/Sampler.hpp"
+#include "Wrapper/StateCache.hpp"
 #include <d3d11.h>
 #include <filesystem>
 
@@ -177,16 +178,12 @@ namespace h2r
 
     inline void BindShaders(Context const &context, ShaderProgram const &shaders)
     {
-        context.pImmediateContext->VSSetShader(shaders.pVertexShader, nullptr, 0);
-        context.pImmediateContext->PSSetShader(shaders.pPixelShader, nullptr, 0);
-        context.pImmediateContext->CSSetShader(shaders.pComputeShader, nullptr, 0);
+        SetCachedShaders(context, shaders.pVertexShader, shaders.pPixelShader, shaders.pComputeShader);
     }
 
     inline void UnbindShaders(Context const &context)
     {
-        context.pImmediateContext->VSSetShader(nullptr, nullptr, 0);
-        context.pImmediateContext->PSSetShader(nullptr, nullptr, 0);
-        context.pImmediateContext->CSSetShader(nullptr, nullptr, 0);
+        SetCachedShaders(context, nullptr, nullptr, nullptr);
     }
 
 } // namespace h2r
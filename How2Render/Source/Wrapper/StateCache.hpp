@@ -0,0 +1,595 @@
+#pragma once
+
+#include "Wrapper/Context.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <d3d11_1.h>
+
+namespace h2r
+{
+
+	// Only the low shader resource slots are shadowed, passes and materials never go past them
+	constexpr uint32_t g_stateCacheResourceSlotCount = 16;
+	constexpr uint32_t g_stateCacheConstantBufferSlotCount = D3D11_COMMONSHADER_CONSTANT_BUFFER_API_SLOT_COUNT;
+	constexpr uint32_t g_stateCacheSamplerSlotCount = D3D11_COMMONSHADER_SAMPLER_SLOT_COUNT;
+	constexpr uint32_t g_stateCacheRenderTargetSlotCount = D3D11_SIMULTANEOUS_RENDER_TARGET_COUNT;
+	constexpr uint32_t g_stateCacheUnorderedAccessSlotCount = D3D11_PS_CS_UAV_REGISTER_COUNT;
+
+	enum class eShaderStage : uint8_t
+	{
+		Vertex = 0,
+		Pixel,
+		Compute,
+		Count,
+	};
+
+	// Mirror of what is bound on the immediate context. Every bound view keeps its resource alive, so the
+	// pointers here never dangle and a recreated object can not alias a cached one. Output bindings are
+	// only dropped when the same resource gets bound as a shader resource and the other way around.
+	struct StateCache
+	{
+		struct ConstantBufferBinding
+		{
+			ID3D11Buffer *pBuffer = nullptr;
+			// Zero constants means the whole buffer is bound
+			uint32_t firstConstant = 0;
+			uint32_t constantCount = 0;
+		};
+
+		struct ShaderResourceBinding
+		{
+			ID3D11ShaderResourceView *pView = nullptr;
+			ID3D11Resource *pResource = nullptr;
+		};
+
+		struct StageBindings
+		{
+			ConstantBufferBinding cbuffers[g_stateCacheConstantBufferSlotCount] = {};
+			ShaderResourceBinding resources[g_stateCacheResourceSlotCount] = {};
+			ID3D11SamplerState *samplers[g_stateCacheSamplerSlotCount] = {};
+		};
+
+		ID3D11VertexShader *pVertexShader = nullptr;
+		ID3D11PixelShader *pPixelShader = nullptr;
+		ID3D11ComputeShader *pComputeShader = nullptr;
+		StageBindings stages[static_cast<uint8_t>(eShaderStage::Count)] = {};
+
+		ID3D11RenderTargetView *renderTargets[g_stateCacheRenderTargetSlotCount] = {};
+		ID3D11Resource *renderTargetResources[g_stateCacheRenderTargetSlotCount] = {};
+		uint32_t renderTargetCount = 0;
+		ID3D11DepthStencilView *pDepthStencilView = nullptr;
+		ID3D11Resource *pDepthStencilResource = nullptr;
+		ID3D11UnorderedAccessView *unorderedAccessViews[g_stateCacheUnorderedAccessSlotCount] = {};
+		ID3D11Resource *unorderedAccessResources[g_stateCacheUnorderedAccessSlotCount] = {};
+
+		ID3D11BlendState *pBlendState = nullptr;
+		float blendFactor[4] = {1.f, 1.f, 1.f, 1.f};
+		uint32_t sampleMask = 0xFFFFFFFF;
+		ID3D11DepthStencilState *pDepthStencilState = nullptr;
+		ID3D11RasterizerState *pRasterizerState = nullptr;
+		D3D11_VIEWPORT viewport = {};
+
+		uint32_t issuedCallCount = 0;
+		uint32_t elidedCallCount = 0;
+	};
+
+	inline void ResetStateCacheCounters(StateCache &cache);
+
+	// The SetCached* calls go straight to the immediate context when the context has no state cache
+	inline void SetCachedShaders(
+		Context const &context,
+		ID3D11VertexShader *vertexShader,
+		ID3D11PixelShader *pixelShader,
+		ID3D11ComputeShader *computeShader);
+
+	inline void SetCachedConstantBuffers(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11Buffer *const *buffers);
+
+	// Binds constants [firstConstant, firstConstant + constantCount) of the buffer, requires the D3D 11.1 runtime
+	inline void SetCachedConstantBufferSlice(
+		Context const &context,
+		eShaderStage stage,
+		uint32_t slot,
+		ID3D11Buffer *buffer,
+		uint32_t firstConstant,
+		uint32_t constantCount);
+
+	inline void SetCachedShaderResources(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11ShaderResourceView *const *views);
+
+	inline void SetCachedSamplers(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11SamplerState *const *samplers);
+
+	inline void SetCachedRenderTargets(
+		Context const &context, ID3D11RenderTargetView *const *views, uint32_t count, ID3D11DepthStencilView *depthStencilView);
+
+	inline void SetCachedUnorderedAccessViews(
+		Context const &context, uint32_t slot, uint32_t count, ID3D11UnorderedAccessView *const *views);
+
+	inline void SetCachedBlendState(
+		Context const &context, ID3D11BlendState *state, float const *blendFactor, uint32_t sampleMask);
+
+	inline void SetCachedDepthStencilState(Context const &context, ID3D11DepthStencilState *state);
+
+	inline void SetCachedRasterizerState(Context const &context, ID3D11RasterizerState *state);
+
+	inline void SetCachedViewport(Context const &context, D3D11_VIEWPORT const &viewport);
+
+} // namespace h2r
+
+namespace h2r
+{
+
+	inline void ResetStateCacheCounters(StateCache &cache)
+	{
+		cache.issuedCallCount = 0;
+		cache.elidedCallCount = 0;
+	}
+
+	inline void CountStateCacheCall(StateCache &cache, bool isIssued)
+	{
+		if (isIssued)
+		{
+			++cache.issuedCallCount;
+		}
+		else
+		{
+			++cache.elidedCallCount;
+		}
+	}
+
+	inline ID3D11Resource *GetViewResource(ID3D11View *view)
+	{
+		if (view == nullptr)
+		{
+			return nullptr;
+		}
+
+		// The view holds its own reference, the cache only needs the pointer for comparisons
+		ID3D11Resource *resource = nullptr;
+		view->GetResource(&resource);
+		resource->Release();
+
+		return resource;
+	}
+
+	inline void SetStageConstantBuffers(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11Buffer *const *buffers)
+	{
+		switch (stage)
+		{
+		case eShaderStage::Vertex:
+			context.pImmediateContext->VSSetConstantBuffers(slot, count, buffers);
+			break;
+		case eShaderStage::Pixel:
+			context.pImmediateContext->PSSetConstantBuffers(slot, count, buffers);
+			break;
+		case eShaderStage::Compute:
+			context.pImmediateContext->CSSetConstantBuffers(slot, count, buffers);
+			break;
+		default:
+			assert(true);
+			break;
+		}
+	}
+
+	inline void SetStageConstantBufferSlice(
+		Context const &context, eShaderStage stage, uint32_t slot, ID3D11Buffer *buffer, uint32_t firstConstant, uint32_t constantCount)
+	{
+		switch (stage)
+		{
+		case eShaderStage::Vertex:
+			context.pImmediateContext1->VSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+			break;
+		case eShaderStage::Pixel:
+			context.pImmediateContext1->PSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+			break;
+		case eShaderStage::Compute:
+			context.pImmediateContext1->CSSetConstantBuffers1(slot, 1, &buffer, &firstConstant, &constantCount);
+			break;
+		default:
+			assert(true);
+			break;
+		}
+	}
+
+	inline void SetStageShaderResources(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11ShaderResourceView *const *views)
+	{
+		switch (stage)
+		{
+		case eShaderStage::Vertex:
+			context.pImmediateContext->VSSetShaderResources(slot, count, views);
+			break;
+		case eShaderStage::Pixel:
+			context.pImmediateContext->PSSetShaderResources(slot, count, views);
+			break;
+		case eShaderStage::Compute:
+			context.pImmediateContext->CSSetShaderResources(slot, count, views);
+			break;
+		default:
+			assert(true);
+			break;
+		}
+	}
+
+	inline void SetStageSamplers(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11SamplerState *const *samplers)
+	{
+		switch (stage)
+		{
+		case eShaderStage::Vertex:
+			context.pImmediateContext->VSSetSamplers(slot, count, samplers);
+			break;
+		case eShaderStage::Pixel:
+			context.pImmediateContext->PSSetSamplers(slot, count, samplers);
+			break;
+		case eShaderStage::Compute:
+			context.pImmediateContext->CSSetSamplers(slot, count, samplers);
+			break;
+		default:
+			assert(true);
+			break;
+		}
+	}
+
+	// Drops every shader resource slot that reads the resource, the runtime would do it on its own when the
+	// resource gets bound for writing, but then the cache would no longer match the context
+	inline void UnbindCachedShaderResourcesOf(Context const &context, StateCache &cache, ID3D11Resource *resource)
+	{
+		if (resource == nullptr)
+		{
+			return;
+		}
+
+		for (uint8_t stageIndex = 0; stageIndex < static_cast<uint8_t>(eShaderStage::Count); ++stageIndex)
+		{
+			auto &bindings = cache.stages[stageIndex].resources;
+			for (uint32_t slot = 0; slot < g_stateCacheResourceSlotCount; ++slot)
+			{
+				if (bindings[slot].pResource == resource)
+				{
+					ID3D11ShaderResourceView *nullView = nullptr;
+					SetStageShaderResources(context, static_cast<eShaderStage>(stageIndex), slot, 1, &nullView);
+					bindings[slot] = {};
+					CountStateCacheCall(cache, true);
+				}
+			}
+		}
+	}
+
+	// Drops the output bindings that write the resource before it gets bound as a shader resource
+	inline void UnbindCachedOutputsOf(Context const &context, StateCache &cache, ID3D11Resource *resource)
+	{
+		if (resource == nullptr)
+		{
+			return;
+		}
+
+		bool isRenderTargetBound = cache.pDepthStencilResource == resource;
+		for (uint32_t slot = 0; slot < cache.renderTargetCount; ++slot)
+		{
+			isRenderTargetBound |= cache.renderTargetResources[slot] == resource;
+		}
+		if (isRenderTargetBound)
+		{
+			context.pImmediateContext->OMSetRenderTargets(0, nullptr, nullptr);
+			std::memset(cache.renderTargets, 0, sizeof(cache.renderTargets));
+			std::memset(cache.renderTargetResources, 0, sizeof(cache.renderTargetResources));
+			cache.renderTargetCount = 0;
+			cache.pDepthStencilView = nullptr;
+			cache.pDepthStencilResource = nullptr;
+			CountStateCacheCall(cache, true);
+		}
+
+		for (uint32_t slot = 0; slot < g_stateCacheUnorderedAccessSlotCount; ++slot)
+		{
+			if (cache.unorderedAccessResources[slot] == resource)
+			{
+				ID3D11UnorderedAccessView *nullView = nullptr;
+				context.pImmediateContext->CSSetUnorderedAccessViews(slot, 1, &nullView, nullptr);
+				cache.unorderedAccessViews[slot] = nullptr;
+				cache.unorderedAccessResources[slot] = nullptr;
+				CountStateCacheCall(cache, true);
+			}
+		}
+	}
+
+	inline void SetCachedShaders(
+		Context const &context,
+		ID3D11VertexShader *vertexShader,
+		ID3D11PixelShader *pixelShader,
+		ID3D11ComputeShader *computeShader)
+	{
+		StateCache *cache = context.pStateCache;
+
+		if (cache == nullptr || cache->pVertexShader != vertexShader)
+		{
+			context.pImmediateContext->VSSetShader(vertexShader, nullptr, 0);
+		}
+		if (cache == nullptr || cache->pPixelShader != pixelShader)
+		{
+			context.pImmediateContext->PSSetShader(pixelShader, nullptr, 0);
+		}
+		if (cache == nullptr || cache->pComputeShader != computeShader)
+		{
+			context.pImmediateContext->CSSetShader(computeShader, nullptr, 0);
+		}
+
+		if (cache != nullptr)
+		{
+			CountStateCacheCall(*cache, cache->pVertexShader != vertexShader);
+			CountStateCacheCall(*cache, cache->pPixelShader != pixelShader);
+			CountStateCacheCall(*cache, cache->pComputeShader != computeShader);
+			cache->pVertexShader = vertexShader;
+			cache->pPixelShader = pixelShader;
+			cache->pComputeShader = computeShader;
+		}
+	}
+
+	inline void SetCachedConstantBuffers(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11Buffer *const *buffers)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr)
+		{
+			SetStageConstantBuffers(context, stage, slot, count, buffers);
+			return;
+		}
+		assert(slot + count <= g_stateCacheConstantBufferSlotCount);
+
+		// One call covers the whole changed range, unchanged slots inside it are rebound for free
+		auto &bindings = cache->stages[static_cast<uint8_t>(stage)].cbuffers;
+		uint32_t first = count;
+		uint32_t last = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			auto const &binding = bindings[slot + i];
+			if (binding.pBuffer != buffers[i] || binding.constantCount != 0)
+			{
+				first = std::min(first, i);
+				last = i;
+				bindings[slot + i] = {buffers[i], 0, 0};
+			}
+		}
+
+		if (first < count)
+		{
+			SetStageConstantBuffers(context, stage, slot + first, last - first + 1, buffers + first);
+		}
+		CountStateCacheCall(*cache, first < count);
+	}
+
+	inline void SetCachedConstantBufferSlice(
+		Context const &context,
+		eShaderStage stage,
+		uint32_t slot,
+		ID3D11Buffer *buffer,
+		uint32_t firstConstant,
+		uint32_t constantCount)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr)
+		{
+			SetStageConstantBufferSlice(context, stage, slot, buffer, firstConstant, constantCount);
+			return;
+		}
+		assert(slot < g_stateCacheConstantBufferSlotCount);
+
+		auto &binding = cache->stages[static_cast<uint8_t>(stage)].cbuffers[slot];
+		bool const isChanged =
+			binding.pBuffer != buffer || binding.firstConstant != firstConstant || binding.constantCount != constantCount;
+		if (isChanged)
+		{
+			SetStageConstantBufferSlice(context, stage, slot, buffer, firstConstant, constantCount);
+			binding = {buffer, firstConstant, constantCount};
+		}
+		CountStateCacheCall(*cache, isChanged);
+	}
+
+	inline void SetCachedShaderResources(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11ShaderResourceView *const *views)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr)
+		{
+			SetStageShaderResources(context, stage, slot, count, views);
+			return;
+		}
+		assert(slot + count <= g_stateCacheResourceSlotCount);
+
+		auto &bindings = cache->stages[static_cast<uint8_t>(stage)].resources;
+		uint32_t first = count;
+		uint32_t last = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (bindings[slot + i].pView != views[i])
+			{
+				ID3D11Resource *resource = GetViewResource(views[i]);
+				UnbindCachedOutputsOf(context, *cache, resource);
+				first = std::min(first, i);
+				last = i;
+				bindings[slot + i] = {views[i], resource};
+			}
+		}
+
+		if (first < count)
+		{
+			SetStageShaderResources(context, stage, slot + first, last - first + 1, views + first);
+		}
+		CountStateCacheCall(*cache, first < count);
+	}
+
+	inline void SetCachedSamplers(
+		Context const &context, eShaderStage stage, uint32_t slot, uint32_t count, ID3D11SamplerState *const *samplers)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr)
+		{
+			SetStageSamplers(context, stage, slot, count, samplers);
+			return;
+		}
+		assert(slot + count <= g_stateCacheSamplerSlotCount);
+
+		auto &bindings = cache->stages[static_cast<uint8_t>(stage)].samplers;
+		uint32_t first = count;
+		uint32_t last = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (bindings[slot + i] != samplers[i])
+			{
+				first = std::min(first, i);
+				last = i;
+				bindings[slot + i] = samplers[i];
+			}
+		}
+
+		if (first < count)
+		{
+			SetStageSamplers(context, stage, slot + first, last - first + 1, samplers + first);
+		}
+		CountStateCacheCall(*cache, first < count);
+	}
+
+	inline void SetCachedRenderTargets(
+		Context const &context, ID3D11RenderTargetView *const *views, uint32_t count, ID3D11DepthStencilView *depthStencilView)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr)
+		{
+			context.pImmediateContext->OMSetRenderTargets(count, views, depthStencilView);
+			return;
+		}
+		assert(count <= g_stateCacheRenderTargetSlotCount);
+
+		bool isChanged = cache->renderTargetCount != count || cache->pDepthStencilView != depthStencilView;
+		for (uint32_t i = 0; i < count && !isChanged; ++i)
+		{
+			isChanged = cache->renderTargets[i] != views[i];
+		}
+
+		if (isChanged)
+		{
+			std::memset(cache->renderTargets, 0, sizeof(cache->renderTargets));
+			std::memset(cache->renderTargetResources, 0, sizeof(cache->renderTargetResources));
+			for (uint32_t i = 0; i < count; ++i)
+			{
+				cache->renderTargets[i] = views[i];
+				cache->renderTargetResources[i] = GetViewResource(views[i]);
+				UnbindCachedShaderResourcesOf(context, *cache, cache->renderTargetResources[i]);
+			}
+			cache->renderTargetCount = count;
+			cache->pDepthStencilView = depthStencilView;
+			cache->pDepthStencilResource = GetViewResource(depthStencilView);
+			UnbindCachedShaderResourcesOf(context, *cache, cache->pDepthStencilResource);
+
+			context.pImmediateContext->OMSetRenderTargets(count, views, depthStencilView);
+		}
+		CountStateCacheCall(*cache, isChanged);
+	}
+
+	inline void SetCachedUnorderedAccessViews(
+		Context const &context, uint32_t slot, uint32_t count, ID3D11UnorderedAccessView *const *views)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr)
+		{
+			context.pImmediateContext->CSSetUnorderedAccessViews(slot, count, views, nullptr);
+			return;
+		}
+		assert(slot + count <= g_stateCacheUnorderedAccessSlotCount);
+
+		uint32_t first = count;
+		uint32_t last = 0;
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (cache->unorderedAccessViews[slot + i] != views[i])
+			{
+				ID3D11Resource *resource = GetViewResource(views[i]);
+				UnbindCachedShaderResourcesOf(context, *cache, resource);
+				first = std::min(first, i);
+				last = i;
+				cache->unorderedAccessViews[slot + i] = views[i];
+				cache->unorderedAccessResources[slot + i] = resource;
+			}
+		}
+
+		if (first < count)
+		{
+			context.pImmediateContext->CSSetUnorderedAccessViews(slot + first, last - first + 1, views + first, nullptr);
+		}
+		CountStateCacheCall(*cache, first < count);
+	}
+
+	inline void SetCachedBlendState(
+		Context const &context, ID3D11BlendState *state, float const *blendFactor, uint32_t sampleMask)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr)
+		{
+			context.pImmediateContext->OMSetBlendState(state, blendFactor, sampleMask);
+			return;
+		}
+
+		// A null factor is the same as a factor of ones
+		float const defaultBlendFactor[4] = {1.f, 1.f, 1.f, 1.f};
+		float const *factor = blendFactor != nullptr ? blendFactor : defaultBlendFactor;
+
+		bool const isChanged = cache->pBlendState != state || cache->sampleMask != sampleMask ||
+							   std::memcmp(cache->blendFactor, factor, sizeof(cache->blendFactor)) != 0;
+		if (isChanged)
+		{
+			context.pImmediateContext->OMSetBlendState(state, factor, sampleMask);
+			cache->pBlendState = state;
+			cache->sampleMask = sampleMask;
+			std::memcpy(cache->blendFactor, factor, sizeof(cache->blendFactor));
+		}
+		CountStateCacheCall(*cache, isChanged);
+	}
+
+	inline void SetCachedDepthStencilState(Context const &context, ID3D11DepthStencilState *state)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr || cache->pDepthStencilState != state)
+		{
+			context.pImmediateContext->OMSetDepthStencilState(state, 0);
+		}
+		if (cache != nullptr)
+		{
+			CountStateCacheCall(*cache, cache->pDepthStencilState != state);
+			cache->pDepthStencilState = state;
+		}
+	}
+
+	inline void SetCachedRasterizerState(Context const &context, ID3D11RasterizerState *state)
+	{
+		StateCache *cache = context.pStateCache;
+		if (cache == nullptr || cache->pRasterizerState != state)
+		{
+			context.pImmediateContext->RSSetState(state);
+		}
+		if (cache != nullptr)
+		{
+			CountStateCacheCall(*cache, cache->pRasterizerState != state);
+			cache->pRasterizerState = state;
+		}
+	}
+
+	inline void SetCachedViewport(Context const &context, D3D11_VIEWPORT const &viewport)
+	{
+		StateCache *cache = context.pStateCache;
+		bool const isChanged = cache == nullptr || std::memcmp(&cache->viewport, &viewport, sizeof(viewport)) != 0;
+		if (isChanged)
+		{
+			context.pImmediateContext->RSSetViewports(1, &viewport);
+		}
+		if (cache != nullptr)
+		{
+			CountStateCacheCall(*cache, isChanged);
+			cache->viewport = viewport;
+		}
+	}
+
+} // namespace h2r
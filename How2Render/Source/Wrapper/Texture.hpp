@@ -2,6 +2,7 @@
 
 #include "ThirdParty/stb_image.h"
 #include "Wrapper/Context.hpp"
+#include <algorithm>
 #include <cstdint>
 #include <d3d11.h>
 #include <filesystem>
@@ -40,6 +41,10 @@ namespace h2r
 		uint32_t height = 0;
 		uint8_t texelByteSize = 0;
 		std::vector<HostTexture::MipLevel> mipChain;
+
+		// Flags and format the file was loaded with, one file can be loaded into several encodings
+		uint32_t loadFlags = 0;
+		DXGI_FORMAT loadFormat = DXGI_FORMAT_UNKNOWN;
 	};
 
 	struct DeviceTexture
@@ -60,7 +65,8 @@ namespace h2r
 			DXGI_FORMAT rtvFormat = DXGI_FORMAT_UNKNOWN;
 			DXGI_FORMAT uavFormat = DXGI_FORMAT_UNKNOWN;
 			DXGI_FORMAT dsvFormat = DXGI_FORMAT_UNKNOWN;
-			HostTexture hostTexture;
+			// Only read during creation, the pixels are not copied
+			HostTexture const *hostTexture = nullptr;
 		};
 
 		std::filesystem::path path;
@@ -76,7 +82,7 @@ namespace h2r
 	inline HostTexture CreateHostTexture(HostTexture::Descriptor desc);
 
 	inline std::optional<DeviceTexture> CreateDeviceTexture(
-		Context const &context, DeviceTexture::Descriptor hostTexture);
+		Context const &context, DeviceTexture::Descriptor const &desc);
 
 	inline void CleanupDeviceTexture(DeviceTexture &texture);
 
@@ -84,6 +90,12 @@ namespace h2r
 
 	inline size_t BitsPerPixel(DXGI_FORMAT fmt);
 
+	inline bool IsBlockCompressed(DXGI_FORMAT fmt);
+
+	inline uint32_t RowPitch(DXGI_FORMAT fmt, uint32_t width);
+
+	inline uint32_t SurfaceByteSize(DXGI_FORMAT fmt, uint32_t width, uint32_t height);
+
 } // namespace h2r
 
 namespace h2r
@@ -91,7 +103,7 @@ namespace h2r
 
 	inline HostTexture CreateHostTexture(HostTexture::Descriptor desc)
 	{
-		uint32_t const imageSize = (uint32_t)(desc.width * desc.height * BytesPerPixel(desc.format));
+		uint32_t const imageSize = SurfaceByteSize(desc.format, desc.width, desc.height);
 
 		HostTexture hostTexture;
 
@@ -106,18 +118,19 @@ namespace h2r
 		return hostTexture;
 	}
 
-	inline std::optional<DeviceTexture> CreateDeviceTexture(Context const &context, DeviceTexture::Descriptor desc)
+	inline std::optional<DeviceTexture> CreateDeviceTexture(Context const &context, DeviceTexture::Descriptor const &desc)
 	{
 		assert(desc.textureFormat);
+		assert(desc.hostTexture);
 
 		DeviceTexture result;
-		result.path = desc.hostTexture.path;
-		result.width = desc.hostTexture.width;
-		result.height = desc.hostTexture.height;
+		result.path = desc.hostTexture->path;
+		result.width = desc.hostTexture->width;
+		result.height = desc.hostTexture->height;
 
 		D3D11_TEXTURE2D_DESC dxTexDesc;
-		dxTexDesc.Width = desc.hostTexture.width;
-		dxTexDesc.Height = desc.hostTexture.height;
+		dxTexDesc.Width = desc.hostTexture->width;
+		dxTexDesc.Height = desc.hostTexture->height;
 		dxTexDesc.MipLevels = 1;
 		dxTexDesc.ArraySize = 1;
 		dxTexDesc.Format = desc.textureFormat;
@@ -132,12 +145,12 @@ namespace h2r
 		switch (desc.mipmapFlag)
 		{
 		case DeviceTexture::Descriptor::eMipMapFlag::USE_PRE_GENERATED:
-			dxTexDesc.MipLevels = uint32_t(desc.hostTexture.mipChain.empty() ? 1 : desc.hostTexture.mipChain.size());
-			for (const auto &mipLevel : desc.hostTexture.mipChain)
+			dxTexDesc.MipLevels = uint32_t(desc.hostTexture->mipChain.empty() ? 1 : desc.hostTexture->mipChain.size());
+			for (const auto &mipLevel : desc.hostTexture->mipChain)
 			{
 				D3D11_SUBRESOURCE_DATA subData;
-				subData.pSysMem = desc.hostTexture.pixels.data() + mipLevel.byteOffset;
-				subData.SysMemPitch = mipLevel.width * (UINT)BytesPerPixel(desc.hostTexture.format);
+				subData.pSysMem = desc.hostTexture->pixels.data() + mipLevel.byteOffset;
+				subData.SysMemPitch = RowPitch(desc.hostTexture->format, mipLevel.width);
 				subData.SysMemSlicePitch = 0;
 				textureData.push_back(subData);
 			}
@@ -148,12 +161,12 @@ namespace h2r
 			dxTexDesc.MiscFlags |= D3D11_RESOURCE_MISC_GENERATE_MIPS;
 			break;
 		case DeviceTexture::Descriptor::eMipMapFlag::NONE:
-			if (!desc.hostTexture.pixels.empty() && !desc.hostTexture.mipChain.empty())
+			if (!desc.hostTexture->pixels.empty() && !desc.hostTexture->mipChain.empty())
 			{
-				auto const &mip = desc.hostTexture.mipChain.front();
+				auto const &mip = desc.hostTexture->mipChain.front();
 				D3D11_SUBRESOURCE_DATA subData;
-				subData.pSysMem = desc.hostTexture.pixels.data() + mip.byteOffset;
-				subData.SysMemPitch = mip.width * (UINT)BytesPerPixel(desc.hostTexture.format);
+				subData.pSysMem = desc.hostTexture->pixels.data() + mip.byteOffset;
+				subData.SysMemPitch = RowPitch(desc.hostTexture->format, mip.width);
 				subData.SysMemSlicePitch = 0;
 				textureData.push_back(subData);
 			}
@@ -190,8 +203,8 @@ namespace h2r
 					result.texture,
 					0,
 					nullptr,
-					desc.hostTexture.pixels.data(),
-					desc.hostTexture.width * (UINT)BytesPerPixel(desc.hostTexture.format),
+					desc.hostTexture->pixels.data(),
+					RowPitch(desc.hostTexture->format, desc.hostTexture->width),
 					0);
 			}
 
@@ -297,6 +310,30 @@ namespace h2r
 		return BitsPerPixel(fmt) / 8;
 	}
 
+	inline bool IsBlockCompressed(DXGI_FORMAT fmt)
+	{
+		return (fmt >= DXGI_FORMAT_BC1_TYPELESS && fmt <= DXGI_FORMAT_BC5_SNORM) ||
+			   (fmt >= DXGI_FORMAT_BC6H_TYPELESS && fmt <= DXGI_FORMAT_BC7_UNORM_SRGB);
+	}
+
+	// Block compressed rows are rows of 4x4 blocks, partial blocks at the edges still take a full block
+	inline uint32_t RowPitch(DXGI_FORMAT fmt, uint32_t width)
+	{
+		if (IsBlockCompressed(fmt))
+		{
+			uint32_t const blockByteSize = static_cast<uint32_t>(BitsPerPixel(fmt) * 2);
+			return std::max(1u, (width + 3) / 4) * blockByteSize;
+		}
+
+		return width * static_cast<uint32_t>(BytesPerPixel(fmt));
+	}
+
+	inline uint32_t SurfaceByteSize(DXGI_FORMAT fmt, uint32_t width, uint32_t height)
+	{
+		uint32_t const rowCount = IsBlockCompressed(fmt) ? std::max(1u, (height + 3) / 4) : height;
+		return RowPitch(fmt, width) * rowCount;
+	}
+
 	inline size_t BitsPerPixel(DXGI_FORMAT fmt)
 	{
 		switch (static_cast<int>(fmt))